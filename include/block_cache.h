@@ -0,0 +1,62 @@
+#ifndef BLOCK_CACHE_H
+#define BLOCK_CACHE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+#include "cpu.h"
+#include "ram.h"
+#include "bios.h"
+#include "jit.h"
+#include "bus.h"
+
+#define BLOCK_MAX_INSTRUCTIONS 64
+#define BLOCK_PAGE_SHIFT BUS_PAGE_SHIFT //Blocks never cross a bus page, so invalidation works per page
+#define BLOCK_PAGE_SIZE (1 << BLOCK_PAGE_SHIFT)
+
+//A basic block decoded once, run until its branch and delay slot
+typedef struct cpu_block
+{
+    uint32_t pc;     //Address the block was decoded from
+    uint32_t length; //Number of instructions
+    jit_block_fn code; //Host code when compiled by the JIT, NULL otherwise
+    struct cpu_block* next_retired;
+    cpu_instr instr[];
+} cpu_block;
+
+typedef struct ps1_block_cache
+{
+    ps1_bus* bus;
+    cpu_block** ram_blocks;  //One slot per word of RAM, indexed by physical address
+    cpu_block** bios_blocks; //One slot per word of BIOS
+    uint16_t ram_page_blocks[RAM_SIZE >> BLOCK_PAGE_SHIFT]; //Blocks alive in each RAM page, 0 means no code
+
+    //Invalidated blocks are kept alive until the block being executed finishes
+    cpu_block* retired;
+
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t invalidations;
+} ps1_block_cache;
+
+ps1_block_cache* ps1_block_cache_create();
+void ps1_block_cache_init(ps1_block_cache* cache);
+void ps1_block_cache_destroy(ps1_block_cache* cache);
+
+void ps1_connect_bus_block_cache(ps1_bus* bus, ps1_block_cache* cache);
+
+cpu_block* ps1_block_cache_fetch(ps1_block_cache* cache, uint32_t pc);
+void ps1_block_cache_invalidate_page(ps1_block_cache* cache, uint32_t address);
+void ps1_block_cache_invalidate_range(ps1_block_cache* cache, uint32_t address, uint32_t length);
+void ps1_block_cache_release_retired(ps1_block_cache* cache);
+void ps1_block_cache_flush(ps1_block_cache* cache);
+
+//Called on every RAM store, only pages holding decoded code pay for the invalidation
+static inline void ps1_block_cache_notify_write(ps1_block_cache* cache, uint32_t address)
+{
+    if(cache->ram_page_blocks[(address & (RAM_SIZE-1)) >> BLOCK_PAGE_SHIFT])
+        ps1_block_cache_invalidate_page(cache, address);
+}
+
+#endif
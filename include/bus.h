@@ -2,15 +2,47 @@
 #define BUS_H
 
 #include <stdint.h>
+#include <stdbool.h>
 #include <string.h>
 #include <stdlib.h>
 
+//The 512MB physical space is split in 4KB pages, each one pointing directly at its backing memory
+#define BUS_PAGE_SHIFT 12
+#define BUS_PAGE_SIZE (1 << BUS_PAGE_SHIFT)
+#define BUS_PAGE_COUNT (0x20000000 >> BUS_PAGE_SHIFT)
+
+//Memory mapped I/O, devices register handlers for ranges of the 4KB window at 0x1F801000
+#define BUS_IO_BASE 0x1F801000
+#define BUS_IO_SIZE 0x1000
+#define BUS_IO_MAX_HANDLERS 32
+
+typedef enum BUS_WIDTH
+{
+    BUS_WIDTH_BYTE = 1,
+    BUS_WIDTH_HALFWORD = 2,
+    BUS_WIDTH_WORD = 4,
+    BUS_WIDTH_ALL = 7
+} BUS_WIDTH;
+
+//Handlers get the full physical address and the width of the access
+typedef uint32_t (*bus_io_read_fn)(void* device, uint32_t address, BUS_WIDTH width);
+typedef void (*bus_io_write_fn)(void* device, uint32_t address, uint32_t value, BUS_WIDTH width);
+
+typedef struct bus_io_handler
+{
+    void* device;
+    bus_io_read_fn read;
+    bus_io_write_fn write;
+    uint8_t widths; //BUS_WIDTH flags the device decodes, accesses of other widths are dropped
+} bus_io_handler;
+
 typedef struct ps1_bios ps1_bios;
 typedef struct ps1_cpu ps1_cpu;
 typedef struct ps1_ram ps1_ram;
 typedef struct ps1_gpu ps1_gpu;
 typedef struct ps1_scratchpad ps1_scratchpad;
 typedef struct ps1_dma ps1_dma;
+typedef struct ps1_fastmem ps1_fastmem;
 
 typedef struct ps1_bus
 {
@@ -20,6 +52,18 @@ typedef struct ps1_bus
     ps1_gpu* gpu;
     ps1_scratchpad* scratchpad;
     ps1_dma* dma;
+
+    //NULL entries fall back to the range checks and I/O handlers
+    uint8_t** read_table;
+    uint8_t** write_table; //Either write_table_normal or write_table_isolated
+    uint8_t** write_table_normal;
+    uint8_t** write_table_isolated; //All NULL, stores with the cache isolated never reach memory directly
+
+    ps1_fastmem* fastmem; //Host MMU mapping of the guest address space, NULL when disabled
+
+    bus_io_handler io_handlers[BUS_IO_MAX_HANDLERS];
+    uint8_t io_handler_count;
+    uint8_t io_map[BUS_IO_SIZE / 4]; //Handler index + 1 for every word of the I/O window, 0 when unmapped
 }ps1_bus;
 
 ps1_bus* ps1_bus_create();
@@ -32,6 +76,11 @@ void ps1_bus_store_byte(ps1_bus* bus, uint32_t address, uint8_t value);
 void ps1_bus_store_halfword(ps1_bus* bus, uint32_t address, uint16_t value);
 void ps1_bus_store_word(ps1_bus* bus, uint32_t address, uint32_t value);
 void ps1_bus_destroy(ps1_bus* bus);
+void ps1_bus_update_memory_map(ps1_bus* bus);
+void ps1_bus_set_cache_isolation(ps1_bus* bus, bool isolated);
+void ps1_bus_set_code_page(ps1_bus* bus, uint32_t address, bool has_code);
+bool ps1_bus_enable_fastmem(ps1_bus* bus);
+bool ps1_bus_register_io(ps1_bus* bus, uint32_t address, uint32_t length, void* device, bus_io_read_fn read, bus_io_write_fn write, uint8_t widths);
 ps1_ram* ps1_bus_get_ram(ps1_bus* bus);
 
 #endif
\ No newline at end of file
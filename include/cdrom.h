@@ -0,0 +1,170 @@
+#ifndef CDROM_H
+#define CDROM_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+#include "disc.h"
+#include "cdrom_audio.h"
+
+#define CDROM_BASE 0x1F801800 //Four byte registers, what most of them are depends on the index in bits 0-1 of the first
+
+//Status register
+#define CDROM_STATUS_PARAMETER_EMPTY (1 << 3)
+#define CDROM_STATUS_PARAMETER_READY (1 << 4) //Parameter FIFO not full
+#define CDROM_STATUS_RESPONSE_READY  (1 << 5)
+#define CDROM_STATUS_DATA_READY      (1 << 6)
+#define CDROM_STATUS_BUSY            (1 << 7) //A command is waiting for its first response
+
+//Drive status byte, the first byte of almost every response
+#define CDROM_STAT_ERROR      (1 << 0)
+#define CDROM_STAT_MOTOR      (1 << 1)
+#define CDROM_STAT_SEEK_ERROR (1 << 2)
+#define CDROM_STAT_ID_ERROR   (1 << 3)
+#define CDROM_STAT_SHELL_OPEN (1 << 4)
+#define CDROM_STAT_READING    (1 << 5)
+#define CDROM_STAT_SEEKING    (1 << 6)
+#define CDROM_STAT_PLAYING    (1 << 7)
+
+//Setmode bits
+#define CDROM_MODE_CDDA         (1 << 0)
+#define CDROM_MODE_AUTO_PAUSE   (1 << 1)
+#define CDROM_MODE_REPORT       (1 << 2)
+#define CDROM_MODE_XA_FILTER    (1 << 3)
+#define CDROM_MODE_IGNORE_BIT   (1 << 4)
+#define CDROM_MODE_WHOLE_SECTOR (1 << 5) //924h bytes from the header on, otherwise the 800h bytes of user data
+#define CDROM_MODE_XA_ADPCM     (1 << 6)
+#define CDROM_MODE_DOUBLE_SPEED (1 << 7)
+
+typedef enum CDROM_COMMAND
+{
+    CDROM_GETSTAT   = 0x01,
+    CDROM_SETLOC    = 0x02,
+    CDROM_PLAY      = 0x03,
+    CDROM_READN     = 0x06,
+    CDROM_MOTOR_ON  = 0x07,
+    CDROM_STOP      = 0x08,
+    CDROM_PAUSE     = 0x09,
+    CDROM_INIT      = 0x0A,
+    CDROM_MUTE      = 0x0B,
+    CDROM_DEMUTE    = 0x0C,
+    CDROM_SETFILTER = 0x0D,
+    CDROM_SETMODE   = 0x0E,
+    CDROM_GETPARAM  = 0x0F,
+    CDROM_GETLOCL   = 0x10,
+    CDROM_GETLOCP   = 0x11,
+    CDROM_GETTN     = 0x13,
+    CDROM_GETTD     = 0x14,
+    CDROM_SEEKL     = 0x15,
+    CDROM_SEEKP     = 0x16,
+    CDROM_TEST      = 0x19,
+    CDROM_GETID     = 0x1A,
+    CDROM_READS     = 0x1B,
+    CDROM_READTOC   = 0x1E
+} CDROM_COMMAND;
+
+//INT1 to INT5 in the interrupt flag register
+typedef enum CDROM_INTERRUPT
+{
+    CDROM_INT_NONE,
+    CDROM_INT_DATA_READY,
+    CDROM_INT_COMPLETE,
+    CDROM_INT_ACKNOWLEDGE,
+    CDROM_INT_DATA_END,
+    CDROM_INT_ERROR
+} CDROM_INTERRUPT;
+
+#define CDROM_FIFO_SIZE 16
+#define CDROM_RESPONSE_QUEUE 4
+#define CDROM_SECTOR_BUFFERS 4 //Backends that don't serve sectors in place fill these in turn
+
+typedef struct ps1_bus ps1_bus;
+typedef struct ps1_dma ps1_dma;
+typedef struct ps1_irq ps1_irq;
+typedef struct ps1_scheduler ps1_scheduler;
+typedef struct ps1_spu ps1_spu;
+
+//A response the controller will give once it is due and the previous interrupt has been acknowledged
+typedef struct cdrom_response
+{
+    uint64_t due;
+    CDROM_INTERRUPT interrupt;
+    uint8_t length;
+    uint8_t data[CDROM_FIFO_SIZE];
+    const uint8_t* sector; //Sector that INT1 announces, the request register loads it into the data FIFO
+} cdrom_response;
+
+/*
+ CD-ROM controller. Commands answer at once with their INT3 and queue their later responses, the queue is
+ handed out one interrupt at a time as the cpu acknowledges them. The drive head isn't ticked either, a seek
+ only sets when it will be over and reading puts the next sector on the scheduler every 1/75 or 1/150 s.
+
+ Sectors are never copied, the data FIFO is a pointer into the disc image mapping and DMA3 copies straight
+ from it into RAM. Audio is handled as its sectors are read too: XA-ADPCM sectors are decoded and resampled whole
+ and CD-DA sectors go as they are, through the volume matrix into the SPU's CD input.
+*/
+typedef struct ps1_cdrom
+{
+    uint8_t index;
+    uint8_t parameters[CDROM_FIFO_SIZE];
+    uint8_t parameter_count;
+    uint8_t response[CDROM_FIFO_SIZE];
+    uint8_t response_length;
+    uint8_t response_position;
+    uint8_t interrupt_enable;
+    uint8_t interrupt_flags; //Interrupt of the response in the FIFO until it is acknowledged
+    bool busy;
+
+    cdrom_response queue[CDROM_RESPONSE_QUEUE];
+    uint32_t queue_head;
+    uint32_t queue_count;
+
+    uint8_t mode;
+    uint8_t stat;         //Motor and error bits, seeking and reading are worked out from the timestamps
+    uint8_t filter_file;
+    uint8_t filter_channel;
+    bool muted;           //CD-DA and XA-ADPCM alike
+    bool adpcm_muted;
+    uint8_t volume[4];    //Left to left, left to right, right to right, right to left, 80h is full volume
+    uint8_t next_volume[4]; //Take effect when applied through index 3
+
+    uint32_t setloc;      //Target of the next read or seek
+    bool setloc_pending;
+    uint32_t position;    //LBA of the next sector to read
+    uint64_t seek_end;    //Timestamp the head gets to position
+    bool reading;
+    bool playing;         //Reading CD-DA for the SPU rather than data for the cpu
+    uint64_t sector_due;  //Timestamp the next sector is read, when reading
+
+    uint8_t scratch[CDROM_SECTOR_BUFFERS][DISC_SECTOR_SIZE];
+    uint32_t scratch_next;
+    const uint8_t* sector;  //Last sector announced with INT1
+    const uint8_t* data;    //Data FIFO
+    uint32_t data_length;
+    uint32_t data_position;
+    cdrom_audio audio;
+
+    ps1_disc* disc;       //Owned, NULL with the shell open
+    ps1_scheduler* scheduler;
+    ps1_irq* irq;
+    ps1_spu* spu;
+} ps1_cdrom;
+
+ps1_cdrom* ps1_cdrom_create();
+void ps1_cdrom_init(ps1_cdrom* cdrom);
+void ps1_cdrom_destroy(ps1_cdrom* cdrom);
+void ps1_connect_bus_cdrom(ps1_bus* bus, ps1_cdrom* cdrom);
+void ps1_connect_scheduler_cdrom(ps1_scheduler* scheduler, ps1_cdrom* cdrom);
+void ps1_connect_dma_cdrom(ps1_dma* dma, ps1_cdrom* cdrom);
+void ps1_connect_irq_cdrom(ps1_irq* irq, ps1_cdrom* cdrom);
+void ps1_connect_spu_cdrom(ps1_spu* spu, ps1_cdrom* cdrom);
+
+void ps1_cdrom_insert(ps1_cdrom* cdrom, ps1_disc* disc);
+void ps1_cdrom_eject(ps1_cdrom* cdrom);
+
+uint8_t ps1_cdrom_read_register(ps1_cdrom* cdrom, uint32_t address);
+void ps1_cdrom_store_register(ps1_cdrom* cdrom, uint32_t address, uint8_t value);
+
+#endif
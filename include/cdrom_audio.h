@@ -0,0 +1,66 @@
+#ifndef CDROM_AUDIO_H
+#define CDROM_AUDIO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+#include "simd.h"
+
+#define CDROM_XA_GROUPS 18          //Sound groups per sector, 128 bytes each from the end of the subheader
+#define CDROM_XA_GROUP_SIZE 128
+#define CDROM_XA_UNIT_SAMPLES 28
+#define CDROM_XA_MAX_SAMPLES 4032   //Per channel in a sector, 4 bit mono
+
+//Subheader coding info
+#define CDROM_XA_STEREO    (1 << 0)
+#define CDROM_XA_HALF_RATE (1 << 2) //18.9kHz, otherwise 37.8kHz
+#define CDROM_XA_8BIT      (1 << 4)
+
+#define CDROM_CDDA_FRAMES 588       //Stereo 44.1kHz frames in a CD-DA sector
+
+//44.1kHz is 7/6 of 37.8kHz and 7/3 of 18.9kHz, outputs are placed in sevenths of an input sample
+#define CDROM_RESAMPLE_PHASES 7
+#define CDROM_RESAMPLE_TAPS 16
+#define CDROM_AUDIO_MAX_FRAMES (CDROM_XA_MAX_SAMPLES * 7 / 3 + 1)
+
+typedef struct cdrom_audio cdrom_audio;
+
+//Units of a sound group with their shift applied and nothing else, 28 samples each. The vector version reads 16 bytes past the group
+typedef void (*cdrom_xa_expand_fn)(const uint8_t* group, bool eight_bit, int32_t units[8][32]);
+//Turns count new samples per channel into 44.1kHz stereo frames in the output, returns how many
+typedef uint32_t (*cdrom_resample_fn)(cdrom_audio* audio, uint32_t count, uint32_t channels);
+
+/*
+ XA-ADPCM decoder and resampler. A sector is decoded in one go when the drive reads it: every sound group has its
+ units expanded together, then the two tap prediction filter runs over them in order, since every sample depends
+ on the last two of its channel. The samples are appended to a buffer per channel after the last few of the
+ previous sector, and a 7 phase polyphase FIR takes them to 44.1kHz.
+*/
+typedef struct cdrom_audio
+{
+    int32_t history[2][2];  //Prediction filter state per channel, last then the one before
+    int16_t input[2][CDROM_RESAMPLE_TAPS - 1 + CDROM_XA_MAX_SAMPLES];
+    uint32_t position;      //Of the next output, in sevenths of a sample from the first new one
+    uint32_t step;          //6 at 37.8kHz, 3 at 18.9kHz
+    int16_t output[CDROM_AUDIO_MAX_FRAMES * 2];
+
+    cdrom_xa_expand_fn expand;
+    cdrom_resample_fn resample;
+} cdrom_audio;
+
+extern const int16_t cdrom_resample_taps[CDROM_RESAMPLE_PHASES][CDROM_RESAMPLE_TAPS];
+
+void cdrom_audio_init(cdrom_audio* audio);
+void cdrom_audio_reset(cdrom_audio* audio);
+bool cdrom_audio_set_simd(cdrom_audio* audio, bool enable);
+uint32_t cdrom_xa_decode(cdrom_audio* audio, const uint8_t* sector);
+
+void cdrom_xa_expand(const uint8_t* group, bool eight_bit, int32_t units[8][32]);
+uint32_t cdrom_audio_resample(cdrom_audio* audio, uint32_t count, uint32_t channels);
+#ifdef PS1_SIMD_AVX2
+void cdrom_xa_expand_avx2(const uint8_t* group, bool eight_bit, int32_t units[8][32]);
+uint32_t cdrom_audio_resample_avx2(cdrom_audio* audio, uint32_t count, uint32_t channels);
+#endif
+
+#endif
@@ -7,16 +7,22 @@
 #include <string.h>
 #include <stdlib.h>
 #include "disassembler.h"
+#include "gte.h"
 
 #define MAX_SIZE_FIFO 2
+#define CPU_SHELL_ENTRY 0x80030000 //Where the BIOS jumps to the shell once the kernel is set up
+#define CPU_EXE_HEADER_SIZE 0x800
+#define CPU_EXE_STACK 0x801FFF00 //What the BIOS gives EXEs that don't set their own stack
 
 typedef enum EXCEPTION
  {
+    INTERRUPT = 0x0,
     OVERFLOW = 0x0C,
     BREAK = 0x9,
     ADEL = 0x04,
     ADES = 0x5,
-    SYSCALL = 0x8
+    SYSCALL = 0x8,
+    COPROCESSOR_UNUSABLE = 0xB
 
  } EXCEPTION;
 
@@ -37,6 +43,43 @@ typedef enum EXCEPTION
 extern const uint32_t cpu_cop0_writemask[];
 
 typedef struct ps1_bus ps1_bus;
+typedef struct ps1_scheduler ps1_scheduler;
+typedef struct ps1_cpu ps1_cpu;
+typedef struct ps1_block_cache ps1_block_cache;
+typedef struct cpu_block cpu_block;
+typedef struct cpu_instr cpu_instr;
+
+typedef struct ps1_jit ps1_jit;
+
+typedef void (*cpu_handler)(ps1_cpu* cpu, const cpu_instr* instr);
+
+typedef enum CPU_BACKEND
+{
+    CPU_BACKEND_INTERPRETER, //Fetch and decode every instruction
+    CPU_BACKEND_BLOCK_CACHE, //Run pre-decoded basic blocks
+    CPU_BACKEND_JIT          //Run basic blocks recompiled to x86-64 code
+} CPU_BACKEND;
+
+typedef enum CPU_INSTR_FLAGS
+{
+    CPU_INSTR_BRANCH = 0x1,    //Branches and jumps, followed by a delay slot
+    CPU_INSTR_LOAD = 0x2,      //Loads that go through the delayed load fifo
+    CPU_INSTR_END_BLOCK = 0x4  //Instructions after which a cached block must stop
+} CPU_INSTR_FLAGS;
+
+//An instruction decoded once by cpu_decode_instr, with every operand field already extracted
+typedef struct cpu_instr
+{
+    cpu_handler handler;
+    uint32_t opcode;
+    uint32_t imm;    //16 bit immediate, zero extended
+    uint32_t target; //26 bit jump target
+    uint8_t rs;
+    uint8_t rt;
+    uint8_t rd;
+    uint8_t shamt;
+    uint8_t flags;
+} cpu_instr;
 
 typedef struct delayed_register
 {
@@ -72,7 +115,12 @@ typedef struct ps1_cpu
     uint32_t opcode; //All instructions are 32 bits long
     uint32_t pc; //Special register pc
     uint32_t cop0[32];
+    ps1_gte gte; //Coprocessor 2
     ps1_bus* bus;
+    ps1_scheduler* scheduler;
+    CPU_BACKEND backend;
+    ps1_block_cache* block_cache;
+    ps1_jit* jit;
     delayed_register fifo_delay_load[MAX_SIZE_FIFO]; //FIFO that handles delay when loading values into general registers
     uint32_t virtual_address;
 
@@ -83,82 +131,107 @@ typedef struct ps1_cpu
     
     //Useful for debugging
     FILE* log;
-    FILE* exe;
     uint32_t debug_rs_value;
     uint32_t debug_rt_value;
-    bool load_exe;
+
+    //PS-X EXE injected when the BIOS hands over to the shell, NULL to boot normally
+    uint8_t* exe;
+    uint32_t exe_size;
+    uint32_t exe_stack;   //Stack of EXEs that don't set one
 } ps1_cpu;
 
-void cpu_tick(ps1_cpu* cpu);
+uint32_t cpu_tick(ps1_cpu* cpu); //Returns the number of instructions executed
+uint64_t cpu_run(ps1_cpu* cpu, uint64_t end); //Runs until cycle end or the next event, returns the cycles executed
+void cpu_step(ps1_cpu* cpu);
+void cpu_check_interrupt(ps1_cpu* cpu);
+uint32_t cpu_run_block(ps1_cpu* cpu, cpu_block* block);
+uint32_t cpu_run_jit(ps1_cpu* cpu, cpu_block* block);
 void cpu_execute_instr(ps1_cpu* cpu);
+void cpu_decode_instr(uint32_t opcode, cpu_instr* instr);
+
+//Pieces of the per instruction sequence, used by the JIT around the code it emits
+void cpu_handle_load(ps1_cpu* cpu);
+void cpu_handle_branch(ps1_cpu* cpu);
+void cpu_leave_instr(ps1_cpu* cpu);
 
 //Cpu instructions
-void cpu_execute_add(ps1_cpu* cpu);
-void cpu_execute_addu(ps1_cpu* cpu);
-void cpu_execute_and(ps1_cpu* cpu);
-void cpu_execute_break(ps1_cpu* cpu);
-void cpu_execute_div(ps1_cpu* cpu);
-void cpu_execute_divu(ps1_cpu* cpu);
-void cpu_execute_jalr(ps1_cpu* cpu);
-void cpu_execute_jr(ps1_cpu* cpu);
-void cpu_execute_mfhi(ps1_cpu* cpu);
-void cpu_execute_mflo(ps1_cpu* cpu);
-void cpu_execute_mthi(ps1_cpu* cpu);
-void cpu_execute_mtlo(ps1_cpu* cpu);
-void cpu_execute_mult(ps1_cpu* cpu);
-void cpu_execute_multu(ps1_cpu* cpu);
-void cpu_execute_nor(ps1_cpu* cpu);
-void cpu_execute_or(ps1_cpu* cpu);
-void cpu_execute_sll(ps1_cpu* cpu);
-void cpu_execute_sllv(ps1_cpu* cpu);
-void cpu_execute_slt(ps1_cpu* cpu);
-void cpu_execute_sltu(ps1_cpu* cpu);
-void cpu_execute_sra(ps1_cpu* cpu);
-void cpu_execute_srav(ps1_cpu* cpu);
-void cpu_execute_srl(ps1_cpu* cpu);
-void cpu_execute_srlv(ps1_cpu* cpu);
-void cpu_execute_sub(ps1_cpu* cpu);
-void cpu_execute_subu(ps1_cpu* cpu);
-void cpu_execute_syscall(ps1_cpu* cpu);
-void cpu_execute_xor(ps1_cpu* cpu);
-
-void cpu_execute_addi(ps1_cpu* cpu);
-void cpu_execute_addiu(ps1_cpu* cpu);
-void cpu_execute_addu(ps1_cpu* cpu);
-void cpu_execute_andi(ps1_cpu* cpu);
-void cpu_execute_beq(ps1_cpu* cpu);
-void cpu_execute_bgtz(ps1_cpu* cpu);
-void cpu_execute_blez(ps1_cpu* cpu);
-void cpu_execute_bne(ps1_cpu* cpu);
-void cpu_execute_jump(ps1_cpu* cpu);
-void cpu_execute_jal(ps1_cpu* cpu);
-void cpu_execute_lb(ps1_cpu* cpu);
-void cpu_execute_lbu(ps1_cpu* cpu);
-void cpu_execute_lh(ps1_cpu* cpu);
-void cpu_execute_lhu(ps1_cpu* cpu);
-void cpu_execute_lui(ps1_cpu* cpu);
-void cpu_execute_lw(ps1_cpu* cpu);
-void cpu_execute_lwl(ps1_cpu* cpu);
-void cpu_execute_lwr(ps1_cpu* cpu);
-void cpu_execute_ori(ps1_cpu* cpu);
-void cpu_execute_sb(ps1_cpu* cpu);
-void cpu_execute_sh(ps1_cpu* cpu);
-void cpu_execute_slti(ps1_cpu* cpu);
-void cpu_execute_sltiu(ps1_cpu* cpu);
-void cpu_execute_sw(ps1_cpu* cpu);
-void cpu_execute_swl(ps1_cpu* cpu);
-void cpu_execute_swr(ps1_cpu* cpu);
-void cpu_execute_xori(ps1_cpu* cpu);
-
-void cpu_execute_bgez(ps1_cpu* cpu);
-void cpu_execute_bgezal(ps1_cpu* cpu);
-void cpu_execute_bltz(ps1_cpu* cpu);
-void cpu_execute_bltzal(ps1_cpu* cpu);
+void cpu_execute_add(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_addu(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_and(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_break(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_div(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_divu(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_jalr(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_jr(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_mfhi(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_mflo(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_mthi(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_mtlo(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_mult(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_multu(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_nor(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_or(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_sll(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_sllv(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_slt(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_sltu(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_sra(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_srav(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_srl(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_srlv(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_sub(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_subu(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_syscall(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_xor(ps1_cpu* cpu, const cpu_instr* instr);
+
+void cpu_execute_addi(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_addiu(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_addu(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_andi(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_beq(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_bgtz(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_blez(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_bne(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_jump(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_jal(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_lb(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_lbu(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_lh(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_lhu(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_lui(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_lw(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_lwl(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_lwr(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_ori(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_sb(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_sh(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_slti(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_sltiu(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_sw(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_swl(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_swr(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_xori(ps1_cpu* cpu, const cpu_instr* instr);
+
+void cpu_execute_bgez(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_bgezal(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_bltz(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_bltzal(ps1_cpu* cpu, const cpu_instr* instr);
 
 //COP0 instructions
-void cpu_execute_mfc0(ps1_cpu* cpu);
-void cpu_execute_mtc0(ps1_cpu* cpu);
-void cpu_execute_rfe(ps1_cpu* cpu);
+void cpu_execute_mfc0(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_mtc0(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_rfe(ps1_cpu* cpu, const cpu_instr* instr);
+
+//COP2 (GTE) instructions
+void cpu_execute_mfc2(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_cfc2(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_mtc2(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_ctc2(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_cop2(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_lwc2(ps1_cpu* cpu, const cpu_instr* instr);
+void cpu_execute_swc2(ps1_cpu* cpu, const cpu_instr* instr);
+
+void cpu_execute_unknown(ps1_cpu* cpu, const cpu_instr* instr);
 
 void cpu_handle_exception(ps1_cpu* cpu, EXCEPTION exception);
 
@@ -166,7 +239,12 @@ ps1_cpu* ps1_cpu_create();
 void ps1_cpu_init(ps1_cpu* cpu);
 void ps1_cpu_destroy(ps1_cpu* cpu);
 void ps1_connect_bus_cpu(ps1_bus* bus, ps1_cpu* cpu);
+void ps1_connect_scheduler_cpu(ps1_scheduler* scheduler, ps1_cpu* cpu);
+bool ps1_cpu_set_backend(ps1_cpu* cpu, CPU_BACKEND backend);
+void ps1_cpu_flush_code(ps1_cpu* cpu);
+bool cpu_compare_state(ps1_cpu* cpu, ps1_cpu* reference);
 
+bool cpu_queue_exe(ps1_cpu* cpu, uint8_t* exe, uint32_t size, uint32_t stack);
 void sideload_exe(ps1_cpu* cpu);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,95 @@
+#ifndef DISC_H
+#define DISC_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+
+//Track files are mapped read only where the host has mmap, elsewhere they are read into memory once
+#if defined(__unix__) || defined(__APPLE__)
+#define DISC_MMAP
+#endif
+
+#define DISC_SECTOR_SIZE 2352  //Raw sector, sync and header included
+#define DISC_MAX_TRACKS 99
+#define DISC_MAX_FILES DISC_MAX_TRACKS
+#define DISC_LEAD_IN 150        //Sectors before LBA 0, MSF 00:02:00 is LBA 0
+#define DISC_SECTORS_PER_SECOND 75
+
+typedef enum DISC_TRACK_TYPE
+{
+    DISC_TRACK_AUDIO,
+    DISC_TRACK_MODE1,
+    DISC_TRACK_MODE2
+} DISC_TRACK_TYPE;
+
+typedef struct disc_file
+{
+    const uint8_t* data;
+    uint64_t size;
+    bool mapped; //Unmapped with munmap, otherwise freed
+} disc_file;
+
+typedef struct disc_track
+{
+    DISC_TRACK_TYPE type;
+    uint32_t start;       //LBA of index 01
+    uint32_t length;      //Sectors from index 01 to the next track
+    uint32_t pregap;      //Sectors before index 01 that belong to the track
+    uint32_t silence;     //Of those, the PREGAP ones that aren't in the file
+    int32_t file;         //-1 for tracks without data
+    uint64_t file_offset; //Byte offset of index 01 in the file, pregap sectors from index 00 sit before it
+} disc_track;
+
+typedef struct ps1_disc ps1_disc;
+
+/*
+ Disc images are read through a backend. read returns the raw sector at an LBA, either straight from the image
+ or from scratch after filling it, NULL past the end of the disc. Pregaps missing from the image read as zeroes.
+*/
+typedef struct disc_backend
+{
+    const uint8_t* (*read)(ps1_disc* disc, uint32_t lba, uint8_t* scratch);
+    void (*close)(ps1_disc* disc);
+} disc_backend;
+
+typedef struct ps1_disc
+{
+    disc_track tracks[DISC_MAX_TRACKS];
+    uint32_t track_count;
+    uint32_t sectors;     //Lead-out LBA
+    disc_file files[DISC_MAX_FILES];
+    uint32_t file_count;
+    const disc_backend* backend;
+    void* data;           //Owned by the backend
+} ps1_disc;
+
+ps1_disc* ps1_disc_open(const char* path);
+void ps1_disc_close(ps1_disc* disc);
+const uint8_t* ps1_disc_read_sector(ps1_disc* disc, uint32_t lba, uint8_t* scratch);
+int32_t ps1_disc_find_track(const ps1_disc* disc, uint32_t lba);
+bool disc_map_file(const char* path, disc_file* file);
+void disc_unmap_file(disc_file* file);
+
+static inline uint8_t disc_to_bcd(uint32_t value)
+{
+    return ((value / 10) << 4) | (value % 10);
+}
+
+static inline uint32_t disc_from_bcd(uint8_t value)
+{
+    return (value >> 4) * 10 + (value & 0xF);
+}
+
+//Absolute MSF of an LBA
+static inline void disc_lba_to_msf(uint32_t lba, uint8_t* minute, uint8_t* second, uint8_t* frame)
+{
+    lba += DISC_LEAD_IN;
+    *minute = lba / (60 * DISC_SECTORS_PER_SECOND);
+    *second = (lba / DISC_SECTORS_PER_SECOND) % 60;
+    *frame = lba % DISC_SECTORS_PER_SECOND;
+}
+
+#endif
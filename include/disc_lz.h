@@ -0,0 +1,22 @@
+#ifndef DISC_LZ_H
+#define DISC_LZ_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+
+/*
+ Byte oriented LZ77 codec for disc image hunks, in the LZ4 block layout: a token with the literal and match
+ lengths, the literals, then a 16 bit offset back into the output. Decoding is a couple of copies per sequence
+ and needs no tables, which is what matters when hunks are decompressed on every cache miss.
+*/
+
+#define DISC_LZ_HASH_BITS 14
+
+//Bytes written, 0 when the compressed data wouldn't fit in capacity
+uint32_t disc_lz_compress(const uint8_t* source, uint32_t size, uint8_t* destination, uint32_t capacity);
+//False unless the compressed data decodes to exactly size bytes
+bool disc_lz_decompress(const uint8_t* source, uint32_t compressed_size, uint8_t* destination, uint32_t size);
+
+#endif
@@ -0,0 +1,109 @@
+#ifndef DISC_PACKED_H
+#define DISC_PACKED_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "disc.h"
+
+/*
+ Packed disc images (.cdz). Every sector of the disc from LBA 0 to the lead-out, pregaps included, is cut into
+ hunks of a few sectors that are compressed on their own, so any sector can be read by decompressing one hunk.
+
+   header        disc_packed_header
+   tracks        disc_packed_track[track_count]
+   hunk index    disc_packed_hunk[hunk_count]
+   hunk data
+
+ Every field is little endian.
+*/
+
+#define DISC_PACKED_MAGIC "PS1DISCZ"
+#define DISC_PACKED_VERSION 1
+#define DISC_PACKED_HUNK_SECTORS 8
+
+#define DISC_PACKED_CACHE_HUNKS 64 //Decompressed hunks kept, about 1.2MB
+#define DISC_PACKED_READ_AHEAD 4   //Hunks decompressed ahead of the read
+#define DISC_PACKED_WORKERS 2
+
+typedef enum DISC_PACKED_CODEC
+{
+    DISC_PACKED_STORED, //Not compressed
+    DISC_PACKED_LZ,
+    DISC_PACKED_ZERO    //Nothing but zeroes, no data
+} DISC_PACKED_CODEC;
+
+typedef struct disc_packed_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t hunk_sectors;
+    uint32_t hunk_count;
+    uint32_t sectors;      //Lead-out LBA
+    uint32_t track_count;
+    uint32_t reserved;
+} disc_packed_header;
+
+typedef struct disc_packed_track
+{
+    uint32_t type;
+    uint32_t start;
+    uint32_t length;
+    uint32_t pregap;
+    uint32_t silence;
+    uint32_t reserved[3];
+} disc_packed_track;
+
+typedef struct disc_packed_hunk
+{
+    uint64_t offset;       //From the start of the file
+    uint32_t length;       //Compressed bytes
+    uint32_t codec;
+} disc_packed_hunk;
+
+typedef struct disc_hunk_slot
+{
+    uint8_t* data;
+    int32_t hunk;          //-1 while empty
+    bool ready;            //Otherwise a thread is still decompressing into it
+    uint64_t used;         //Last use, the oldest ready slot is taken for the next hunk
+} disc_hunk_slot;
+
+/*
+ Backend state. Hunks are decompressed into a fixed set of slots, misses on the cpu thread and read-ahead on the
+ worker pool. Whenever a read moves on to another hunk the next few in the same direction are queued for the
+ workers, so a sequential ReadN finds its sectors decompressed already and a seek costs a single hunk.
+*/
+typedef struct disc_packed
+{
+    const disc_packed_hunk* hunks; //Into the mapping
+    uint32_t hunk_count;
+    uint32_t hunk_sectors;
+    uint32_t hunk_size;
+
+    disc_hunk_slot slots[DISC_PACKED_CACHE_HUNKS];
+    int16_t* slot_of;      //Per hunk, -1 when it isn't cached
+    uint64_t clock;
+
+    int32_t last_hunk;
+    int32_t direction;
+    int32_t queue[DISC_PACKED_READ_AHEAD];
+    uint32_t queue_count;
+
+    pthread_t workers[DISC_PACKED_WORKERS];
+    uint32_t worker_count;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;   //Read-ahead queued or quit
+    pthread_cond_t done;   //A slot became ready
+    bool quit;
+
+    uint64_t hits;
+    uint64_t misses;
+} disc_packed;
+
+bool disc_open_packed(ps1_disc* disc, const char* path);
+bool ps1_disc_pack(ps1_disc* disc, const char* path);
+
+#endif
@@ -3,10 +3,11 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include <stdbool.h>
 #include <string.h>
 #include <stdlib.h>
 
-typedef enum DMA_REGISTERS 
+typedef enum DMA_REGISTERS
 {
     DMA_MDEC_IN      = 0x1F801080, // DMA0 channel 0 - MDECin
     DMA_MDEC_OUT     = 0x1F801090, // DMA1 channel 1 - MDECout
@@ -19,6 +20,35 @@ typedef enum DMA_REGISTERS
     DMA_DICR         = 0x1F8010F4  // DICR - DMA Interrupt register
 } DMA_REGISTERS;
 
+typedef enum DMA_CHANNEL
+{
+    DMA_CHANNEL_MDEC_IN,
+    DMA_CHANNEL_MDEC_OUT,
+    DMA_CHANNEL_GPU,
+    DMA_CHANNEL_CDROM,
+    DMA_CHANNEL_SPU,
+    DMA_CHANNEL_PIO,
+    DMA_CHANNEL_OTC,
+    DMA_CHANNEL_COUNT
+} DMA_CHANNEL;
+
+//CHCR fields
+#define DMA_CHCR_FROM_RAM  (1 << 0)
+#define DMA_CHCR_DECREMENT (1 << 1)
+#define DMA_CHCR_CHOPPING  (1 << 8)
+#define DMA_CHCR_SYNC_SHIFT 9
+#define DMA_CHCR_BUSY      (1 << 24)
+#define DMA_CHCR_TRIGGER   (1 << 28)
+
+typedef enum DMA_SYNC
+{
+    DMA_SYNC_MANUAL,      //All words at once, started by the trigger bit
+    DMA_SYNC_REQUEST,     //Blocks, as the device asks for them
+    DMA_SYNC_LINKED_LIST  //GPU command lists
+} DMA_SYNC;
+
+#define DMA_CYCLES_PER_WORD 1 //Cpu cycles stolen for every word moved
+#define DMA_CYCLES_PER_NODE 8 //Extra cost of fetching a linked list header
 
 typedef struct channel
 {
@@ -27,14 +57,34 @@ typedef struct channel
     uint32_t chcr;
 }channel;
 
+//Devices move words between RAM and their FIFOs in whole spans
+typedef void (*dma_write_fn)(void* device, const uint32_t* words, uint32_t count); //RAM to device
+typedef void (*dma_read_fn)(void* device, uint32_t* words, uint32_t count);        //Device to RAM
+
+typedef struct dma_port
+{
+    void* device;
+    dma_write_fn write;
+    dma_read_fn read;
+}dma_port;
+
 typedef struct ps1_bus ps1_bus;
+typedef struct ps1_scheduler ps1_scheduler;
+typedef struct ps1_irq ps1_irq;
 
 typedef struct ps1_dma
-{   
-    channel channel[7];
+{
+    channel channel[DMA_CHANNEL_COUNT];
+    dma_port port[DMA_CHANNEL_COUNT];
     uint32_t dpcr;
     uint32_t dicr;
+    bool irq_line; //DICR bit 31, interrupts are requested on its rising edge
+    uint8_t requests;       //DMA request lines, one bit per channel
+    uint8_t request_driven; //Channels whose device drives its line, their request mode transfers wait for it
+    uint64_t stolen_cycles;
     ps1_bus* bus;
+    ps1_scheduler* scheduler;
+    ps1_irq* irq;
 }ps1_dma;
 
 
@@ -42,10 +92,11 @@ ps1_dma* ps1_dma_create();
 void ps1_dma_init(ps1_dma* dma);
 void ps1_dma_destroy(ps1_dma* dma);
 void ps1_connect_bus_dma(ps1_bus* bus, ps1_dma* dma);
+void ps1_connect_scheduler_dma(ps1_scheduler* scheduler, ps1_dma* dma);
+void ps1_connect_irq_dma(ps1_irq* irq, ps1_dma* dma);
+void ps1_dma_connect_port(ps1_dma* dma, DMA_CHANNEL channel, void* device, dma_write_fn write, dma_read_fn read);
+void ps1_dma_set_request(ps1_dma* dma, DMA_CHANNEL channel, bool active);
 void ps1_dma_do_transfer(ps1_dma* dma);
-void ps1_dma_do_otc(ps1_dma* dma);
-void ps1_dma_do_linklist(ps1_dma* dma);
-void ps1_dma_do_vramwrite(ps1_dma* dma);
 
 uint8_t ps1_dma_read_byte(ps1_dma* dma, uint32_t address);
 uint16_t ps1_dma_read_halfword(ps1_dma* dma, uint32_t address);
@@ -56,4 +107,4 @@ void ps1_dma_store_halfword(ps1_dma* dma, uint32_t address, uint16_t value);
 void ps1_dma_store_word(ps1_dma* dma, uint32_t address, uint32_t value);
 
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,52 @@
+#ifndef FASTMEM_H
+#define FASTMEM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+
+//Only Linux on x86-64 has the memfd mirrors and the fault handler that decodes the JIT accesses
+#if defined(__linux__) && (defined(__x86_64__) || defined(_M_X64))
+#define FASTMEM_SUPPORTED
+#endif
+
+#define FASTMEM_REGION_SIZE 0x100000000ULL //Whole 32 bit guest address space
+#define FASTMEM_MIRROR_SIZE 0x00800000     //RAM repeats four times in the first 8MB of every segment
+#define FASTMEM_MAX_INSTANCES 16           //Live at once, every one has its own region
+
+typedef struct ps1_bus ps1_bus;
+
+/*
+ The guest address space is reserved as one 4GB host region. RAM and BIOS live in a memfd that is mapped at every
+ place they appear in KUSEG, KSEG0 and KSEG1, so base + guest address is a valid host pointer without any check.
+ Everything else is left without access: MMIO, scratchpad and unmapped accesses fault and the signal handler
+ redoes them through the ps1_bus functions. RAM pages holding cached code and the whole RAM while the cache is
+ isolated are made read only, so those stores fault too.
+*/
+typedef struct ps1_fastmem
+{
+    ps1_bus* bus;
+    uint8_t* base;   //Start of the 4GB region
+    uint8_t* memory; //Primary view of the memfd, RAM followed by the BIOS
+    int fd;
+    bool isolated;
+    uint64_t faults;
+    int32_t slot;    //In the table the fault handler looks at, -1 until registered
+} ps1_fastmem;
+
+ps1_fastmem* ps1_fastmem_create();
+bool ps1_fastmem_init(ps1_fastmem* fastmem, ps1_bus* bus);
+void ps1_fastmem_destroy(ps1_fastmem* fastmem);
+
+bool ps1_fastmem_available();
+void ps1_fastmem_map_bios(ps1_fastmem* fastmem);
+void ps1_fastmem_set_cache_isolation(ps1_fastmem* fastmem, bool isolated);
+void ps1_fastmem_set_code_page(ps1_fastmem* fastmem, uint32_t address, bool has_code);
+
+static inline uint8_t* ps1_fastmem_pointer(ps1_fastmem* fastmem, uint32_t address)
+{
+    return fastmem->base + address;
+}
+
+#endif
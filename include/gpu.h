@@ -7,17 +7,153 @@
 #include <string.h>
 #include <stdlib.h>
 
+//NTSC video timing in cpu cycles (3413 video cycles per line at 11/7 of the cpu clock)
+#define GPU_SCANLINES_PER_FRAME 263
+#define GPU_CYCLES_PER_SCANLINE 2172
+#define GPU_CYCLES_PER_FRAME (GPU_SCANLINES_PER_FRAME * GPU_CYCLES_PER_SCANLINE)
+
+//VRAM is a single 1024x512 surface of 16 bit pixels
+#define GPU_VRAM_WIDTH 1024
+#define GPU_VRAM_HEIGHT 512
+#define GPU_VRAM_SIZE (GPU_VRAM_WIDTH * GPU_VRAM_HEIGHT * 2)
+
+#define GPU_FIFO_SIZE 16 //Words of the longest GP0 packet (gouraud textured quad is 12)
+
+//GPUSTAT fields
+#define GPUSTAT_TEXPAGE_MASK      0x000001FF //Texture page, semi-transparency and texture depth, written by E1h
+#define GPUSTAT_DITHER            (1 << 9)
+#define GPUSTAT_DRAW_TO_DISPLAY   (1 << 10)
+#define GPUSTAT_SET_MASK          (1 << 11)
+#define GPUSTAT_CHECK_MASK        (1 << 12)
+#define GPUSTAT_DISPLAY_MODE_MASK 0x007F4000 //Written by GP1(08h)
+#define GPUSTAT_24BIT             (1 << 21)
+#define GPUSTAT_DISPLAY_DISABLE   (1 << 23)
+#define GPUSTAT_IRQ               (1 << 24)
+#define GPUSTAT_DMA_REQUEST       (1 << 25)
+#define GPUSTAT_READY_CMD         (1 << 26)
+#define GPUSTAT_READY_VRAM_READ   (1 << 27)
+#define GPUSTAT_READY_DMA         (1 << 28)
+#define GPUSTAT_DMA_SHIFT         29
+#define GPUSTAT_ODD_LINE          (1u << 31)
+
+typedef enum GP0_MODE
+{
+    GP0_MODE_COMMAND,    //Collecting the words of a packet
+    GP0_MODE_POLYLINE,   //Extra vertices of a polyline until the 5xxx5xxxh terminator
+    GP0_MODE_VRAM_WRITE  //Pixels of a CPU to VRAM transfer
+} GP0_MODE;
+
+//Rectangle of VRAM being copied to or from the CPU, two pixels per word
+typedef struct gpu_transfer
+{
+    uint32_t x;
+    uint32_t y;
+    uint32_t width;
+    uint32_t height;
+    uint32_t current_x; //Relative to x
+    uint32_t current_y; //Relative to y
+    bool active;
+} gpu_transfer;
+
+/*
+ GPUSTAT as the cpu thread sees it while commands run on the render thread. Words are only split into packets
+ here, far enough to follow the few commands that change GPUSTAT, so polling it never waits for drawing.
+*/
+typedef struct gpu_status_tracker
+{
+    uint32_t status;
+    GP0_MODE mode;
+    uint32_t packet[GPU_FIFO_SIZE];
+    uint32_t count;
+    uint32_t length;
+    uint32_t transfer_words; //Left in a CPU to VRAM transfer
+} gpu_status_tracker;
+
 typedef struct ps1_bus ps1_bus;
+typedef struct ps1_scheduler ps1_scheduler;
+typedef struct ps1_irq ps1_irq;
+typedef struct ps1_dma ps1_dma;
+typedef struct gpu_draw_state gpu_draw_state;
+typedef struct gpu_span gpu_span;
+typedef struct ps1_gpu_thread ps1_gpu_thread;
+typedef struct ps1_gpu_tiles ps1_gpu_tiles;
+typedef struct ps1_gpu_texture_cache ps1_gpu_texture_cache;
+typedef struct ps1_gpu_trace ps1_gpu_trace;
+typedef struct ps1_gpu_dump ps1_gpu_dump;
+
+//Draws the leading part of a span with vector instructions, returns the number of pixels drawn
+typedef int32_t (*gpu_span_simd_fn)(uint16_t* vram, const gpu_draw_state* state, const gpu_span* span);
+
 typedef struct ps1_gpu
 {
+    uint16_t* vram;
+    gpu_span_simd_fn span_simd; //NULL when spans only use the scalar loop
     uint32_t GPUSTAT;
+    uint32_t gpuread; //Latched GPUREAD value for info requests
+
+    //GP0 packet being collected
+    GP0_MODE mode;
+    uint32_t fifo[GPU_FIFO_SIZE];
+    uint32_t fifo_count;
+    uint32_t fifo_length;  //Words of the current packet
+    uint32_t polyline_color;
+    uint32_t polyline_vertex;
+
+    gpu_transfer vram_write;
+    gpu_transfer vram_read;
+
+    //Drawing environment
+    uint8_t texture_window_mask_x; //In 8 pixel steps
+    uint8_t texture_window_mask_y;
+    uint8_t texture_window_offset_x;
+    uint8_t texture_window_offset_y;
+    bool rect_flip_x;
+    bool rect_flip_y;
+    uint16_t draw_left;   //Drawing area, inclusive
+    uint16_t draw_top;
+    uint16_t draw_right;
+    uint16_t draw_bottom;
+    int16_t draw_offset_x;
+    int16_t draw_offset_y;
+
+    //Display control
+    uint16_t display_x; //Top left of the displayed area in VRAM
+    uint16_t display_y;
+    uint16_t display_h_start; //Horizontal range in video cycles
+    uint16_t display_h_end;
+    uint16_t display_v_start; //Vertical range in scanlines
+    uint16_t display_v_end;
+
+    uint64_t frame_count; //VBlanks seen since power on
+    uint64_t primitive_count; //Primitives drawn since power on and the pixels they covered, kept by the GP0 thread
+    uint64_t pixel_count;
+    bool odd_field;       //GPUSTAT bit 31, kept apart so the cpu thread never writes GPUSTAT
+    gpu_status_tracker cpu_status; //Only used while the render thread runs
+    ps1_scheduler* scheduler;
+    ps1_irq* irq;
+    ps1_gpu_thread* thread; //Render thread, NULL when commands run on the cpu thread
+    ps1_gpu_tiles* tiles;   //Worker pool, NULL when primitives are drawn as they arrive
+    ps1_gpu_texture_cache* texture_cache; //NULL when textures are sampled straight from VRAM
+    ps1_gpu_trace* trace;   //GP0/GP1 recorder, NULL when not capturing
+    ps1_gpu_dump* dump;     //Headless frame output, NULL when not dumping
 }ps1_gpu;
 
 uint32_t ps1_gpu_read_word(ps1_gpu* gpu, uint32_t address);
 void ps1_gpu_write_word(ps1_gpu* gpu, uint32_t address, uint32_t value);
+void ps1_gpu_write_gp0(ps1_gpu* gpu, uint32_t value);
+void ps1_gpu_write_gp0_block(ps1_gpu* gpu, const uint32_t* words, uint32_t count);
+void ps1_gpu_write_gp1(ps1_gpu* gpu, uint32_t value);
+void ps1_gpu_execute_gp0_block(ps1_gpu* gpu, const uint32_t* words, uint32_t count);
+void ps1_gpu_execute_gp1(ps1_gpu* gpu, uint32_t value);
+void ps1_gpu_sync(ps1_gpu* gpu);
+void ps1_gpu_seed_status(ps1_gpu* gpu);
 
 ps1_gpu* ps1_gpu_create();
 void ps1_gpu_init(ps1_gpu* gpu);
 void ps1_gpu_destroy(ps1_gpu* gpu);
+void ps1_connect_bus_gpu(ps1_bus* bus, ps1_gpu* gpu);
+void ps1_connect_scheduler_gpu(ps1_scheduler* scheduler, ps1_gpu* gpu);
+void ps1_connect_dma_gpu(ps1_dma* dma, ps1_gpu* gpu);
+void ps1_connect_irq_gpu(ps1_irq* irq, ps1_gpu* gpu);
 
-#endif
\ No newline at end of file
+#endif
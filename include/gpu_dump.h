@@ -0,0 +1,58 @@
+#ifndef GPU_DUMP_H
+#define GPU_DUMP_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#define GPU_DUMP_QUEUE 8 //Frames converted ahead of the writer thread, more are dropped instead of stalling the cpu thread
+#define GPU_DUMP_MAX_WIDTH 640
+#define GPU_DUMP_MAX_HEIGHT 512
+
+typedef enum GPU_DUMP_FORMAT
+{
+    GPU_DUMP_Y4M, //YUV4MPEG2, 4:4:4 planar, every frame the size of the first one
+    GPU_DUMP_PPM  //Binary PPM images one after the other, each with its own size
+} GPU_DUMP_FORMAT;
+
+typedef struct ps1_gpu ps1_gpu;
+
+typedef struct gpu_dump_frame
+{
+    uint8_t* data; //Three bytes per pixel either way, RGB or the Y, U and V planes
+    uint32_t width;
+    uint32_t height;
+} gpu_dump_frame;
+
+/*
+ At every VBlank the display area is converted straight from VRAM into a free slot of the queue, and the writer
+ thread hands the slot to the file as it is. The file is unbuffered, so the pixels go from the slot to the OS
+ without another copy. When the writer falls GPU_DUMP_QUEUE frames behind the new frames are dropped and counted.
+*/
+typedef struct ps1_gpu_dump
+{
+    FILE* file;
+    bool close_file; //False for stdout
+    GPU_DUMP_FORMAT format;
+    uint32_t width;  //Y4M stream size, taken from the display mode of the first frame
+    uint32_t height;
+    bool pal;
+
+    gpu_dump_frame frames[GPU_DUMP_QUEUE];
+    uint32_t head;   //Frames queued, only the cpu thread moves it
+    uint32_t tail;   //Frames written, only the writer thread moves it
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    bool quit;
+    bool failed;     //A write failed, the rest of the frames are thrown away
+    uint64_t written;
+    uint64_t dropped;
+} ps1_gpu_dump;
+
+bool ps1_gpu_start_dump(ps1_gpu* gpu, const char* path);
+void ps1_gpu_stop_dump(ps1_gpu* gpu);
+void ps1_gpu_dump_frame(ps1_gpu* gpu);
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef GPU_RASTER_H
+#define GPU_RASTER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "simd.h"
+
+typedef struct ps1_gpu ps1_gpu;
+
+//Attributes of a primitive, decoded once from the GP0 command byte
+typedef enum GPU_DRAW_FLAGS
+{
+    GPU_DRAW_GOURAUD = 0x1,  //Colors are interpolated, otherwise the first vertex color is used
+    GPU_DRAW_TEXTURED = 0x2,
+    GPU_DRAW_RAW = 0x4,      //Texels are not modulated by the vertex color
+    GPU_DRAW_SEMI = 0x8,     //Semi-transparent, for textured primitives only texels with bit 15 set are
+    GPU_DRAW_DITHER = 0x10,
+    GPU_DRAW_CACHED = 0x20   //Texels come from the decoded copy in texels instead of VRAM
+} GPU_DRAW_FLAGS;
+
+typedef enum GPU_TEXTURE_DEPTH
+{
+    GPU_TEXTURE_4BIT,
+    GPU_TEXTURE_8BIT,
+    GPU_TEXTURE_15BIT
+} GPU_TEXTURE_DEPTH;
+
+typedef struct gpu_vertex
+{
+    int32_t x;
+    int32_t y;
+    uint8_t r;
+    uint8_t g;
+    uint8_t b;
+    uint8_t u;
+    uint8_t v;
+} gpu_vertex;
+
+//Everything the inner loops need about a primitive, resolved before the first span
+typedef struct gpu_draw_state
+{
+    uint32_t flags;
+    uint8_t semi_mode;
+    uint8_t texture_depth;
+    uint16_t texpage_x;  //In pixels
+    uint16_t texpage_y;
+    uint16_t clut_x;
+    uint16_t clut_y;
+    const uint16_t* texels; //Texture cache entry, 256x256 indexed by v * 256 + u
+    uint8_t window_and_u; //Texture window, u = (u & and) | or
+    uint8_t window_and_v;
+    uint8_t window_or_u;
+    uint8_t window_or_v;
+    int32_t clip_left;   //Drawing area, inclusive
+    int32_t clip_top;
+    int32_t clip_right;
+    int32_t clip_bottom;
+    uint16_t mask_set;   //0x8000 when drawn pixels get the mask bit
+    uint16_t mask_check; //0x8000 when pixels with the mask bit are not drawn over
+    bool flip_x;         //Rectangles only
+    bool flip_y;
+} gpu_draw_state;
+
+//A horizontal run of pixels, attributes are 16.16 fixed point values at the first pixel plus a per pixel step
+typedef struct gpu_span
+{
+    int32_t x;
+    int32_t y;
+    int32_t length;
+    int32_t r, g, b, u, v;
+    int32_t dr, dg, db, du, dv;
+} gpu_span;
+
+bool ps1_gpu_set_simd(ps1_gpu* gpu, bool enable);
+void ps1_gpu_draw_span(ps1_gpu* gpu, const gpu_draw_state* state, const gpu_span* span);
+uint32_t ps1_gpu_draw_triangle(ps1_gpu* gpu, const gpu_draw_state* state, const gpu_vertex* v0, const gpu_vertex* v1, const gpu_vertex* v2);
+uint32_t ps1_gpu_draw_line(ps1_gpu* gpu, const gpu_draw_state* state, const gpu_vertex* v0, const gpu_vertex* v1);
+uint32_t ps1_gpu_draw_rect(ps1_gpu* gpu, const gpu_draw_state* state, const gpu_vertex* origin, int32_t width, int32_t height);
+
+#ifdef PS1_SIMD_AVX2
+int32_t ps1_gpu_draw_span_avx2(uint16_t* vram, const gpu_draw_state* state, const gpu_span* span);
+#endif
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef GPU_TEXTURE_CACHE_H
+#define GPU_TEXTURE_CACHE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "gpu.h"
+#include "gpu_raster.h"
+
+#define GPU_TEXTURE_CACHE_ENTRIES 32
+#define GPU_TEXTURE_TEXELS (256 * 256)
+
+//A texture page run through its CLUT once, so sampling it is a single load whatever the depth
+typedef struct gpu_cached_texture
+{
+    uint32_t key;       //Texture page, depth and CLUT
+    bool valid;
+    uint64_t last_used;
+    int32_t box[4];     //VRAM the texels were decoded from: left, top, right, bottom
+    uint16_t* texels;   //Indexed by v * 256 + u, with a spare halfword for the AVX2 gathers
+} gpu_cached_texture;
+
+/*
+ Entries are keyed by everything that changes the decoded texels, the texture window is applied to u and v
+ before the lookup so it is not part of it. Anything writing VRAM reports the rectangle it covers and every
+ entry decoded from there is dropped. Texels are only overwritten on a miss, which first waits for the batched
+ primitives since they may still be sampling the entry being replaced.
+*/
+typedef struct ps1_gpu_texture_cache
+{
+    gpu_cached_texture entries[GPU_TEXTURE_CACHE_ENTRIES];
+    uint32_t last;  //Entry of the previous hit, primitives in a row mostly share a texture
+    uint64_t clock; //Lookups so far, for picking the least recently used entry
+
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t invalidations;
+} ps1_gpu_texture_cache;
+
+ps1_gpu_texture_cache* ps1_gpu_texture_cache_create();
+void ps1_gpu_texture_cache_init(ps1_gpu_texture_cache* cache);
+void ps1_gpu_texture_cache_destroy(ps1_gpu_texture_cache* cache);
+
+bool ps1_gpu_set_texture_cache(ps1_gpu* gpu, bool enable);
+const uint16_t* ps1_gpu_texture_cache_lookup(ps1_gpu* gpu, const gpu_draw_state* state);
+void ps1_gpu_texture_cache_invalidate(ps1_gpu* gpu, int32_t x, int32_t y, int32_t width, int32_t height);
+void ps1_gpu_texture_box(const gpu_draw_state* state, int32_t* box);
+
+static inline void gpu_box_clear(int32_t* box)
+{
+    box[0] = GPU_VRAM_WIDTH;
+    box[1] = GPU_VRAM_HEIGHT;
+    box[2] = -1;
+    box[3] = -1;
+}
+
+//Grows the box (left, top, right, bottom) to hold the rectangle, one wrapping around the right edge of VRAM takes the whole width
+static inline void gpu_box_add(int32_t* box, int32_t x, int32_t y, int32_t width, int32_t height)
+{
+    if(x + width > GPU_VRAM_WIDTH)
+    {
+        x = 0;
+        width = GPU_VRAM_WIDTH;
+    }
+
+    box[0] = x < box[0] ? x : box[0];
+    box[1] = y < box[1] ? y : box[1];
+    box[2] = x + width - 1 > box[2] ? x + width - 1 : box[2];
+    box[3] = y + height - 1 > box[3] ? y + height - 1 : box[3];
+}
+
+static inline bool gpu_box_overlaps(const int32_t* a, const int32_t* b)
+{
+    return a[0] <= b[2] && a[2] >= b[0] && a[1] <= b[3] && a[3] >= b[1];
+}
+
+#endif
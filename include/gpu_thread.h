@@ -0,0 +1,45 @@
+#ifndef GPU_THREAD_H
+#define GPU_THREAD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#define GPU_RING_SIZE 0x10000    //Words, must be a power of two
+#define GPU_RING_MAX_ENTRY 0x1000 //Longer GP0 blocks are split, an entry never wraps around the ring
+
+//Every entry starts with a header word: type in the top byte, payload word count below
+typedef enum GPU_RING_ENTRY
+{
+    GPU_RING_GP0,  //GP0 words
+    GPU_RING_GP1,  //One GP1 word
+    GPU_RING_PAD,  //Skips to the start of the ring
+    GPU_RING_QUIT  //Stops the render thread
+} GPU_RING_ENTRY;
+
+typedef struct ps1_gpu ps1_gpu;
+
+/*
+ Single producer, single consumer ring between the cpu thread and the render thread. The cpu thread only writes
+ words and head, the render thread only reads them and advances tail once an entry is fully executed, so
+ tail == head means every command sent so far has been drawn.
+*/
+typedef struct ps1_gpu_thread
+{
+    ps1_gpu* gpu;
+    uint32_t* ring;
+    _Atomic uint32_t head; //Next word the cpu thread writes, only grows (indices are masked)
+    _Atomic uint32_t tail; //Next word the render thread reads
+    _Atomic bool sleeping; //The render thread is waiting on wake
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+} ps1_gpu_thread;
+
+bool ps1_gpu_start_thread(ps1_gpu* gpu);
+void ps1_gpu_stop_thread(ps1_gpu* gpu);
+void ps1_gpu_thread_push(ps1_gpu_thread* thread, GPU_RING_ENTRY type, const uint32_t* words, uint32_t count);
+void ps1_gpu_thread_sync(ps1_gpu_thread* thread);
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef GPU_TILES_H
+#define GPU_TILES_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "gpu_raster.h"
+
+#define GPU_TILES_MAX_WORKERS 64
+#define GPU_TILES_BATCH_SIZE 1024 //Primitives collected before the workers are started
+
+typedef enum GPU_PRIMITIVE
+{
+    GPU_PRIMITIVE_TRIANGLE,
+    GPU_PRIMITIVE_LINE,
+    GPU_PRIMITIVE_RECT
+} GPU_PRIMITIVE;
+
+//A primitive kept for later, with the drawing environment it was sent with
+typedef struct gpu_primitive
+{
+    GPU_PRIMITIVE type;
+    gpu_draw_state state;
+    gpu_vertex vertices[3];
+    int32_t width;  //Rectangles only
+    int32_t height;
+    int32_t top;    //Rows the primitive can touch, inclusive
+    int32_t bottom;
+} gpu_primitive;
+
+typedef struct ps1_gpu_tiles ps1_gpu_tiles;
+
+typedef struct gpu_worker
+{
+    ps1_gpu_tiles* tiles;
+    uint32_t index;
+    pthread_t thread;
+} gpu_worker;
+
+/*
+ VRAM is cut into horizontal bands, band i belongs to worker i % worker_count. On a flush every worker walks the
+ whole batch in order and draws each primitive clipped to its own bands, so the primitives touching a band are
+ drawn in the order they were sent and every pixel is computed exactly as in a single threaded draw. Anything
+ that reads VRAM outside the pixel being drawn has to see the batch finished first: transfers flush it, and so
+ does a textured primitive whose texture page or CLUT overlaps what the batch draws, or a primitive drawing over
+ a texture the batch still reads from VRAM. One that samples its own area is drawn whole by the flushing thread.
+*/
+typedef struct ps1_gpu_tiles
+{
+    ps1_gpu* gpu;
+    uint32_t worker_count; //Including the thread that flushes, which works as worker 0
+    uint32_t tile_count;
+    uint32_t tile_height;
+    gpu_worker workers[GPU_TILES_MAX_WORKERS];
+
+    gpu_primitive batch[GPU_TILES_BATCH_SIZE];
+    uint32_t batch_count;
+    int32_t dirty[4];   //Left, top, right, bottom of everything the batch draws, empty when left > right
+    int32_t sampled[4]; //Same for the texture pages and CLUTs the batch reads from VRAM, not through the texture cache
+
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    uint32_t generation; //Bumped for every flush and to stop the workers
+    uint32_t busy;       //Workers still drawing the current batch
+    uint64_t pixels;     //Drawn by the other workers during the current flush
+    bool quit;
+} ps1_gpu_tiles;
+
+bool ps1_gpu_start_workers(ps1_gpu* gpu, uint32_t workers, uint32_t tiles);
+void ps1_gpu_stop_workers(ps1_gpu* gpu);
+void ps1_gpu_flush_primitives(ps1_gpu* gpu);
+
+//Draw right away without workers, otherwise add the primitive to the batch, the texture cache is resolved either way
+void ps1_gpu_queue_triangle(ps1_gpu* gpu, const gpu_draw_state* state, const gpu_vertex* v0, const gpu_vertex* v1, const gpu_vertex* v2);
+void ps1_gpu_queue_line(ps1_gpu* gpu, const gpu_draw_state* state, const gpu_vertex* v0, const gpu_vertex* v1);
+void ps1_gpu_queue_rect(ps1_gpu* gpu, const gpu_draw_state* state, const gpu_vertex* origin, int32_t width, int32_t height);
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef GPU_TRACE_H
+#define GPU_TRACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+#define GPU_TRACE_MAGIC 0x52544750 //"PGTR"
+#define GPU_TRACE_VERSION 1
+#define GPU_TRACE_BUFFER_SIZE 0x10000 //Words kept in memory before they go to the file
+#define GPU_TRACE_MAX_RECORD 0xFFFFFF //Payload words of a record, longer blocks are split
+
+/*
+ A trace is the magic and version words followed by records. Every record starts with a header word, type in
+ the top byte and payload word count below, the same layout as the render thread ring. The first records set
+ up VRAM and the drawing and display environment, so a trace replays on a freshly initialised GPU.
+*/
+typedef enum GPU_TRACE_RECORD
+{
+    GPU_TRACE_GP0,   //GP0 words, transfer data included
+    GPU_TRACE_GP1,   //One GP1 word
+    GPU_TRACE_FRAME  //VBlank, no payload
+} GPU_TRACE_RECORD;
+
+typedef struct ps1_gpu ps1_gpu;
+
+typedef struct ps1_gpu_trace
+{
+    FILE* file;
+    bool started;      //The GPU was idle and the starting state is written, words before that are dropped
+    uint32_t* buffer;
+    uint32_t buffer_count;
+    uint32_t last_gp0; //Buffer index of the last record header when it is GP0, consecutive GP0 words share it
+    bool last_is_gp0;
+    uint64_t frames;
+    uint64_t words;
+} ps1_gpu_trace;
+
+bool ps1_gpu_start_trace(ps1_gpu* gpu, const char* path);
+void ps1_gpu_stop_trace(ps1_gpu* gpu);
+void ps1_gpu_trace_record(ps1_gpu* gpu, GPU_TRACE_RECORD type, const uint32_t* words, uint32_t count);
+void ps1_gpu_trace_frame(ps1_gpu* gpu);
+
+#endif
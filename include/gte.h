@@ -0,0 +1,80 @@
+#ifndef GTE_H
+#define GTE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "simd.h"
+
+//FLAG bits, index is the MAC/IR register number
+#define GTE_FLAG_MAC_POSITIVE(index) (1u << (31 - (index))) //MAC1-3 above +(2^43)-1
+#define GTE_FLAG_MAC_NEGATIVE(index) (1u << (28 - (index))) //MAC1-3 below -2^43
+#define GTE_FLAG_IR(index)           ((index) ? 1u << (25 - (index)) : 1u << 12) //IR0 0..1000h, IR1-3 -8000h..7FFFh
+#define GTE_FLAG_COLOR(index)        (1u << (21 - (index))) //Color FIFO R, G, B 0..FFh
+#define GTE_FLAG_SZ                  (1u << 18) //SZ3 and OTZ 0..FFFFh
+#define GTE_FLAG_DIVIDE              (1u << 17) //H/SZ3 out of range
+#define GTE_FLAG_MAC0_POSITIVE       (1u << 16)
+#define GTE_FLAG_MAC0_NEGATIVE       (1u << 15)
+#define GTE_FLAG_SX                  (1u << 14) //SX2 -400h..3FFh
+#define GTE_FLAG_SY                  (1u << 13)
+#define GTE_FLAG_ERROR_MASK          0x7F87E000 //Bits that set bit 31 when read
+#define GTE_FLAG_WRITE_MASK          0x7FFFF000
+
+typedef struct ps1_gte ps1_gte;
+
+//(T SHL 12) + M * V for three vectors, the per vector sums of the three rows wrapped to 44 bits, overflows go to FLAG
+typedef void (*gte_transform3_fn)(ps1_gte* gte, const int16_t m[3][3], const int32_t* t, const int16_t v[3][3], int64_t out[3][3]);
+
+/*
+ Geometry Transformation Engine, coprocessor 2. The 64 registers are kept unpacked, reads and writes through
+ MFC2/CFC2/MTC2/CTC2/LWC2/SWC2 repack them with the sign and zero extension quirks of the real register file.
+*/
+typedef struct ps1_gte
+{
+    //Data registers
+    int16_t v[3][3];      //V0-V2, x y z
+    uint32_t rgbc;        //Color and GPU command code
+    uint16_t otz;
+    int16_t ir[4];
+    int16_t sxy[3][2];    //Screen XY FIFO, [2] is the newest
+    uint16_t sz[4];       //Screen Z FIFO, [3] is the newest
+    uint32_t rgb[3];      //Color FIFO, [2] is the newest
+    uint32_t res1;
+    int32_t mac[4];
+    uint32_t lzcs;
+    uint32_t lzcr;
+
+    //Control registers
+    int16_t rotation[3][3];
+    int32_t translation[3];
+    int16_t light[3][3];
+    int32_t background[3];
+    int16_t color[3][3];
+    int32_t far_color[3];
+    int32_t ofx;          //Screen offset, 16.16
+    int32_t ofy;
+    uint16_t h;           //Projection plane distance
+    int16_t dqa;          //Depth cueing coefficient and offset
+    int32_t dqb;
+    int16_t zsf3;         //Average Z scale factors
+    int16_t zsf4;
+    uint32_t flag;        //Without bit 31, computed when read
+
+    gte_transform3_fn transform3; //Scalar or vector kernel for RTPT, NCT, NCCT and NCDT
+    uint64_t commands;
+} ps1_gte;
+
+void ps1_gte_init(ps1_gte* gte);
+void ps1_gte_set_simd(ps1_gte* gte, bool enable);
+uint32_t ps1_gte_read_data(ps1_gte* gte, uint32_t reg);
+void ps1_gte_write_data(ps1_gte* gte, uint32_t reg, uint32_t value);
+uint32_t ps1_gte_read_control(ps1_gte* gte, uint32_t reg);
+void ps1_gte_write_control(ps1_gte* gte, uint32_t reg, uint32_t value);
+void ps1_gte_execute(ps1_gte* gte, uint32_t command);
+
+void ps1_gte_transform3(ps1_gte* gte, const int16_t m[3][3], const int32_t* t, const int16_t v[3][3], int64_t out[3][3]);
+#ifdef PS1_SIMD_AVX2
+void ps1_gte_transform3_avx2(ps1_gte* gte, const int16_t m[3][3], const int32_t* t, const int16_t v[3][3], int64_t out[3][3]);
+#endif
+
+#endif
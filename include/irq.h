@@ -0,0 +1,50 @@
+#ifndef IRQ_H
+#define IRQ_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+
+#define IRQ_STATUS 0x1F801070 //I_STAT, writing acknowledges the bits written as 0
+#define IRQ_MASK   0x1F801074 //I_MASK
+
+typedef enum IRQ_SOURCE
+{
+    IRQ_VBLANK,
+    IRQ_GPU,
+    IRQ_CDROM,
+    IRQ_DMA,
+    IRQ_TIMER0,
+    IRQ_TIMER1,
+    IRQ_TIMER2,
+    IRQ_CONTROLLER,
+    IRQ_SIO,
+    IRQ_SPU,
+    IRQ_LIGHTPEN,
+    IRQ_COUNT
+} IRQ_SOURCE;
+
+typedef struct ps1_bus ps1_bus;
+typedef struct ps1_cpu ps1_cpu;
+
+/*
+ Interrupt controller. Devices set their I_STAT bit when they request an interrupt, the cpu only sees whether any
+ unmasked bit is set, through CAUSE bit 10. It is updated whenever I_STAT or I_MASK change, so the cpu doesn't have
+ to poll anything.
+*/
+typedef struct ps1_irq
+{
+    uint32_t status;
+    uint32_t mask;
+    ps1_cpu* cpu;
+} ps1_irq;
+
+ps1_irq* ps1_irq_create();
+void ps1_irq_init(ps1_irq* irq);
+void ps1_irq_destroy(ps1_irq* irq);
+void ps1_connect_bus_irq(ps1_bus* bus, ps1_irq* irq);
+void ps1_connect_irq_cpu(ps1_irq* irq, ps1_cpu* cpu);
+void ps1_irq_raise(ps1_irq* irq, IRQ_SOURCE source);
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef ISO9660_H
+#define ISO9660_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+#include "disc.h"
+
+#define ISO_BLOCK_SIZE 2048
+#define ISO_PRIMARY_DESCRIPTOR 16 //LBA of the primary volume descriptor
+#define ISO_NAME_LENGTH 32        //PS1 discs stick to 8.3 names and the ;1 version
+
+typedef struct iso_entry
+{
+    char name[ISO_NAME_LENGTH]; //Without the ;1 version
+    uint32_t lba;
+    uint32_t size;
+    bool directory;
+} iso_entry;
+
+typedef struct iso_directory
+{
+    uint32_t lba;
+    iso_entry* entries;
+    uint32_t count;
+} iso_directory;
+
+/*
+ Read only ISO9660 file system over a disc. Only the directories a lookup goes through are read, each of them
+ once, later lookups find it among the parsed ones.
+*/
+typedef struct ps1_iso
+{
+    ps1_disc* disc;
+    iso_entry root;
+    iso_directory* directories;
+    uint32_t directory_count;
+    uint32_t directory_capacity;
+} ps1_iso;
+
+ps1_iso* ps1_iso_open(ps1_disc* disc);
+void ps1_iso_close(ps1_iso* iso);
+bool ps1_iso_find(ps1_iso* iso, const char* path, iso_entry* entry);
+uint8_t* ps1_iso_read_file(ps1_iso* iso, const iso_entry* entry);
+uint8_t* ps1_iso_load(ps1_iso* iso, const char* path, uint32_t* size);
+bool ps1_iso_find_boot(ps1_iso* iso, char* path, size_t path_length, uint32_t* stack);
+
+#endif
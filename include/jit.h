@@ -0,0 +1,36 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+
+#define JIT_BUFFER_SIZE (32*1024*1024)
+#define JIT_MAX_BLOCK_SIZE (16*1024) //Worst case host code for one BLOCK_MAX_INSTRUCTIONS block
+
+typedef struct ps1_cpu ps1_cpu;
+typedef struct cpu_block cpu_block;
+
+//Compiled blocks return the number of guest instructions they executed
+typedef uint32_t (*jit_block_fn)(ps1_cpu* cpu);
+
+typedef struct ps1_jit
+{
+    uint8_t* buffer; //Executable memory, blocks are bump allocated until it is full and then all flushed
+    uint32_t used;
+    uint8_t* ptr;    //Current emit position
+    uint64_t compiled_blocks;
+    uint64_t flushes;
+} ps1_jit;
+
+ps1_jit* ps1_jit_create();
+bool ps1_jit_init(ps1_jit* jit);
+void ps1_jit_destroy(ps1_jit* jit);
+
+bool ps1_jit_available();
+bool ps1_jit_needs_flush(ps1_jit* jit);
+void ps1_jit_reset(ps1_jit* jit);
+jit_block_fn ps1_jit_compile(ps1_jit* jit, ps1_cpu* cpu, cpu_block* block);
+
+#endif
@@ -0,0 +1,138 @@
+#ifndef MDEC_H
+#define MDEC_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "simd.h"
+
+#define MDEC_DATA    0x1F801820 //Write: command/parameters, read: output FIFO
+#define MDEC_CONTROL 0x1F801824 //Write: control, read: status
+
+//Control bits
+#define MDEC_CONTROL_RESET      (1u << 31)
+#define MDEC_CONTROL_ENABLE_IN  (1u << 30) //DMA0 requests
+#define MDEC_CONTROL_ENABLE_OUT (1u << 29) //DMA1 requests
+
+//Status bits
+#define MDEC_STATUS_OUT_EMPTY   (1u << 31)
+#define MDEC_STATUS_IN_FULL     (1u << 30)
+#define MDEC_STATUS_BUSY        (1u << 29)
+#define MDEC_STATUS_IN_REQUEST  (1u << 28)
+#define MDEC_STATUS_OUT_REQUEST (1u << 27)
+
+typedef enum MDEC_COMMAND
+{
+    MDEC_COMMAND_NONE,
+    MDEC_COMMAND_DECODE = 1, //Macroblocks, parameter count in bits 0-15
+    MDEC_COMMAND_QUANT  = 2, //Quantization tables, luma then chroma when bit 0 is set
+    MDEC_COMMAND_SCALE  = 3  //IDCT matrix, 64 signed halfwords
+} MDEC_COMMAND;
+
+typedef enum MDEC_DEPTH
+{
+    MDEC_DEPTH_4,
+    MDEC_DEPTH_8,
+    MDEC_DEPTH_24,
+    MDEC_DEPTH_15
+} MDEC_DEPTH;
+
+typedef enum MDEC_BLOCK
+{
+    MDEC_BLOCK_Y1,
+    MDEC_BLOCK_Y2,
+    MDEC_BLOCK_Y3,
+    MDEC_BLOCK_Y4,
+    MDEC_BLOCK_CR, //Also the only block of monochrome macroblocks
+    MDEC_BLOCK_CB,
+    MDEC_BLOCK_COUNT
+} MDEC_BLOCK;
+
+#define MDEC_MACROBLOCK_WORDS 192 //16x16 pixels at 24 bits, the largest output
+
+typedef struct ps1_mdec ps1_mdec;
+typedef struct ps1_bus ps1_bus;
+typedef struct ps1_dma ps1_dma;
+
+//Two pass 8x8 IDCT in place, the coefficients come in as -400h..3FFh and go out as -128..127
+typedef void (*mdec_idct_fn)(const ps1_mdec* mdec, int16_t* block);
+
+/*
+ Macroblock decoder. Parameter words of a decode command are run length decoded a halfword at a time as they
+ arrive, every finished block goes through the IDCT and every finished macroblock is converted to pixels and
+ appended to the output FIFO, which grows as needed.
+
+ In threaded mode the parameter words are queued to a worker thread instead, so decoding runs while the cpu
+ thread carries on. Anything that needs the decoder state, the output FIFO, a status read or a new command,
+ waits for the worker, output reads only for as many words as they take.
+*/
+typedef struct ps1_mdec
+{
+    uint32_t command;       //Last command word, its bits 25-28 show up in the status
+    MDEC_COMMAND mode;      //What the remaining parameter words are for
+    uint32_t remaining;     //Parameter words still expected
+    uint32_t table_index;   //Words of the current table command received
+    bool enable_in;
+    bool enable_out;
+
+    uint8_t quant[2][64];   //Luma and chroma quantization, in zigzag order
+    int16_t scale[64];      //IDCT matrix, row u is frequency u
+
+    //Decoder, owned by the worker in threaded mode
+    int16_t blocks[MDEC_BLOCK_COUNT][64];
+    MDEC_BLOCK block;       //Block being decoded
+    uint32_t k;             //Coefficient index, 64 while waiting for the DC value
+    uint32_t q;             //Quantization scale of the block
+
+    uint32_t* output;
+    uint32_t output_head;   //Next word to read
+    uint32_t output_tail;
+    uint32_t output_capacity;
+
+    mdec_idct_fn idct;
+    //Scale table rearranged for the vector IDCT, rebuilt with every scale command
+    uint32_t scale_columns[8][4];   //S[2k][y] | S[2k+1][y] << 16
+    int16_t scale_pairs[4][16];     //Rows 2k and 2k+1 interleaved, x 0-3 then x 4-7
+
+    //Worker thread
+    bool threaded;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;    //Words queued or quit
+    pthread_cond_t done;    //Output appended or the queue drained
+    uint32_t* pending;      //Filled by the cpu thread
+    uint32_t pending_count;
+    uint32_t pending_capacity;
+    uint32_t* working;      //Swapped with pending by the worker
+    uint32_t working_capacity;
+    bool busy;              //The worker is decoding its copy
+    MDEC_BLOCK status_block; //Block as of the last finished batch, for status reads while the worker runs
+    bool quit;
+
+    uint64_t macroblocks;
+    ps1_dma* dma;
+} ps1_mdec;
+
+ps1_mdec* ps1_mdec_create();
+void ps1_mdec_init(ps1_mdec* mdec);
+void ps1_mdec_destroy(ps1_mdec* mdec);
+void ps1_connect_bus_mdec(ps1_bus* bus, ps1_mdec* mdec);
+void ps1_connect_dma_mdec(ps1_dma* dma, ps1_mdec* mdec);
+bool ps1_mdec_set_simd(ps1_mdec* mdec, bool enable);
+bool ps1_mdec_start_thread(ps1_mdec* mdec);
+void ps1_mdec_stop_thread(ps1_mdec* mdec);
+
+void ps1_mdec_write_block(ps1_mdec* mdec, const uint32_t* words, uint32_t count);
+void ps1_mdec_read_block(ps1_mdec* mdec, uint32_t* words, uint32_t count);
+void ps1_mdec_write_control(ps1_mdec* mdec, uint32_t value);
+uint32_t ps1_mdec_read_status(ps1_mdec* mdec);
+
+void ps1_mdec_idct(const ps1_mdec* mdec, int16_t* block);
+#ifdef PS1_SIMD_AVX2
+void ps1_mdec_idct_avx2(const ps1_mdec* mdec, int16_t* block);
+#endif
+
+#endif
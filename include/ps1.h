@@ -2,9 +2,11 @@
 #define PS1_H
 
 #include <stdint.h>
+#include <stdbool.h>
 #include <string.h>
 #include <string.h>
 #include <stdlib.h>
+#include "cpu.h"
 
 typedef struct ps1_cpu ps1_cpu;
 typedef struct ps1_ram ps1_ram;
@@ -13,6 +15,12 @@ typedef struct ps1_bus ps1_bus;
 typedef struct ps1_gpu ps1_gpu;
 typedef struct ps1_scratchpad ps1_scratchpad;
 typedef struct ps1_dma ps1_dma;
+typedef struct ps1_mdec ps1_mdec;
+typedef struct ps1_irq ps1_irq;
+typedef struct ps1_timers ps1_timers;
+typedef struct ps1_cdrom ps1_cdrom;
+typedef struct ps1_spu ps1_spu;
+typedef struct ps1_scheduler ps1_scheduler;
 
 typedef struct ps1
 {
@@ -23,6 +31,12 @@ typedef struct ps1
     ps1_gpu* gpu;
     ps1_scratchpad* scratchpad;
     ps1_dma* dma;
+    ps1_mdec* mdec;
+    ps1_irq* irq;
+    ps1_timers* timers;
+    ps1_cdrom* cdrom;
+    ps1_spu* spu;
+    ps1_scheduler* scheduler;
 
 }ps1;
 
@@ -31,5 +45,23 @@ void ps1_init(ps1* ps1);
 void ps1_destroy(ps1* ps1);
 void ps1_load_bios(ps1* ps1);
 void ps1_play(ps1* ps1);
+uint64_t ps1_run_cycles(ps1* ps1, uint64_t cycles);
+void ps1_run_frame(ps1* ps1);
+void ps1_set_cpu_backend(ps1* ps1, CPU_BACKEND backend);
+bool ps1_enable_fastmem(ps1* ps1);
+bool ps1_set_gpu_simd(ps1* ps1, bool enable);
+bool ps1_set_gpu_threaded(ps1* ps1, bool enable);
+bool ps1_set_gpu_workers(ps1* ps1, uint32_t workers, uint32_t tiles);
+bool ps1_set_gpu_texture_cache(ps1* ps1, bool enable);
+bool ps1_start_gpu_trace(ps1* ps1, const char* path);
+void ps1_stop_gpu_trace(ps1* ps1);
+bool ps1_start_frame_dump(ps1* ps1, const char* path);
+void ps1_stop_frame_dump(ps1* ps1);
+bool ps1_set_mdec_threaded(ps1* ps1, bool enable);
+bool ps1_insert_disc(ps1* ps1, const char* path);
+uint32_t ps1_read_audio(ps1* ps1, int16_t* frames, uint32_t count);
+bool ps1_boot_exe(ps1* ps1, const char* path);
+bool ps1_fast_boot(ps1* ps1);
+bool ps1_lockstep(ps1* test, ps1* reference);
 
 #endif
\ No newline at end of file
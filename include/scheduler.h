@@ -0,0 +1,67 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+
+#define CPU_CLOCK 33868800 //Hz, every timestamp is counted in cpu cycles
+
+//Every device event has a fixed slot, so rescheduling never allocates
+typedef enum SCHEDULER_EVENT
+{
+    EVENT_DMA,
+    EVENT_VBLANK,
+    EVENT_HBLANK,
+    EVENT_TIMER0,
+    EVENT_TIMER1,
+    EVENT_TIMER2,
+    EVENT_CDROM,
+    EVENT_SPU,
+    EVENT_COUNT
+} SCHEDULER_EVENT;
+
+//timestamp is when the event was due, periodic events reschedule from it so they don't drift
+typedef void (*scheduler_callback)(void* device, uint64_t timestamp);
+
+typedef struct scheduler_event
+{
+    uint64_t timestamp;
+    scheduler_callback callback;
+    void* device;
+    int32_t heap_index; //-1 when not scheduled
+} scheduler_event;
+
+typedef struct ps1_scheduler
+{
+    uint64_t cycles;        //Global cycle counter
+    uint64_t next_deadline; //Timestamp of the earliest event, UINT64_MAX when there is none
+    scheduler_event events[EVENT_COUNT];
+    uint8_t heap[EVENT_COUNT]; //Min-heap of scheduled event ids ordered by timestamp
+    uint32_t heap_size;
+} ps1_scheduler;
+
+ps1_scheduler* ps1_scheduler_create();
+void ps1_scheduler_init(ps1_scheduler* scheduler);
+void ps1_scheduler_destroy(ps1_scheduler* scheduler);
+
+void ps1_scheduler_register(ps1_scheduler* scheduler, SCHEDULER_EVENT event, scheduler_callback callback, void* device);
+void ps1_scheduler_schedule(ps1_scheduler* scheduler, SCHEDULER_EVENT event, uint64_t cycles_from_now);
+void ps1_scheduler_schedule_at(ps1_scheduler* scheduler, SCHEDULER_EVENT event, uint64_t timestamp);
+void ps1_scheduler_cancel(ps1_scheduler* scheduler, SCHEDULER_EVENT event);
+bool ps1_scheduler_is_scheduled(ps1_scheduler* scheduler, SCHEDULER_EVENT event);
+void ps1_scheduler_run_events(ps1_scheduler* scheduler);
+
+static inline void ps1_scheduler_add_cycles(ps1_scheduler* scheduler, uint64_t cycles)
+{
+    scheduler->cycles += cycles;
+}
+
+//True when the cpu has to stop and let ps1_scheduler_run_events catch up
+static inline bool ps1_scheduler_event_due(ps1_scheduler* scheduler)
+{
+    return scheduler->cycles >= scheduler->next_deadline;
+}
+
+#endif
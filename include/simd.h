@@ -0,0 +1,17 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <stdbool.h>
+
+/*
+ Vector kernels need gcc or clang on x86-64. They are built into every such binary and picked at runtime, only
+ the functions marked PS1_AVX2_TARGET use AVX2 so the rest of the emulator keeps running on any x86-64 cpu.
+*/
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#define PS1_SIMD_AVX2
+#define PS1_AVX2_TARGET __attribute__((target("avx2")))
+#endif
+
+bool ps1_cpu_has_avx2();
+
+#endif
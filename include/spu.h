@@ -0,0 +1,204 @@
+#ifndef SPU_H
+#define SPU_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include "simd.h"
+
+#define SPU_BASE 0x1F801C00
+#define SPU_SIZE 0x400        //Voices, control and reverb registers, then the internal volumes
+#define SPU_RAM_SIZE 0x80000
+#define SPU_VOICE_COUNT 24
+#define SPU_ADPCM_SAMPLES 28  //Per 16 byte block
+
+#define SPU_SAMPLE_RATE 44100
+#define SPU_SAMPLE_CYCLES 768 //CPU_CLOCK / SPU_SAMPLE_RATE, exactly
+#define SPU_BLOCK 32          //Samples mixed at once, a multiple of 8
+#define SPU_RING_SIZE 8192    //Stereo frames waiting for the host, a power of 2
+#define SPU_CD_RING_SIZE 16384 //Stereo frames of CD audio waiting to be mixed, a power of 2
+
+//Register offsets from SPU_BASE, voice registers are 16 bytes per voice from 0
+#define SPU_VOICE_VOLUME_LEFT  0x0
+#define SPU_VOICE_VOLUME_RIGHT 0x2
+#define SPU_VOICE_PITCH        0x4
+#define SPU_VOICE_START        0x6  //In 8 byte units like every SPU RAM address
+#define SPU_VOICE_ADSR_LOW     0x8
+#define SPU_VOICE_ADSR_HIGH    0xA
+#define SPU_VOICE_ADSR_LEVEL   0xC
+#define SPU_VOICE_REPEAT       0xE
+
+#define SPU_MAIN_VOLUME        0x180 //Left, right
+#define SPU_REVERB_VOLUME      0x184
+#define SPU_KEY_ON             0x188 //Voices 0-15, then 16-23 in the next halfword
+#define SPU_KEY_OFF            0x18C
+#define SPU_PITCH_MOD          0x190
+#define SPU_NOISE_ON           0x194
+#define SPU_REVERB_ON          0x198
+#define SPU_ENDX               0x19C
+#define SPU_REVERB_BASE        0x1A2
+#define SPU_IRQ_ADDRESS        0x1A4
+#define SPU_TRANSFER_ADDRESS   0x1A6
+#define SPU_TRANSFER_FIFO      0x1A8
+#define SPU_CONTROL            0x1AA
+#define SPU_TRANSFER_CONTROL   0x1AC
+#define SPU_STATUS             0x1AE
+#define SPU_CD_VOLUME          0x1B0
+#define SPU_EXTERN_VOLUME      0x1B4
+#define SPU_CURRENT_VOLUME     0x1B8
+#define SPU_REVERB_CONFIG      0x1C0 //32 halfwords, SPU_REVERB_REGISTER
+#define SPU_VOICE_CURRENT      0x200 //Current left and right volume of every voice
+
+//SPUCNT bits
+#define SPU_CONTROL_CD_AUDIO      (1 << 0)
+#define SPU_CONTROL_CD_REVERB     (1 << 2)
+#define SPU_CONTROL_TRANSFER_SHIFT 4
+#define SPU_CONTROL_IRQ_ENABLE    (1 << 6)
+#define SPU_CONTROL_REVERB        (1 << 7) //Master enable of the reverb unit
+#define SPU_CONTROL_UNMUTE        (1 << 14)
+#define SPU_CONTROL_ENABLE        (1 << 15)
+
+//SPUSTAT bits, 0-5 follow SPUCNT
+#define SPU_STATUS_IRQ            (1 << 6)
+#define SPU_STATUS_DMA_REQUEST    (1 << 7)
+
+typedef enum SPU_ADSR_PHASE
+{
+    SPU_ADSR_OFF,
+    SPU_ADSR_ATTACK,
+    SPU_ADSR_DECAY,
+    SPU_ADSR_SUSTAIN,
+    SPU_ADSR_RELEASE
+} SPU_ADSR_PHASE;
+
+//Reverb configuration in register order, the d and m entries are SPU RAM offsets in 8 byte units
+typedef enum SPU_REVERB_REGISTER
+{
+    SPU_REVERB_DAPF1, SPU_REVERB_DAPF2, SPU_REVERB_VIIR, SPU_REVERB_VCOMB1,
+    SPU_REVERB_VCOMB2, SPU_REVERB_VCOMB3, SPU_REVERB_VCOMB4, SPU_REVERB_VWALL,
+    SPU_REVERB_VAPF1, SPU_REVERB_VAPF2, SPU_REVERB_MLSAME, SPU_REVERB_MRSAME,
+    SPU_REVERB_MLCOMB1, SPU_REVERB_MRCOMB1, SPU_REVERB_MLCOMB2, SPU_REVERB_MRCOMB2,
+    SPU_REVERB_DLSAME, SPU_REVERB_DRSAME, SPU_REVERB_MLDIFF, SPU_REVERB_MRDIFF,
+    SPU_REVERB_MLCOMB3, SPU_REVERB_MRCOMB3, SPU_REVERB_MLCOMB4, SPU_REVERB_MRCOMB4,
+    SPU_REVERB_DLDIFF, SPU_REVERB_DRDIFF, SPU_REVERB_MLAPF1, SPU_REVERB_MRAPF1,
+    SPU_REVERB_MLAPF2, SPU_REVERB_MRAPF2, SPU_REVERB_VLIN, SPU_REVERB_VRIN,
+    SPU_REVERB_COUNT
+} SPU_REVERB_REGISTER;
+
+typedef struct ps1_spu ps1_spu;
+typedef struct ps1_bus ps1_bus;
+typedef struct ps1_dma ps1_dma;
+typedef struct ps1_irq ps1_irq;
+typedef struct ps1_scheduler ps1_scheduler;
+
+//Volume register in fixed mode, or a sweep moving the current volume a step per sample
+typedef struct spu_volume
+{
+    uint16_t setting;
+    int16_t current;
+    uint32_t counter;
+} spu_volume;
+
+typedef struct spu_voice
+{
+    spu_volume volume[2];
+    uint16_t pitch;         //1000h plays at 44.1kHz
+    uint16_t start;
+    uint16_t repeat;
+    uint32_t adsr;          //Low register | high register << 16
+    SPU_ADSR_PHASE phase;
+    int16_t level;          //Envelope
+    uint32_t adsr_counter;
+
+    uint32_t address;       //Byte address of the block being played
+    uint32_t counter;       //Sample of the block in bits 12 and up, interpolation phase in bits 4-11
+    uint8_t flags;          //Loop flags of the block being played
+    int16_t samples[3 + SPU_ADPCM_SAMPLES]; //The last 3 of the previous block for the interpolation, then the block
+    int16_t history[2];     //ADPCM filter state
+} spu_voice;
+
+//Sums the voices in the mask into the dry and reverb mixes, count samples of every voice's output block
+typedef void (*spu_mix_fn)(ps1_spu* spu, uint32_t voices, uint32_t count);
+
+/*
+ Sound processing unit. It isn't ticked with the cpu, samples are rendered SPU_BLOCK at a time from a periodic
+ event, and any register access first renders up to the current cycle so writes land on the sample they were
+ made at. Each voice decodes, interpolates and applies its envelope over the whole block on its own, then the
+ mixer sums every active voice into the dry and reverb mixes in one pass.
+
+ CD audio comes in through a second ring, filled a sector at a time by the drive and taken a frame per sample.
+ Finished stereo frames go into a ring the host drains from any thread, when it falls behind the newest frames
+ are dropped.
+*/
+typedef struct ps1_spu
+{
+    uint8_t* ram;
+    uint16_t registers[SPU_SIZE / 2]; //As last written, for the registers that read back that way
+
+    spu_voice voices[SPU_VOICE_COUNT];
+    spu_volume main_volume[2];
+    int16_t reverb_volume[2];
+    uint32_t pitch_mod;
+    uint32_t noise_on;
+    uint32_t reverb_on;
+    uint32_t endx;
+    uint16_t control;
+    uint16_t status;
+    uint32_t irq_address;
+    uint32_t transfer_address;
+
+    uint16_t noise_level;
+    int32_t noise_timer;
+
+    uint16_t reverb[SPU_REVERB_COUNT];
+    uint32_t reverb_base;
+    uint32_t reverb_current;
+    bool reverb_odd;        //The reverb runs at 22.05kHz, every other sample
+    int32_t reverb_output[2];
+
+    //CD audio at 44.1kHz, queued by the drive a sector at a time
+    int16_t* cd_ring;
+    uint32_t cd_head;
+    uint32_t cd_tail;
+    int16_t cd_volume[2];
+
+    //Block being rendered
+    int16_t voice_output[SPU_VOICE_COUNT][SPU_BLOCK];
+    int16_t noise[SPU_BLOCK];
+    int32_t mix[2][SPU_BLOCK];
+    int32_t reverb_input[2][SPU_BLOCK];
+    spu_mix_fn mixer;
+
+    uint64_t clock;         //Timestamp of the next sample to render
+    int16_t* ring;
+    atomic_uint ring_head;
+    atomic_uint ring_tail;
+    uint64_t dropped;
+
+    ps1_scheduler* scheduler;
+    ps1_irq* irq;
+} ps1_spu;
+
+ps1_spu* ps1_spu_create();
+void ps1_spu_init(ps1_spu* spu);
+void ps1_spu_destroy(ps1_spu* spu);
+void ps1_connect_bus_spu(ps1_bus* bus, ps1_spu* spu);
+void ps1_connect_scheduler_spu(ps1_scheduler* scheduler, ps1_spu* spu);
+void ps1_connect_dma_spu(ps1_dma* dma, ps1_spu* spu);
+void ps1_connect_irq_spu(ps1_irq* irq, ps1_spu* spu);
+bool ps1_spu_set_simd(ps1_spu* spu, bool enable);
+
+uint16_t ps1_spu_read_register(ps1_spu* spu, uint32_t address);
+void ps1_spu_store_register(ps1_spu* spu, uint32_t address, uint16_t value);
+uint32_t ps1_spu_read_audio(ps1_spu* spu, int16_t* frames, uint32_t count);
+void ps1_spu_queue_cd_audio(ps1_spu* spu, const int16_t* frames, uint32_t count);
+
+void ps1_spu_mix(ps1_spu* spu, uint32_t voices, uint32_t count);
+#ifdef PS1_SIMD_AVX2
+void ps1_spu_mix_avx2(ps1_spu* spu, uint32_t voices, uint32_t count);
+#endif
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef TIMERS_H
+#define TIMERS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+
+#define TIMERS_BASE  0x1F801100 //Counter n at TIMERS_BASE + n * 0x10: value, mode, target
+#define TIMERS_COUNT 3
+
+//Mode fields
+#define TIMER_MODE_SYNC_ENABLE     (1 << 0)
+#define TIMER_MODE_SYNC_SHIFT      1
+#define TIMER_MODE_RESET_AT_TARGET (1 << 3) //Otherwise the counter wraps after FFFFh
+#define TIMER_MODE_IRQ_TARGET      (1 << 4)
+#define TIMER_MODE_IRQ_OVERFLOW    (1 << 5)
+#define TIMER_MODE_IRQ_REPEAT      (1 << 6) //Otherwise one IRQ per mode write
+#define TIMER_MODE_IRQ_TOGGLE      (1 << 7) //Otherwise bit 10 pulses
+#define TIMER_MODE_CLOCK_SHIFT     8
+#define TIMER_MODE_IRQ_LINE        (1 << 10) //0 while an interrupt is requested
+#define TIMER_MODE_REACHED_TARGET  (1 << 11) //Both cleared when the mode is read
+#define TIMER_MODE_REACHED_FFFF    (1 << 12)
+#define TIMER_MODE_WRITE_MASK      0x03FF
+
+#define TIMER_FIXED_SHIFT 16 //Periods and timestamps of the counters are cpu cycles in 16.16 fixed point
+
+typedef struct ps1_bus ps1_bus;
+typedef struct ps1_gpu ps1_gpu;
+typedef struct ps1_irq ps1_irq;
+typedef struct ps1_scheduler ps1_scheduler;
+
+/*
+ A counter is never ticked. It keeps the value it had at a base timestamp and the length of one of its ticks, the
+ current value is worked out from the cycle clock when it is read or changed. The next target or FFFFh IRQ is an
+ event at the cycle the counter gets there.
+*/
+typedef struct root_counter
+{
+    uint16_t value;  //At base
+    uint16_t mode;
+    uint16_t target;
+    uint64_t base;   //16.16 timestamp
+    uint64_t period; //16.16 cycles per tick, 0 while the counter is stopped
+    bool fired;      //One shot IRQ already requested since the last mode write
+} root_counter;
+
+typedef struct ps1_timers
+{
+    root_counter counter[TIMERS_COUNT];
+    ps1_gpu* gpu;    //Dot clock of counter 0 depends on the horizontal resolution
+    ps1_irq* irq;
+    ps1_scheduler* scheduler;
+} ps1_timers;
+
+ps1_timers* ps1_timers_create();
+void ps1_timers_init(ps1_timers* timers, ps1_gpu* gpu);
+void ps1_timers_destroy(ps1_timers* timers);
+void ps1_connect_bus_timers(ps1_bus* bus, ps1_timers* timers);
+void ps1_connect_scheduler_timers(ps1_scheduler* scheduler, ps1_timers* timers);
+void ps1_connect_irq_timers(ps1_irq* irq, ps1_timers* timers);
+
+uint32_t ps1_timers_read_register(ps1_timers* timers, uint32_t address);
+void ps1_timers_store_register(ps1_timers* timers, uint32_t address, uint32_t value);
+
+#endif
@@ -2,15 +2,108 @@
 #include <stdio.h>
 #include <stdbool.h>
 
-int main() 
+int main(int argc, char** argv)
 {
+    CPU_BACKEND backend = CPU_BACKEND_BLOCK_CACHE;
+    bool lockstep = false;
+    bool fastmem = false;
+    bool scalar_gpu = false;
+    bool threaded_gpu = false;
+    bool texture_cache = true;
+    bool threaded_mdec = false;
+    uint32_t gpu_workers = 1;
+    uint32_t gpu_tiles = 16;
+    const char* gpu_trace = NULL;
+    const char* frame_dump = NULL;
+    const char* disc = NULL;
+    const char* exe = NULL;
+    bool fast_boot = false;
+
+    for(int i = 1; i < argc; i++)
+    {
+        if(!strcmp(argv[i], "--interpreter"))
+            backend = CPU_BACKEND_INTERPRETER;
+        else if(!strcmp(argv[i], "--jit"))
+            backend = CPU_BACKEND_JIT;
+        else if(!strcmp(argv[i], "--lockstep")) //Checks the selected backend against the interpreter
+            lockstep = true;
+        else if(!strcmp(argv[i], "--fastmem")) //Host MMU memory mapping for the JIT, Linux x86-64 only
+            fastmem = true;
+        else if(!strcmp(argv[i], "--scalar-gpu")) //Skips the AVX2 span routine
+            scalar_gpu = true;
+        else if(!strcmp(argv[i], "--threaded-gpu")) //Draws on a second thread
+            threaded_gpu = true;
+        else if(!strcmp(argv[i], "--threaded-mdec")) //Decodes movie frames on a second thread
+            threaded_mdec = true;
+        else if(!strcmp(argv[i], "--no-texture-cache")) //Samples every texel from VRAM
+            texture_cache = false;
+        else if(!strcmp(argv[i], "--gpu-trace") && i + 1 < argc) //Records the GPU command stream for gpu_replay
+            gpu_trace = argv[++i];
+        else if(!strcmp(argv[i], "--dump-frames") && i + 1 < argc) //Y4M, or PPM for a .ppm name, "-" writes to stdout
+            frame_dump = argv[++i];
+        else if(!strcmp(argv[i], "--disc") && i + 1 < argc) //A .cue sheet or a single .bin track
+            disc = argv[++i];
+        else if(!strcmp(argv[i], "--exe") && i + 1 < argc) //Runs a PS-X EXE in place of the shell
+            exe = argv[++i];
+        else if(!strcmp(argv[i], "--fast-boot")) //Boots the disc's EXE straight away, without the BIOS intro
+            fast_boot = true;
+        else if(!strcmp(argv[i], "--gpu-workers") && i + 1 < argc) //Threads sharing the rasterization, the one sending commands included
+            gpu_workers = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "--gpu-tiles") && i + 1 < argc) //Bands of VRAM handed out to the workers
+            gpu_tiles = atoi(argv[++i]);
+    }
+
     ps1* PS1 = ps1_create();
     ps1_init(PS1);
     ps1_load_bios(PS1);
+    ps1_set_cpu_backend(PS1, backend);
+    if(fastmem && !ps1_enable_fastmem(PS1))
+        printf("Fastmem not available, using the page tables\n");
+    if(scalar_gpu)
+        ps1_set_gpu_simd(PS1, false);
+    if(!texture_cache)
+        ps1_set_gpu_texture_cache(PS1, false);
+    if(threaded_gpu && !ps1_set_gpu_threaded(PS1, true))
+        printf("GPU thread not available, drawing on the cpu thread\n");
+    if(threaded_mdec && !ps1_set_mdec_threaded(PS1, true))
+        printf("MDEC thread not available, decoding on the cpu thread\n");
+    if(gpu_workers > 1 && !ps1_set_gpu_workers(PS1, gpu_workers, gpu_tiles))
+        printf("Not every GPU worker could be started\n");
+    if(disc != NULL && !ps1_insert_disc(PS1, disc))
+        printf("Couldn't load the disc, starting with the shell open\n");
+    if(exe != NULL && !ps1_boot_exe(PS1, exe))
+        printf("Booting the BIOS shell instead\n");
+    else if(exe == NULL && fast_boot && !ps1_fast_boot(PS1))
+        printf("Booting the BIOS shell instead\n");
+    if(gpu_trace != NULL)
+        ps1_start_gpu_trace(PS1, gpu_trace);
+    if(frame_dump != NULL)
+        ps1_start_frame_dump(PS1, frame_dump);
+
+    if(lockstep)
+    {
+        ps1* reference = ps1_create();
+        ps1_init(reference);
+        ps1_load_bios(reference);
+        ps1_set_cpu_backend(reference, CPU_BACKEND_INTERPRETER);
+        if(disc != NULL)
+            ps1_insert_disc(reference, disc);
+        if(exe != NULL)
+            ps1_boot_exe(reference, exe);
+        else if(fast_boot)
+            ps1_fast_boot(reference);
+
+        while(ps1_lockstep(PS1, reference));
+
+        printf("Backends diverged\n");
+        ps1_destroy(reference);
+    }
+    else
+    {
+        while(true)
+            ps1_run_frame(PS1);
+    }
 
-    while(true)
-        ps1_play(PS1);
-    
     ps1_destroy(PS1);
     return 0;
 }
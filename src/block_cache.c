@@ -0,0 +1,163 @@
+#include "bus.h"
+#include "block_cache.h"
+
+ps1_block_cache* ps1_block_cache_create()
+{
+    return (ps1_block_cache*)malloc(sizeof(ps1_block_cache));
+}
+
+void ps1_block_cache_init(ps1_block_cache* cache)
+{
+    memset(cache, 0, sizeof(ps1_block_cache));
+    cache->ram_blocks = calloc(RAM_SIZE / 4, sizeof(cpu_block*));
+    cache->bios_blocks = calloc(BIOS_SIZE / 4, sizeof(cpu_block*));
+}
+
+void ps1_block_cache_destroy(ps1_block_cache* cache)
+{
+    ps1_block_cache_flush(cache);
+    ps1_block_cache_release_retired(cache);
+    free (cache->ram_blocks);
+    free (cache->bios_blocks);
+    free (cache);
+}
+
+void ps1_connect_bus_block_cache(ps1_bus* bus, ps1_block_cache* cache)
+{
+    cache->bus = bus;
+}
+
+//Returns the slot that holds the block starting at pc, NULL if code at that address can't be cached
+static cpu_block** ps1_block_cache_slot(ps1_block_cache* cache, uint32_t pc)
+{
+    uint32_t masked_address = pc & 0x1FFFFFFF;
+
+    if(masked_address < 0x00800000)
+        return &cache->ram_blocks[(masked_address & (RAM_SIZE-1)) >> 2];
+    else if(masked_address >= 0x1FC00000 && masked_address < 0x1FC00000 + BIOS_SIZE)
+        return &cache->bios_blocks[(masked_address - 0x1FC00000) >> 2];
+
+    return NULL;
+}
+
+static cpu_block* ps1_block_cache_compile(ps1_block_cache* cache, uint32_t pc)
+{
+    cpu_instr decoded[BLOCK_MAX_INSTRUCTIONS];
+    uint32_t length = 0;
+    uint32_t address = pc;
+    bool delay_slot = false;
+
+    while(length < BLOCK_MAX_INSTRUCTIONS)
+    {
+        cpu_instr* instr = &decoded[length++];
+        cpu_decode_instr(ps1_bus_read_word(cache->bus, address), instr);
+        address += 4;
+
+        if(delay_slot || (instr->flags & CPU_INSTR_END_BLOCK))
+            break;
+        if(instr->flags & CPU_INSTR_BRANCH)
+            delay_slot = true;
+
+        //A delay slot on the next page starts a block of its own, the branch state lives in the cpu
+        if((address & (BLOCK_PAGE_SIZE-1)) == 0)
+            break;
+    }
+
+    cpu_block* block = malloc(sizeof(cpu_block) + length * sizeof(cpu_instr));
+    block->pc = pc;
+    block->length = length;
+    block->code = NULL;
+    block->next_retired = NULL;
+    memcpy(block->instr, decoded, length * sizeof(cpu_instr));
+    return block;
+}
+
+cpu_block* ps1_block_cache_fetch(ps1_block_cache* cache, uint32_t pc)
+{
+    cpu_block** slot = ps1_block_cache_slot(cache, pc);
+    if(slot == NULL)
+        return NULL;
+
+    if(*slot != NULL)
+    {
+        cache->hits++;
+        return *slot;
+    }
+
+    cache->misses++;
+    *slot = ps1_block_cache_compile(cache, pc);
+
+    if((pc & 0x1FFFFFFF) < 0x00800000)
+    {
+        //The first block of a page stops the bus from writing to it directly
+        if(cache->ram_page_blocks[(pc & (RAM_SIZE-1)) >> BLOCK_PAGE_SHIFT]++ == 0)
+            ps1_bus_set_code_page(cache->bus, pc, true);
+    }
+
+    return *slot;
+}
+
+void ps1_block_cache_invalidate_page(ps1_block_cache* cache, uint32_t address)
+{
+    uint32_t page = (address & (RAM_SIZE-1)) >> BLOCK_PAGE_SHIFT;
+    cpu_block** slot = &cache->ram_blocks[(page << BLOCK_PAGE_SHIFT) >> 2];
+
+    for(int i = 0; i < BLOCK_PAGE_SIZE / 4 && cache->ram_page_blocks[page]; i++)
+    {
+        if(slot[i] != NULL)
+        {
+            slot[i]->next_retired = cache->retired;
+            cache->retired = slot[i];
+            slot[i] = NULL;
+            cache->ram_page_blocks[page]--;
+            cache->invalidations++;
+        }
+    }
+
+    ps1_bus_set_code_page(cache->bus, page << BLOCK_PAGE_SHIFT, false);
+}
+
+void ps1_block_cache_invalidate_range(ps1_block_cache* cache, uint32_t address, uint32_t length)
+{
+    if(length == 0)
+        return;
+
+    uint32_t first = (address & (RAM_SIZE-1)) >> BLOCK_PAGE_SHIFT;
+    uint32_t last = ((address & (RAM_SIZE-1)) + length - 1) >> BLOCK_PAGE_SHIFT;
+
+    for(uint32_t page = first; page <= last; page++)
+    {
+        uint32_t wrapped = page & ((RAM_SIZE >> BLOCK_PAGE_SHIFT) - 1);
+        if(cache->ram_page_blocks[wrapped])
+            ps1_block_cache_invalidate_page(cache, wrapped << BLOCK_PAGE_SHIFT);
+    }
+}
+
+void ps1_block_cache_release_retired(ps1_block_cache* cache)
+{
+    while(cache->retired != NULL)
+    {
+        cpu_block* block = cache->retired;
+        cache->retired = block->next_retired;
+        free (block);
+    }
+}
+
+void ps1_block_cache_flush(ps1_block_cache* cache)
+{
+    for(int page = 0; page < (RAM_SIZE >> BLOCK_PAGE_SHIFT); page++)
+    {
+        if(cache->ram_page_blocks[page])
+            ps1_block_cache_invalidate_page(cache, page << BLOCK_PAGE_SHIFT);
+    }
+
+    for(int i = 0; i < BIOS_SIZE / 4; i++)
+    {
+        if(cache->bios_blocks[i] != NULL)
+        {
+            cache->bios_blocks[i]->next_retired = cache->retired;
+            cache->retired = cache->bios_blocks[i];
+            cache->bios_blocks[i] = NULL;
+        }
+    }
+}
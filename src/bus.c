@@ -5,6 +5,8 @@
 #include "scratchpad.h"
 #include "dma.h"
 #include "bus.h"
+#include "block_cache.h"
+#include "fastmem.h"
 
 //TODO: Check for unhandled mirrors
 ps1_bus* ps1_bus_create()
@@ -20,15 +22,141 @@ void ps1_bus_init(ps1_bus* bus, ps1_bios* bios, ps1_cpu* cpu, ps1_ram* ram, ps1_
     bus->gpu = gpu;
     bus->scratchpad = scratchpad;
     bus->dma = dma;
+
+    bus->read_table = calloc(BUS_PAGE_COUNT, sizeof(uint8_t*));
+    bus->write_table_normal = calloc(BUS_PAGE_COUNT, sizeof(uint8_t*));
+    bus->write_table_isolated = calloc(BUS_PAGE_COUNT, sizeof(uint8_t*));
+    bus->write_table = bus->write_table_normal;
+    bus->fastmem = NULL;
+    ps1_bus_update_memory_map(bus);
+
+    bus->io_handler_count = 0;
+    memset(bus->io_map, 0, sizeof(bus->io_map));
 }
 
-uint8_t ps1_bus_read_byte(ps1_bus* bus, uint32_t address)
+//Maps [address, address + length) of the I/O window to a device, later registrations override earlier ones
+bool ps1_bus_register_io(ps1_bus* bus, uint32_t address, uint32_t length, void* device, bus_io_read_fn read, bus_io_write_fn write, uint8_t widths)
+{
+    uint32_t offset = (address & 0x1FFFFFFF) - BUS_IO_BASE;
+    if(offset >= BUS_IO_SIZE || length > BUS_IO_SIZE - offset || bus->io_handler_count == BUS_IO_MAX_HANDLERS)
+    {
+        printf("Error: Could not register I/O handler at 0x%08X (length 0x%X)\n", address, length);
+        return false;
+    }
+
+    bus_io_handler* handler = &bus->io_handlers[bus->io_handler_count++];
+    handler->device = device;
+    handler->read = read;
+    handler->write = write;
+    handler->widths = widths;
+
+    for(uint32_t i = offset / 4; i < (offset + length + 3) / 4; i++)
+        bus->io_map[i] = bus->io_handler_count;
+    return true;
+}
+
+static bus_io_handler* ps1_bus_io_handler(ps1_bus* bus, uint32_t masked_address, BUS_WIDTH width)
+{
+    uint8_t index = bus->io_map[(masked_address - BUS_IO_BASE) >> 2];
+    if(index == 0 || !(bus->io_handlers[index - 1].widths & width))
+        return NULL;
+    return &bus->io_handlers[index - 1];
+}
+
+static uint32_t ps1_bus_io_read(ps1_bus* bus, uint32_t masked_address, BUS_WIDTH width, uint32_t unmapped)
+{
+    bus_io_handler* handler = ps1_bus_io_handler(bus, masked_address, width);
+    if(handler == NULL || handler->read == NULL)
+        return unmapped;
+    return handler->read(handler->device, masked_address, width);
+}
+
+static void ps1_bus_io_write(ps1_bus* bus, uint32_t masked_address, uint32_t value, BUS_WIDTH width)
+{
+    bus_io_handler* handler = ps1_bus_io_handler(bus, masked_address, width);
+    if(handler != NULL && handler->write != NULL)
+        handler->write(handler->device, masked_address, value, width);
+}
+
+//Rebuilds the page tables, needed whenever a backing buffer is (re)allocated
+void ps1_bus_update_memory_map(ps1_bus* bus)
+{
+    memset(bus->read_table, 0, BUS_PAGE_COUNT * sizeof(uint8_t*));
+    memset(bus->write_table_normal, 0, BUS_PAGE_COUNT * sizeof(uint8_t*));
+
+    //Main RAM (2MB), mirrored four times in the first 8MB
+    for(uint32_t address = 0; address < 0x00800000; address += BUS_PAGE_SIZE)
+    {
+        bus->read_table[address >> BUS_PAGE_SHIFT] = bus->ram->ram_buff + (address & (RAM_SIZE-1));
+        bus->write_table_normal[address >> BUS_PAGE_SHIFT] = bus->ram->ram_buff + (address & (RAM_SIZE-1));
+    }
+
+    //BIOS ROM (512KB), read only
+    if(bus->bios->buffer != NULL)
+    {
+        for(uint32_t offset = 0; offset < BIOS_SIZE; offset += BUS_PAGE_SIZE)
+            bus->read_table[(0x1FC00000 + offset) >> BUS_PAGE_SHIFT] = bus->bios->buffer + offset;
+    }
+
+    if(bus->fastmem != NULL)
+        ps1_fastmem_map_bios(bus->fastmem);
+
+    //Scratchpad pages stay NULL: it is smaller than a page and isn't visible through KSEG1
+
+    for(uint32_t address = 0; address < RAM_SIZE; address += BUS_PAGE_SIZE)
+    {
+        if(bus->cpu->block_cache->ram_page_blocks[address >> BLOCK_PAGE_SHIFT])
+            ps1_bus_set_code_page(bus, address, true);
+    }
+}
+
+void ps1_bus_set_cache_isolation(ps1_bus* bus, bool isolated)
+{
+    bus->write_table = isolated ? bus->write_table_isolated : bus->write_table_normal;
+    if(bus->fastmem != NULL)
+        ps1_fastmem_set_cache_isolation(bus->fastmem, isolated);
+}
+
+//Stores to RAM pages holding cached code take the slow path, which invalidates the blocks
+void ps1_bus_set_code_page(ps1_bus* bus, uint32_t address, bool has_code)
+{
+    uint32_t offset = address & (RAM_SIZE-1) & ~(BUS_PAGE_SIZE-1);
+
+    for(uint32_t mirror = 0; mirror < 0x00800000; mirror += RAM_SIZE)
+        bus->write_table_normal[(mirror + offset) >> BUS_PAGE_SHIFT] = has_code ? NULL : bus->ram->ram_buff + offset;
+
+    if(bus->fastmem != NULL)
+        ps1_fastmem_set_code_page(bus->fastmem, offset, has_code);
+}
+
+//Moves RAM into the fastmem region, code compiled against the old buffer has to be flushed by the caller
+bool ps1_bus_enable_fastmem(ps1_bus* bus)
+{
+    if(bus->fastmem != NULL)
+        return true;
+
+    ps1_fastmem* fastmem = ps1_fastmem_create();
+    if(!ps1_fastmem_init(fastmem, bus))
+    {
+        free (fastmem);
+        return false;
+    }
+
+    bus->fastmem = fastmem;
+    ps1_bus_update_memory_map(bus);
+    ps1_bus_set_cache_isolation(bus, bus->cpu->cop0[COP0_SR] & 0x10000);
+    return true;
+}
+
+static uint8_t ps1_bus_read_byte_slow(ps1_bus* bus, uint32_t address)
 {
     uint8_t data = 0x00; 
     uint32_t masked_address = address & 0x1FFFFFFF; // Mask to 512MB space
 
-    if (masked_address < 0x00200000)  // Main RAM (2MB, first 64K reserved for BIOS)
+    if (masked_address < 0x00800000)  // Main RAM (2MB mirrored up to 8MB, first 64K reserved for BIOS)
         data = ps1_ram_read_byte(bus->ram, masked_address);
+    else if (masked_address >= BUS_IO_BASE && masked_address < BUS_IO_BASE + BUS_IO_SIZE)  // I/O Ports (4KB)
+        data = ps1_bus_io_read(bus, masked_address, BUS_WIDTH_BYTE, data);
     else if (masked_address >= 0x1FC00000 && masked_address < 0x20000000) // BIOS ROM (512KB, max 4MB)
         data = ps1_bios_read_byte(bus->bios, masked_address);
     else if ((masked_address >= 0x1F800000 && masked_address < 0x1F800400) && address < 0x9F800400)  // Scratchpad RAM (1KB)
@@ -36,9 +164,6 @@ uint8_t ps1_bus_read_byte(ps1_bus* bus, uint32_t address)
 /*     else if(masked_address >= 0x1F000000 && masked_address < 0x1F800000)
         printf("Unhandled memory read at 0x%08X, tried to read word from Expansion Region 1  PC: %08x\n", address, bus->cpu->pc);
 
-    else if (masked_address >= 0x1F801000 && masked_address < 0x1F802000)  // I/O Ports (4KB)
-        printf("Unhandled memory read at 0x%08X, tried to read byte from IO ports  PC: %08x\n", address, bus->cpu->pc);
-
     else if (masked_address >= 0x1F802000 && masked_address < 0x1FA00000)  // Expansion Region 2 (8KB I/O)
         printf("Unhandled memory read at 0x%08X, tried to read byte from Expansion Region 2  PC: %08x\n", address, bus->cpu->pc);
 
@@ -54,13 +179,15 @@ uint8_t ps1_bus_read_byte(ps1_bus* bus, uint32_t address)
     return data;
 }
 
-uint16_t ps1_bus_read_halfword(ps1_bus* bus, uint32_t address)
+static uint16_t ps1_bus_read_halfword_slow(ps1_bus* bus, uint32_t address)
 {
     uint16_t data = 0x00;
     uint32_t masked_address = address & 0x1FFFFFFF; // Mask to 512MB space
 
-    if (masked_address < 0x00200000)  // Main RAM (2MB, first 64K reserved for BIOS)
+    if (masked_address < 0x00800000)  // Main RAM (2MB mirrored up to 8MB, first 64K reserved for BIOS)
         data = ps1_ram_read_halfword(bus->ram, masked_address);
+    else if (masked_address >= BUS_IO_BASE && masked_address < BUS_IO_BASE + BUS_IO_SIZE)  // I/O Ports (4KB)
+        data = ps1_bus_io_read(bus, masked_address, BUS_WIDTH_HALFWORD, data);
     else if (masked_address >= 0x1FC00000 && masked_address < 0x20000000) // BIOS ROM (512KB, max 4MB)
         data = ps1_bios_read_halfword(bus->bios, masked_address);
     else if ((masked_address >= 0x1F800000 && masked_address < 0x1F800400) && address < 0x9F800400)  // Scratchpad RAM (1KB)
@@ -68,9 +195,6 @@ uint16_t ps1_bus_read_halfword(ps1_bus* bus, uint32_t address)
 /*  else if(masked_address >= 0x1F000000 && masked_address < 0x1F800000)
         printf("Unhandled memory read at 0x%08X, tried to read halfword from Expansion Region 1  PC: %08x\n", address, bus->cpu->pc);
 
-    else if (masked_address >= 0x1F801000 && masked_address < 0x1F802000)  // I/O Ports (4KB)
-        printf("Unhandled memory read at 0x%08X, tried to read halfword from IO ports  PC: %08x\n", address, bus->cpu->pc);
-
     else if (masked_address >= 0x1F802000 && masked_address < 0x1FA00000)  // Expansion Region 2 (8KB I/O)
         printf("Unhandled memory read at 0x%08X, tried to read halfword from Expansion Region 2  PC: %08x\n", address, bus->cpu->pc);
 
@@ -86,23 +210,19 @@ uint16_t ps1_bus_read_halfword(ps1_bus* bus, uint32_t address)
     return data;
 }
 
-uint32_t ps1_bus_read_word(ps1_bus* bus, uint32_t address)
+static uint32_t ps1_bus_read_word_slow(ps1_bus* bus, uint32_t address)
 {
     uint32_t data = 0xFFFFFFFF;
     uint32_t masked_address = address & 0x1FFFFFFF; // Mask to 512MB space
 
-    if (masked_address < 0x00200000)  // Main RAM (2MB, first 64K reserved for BIOS)
+    if (masked_address < 0x00800000)  // Main RAM (2MB mirrored up to 8MB, first 64K reserved for BIOS)
         data = ps1_ram_read_word(bus->ram, masked_address);
+    else if (masked_address >= BUS_IO_BASE && masked_address < BUS_IO_BASE + BUS_IO_SIZE)  // I/O Ports (4KB)
+        data = ps1_bus_io_read(bus, masked_address, BUS_WIDTH_WORD, data);
     else if (masked_address >= 0x1FC00000 && masked_address < 0x20000000) // BIOS ROM (512KB, max 4MB)
         data = ps1_bios_read_word(bus->bios, masked_address);
     else if ((masked_address >= 0x1F800000 && masked_address < 0x1F800400) && address < 0x9F800400)  // Scratchpad RAM (1KB)
         data = ps1_scratchpad_read_word(bus->scratchpad, masked_address);
-    else if(masked_address >= 0x1F801080 && masked_address <= 0x1F8010FC)
-        data = ps1_dma_read_word(bus->dma, address);
-    else if(masked_address == 0x1F801814)
-        data = 0x1C000000;
-/*     else if (masked_address >= 0x1F801000 && masked_address < 0x1F802000)  // I/O Ports (4KB)
-        printf("Unhandled memory read at 0x%08X, tried to read word from I/O Ports  PC: %08x\n", address, bus->cpu->pc); */
 /*     else if(masked_address >= 0x1F000000 && masked_address < 0x1F800000)
         printf("Unhandled memory read at 0x%08X, tried to read word from Expansion Region 1  PC: %08x\n", address, bus->cpu->pc);
 
@@ -122,22 +242,25 @@ uint32_t ps1_bus_read_word(ps1_bus* bus, uint32_t address)
 }
 
 
-void ps1_bus_store_byte(ps1_bus* bus, uint32_t address, uint8_t value)
+static void ps1_bus_store_byte_slow(ps1_bus* bus, uint32_t address, uint8_t value)
 {
     uint32_t masked_address = address & 0x1FFFFFFF; // Mask to 512MB space
     if (!(bus->cpu->cop0[COP0_SR] & 0x10000))
     {
         if (address < 0xFFFE0000)  // Ignore CPU control registers
         {
-            if (masked_address < 0x00200000)  // Main RAM (2MB, first 64K reserved for BIOS)
-                ps1_ram_store_byte(bus->ram, masked_address, value);      
+            if (masked_address < 0x00800000)  // Main RAM (2MB mirrored up to 8MB, first 64K reserved for BIOS)
+            {
+                ps1_ram_store_byte(bus->ram, masked_address, value);
+                ps1_block_cache_notify_write(bus->cpu->block_cache, masked_address);
+            }
+            else if (masked_address >= BUS_IO_BASE && masked_address < BUS_IO_BASE + BUS_IO_SIZE)  // I/O Ports (4KB)
+                ps1_bus_io_write(bus, masked_address, value, BUS_WIDTH_BYTE);
             else if ((masked_address >= 0x1F800000 && masked_address < 0x1F800400) && address < 0x9F800400)  // Scratchpad RAM (1KB)
                 ps1_scratchpad_store_byte(bus->scratchpad, masked_address, value);
 /*          
             else if(masked_address >= 0x1F000000 && masked_address < 0x1F800000)
                 printf("Unhandled memory write at 0x%08X, tried to write byte to Expansion Region 1  PC: %08x\n", address, bus->cpu->pc);      
-            else if (masked_address >= 0x1F801000 && masked_address < 0x1F802000)  // I/O Ports (4KB)
-                printf("Unhandled memory write at 0x%08X, tried to write byte to IO ports  PC: %08x\n", address, bus->cpu->pc);
             
             else if (masked_address >= 0x1F802000 && masked_address < 0x1FA00000)  // Expansion Region 2 (8KB I/O)
                 printf("Unhandled memory write at 0x%08X, tried to write byte to Expansion Region 2  PC: %08x\n", address, bus->cpu->pc);
@@ -159,23 +282,25 @@ void ps1_bus_store_byte(ps1_bus* bus, uint32_t address, uint8_t value)
     }
 }
 
-void ps1_bus_store_halfword(ps1_bus* bus, uint32_t address, uint16_t value)
+static void ps1_bus_store_halfword_slow(ps1_bus* bus, uint32_t address, uint16_t value)
 {
     uint32_t masked_address = address & 0x1FFFFFFF; // Mask to 512MB space
     if (!(bus->cpu->cop0[COP0_SR] & 0x10000))
     {
         if (address < 0xFFFE0000)  // Ignore CPU control registers
         {
-            if (masked_address < 0x00200000)  // Main RAM (2MB, first 64K reserved for BIOS)
+            if (masked_address < 0x00800000)  // Main RAM (2MB mirrored up to 8MB, first 64K reserved for BIOS)
+            {
                 ps1_ram_store_halfword(bus->ram, masked_address, value);
+                ps1_block_cache_notify_write(bus->cpu->block_cache, masked_address);
+            }
+            else if (masked_address >= BUS_IO_BASE && masked_address < BUS_IO_BASE + BUS_IO_SIZE)  // I/O Ports (4KB)
+                ps1_bus_io_write(bus, masked_address, value, BUS_WIDTH_HALFWORD);
             else if ((masked_address >= 0x1F800000 && masked_address < 0x1F800400) && address < 0x9F800400)  // Scratchpad RAM (1KB)
                 ps1_scratchpad_store_halfword(bus->scratchpad, masked_address, value);
 /*             else if(masked_address >= 0x1F000000 && masked_address < 0x1F800000)
                 printf("Unhandled memory write at 0x%08X, tried to write halfword to Expansion Region 1  PC: %08x\n", address, bus->cpu->pc);
             
-            else if (masked_address >= 0x1F801000 && masked_address < 0x1F802000)  // I/O Ports (4KB)
-                printf("Unhandled memory write at 0x%08X, tried to write halfword to IO ports  PC: %08x\n", address, bus->cpu->pc);
-            
             else if (masked_address >= 0x1F802000 && masked_address < 0x1FA00000)  // Expansion Region 2 (8KB I/O)
                 printf("Unhandled memory write at 0x%08X, tried to write halfword to Expansion Region 2  PC: %08x\n", address, bus->cpu->pc);
             
@@ -196,7 +321,7 @@ void ps1_bus_store_halfword(ps1_bus* bus, uint32_t address, uint16_t value)
 }
 
 
-void ps1_bus_store_word(ps1_bus* bus, uint32_t address, uint32_t value)
+static void ps1_bus_store_word_slow(ps1_bus* bus, uint32_t address, uint32_t value)
 {
     uint32_t masked_address = address & 0x1FFFFFFF; // Mask to 512MB space
 
@@ -204,18 +329,15 @@ void ps1_bus_store_word(ps1_bus* bus, uint32_t address, uint32_t value)
     {
         if (address < 0xFFFE0000)  // Ignore CPU control registers
         {
-            if (masked_address < 0x00200000)  // Main RAM (2MB, first 64K reserved for BIOS)
+            if (masked_address < 0x00800000)  // Main RAM (2MB mirrored up to 8MB, first 64K reserved for BIOS)
+            {
                 ps1_ram_store_word(bus->ram, masked_address, value);
+                ps1_block_cache_notify_write(bus->cpu->block_cache, masked_address);
+            }
+            else if (masked_address >= BUS_IO_BASE && masked_address < BUS_IO_BASE + BUS_IO_SIZE)  // I/O Ports (4KB)
+                ps1_bus_io_write(bus, masked_address, value, BUS_WIDTH_WORD);
             else if ((masked_address >= 0x1F800000 && masked_address < 0x1F800400) && address < 0x9F800400)  // Scratchpad RAM (1KB)
                 ps1_scratchpad_store_word(bus->scratchpad, masked_address, value);
-            else if(masked_address >= 0x1F801080 && masked_address <= 0x1F8010FC)
-                ps1_dma_store_word(bus->dma, address, value);
-            else if(masked_address == 0x1F801810)
-                ps1_gpu_write_word(bus->gpu, 0x1F801810, value);
-
-/*             else if (masked_address >= 0x1F801000 && masked_address < 0x1F802000)  // I/O Ports (4KB)
-                printf("Unhandled memory write at 0x%08X, tried to write word to IO ports  PC: %08x\n", address, bus->cpu->pc); */
-            
 
 /*             else if(masked_address >= 0x1F000000 && masked_address < 0x1F800000)
                 printf("Unhandled memory write at 0x%08X, tried to write word to Expansion Region 1  PC: %08x\n", address, bus->cpu->pc);
@@ -240,6 +362,63 @@ void ps1_bus_store_word(ps1_bus* bus, uint32_t address, uint32_t value)
     }
 }
 
+uint8_t ps1_bus_read_byte(ps1_bus* bus, uint32_t address)
+{
+    uint32_t masked_address = address & 0x1FFFFFFF;
+    uint8_t* page = bus->read_table[masked_address >> BUS_PAGE_SHIFT];
+    if(page != NULL)
+        return *(page + (masked_address & (BUS_PAGE_SIZE-1)));
+    return ps1_bus_read_byte_slow(bus, address);
+}
+
+uint16_t ps1_bus_read_halfword(ps1_bus* bus, uint32_t address)
+{
+    uint32_t masked_address = address & 0x1FFFFFFF;
+    uint8_t* page = bus->read_table[masked_address >> BUS_PAGE_SHIFT];
+    if(page != NULL)
+        return *(uint16_t*)(page + (masked_address & (BUS_PAGE_SIZE-1)));
+    return ps1_bus_read_halfword_slow(bus, address);
+}
+
+uint32_t ps1_bus_read_word(ps1_bus* bus, uint32_t address)
+{
+    uint32_t masked_address = address & 0x1FFFFFFF;
+    uint8_t* page = bus->read_table[masked_address >> BUS_PAGE_SHIFT];
+    if(page != NULL)
+        return *(uint32_t*)(page + (masked_address & (BUS_PAGE_SIZE-1)));
+    return ps1_bus_read_word_slow(bus, address);
+}
+
+void ps1_bus_store_byte(ps1_bus* bus, uint32_t address, uint8_t value)
+{
+    uint32_t masked_address = address & 0x1FFFFFFF;
+    uint8_t* page = bus->write_table[masked_address >> BUS_PAGE_SHIFT];
+    if(page != NULL)
+        *(page + (masked_address & (BUS_PAGE_SIZE-1))) = value;
+    else
+        ps1_bus_store_byte_slow(bus, address, value);
+}
+
+void ps1_bus_store_halfword(ps1_bus* bus, uint32_t address, uint16_t value)
+{
+    uint32_t masked_address = address & 0x1FFFFFFF;
+    uint8_t* page = bus->write_table[masked_address >> BUS_PAGE_SHIFT];
+    if(page != NULL)
+        *(uint16_t*)(page + (masked_address & (BUS_PAGE_SIZE-1))) = value;
+    else
+        ps1_bus_store_halfword_slow(bus, address, value);
+}
+
+void ps1_bus_store_word(ps1_bus* bus, uint32_t address, uint32_t value)
+{
+    uint32_t masked_address = address & 0x1FFFFFFF;
+    uint8_t* page = bus->write_table[masked_address >> BUS_PAGE_SHIFT];
+    if(page != NULL)
+        *(uint32_t*)(page + (masked_address & (BUS_PAGE_SIZE-1))) = value;
+    else
+        ps1_bus_store_word_slow(bus, address, value);
+}
+
 ps1_ram* ps1_bus_get_ram(ps1_bus* bus)
 {
     return bus->ram;
@@ -247,5 +426,10 @@ ps1_ram* ps1_bus_get_ram(ps1_bus* bus)
 
 void ps1_bus_destroy(ps1_bus* bus)
 {
+    free (bus->read_table);
+    free (bus->write_table_normal);
+    free (bus->write_table_isolated);
+    if(bus->fastmem != NULL)
+        ps1_fastmem_destroy(bus->fastmem);
     free (bus);
 }
\ No newline at end of file
@@ -0,0 +1,824 @@
+#include "bus.h"
+#include "dma.h"
+#include "irq.h"
+#include "scheduler.h"
+#include "spu.h"
+#include "cdrom.h"
+
+//Rough drive timings in cpu cycles, the real ones vary with the disc and the drive
+#define CDROM_ACK_CYCLES        25000   //Until the first response of a command
+#define CDROM_SECOND_CYCLES     19000   //Between the first and second response of the quick commands
+#define CDROM_SEEK_CYCLES       20000   //Shortest seek
+#define CDROM_SEEK_SECTOR_CYCLES 32     //Added for every sector the head moves over
+#define CDROM_SEEK_MAX_CYCLES   CPU_CLOCK
+#define CDROM_INIT_CYCLES       (CPU_CLOCK / 4)
+#define CDROM_STOP_CYCLES       (CPU_CLOCK / 2) //Spinning down
+#define CDROM_TOC_CYCLES        (CPU_CLOCK / 2)
+
+//Second byte of INT5 responses
+#define CDROM_ERROR_BAD_PARAMETER 0x10
+#define CDROM_ERROR_PARAMETER_COUNT 0x20
+#define CDROM_ERROR_BAD_COMMAND   0x40
+#define CDROM_ERROR_NO_DISC       0x80
+
+ps1_cdrom* ps1_cdrom_create()
+{
+    return (ps1_cdrom*)malloc(sizeof(ps1_cdrom));
+}
+
+void ps1_cdrom_init(ps1_cdrom* cdrom)
+{
+    memset(cdrom, 0, sizeof(ps1_cdrom));
+    cdrom_audio_init(&cdrom->audio);
+    //Straight through, as the BIOS leaves it
+    cdrom->volume[0] = cdrom->volume[2] = 0x80;
+    cdrom->next_volume[0] = cdrom->next_volume[2] = 0x80;
+}
+
+void ps1_cdrom_destroy(ps1_cdrom* cdrom)
+{
+    ps1_cdrom_eject(cdrom);
+    free (cdrom);
+}
+
+static uint64_t cdrom_now(ps1_cdrom* cdrom)
+{
+    return cdrom->scheduler != NULL ? cdrom->scheduler->cycles : 0;
+}
+
+static uint64_t cdrom_sector_cycles(ps1_cdrom* cdrom)
+{
+    return CPU_CLOCK / (cdrom->mode & CDROM_MODE_DOUBLE_SPEED ? 2 * DISC_SECTORS_PER_SECOND : DISC_SECTORS_PER_SECOND);
+}
+
+//The drive status as it will be at a timestamp
+static uint8_t cdrom_stat(ps1_cdrom* cdrom, uint64_t at)
+{
+    uint8_t stat = cdrom->stat;
+    if(cdrom->disc == NULL)
+        stat |= CDROM_STAT_SHELL_OPEN;
+    if(at < cdrom->seek_end)
+        stat |= CDROM_STAT_SEEKING;
+    else if(cdrom->reading)
+        stat |= cdrom->playing ? CDROM_STAT_PLAYING : CDROM_STAT_READING;
+    return stat;
+}
+
+static cdrom_response* cdrom_queue(ps1_cdrom* cdrom, uint64_t due, CDROM_INTERRUPT interrupt)
+{
+    //A cpu that never acknowledges anything loses the oldest responses
+    if(cdrom->queue_count == CDROM_RESPONSE_QUEUE)
+    {
+        cdrom->queue_head = (cdrom->queue_head + 1) % CDROM_RESPONSE_QUEUE;
+        cdrom->queue_count--;
+    }
+
+    cdrom_response* response = &cdrom->queue[(cdrom->queue_head + cdrom->queue_count) % CDROM_RESPONSE_QUEUE];
+    cdrom->queue_count++;
+    memset(response, 0, sizeof(cdrom_response));
+    response->due = due;
+    response->interrupt = interrupt;
+    return response;
+}
+
+static void cdrom_push(cdrom_response* response, uint8_t value)
+{
+    if(response->length < CDROM_FIFO_SIZE)
+        response->data[response->length++] = value;
+}
+
+//INT3 with only the status byte, what most commands answer first
+static cdrom_response* cdrom_acknowledge(ps1_cdrom* cdrom, uint64_t due)
+{
+    cdrom_response* response = cdrom_queue(cdrom, due, CDROM_INT_ACKNOWLEDGE);
+    cdrom_push(response, cdrom_stat(cdrom, due));
+    return response;
+}
+
+static void cdrom_complete(ps1_cdrom* cdrom, uint64_t due)
+{
+    cdrom_push(cdrom_queue(cdrom, due, CDROM_INT_COMPLETE), cdrom_stat(cdrom, due));
+}
+
+static void cdrom_error(ps1_cdrom* cdrom, uint64_t due, uint8_t code)
+{
+    cdrom_response* response = cdrom_queue(cdrom, due, CDROM_INT_ERROR);
+    cdrom_push(response, cdrom_stat(cdrom, due) | CDROM_STAT_ERROR);
+    cdrom_push(response, code);
+}
+
+//Hands the next response to the cpu, once the last one has been acknowledged
+static void cdrom_deliver(ps1_cdrom* cdrom, uint64_t now)
+{
+    if(cdrom->interrupt_flags || !cdrom->queue_count)
+        return;
+
+    cdrom_response* response = &cdrom->queue[cdrom->queue_head];
+    if(response->due > now)
+        return;
+
+    memset(cdrom->response, 0, sizeof(cdrom->response));
+    memcpy(cdrom->response, response->data, response->length);
+    cdrom->response_length = response->length;
+    cdrom->response_position = 0;
+    cdrom->interrupt_flags = response->interrupt;
+    if(response->sector != NULL)
+        cdrom->sector = response->sector;
+    cdrom->queue_head = (cdrom->queue_head + 1) % CDROM_RESPONSE_QUEUE;
+    cdrom->queue_count--;
+    cdrom->busy = false;
+
+    if((cdrom->interrupt_flags & cdrom->interrupt_enable) && cdrom->irq != NULL)
+        ps1_irq_raise(cdrom->irq, IRQ_CDROM);
+}
+
+//The next sector or deliverable response, whichever comes first
+static void cdrom_schedule(ps1_cdrom* cdrom)
+{
+    if(cdrom->scheduler == NULL)
+        return;
+
+    uint64_t next = cdrom->reading ? cdrom->sector_due : UINT64_MAX;
+    if(cdrom->queue_count && !cdrom->interrupt_flags && cdrom->queue[cdrom->queue_head].due < next)
+        next = cdrom->queue[cdrom->queue_head].due;
+
+    if(next == UINT64_MAX)
+        ps1_scheduler_cancel(cdrom->scheduler, EVENT_CDROM);
+    else
+        ps1_scheduler_schedule_at(cdrom->scheduler, EVENT_CDROM, next);
+}
+
+//Moves the head to an LBA, after whatever seek is still going on
+static void cdrom_seek(ps1_cdrom* cdrom, uint64_t now, uint32_t target)
+{
+    uint32_t distance = target > cdrom->position ? target - cdrom->position : cdrom->position - target;
+    uint64_t cycles = CDROM_SEEK_CYCLES + (uint64_t)distance * CDROM_SEEK_SECTOR_CYCLES;
+    if(cycles > CDROM_SEEK_MAX_CYCLES)
+        cycles = CDROM_SEEK_MAX_CYCLES;
+
+    cdrom->seek_end = (now > cdrom->seek_end ? now : cdrom->seek_end) + cycles;
+    cdrom->position = target;
+    cdrom->setloc_pending = false;
+    cdrom->stat |= CDROM_STAT_MOTOR;
+}
+
+//With XA-ADPCM on, the audio sectors of mode 2 tracks are meant for the SPU and never reach the data FIFO
+static bool cdrom_audio_sector(ps1_cdrom* cdrom, const uint8_t* sector)
+{
+    return (cdrom->mode & CDROM_MODE_XA_ADPCM) && sector[15] == 2 && (sector[18] & 0x04);
+}
+
+//Each output side takes both inputs at their volume, 80h is full volume
+static void cdrom_send_audio(ps1_cdrom* cdrom, int16_t* frames, uint32_t count)
+{
+    if(cdrom->spu == NULL || cdrom->muted)
+        return;
+
+    const uint8_t* volume = cdrom->volume;
+    for(uint32_t i = 0; i < count; i++)
+    {
+        int32_t left = frames[i * 2];
+        int32_t right = frames[i * 2 + 1];
+        int32_t mixed_left = (left * volume[0] + right * volume[3]) >> 7;
+        int32_t mixed_right = (right * volume[2] + left * volume[1]) >> 7;
+        frames[i * 2] = mixed_left < -0x8000 ? -0x8000 : mixed_left > 0x7FFF ? 0x7FFF : mixed_left;
+        frames[i * 2 + 1] = mixed_right < -0x8000 ? -0x8000 : mixed_right > 0x7FFF ? 0x7FFF : mixed_right;
+    }
+    ps1_spu_queue_cd_audio(cdrom->spu, frames, count);
+}
+
+//With the filter on only the channel it selects is played, the other interleaved streams are skipped
+static void cdrom_play_xa(ps1_cdrom* cdrom, const uint8_t* sector)
+{
+    if((cdrom->mode & CDROM_MODE_XA_FILTER) && (sector[16] != cdrom->filter_file || sector[17] != cdrom->filter_channel))
+        return;
+
+    uint32_t frames = cdrom_xa_decode(&cdrom->audio, sector);
+    if(!cdrom->adpcm_muted)
+        cdrom_send_audio(cdrom, cdrom->audio.output, frames);
+}
+
+//INT1 for a sector or a report, replacing one the cpu hasn't been told about yet like the drive's own buffer would
+static cdrom_response* cdrom_data_ready(ps1_cdrom* cdrom, uint64_t due)
+{
+    if(cdrom->queue_count)
+    {
+        cdrom_response* last = &cdrom->queue[(cdrom->queue_head + cdrom->queue_count - 1) % CDROM_RESPONSE_QUEUE];
+        if(last->interrupt == CDROM_INT_DATA_READY)
+        {
+            last->length = 0;
+            last->due = due;
+            last->sector = NULL;
+            return last;
+        }
+    }
+    return cdrom_queue(cdrom, due, CDROM_INT_DATA_READY);
+}
+
+/*
+ CD-DA sectors are 588 stereo frames at 44.1kHz already. In report mode every 10th sector answers INT1 with the
+ position, absolute and relative to the track in turns, and auto pause stops at the end of the track with INT4.
+*/
+static void cdrom_play_cdda(ps1_cdrom* cdrom, const uint8_t* sector, uint64_t due)
+{
+    int16_t frames[CDROM_CDDA_FRAMES * 2];
+    memcpy(frames, sector, sizeof(frames));
+    int32_t peak = 0;
+    for(uint32_t i = 0; i < CDROM_CDDA_FRAMES; i++)
+        peak = abs(frames[i * 2]) > peak ? abs(frames[i * 2]) : peak;
+    cdrom_send_audio(cdrom, frames, CDROM_CDDA_FRAMES);
+
+    uint32_t lba = cdrom->position - 1;
+    int32_t index = ps1_disc_find_track(cdrom->disc, lba);
+    if((cdrom->mode & CDROM_MODE_AUTO_PAUSE) && ps1_disc_find_track(cdrom->disc, lba + 1) != index)
+    {
+        cdrom->reading = false;
+        cdrom->playing = false;
+        cdrom_push(cdrom_queue(cdrom, due, CDROM_INT_DATA_END), cdrom_stat(cdrom, due));
+        return;
+    }
+
+    uint8_t minute, second, frame;
+    disc_lba_to_msf(lba, &minute, &second, &frame);
+    if(!(cdrom->mode & CDROM_MODE_REPORT) || frame % 10)
+        return;
+
+    const disc_track* track = &cdrom->disc->tracks[index < 0 ? 0 : index];
+    cdrom_response* response = cdrom_data_ready(cdrom, due);
+    cdrom_push(response, cdrom_stat(cdrom, due));
+    cdrom_push(response, disc_to_bcd(index < 0 ? 1 : index + 1));
+    cdrom_push(response, lba >= track->start ? 0x01 : 0x00);
+    if(frame / 10 & 1)
+    {
+        uint32_t relative = lba >= track->start ? lba - track->start : track->start - lba;
+        cdrom_push(response, disc_to_bcd(relative / (60 * DISC_SECTORS_PER_SECOND)));
+        cdrom_push(response, disc_to_bcd((relative / DISC_SECTORS_PER_SECOND) % 60) | 0x80);
+        cdrom_push(response, disc_to_bcd(relative % DISC_SECTORS_PER_SECOND));
+    }
+    else
+    {
+        cdrom_push(response, disc_to_bcd(minute));
+        cdrom_push(response, disc_to_bcd(second));
+        cdrom_push(response, disc_to_bcd(frame));
+    }
+    cdrom_push(response, peak);
+    cdrom_push(response, peak >> 8);
+}
+
+static void cdrom_read_sector(ps1_cdrom* cdrom)
+{
+    uint64_t due = cdrom->sector_due;
+    cdrom->sector_due += cdrom_sector_cycles(cdrom);
+
+    uint8_t* scratch = cdrom->scratch[cdrom->scratch_next];
+    const uint8_t* sector = ps1_disc_read_sector(cdrom->disc, cdrom->position, scratch);
+    if(sector == NULL)
+    {
+        //Past the lead-out
+        cdrom->reading = false;
+        cdrom_push(cdrom_queue(cdrom, due, CDROM_INT_DATA_END), cdrom_stat(cdrom, due));
+        return;
+    }
+    if(sector == scratch)
+        cdrom->scratch_next = (cdrom->scratch_next + 1) % CDROM_SECTOR_BUFFERS;
+    cdrom->position++;
+
+    if(cdrom->playing)
+    {
+        cdrom_play_cdda(cdrom, sector, due);
+        return;
+    }
+    if(cdrom_audio_sector(cdrom, sector))
+    {
+        cdrom_play_xa(cdrom, sector);
+        return;
+    }
+
+    cdrom_response* response = cdrom_data_ready(cdrom, due);
+    cdrom_push(response, cdrom_stat(cdrom, due));
+    response->sector = sector;
+}
+
+static void cdrom_update(ps1_cdrom* cdrom, uint64_t now)
+{
+    while(cdrom->reading && cdrom->sector_due <= now)
+        cdrom_read_sector(cdrom);
+    cdrom_deliver(cdrom, now);
+    cdrom_schedule(cdrom);
+}
+
+//Reads data or plays CD-DA from the setloc target if there is a new one, otherwise from where the head is
+static void cdrom_start_reading(ps1_cdrom* cdrom, uint64_t now, bool playing)
+{
+    bool seek = cdrom->setloc_pending;
+    bool restart = seek || !cdrom->reading || playing != cdrom->playing;
+    if(seek)
+    {
+        cdrom_seek(cdrom, now, cdrom->setloc);
+        cdrom_audio_reset(&cdrom->audio);
+    }
+    cdrom->playing = playing;
+    if(restart)
+        cdrom->sector_due = (now > cdrom->seek_end ? now : cdrom->seek_end) + cdrom_sector_cycles(cdrom);
+    cdrom->reading = true;
+    cdrom->stat |= CDROM_STAT_MOTOR;
+}
+
+static uint32_t cdrom_msf_to_lba(const uint8_t* msf)
+{
+    uint32_t frames = (disc_from_bcd(msf[0]) * 60 + disc_from_bcd(msf[1])) * DISC_SECTORS_PER_SECOND + disc_from_bcd(msf[2]);
+    return frames >= DISC_LEAD_IN ? frames - DISC_LEAD_IN : 0;
+}
+
+static bool cdrom_find_text(const uint8_t* data, uint32_t length, const char* text)
+{
+    size_t text_length = strlen(text);
+    for(uint32_t i = 0; i + text_length <= length; i++)
+    {
+        if(!memcmp(data + i, text, text_length))
+            return true;
+    }
+    return false;
+}
+
+//The license string in sector 4 says which region the disc is for
+static void cdrom_get_id(ps1_cdrom* cdrom, uint64_t due)
+{
+    if(cdrom->disc == NULL)
+    {
+        cdrom_response* response = cdrom_queue(cdrom, due, CDROM_INT_ERROR);
+        cdrom_push(response, CDROM_STAT_ID_ERROR);
+        cdrom_push(response, 0x40);
+        for(uint32_t i = 0; i < 6; i++)
+            cdrom_push(response, 0);
+        return;
+    }
+
+    if(cdrom->disc->tracks[0].type == DISC_TRACK_AUDIO)
+    {
+        cdrom_response* response = cdrom_queue(cdrom, due, CDROM_INT_ERROR);
+        cdrom_push(response, cdrom_stat(cdrom, due) | CDROM_STAT_ID_ERROR);
+        cdrom_push(response, 0x90);
+        for(uint32_t i = 0; i < 6; i++)
+            cdrom_push(response, 0);
+        return;
+    }
+
+    uint8_t scratch[DISC_SECTOR_SIZE];
+    const uint8_t* license = ps1_disc_read_sector(cdrom->disc, 4, scratch);
+    char region = 'I';
+    if(license != NULL && cdrom_find_text(license + 24, 0x800, "Amer"))
+        region = 'A';
+    else if(license != NULL && cdrom_find_text(license + 24, 0x800, "Euro"))
+        region = 'E';
+
+    cdrom_response* response = cdrom_queue(cdrom, due, CDROM_INT_COMPLETE);
+    cdrom_push(response, cdrom_stat(cdrom, due));
+    cdrom_push(response, 0x00); //Licensed
+    cdrom_push(response, 0x20); //Mode 2
+    cdrom_push(response, 0x00);
+    cdrom_push(response, 'S');
+    cdrom_push(response, 'C');
+    cdrom_push(response, 'E');
+    cdrom_push(response, region);
+}
+
+//Track, index, position in the track and on the disc of the sector under the head
+static void cdrom_get_loc_p(ps1_cdrom* cdrom, uint64_t due)
+{
+    uint32_t lba = cdrom->position > 0 ? cdrom->position - 1 : 0;
+    int32_t index = ps1_disc_find_track(cdrom->disc, lba);
+    const disc_track* track = &cdrom->disc->tracks[index < 0 ? 0 : index];
+    uint32_t relative = lba >= track->start ? lba - track->start : track->start - lba;
+    uint8_t minute, second, frame;
+
+    cdrom_response* response = cdrom_queue(cdrom, due, CDROM_INT_ACKNOWLEDGE);
+    cdrom_push(response, disc_to_bcd(index < 0 ? 1 : index + 1));
+    cdrom_push(response, lba >= track->start ? 0x01 : 0x00);
+    cdrom_push(response, disc_to_bcd(relative / (60 * DISC_SECTORS_PER_SECOND)));
+    cdrom_push(response, disc_to_bcd((relative / DISC_SECTORS_PER_SECOND) % 60));
+    cdrom_push(response, disc_to_bcd(relative % DISC_SECTORS_PER_SECOND));
+    disc_lba_to_msf(lba, &minute, &second, &frame);
+    cdrom_push(response, disc_to_bcd(minute));
+    cdrom_push(response, disc_to_bcd(second));
+    cdrom_push(response, disc_to_bcd(frame));
+}
+
+static void cdrom_get_td(ps1_cdrom* cdrom, uint64_t due)
+{
+    uint32_t track = disc_from_bcd(cdrom->parameters[0]);
+    if(track > cdrom->disc->track_count)
+    {
+        cdrom_error(cdrom, due, CDROM_ERROR_BAD_PARAMETER);
+        return;
+    }
+
+    //Track 0 is the lead-out
+    uint32_t lba = track ? cdrom->disc->tracks[track - 1].start : cdrom->disc->sectors;
+    uint8_t minute, second, frame;
+    disc_lba_to_msf(lba, &minute, &second, &frame);
+    cdrom_response* response = cdrom_acknowledge(cdrom, due);
+    cdrom_push(response, disc_to_bcd(minute));
+    cdrom_push(response, disc_to_bcd(second));
+}
+
+//Parameters a command takes, -1 for the ones that aren't checked
+static int32_t cdrom_parameter_count(uint8_t command)
+{
+    switch(command)
+    {
+        case CDROM_SETLOC:    return 3;
+        case CDROM_SETFILTER: return 2;
+        case CDROM_SETMODE:   return 1;
+        case CDROM_GETTD:     return 1;
+        case CDROM_GETSTAT:
+        case CDROM_READN:
+        case CDROM_READS:
+        case CDROM_PAUSE:
+        case CDROM_INIT:
+        case CDROM_GETID:
+        case CDROM_SEEKL:
+        case CDROM_SEEKP:     return 0;
+    }
+    return -1;
+}
+
+static bool cdrom_needs_disc(uint8_t command)
+{
+    switch(command)
+    {
+        case CDROM_PLAY:
+        case CDROM_READN:
+        case CDROM_READS:
+        case CDROM_SEEKL:
+        case CDROM_SEEKP:
+        case CDROM_GETLOCL:
+        case CDROM_GETLOCP:
+        case CDROM_GETTN:
+        case CDROM_GETTD:
+        case CDROM_READTOC:
+            return true;
+    }
+    return false;
+}
+
+static void cdrom_command(ps1_cdrom* cdrom, uint8_t command)
+{
+    uint64_t now = cdrom_now(cdrom);
+    uint64_t due = now + CDROM_ACK_CYCLES;
+    int32_t expected = cdrom_parameter_count(command);
+    cdrom->busy = true;
+
+    if(expected >= 0 && expected != cdrom->parameter_count)
+        cdrom_error(cdrom, due, CDROM_ERROR_PARAMETER_COUNT);
+    else if(cdrom->disc == NULL && cdrom_needs_disc(command))
+        cdrom_error(cdrom, due, CDROM_ERROR_NO_DISC);
+    else switch(command)
+    {
+        case CDROM_GETSTAT:
+            cdrom_acknowledge(cdrom, due);
+            break;
+        case CDROM_SETLOC:
+            cdrom->setloc = cdrom_msf_to_lba(cdrom->parameters);
+            cdrom->setloc_pending = true;
+            cdrom_acknowledge(cdrom, due);
+            break;
+        case CDROM_PLAY:
+        {
+            //A track number starts it from the beginning of that track
+            uint32_t track = cdrom->parameter_count ? disc_from_bcd(cdrom->parameters[0]) : 0;
+            if(track > cdrom->disc->track_count)
+            {
+                cdrom_error(cdrom, due, CDROM_ERROR_BAD_PARAMETER);
+                break;
+            }
+            if(track)
+            {
+                cdrom->setloc = cdrom->disc->tracks[track - 1].start;
+                cdrom->setloc_pending = true;
+            }
+            cdrom_start_reading(cdrom, now, true);
+            cdrom_acknowledge(cdrom, due);
+            break;
+        }
+        case CDROM_READN:
+        case CDROM_READS:
+            cdrom_start_reading(cdrom, now, false);
+            cdrom_acknowledge(cdrom, due);
+            break;
+        case CDROM_MOTOR_ON:
+            cdrom_acknowledge(cdrom, due);
+            cdrom->stat |= CDROM_STAT_MOTOR;
+            cdrom_complete(cdrom, due + CDROM_SECOND_CYCLES);
+            break;
+        case CDROM_STOP:
+        {
+            bool spinning = cdrom->stat & CDROM_STAT_MOTOR;
+            cdrom_acknowledge(cdrom, due);
+            cdrom->reading = false;
+            cdrom->stat &= ~CDROM_STAT_MOTOR;
+            cdrom_complete(cdrom, due + (spinning ? CDROM_STOP_CYCLES : CDROM_SECOND_CYCLES));
+            break;
+        }
+        case CDROM_PAUSE:
+        {
+            //Stopping a read takes about as long as a sector
+            bool reading = cdrom->reading;
+            cdrom_acknowledge(cdrom, due);
+            cdrom->reading = false;
+            cdrom_complete(cdrom, due + (reading ? cdrom_sector_cycles(cdrom) : CDROM_SECOND_CYCLES));
+            break;
+        }
+        case CDROM_INIT:
+            cdrom->queue_count = 0;
+            cdrom->mode = CDROM_MODE_WHOLE_SECTOR;
+            cdrom->reading = false;
+            cdrom->stat = cdrom->disc != NULL ? CDROM_STAT_MOTOR : 0;
+            cdrom_acknowledge(cdrom, due);
+            cdrom_complete(cdrom, due + CDROM_INIT_CYCLES);
+            break;
+        case CDROM_MUTE:
+        case CDROM_DEMUTE:
+            cdrom->muted = command == CDROM_MUTE;
+            cdrom_acknowledge(cdrom, due);
+            break;
+        case CDROM_SETFILTER:
+            cdrom->filter_file = cdrom->parameters[0];
+            cdrom->filter_channel = cdrom->parameters[1];
+            cdrom_acknowledge(cdrom, due);
+            break;
+        case CDROM_SETMODE:
+            cdrom->mode = cdrom->parameters[0];
+            cdrom_acknowledge(cdrom, due);
+            break;
+        case CDROM_GETPARAM:
+        {
+            cdrom_response* response = cdrom_acknowledge(cdrom, due);
+            cdrom_push(response, cdrom->mode);
+            cdrom_push(response, 0x00);
+            cdrom_push(response, cdrom->filter_file);
+            cdrom_push(response, cdrom->filter_channel);
+            break;
+        }
+        case CDROM_GETLOCL:
+        {
+            //The header and subheader of the last sector read, without a status byte
+            if(cdrom->sector == NULL)
+            {
+                cdrom_error(cdrom, due, CDROM_ERROR_BAD_COMMAND);
+                break;
+            }
+            cdrom_response* response = cdrom_queue(cdrom, due, CDROM_INT_ACKNOWLEDGE);
+            for(uint32_t i = 12; i < 20; i++)
+                cdrom_push(response, cdrom->sector[i]);
+            break;
+        }
+        case CDROM_GETLOCP:
+            cdrom_get_loc_p(cdrom, due);
+            break;
+        case CDROM_GETTN:
+        {
+            cdrom_response* response = cdrom_acknowledge(cdrom, due);
+            cdrom_push(response, 0x01);
+            cdrom_push(response, disc_to_bcd(cdrom->disc->track_count));
+            break;
+        }
+        case CDROM_GETTD:
+            cdrom_get_td(cdrom, due);
+            break;
+        case CDROM_SEEKL:
+        case CDROM_SEEKP:
+            cdrom->reading = false;
+            cdrom_seek(cdrom, now, cdrom->setloc);
+            cdrom_acknowledge(cdrom, due);
+            cdrom_complete(cdrom, cdrom->seek_end > due ? cdrom->seek_end : due + CDROM_SECOND_CYCLES);
+            break;
+        case CDROM_TEST:
+            //Only the version query, 19h/20h answers the date and version of the controller BIOS
+            if(cdrom->parameter_count == 1 && cdrom->parameters[0] == 0x20)
+            {
+                cdrom_response* response = cdrom_queue(cdrom, due, CDROM_INT_ACKNOWLEDGE);
+                cdrom_push(response, 0x94);
+                cdrom_push(response, 0x09);
+                cdrom_push(response, 0x19);
+                cdrom_push(response, 0xC0);
+            }
+            else
+                cdrom_error(cdrom, due, CDROM_ERROR_BAD_PARAMETER);
+            break;
+        case CDROM_GETID:
+            cdrom_acknowledge(cdrom, due);
+            cdrom_get_id(cdrom, due + CDROM_SECOND_CYCLES);
+            break;
+        case CDROM_READTOC:
+            cdrom_acknowledge(cdrom, due);
+            cdrom_complete(cdrom, due + CDROM_TOC_CYCLES);
+            break;
+        default:
+            printf("Unhandled CD-ROM command %02Xh\n", command);
+            cdrom_error(cdrom, due, CDROM_ERROR_BAD_COMMAND);
+            break;
+    }
+
+    cdrom->parameter_count = 0;
+    cdrom_schedule(cdrom);
+}
+
+//Bit 7 of the request register loads the announced sector into the data FIFO, clearing it empties the FIFO
+static void cdrom_request(ps1_cdrom* cdrom, uint8_t value)
+{
+    cdrom->data_position = 0;
+    cdrom->data_length = 0;
+    if(!(value & 0x80) || cdrom->sector == NULL)
+        return;
+
+    if(cdrom->mode & CDROM_MODE_WHOLE_SECTOR)
+    {
+        cdrom->data = cdrom->sector + 12;
+        cdrom->data_length = 0x924;
+    }
+    else
+    {
+        //User data follows the header in mode 1 sectors and the subheader in mode 2 sectors
+        cdrom->data = cdrom->sector + (cdrom->sector[15] == 1 ? 16 : 24);
+        cdrom->data_length = 0x800;
+    }
+}
+
+static uint8_t cdrom_read_data(ps1_cdrom* cdrom)
+{
+    return cdrom->data_position < cdrom->data_length ? cdrom->data[cdrom->data_position++] : 0;
+}
+
+uint8_t ps1_cdrom_read_register(ps1_cdrom* cdrom, uint32_t address)
+{
+    switch(address & 0x3)
+    {
+        case 0:
+        {
+            uint8_t status = cdrom->index;
+            if(!cdrom->parameter_count)
+                status |= CDROM_STATUS_PARAMETER_EMPTY;
+            if(cdrom->parameter_count < CDROM_FIFO_SIZE)
+                status |= CDROM_STATUS_PARAMETER_READY;
+            if(cdrom->response_position < cdrom->response_length)
+                status |= CDROM_STATUS_RESPONSE_READY;
+            if(cdrom->data_position < cdrom->data_length)
+                status |= CDROM_STATUS_DATA_READY;
+            if(cdrom->busy)
+                status |= CDROM_STATUS_BUSY;
+            return status;
+        }
+        case 1:
+        {
+            //Reading past the response wraps around the 16 byte FIFO
+            uint8_t value = cdrom->response[cdrom->response_position % CDROM_FIFO_SIZE];
+            cdrom->response_position++;
+            return value;
+        }
+        case 2:
+            return cdrom_read_data(cdrom);
+        case 3:
+            return (cdrom->index & 1 ? cdrom->interrupt_flags : cdrom->interrupt_enable) | 0xE0;
+    }
+    return 0;
+}
+
+void ps1_cdrom_store_register(ps1_cdrom* cdrom, uint32_t address, uint8_t value)
+{
+    //Register and index, the index register itself is the same at every index
+    uint32_t target = address & 0x3 ? ((address & 0x3) << 2) | cdrom->index : 0;
+    switch(target)
+    {
+        case 0x0:
+            cdrom->index = value & 0x3;
+            break;
+        case 0x4:
+            cdrom_command(cdrom, value);
+            break;
+        case 0x7:
+            cdrom->next_volume[2] = value;
+            break;
+        case 0x8:
+            if(cdrom->parameter_count < CDROM_FIFO_SIZE)
+                cdrom->parameters[cdrom->parameter_count++] = value;
+            break;
+        case 0x9:
+            cdrom->interrupt_enable = value & 0x1F;
+            break;
+        case 0xA:
+            cdrom->next_volume[0] = value;
+            break;
+        case 0xB:
+            cdrom->next_volume[3] = value;
+            break;
+        case 0xC:
+            cdrom_request(cdrom, value);
+            break;
+        case 0xD:
+            //Acknowledging lets the next queued response through
+            cdrom->interrupt_flags &= ~(value & 0x1F);
+            if(value & 0x40)
+                cdrom->parameter_count = 0;
+            if(!cdrom->interrupt_flags)
+                cdrom_update(cdrom, cdrom_now(cdrom));
+            break;
+        case 0xE:
+            cdrom->next_volume[1] = value;
+            break;
+        case 0xF:
+            cdrom->adpcm_muted = value & 0x01;
+            if(value & 0x20)
+                memcpy(cdrom->volume, cdrom->next_volume, sizeof(cdrom->volume));
+            break;
+    }
+}
+
+//The data FIFO can be read a halfword or word at a time too, every other register is a byte
+static uint32_t ps1_cdrom_io_read(void* device, uint32_t address, BUS_WIDTH width)
+{
+    ps1_cdrom* cdrom = (ps1_cdrom*)device;
+    if((address & 0x3) != 2 || width == BUS_WIDTH_BYTE)
+        return ps1_cdrom_read_register(cdrom, address);
+
+    uint32_t value = 0;
+    for(uint32_t i = 0; i < (uint32_t)width; i++)
+        value |= (uint32_t)cdrom_read_data(cdrom) << (i * 8);
+    return value;
+}
+
+static void ps1_cdrom_io_write(void* device, uint32_t address, uint32_t value, BUS_WIDTH width)
+{
+    ps1_cdrom_store_register((ps1_cdrom*)device, address, value);
+}
+
+void ps1_connect_bus_cdrom(ps1_bus* bus, ps1_cdrom* cdrom)
+{
+    ps1_bus_register_io(bus, CDROM_BASE, 4, cdrom, ps1_cdrom_io_read, ps1_cdrom_io_write, BUS_WIDTH_ALL);
+}
+
+static void ps1_cdrom_event(void* device, uint64_t timestamp)
+{
+    cdrom_update((ps1_cdrom*)device, timestamp);
+}
+
+void ps1_connect_scheduler_cdrom(ps1_scheduler* scheduler, ps1_cdrom* cdrom)
+{
+    cdrom->scheduler = scheduler;
+    ps1_scheduler_register(scheduler, EVENT_CDROM, ps1_cdrom_event, cdrom);
+}
+
+//DMA3 copies out of the sector in place, past the end of the FIFO it reads zeroes
+static void ps1_cdrom_dma_read(void* device, uint32_t* words, uint32_t count)
+{
+    ps1_cdrom* cdrom = (ps1_cdrom*)device;
+    uint32_t bytes = count * 4;
+    uint32_t available = cdrom->data_length - cdrom->data_position;
+    uint32_t copied = bytes < available ? bytes : available;
+
+    if(copied)
+        memcpy(words, cdrom->data + cdrom->data_position, copied);
+    cdrom->data_position += copied;
+    if(copied < bytes)
+        memset((uint8_t*)words + copied, 0, bytes - copied);
+}
+
+void ps1_connect_dma_cdrom(ps1_dma* dma, ps1_cdrom* cdrom)
+{
+    ps1_dma_connect_port(dma, DMA_CHANNEL_CDROM, cdrom, NULL, ps1_cdrom_dma_read);
+}
+
+void ps1_connect_irq_cdrom(ps1_irq* irq, ps1_cdrom* cdrom)
+{
+    cdrom->irq = irq;
+}
+
+void ps1_connect_spu_cdrom(ps1_spu* spu, ps1_cdrom* cdrom)
+{
+    cdrom->spu = spu;
+}
+
+//Takes ownership of the disc, the lid closes on it with the motor spinning
+void ps1_cdrom_insert(ps1_cdrom* cdrom, ps1_disc* disc)
+{
+    ps1_cdrom_eject(cdrom);
+    cdrom->disc = disc;
+    cdrom->stat = CDROM_STAT_MOTOR;
+}
+
+void ps1_cdrom_eject(ps1_cdrom* cdrom)
+{
+    if(cdrom->disc == NULL)
+        return;
+
+    //Nothing may point into the image once it is closed
+    cdrom->reading = false;
+    cdrom->queue_count = 0;
+    cdrom->sector = NULL;
+    cdrom->data_length = 0;
+    cdrom->data_position = 0;
+    cdrom->stat = 0;
+    ps1_disc_close(cdrom->disc);
+    cdrom->disc = NULL;
+    cdrom_schedule(cdrom);
+}
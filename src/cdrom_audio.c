@@ -0,0 +1,151 @@
+#include "cdrom_audio.h"
+
+static const int32_t cdrom_xa_positive[4] = {0, 60, 115, 98};
+static const int32_t cdrom_xa_negative[4] = {0, 0, -52, -55};
+
+/*
+ Blackman windowed sinc cut at 17kHz for 37.8kHz input, the same fraction of 18.9kHz for half rate sectors.
+ Oldest sample first, every phase sums to 4000h.
+*/
+const int16_t cdrom_resample_taps[CDROM_RESAMPLE_PHASES][CDROM_RESAMPLE_TAPS] =
+{
+    {0x0002, -0x000D, 0x0011, 0x002D, -0x012C, 0x03D8, -0x0A7C, 0x279D, 0x279D, -0x0A7C, 0x03D8, -0x012C, 0x002D, 0x0011, -0x000D, 0x0002},
+    {0x0000, -0x0001, -0x0016, 0x0087, -0x01C6, 0x048C, -0x0A6A, 0x1DF0, 0x2FEA, -0x088E, 0x023F, -0x0032, -0x0050, 0x0042, -0x001B, 0x0004},
+    {0x0000, 0x0006, -0x002E, 0x00B6, -0x01FA, 0x0469, -0x08C8, 0x13D7, 0x35FD, -0x0465, -0x0027, 0x010F, -0x00E0, 0x0077, -0x0029, 0x0006},
+    {0x0000, 0x0009, -0x0037, 0x00BD, -0x01D3, 0x039E, -0x0625, 0x0A40, 0x3930, 0x01FB, -0x0316, 0x0269, -0x016B, 0x00A4, -0x0034, 0x0008},
+    {0x0000, 0x0008, -0x0034, 0x00A4, -0x016B, 0x0269, -0x0316, 0x01FB, 0x3930, 0x0A40, -0x0625, 0x039E, -0x01D3, 0x00BD, -0x0037, 0x0009},
+    {0x0000, 0x0006, -0x0029, 0x0077, -0x00E0, 0x010F, -0x0027, -0x0465, 0x35FD, 0x13D7, -0x08C8, 0x0469, -0x01FA, 0x00B6, -0x002E, 0x0006},
+    {0x0000, 0x0004, -0x001B, 0x0042, -0x0050, -0x0032, 0x023F, -0x088F, 0x2FEB, 0x1DF0, -0x0A6A, 0x048C, -0x01C6, 0x0087, -0x0016, -0x0001},
+};
+
+void cdrom_audio_init(cdrom_audio* audio)
+{
+    memset(audio, 0, sizeof(cdrom_audio));
+    audio->step = 6;
+    cdrom_audio_set_simd(audio, true);
+}
+
+//A new stream starts from silence
+void cdrom_audio_reset(cdrom_audio* audio)
+{
+    memset(audio->history, 0, sizeof(audio->history));
+    memset(audio->input, 0, sizeof(audio->input));
+    audio->position = 0;
+}
+
+bool cdrom_audio_set_simd(cdrom_audio* audio, bool enable)
+{
+    audio->expand = cdrom_xa_expand;
+    audio->resample = cdrom_audio_resample;
+#ifdef PS1_SIMD_AVX2
+    if(enable && ps1_cpu_has_avx2())
+    {
+        audio->expand = cdrom_xa_expand_avx2;
+        audio->resample = cdrom_audio_resample_avx2;
+    }
+#endif
+    return audio->expand != cdrom_xa_expand || !enable;
+}
+
+static inline int32_t cdrom_audio_clamp(int32_t value)
+{
+    return value < -0x8000 ? -0x8000 : value > 0x7FFF ? 0x7FFF : value;
+}
+
+/*
+ The data is 28 rows of 4 bytes, unit u is nibble u of every row in 4 bit groups and byte u in 8 bit ones. Its
+ parameter byte is header byte 4 + u, the shift in the low nibble goes from 12 for the quietest units down to 0.
+ Moving the sample to the top of the word and back down sign extends it on the way.
+*/
+void cdrom_xa_expand(const uint8_t* group, bool eight_bit, int32_t units[8][32])
+{
+    uint32_t count = eight_bit ? 4 : 8;
+    for(uint32_t u = 0; u < count; u++)
+    {
+        uint32_t range = group[4 + u] & 0xF;
+        uint32_t shift = 16 + (range > 12 ? 9 : range);
+        uint32_t top = eight_bit ? 24 - 8 * u : 28 - 4 * u;
+        for(uint32_t i = 0; i < CDROM_XA_UNIT_SAMPLES; i++)
+        {
+            const uint8_t* row = group + 16 + i * 4;
+            uint32_t value = row[0] | row[1] << 8 | row[2] << 16 | (uint32_t)row[3] << 24;
+            units[u][i] = (int32_t)(value << top) >> shift;
+        }
+    }
+}
+
+static void cdrom_xa_filter(cdrom_audio* audio, const int32_t* unit, uint8_t parameter, uint32_t channel, int16_t* output)
+{
+    uint32_t filter = (parameter >> 4) & 0x3;
+    int32_t old = audio->history[channel][0];
+    int32_t older = audio->history[channel][1];
+    for(uint32_t i = 0; i < CDROM_XA_UNIT_SAMPLES; i++)
+    {
+        int32_t sample = cdrom_audio_clamp(unit[i] + ((old * cdrom_xa_positive[filter] + older * cdrom_xa_negative[filter] + 32) >> 6));
+        output[i] = sample;
+        older = old;
+        old = sample;
+    }
+    audio->history[channel][0] = old;
+    audio->history[channel][1] = older;
+}
+
+uint32_t cdrom_audio_resample(cdrom_audio* audio, uint32_t count, uint32_t channels)
+{
+    uint32_t frames = 0;
+    uint32_t end = count * CDROM_RESAMPLE_PHASES;
+    for(; audio->position < end; audio->position += audio->step)
+    {
+        const int16_t* taps = cdrom_resample_taps[audio->position % CDROM_RESAMPLE_PHASES];
+        uint32_t first = audio->position / CDROM_RESAMPLE_PHASES;
+        for(uint32_t channel = 0; channel < channels; channel++)
+        {
+            const int16_t* samples = audio->input[channel] + first;
+            int32_t sum = 0;
+            for(uint32_t k = 0; k < CDROM_RESAMPLE_TAPS; k++)
+                sum += samples[k] * taps[k];
+            audio->output[frames * 2 + channel] = cdrom_audio_clamp((sum + 0x2000) >> 14);
+        }
+        if(channels == 1)
+            audio->output[frames * 2 + 1] = audio->output[frames * 2];
+        frames++;
+    }
+    audio->position -= end;
+    return frames;
+}
+
+/*
+ Decodes an XA audio sector and resamples it, the frames are left in the output. Stereo sectors alternate left
+ and right units, mono ones carry twice as many samples of a single channel.
+*/
+uint32_t cdrom_xa_decode(cdrom_audio* audio, const uint8_t* sector)
+{
+    uint8_t coding = sector[19];
+    bool stereo = coding & CDROM_XA_STEREO;
+    bool eight_bit = coding & CDROM_XA_8BIT;
+    uint32_t units = eight_bit ? 4 : 8;
+    uint32_t count[2] = {0, 0};
+    int32_t expanded[8][32];
+    audio->step = coding & CDROM_XA_HALF_RATE ? 3 : 6;
+
+    for(uint32_t g = 0; g < CDROM_XA_GROUPS; g++)
+    {
+        const uint8_t* group = sector + 24 + g * CDROM_XA_GROUP_SIZE;
+        audio->expand(group, eight_bit, expanded);
+        for(uint32_t u = 0; u < units; u++)
+        {
+            uint32_t channel = stereo ? u & 1 : 0;
+            int16_t* output = audio->input[channel] + CDROM_RESAMPLE_TAPS - 1 + count[channel];
+            cdrom_xa_filter(audio, expanded[u], group[4 + u], channel, output);
+            count[channel] += CDROM_XA_UNIT_SAMPLES;
+        }
+    }
+
+    uint32_t channels = stereo ? 2 : 1;
+    uint32_t frames = audio->resample(audio, count[0], channels);
+
+    //The last samples stay in front for the next sector's first outputs
+    for(uint32_t channel = 0; channel < channels; channel++)
+        memmove(audio->input[channel], audio->input[channel] + count[0], (CDROM_RESAMPLE_TAPS - 1) * sizeof(int16_t));
+    return frames;
+}
@@ -0,0 +1,57 @@
+#include "cdrom_audio.h"
+
+#ifdef PS1_SIMD_AVX2
+
+#include <immintrin.h>
+
+//Eight rows per register, each unit is the same two shifts with its own counts. The 4th load runs past row 27
+PS1_AVX2_TARGET void cdrom_xa_expand_avx2(const uint8_t* group, bool eight_bit, int32_t units[8][32])
+{
+    __m256i rows[4];
+    for(uint32_t r = 0; r < 4; r++)
+        rows[r] = _mm256_loadu_si256((const __m256i*)(group + 16 + r * 32));
+
+    uint32_t count = eight_bit ? 4 : 8;
+    for(uint32_t u = 0; u < count; u++)
+    {
+        uint32_t range = group[4 + u] & 0xF;
+        __m128i top = _mm_cvtsi32_si128(eight_bit ? 24 - 8 * u : 28 - 4 * u);
+        __m128i shift = _mm_cvtsi32_si128(16 + (range > 12 ? 9 : range));
+        for(uint32_t r = 0; r < 4; r++)
+            _mm256_storeu_si256((__m256i*)(units[u] + r * 8), _mm256_sra_epi32(_mm256_sll_epi32(rows[r], top), shift));
+    }
+}
+
+PS1_AVX2_TARGET static inline int32_t cdrom_audio_dot(const int16_t* samples, __m256i taps)
+{
+    __m256i products = _mm256_madd_epi16(_mm256_loadu_si256((const __m256i*)samples), taps);
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(products), _mm256_extracti128_si256(products, 1));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4E));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+    int32_t value = (_mm_cvtsi128_si32(sum) + 0x2000) >> 14;
+    return value < -0x8000 ? -0x8000 : value > 0x7FFF ? 0x7FFF : value;
+}
+
+//All 16 taps of an output in one multiply, madd pairs them up and the rest is a horizontal sum
+PS1_AVX2_TARGET uint32_t cdrom_audio_resample_avx2(cdrom_audio* audio, uint32_t count, uint32_t channels)
+{
+    __m256i taps[CDROM_RESAMPLE_PHASES];
+    for(uint32_t phase = 0; phase < CDROM_RESAMPLE_PHASES; phase++)
+        taps[phase] = _mm256_loadu_si256((const __m256i*)cdrom_resample_taps[phase]);
+
+    uint32_t frames = 0;
+    uint32_t end = count * CDROM_RESAMPLE_PHASES;
+    for(; audio->position < end; audio->position += audio->step)
+    {
+        __m256i phase = taps[audio->position % CDROM_RESAMPLE_PHASES];
+        uint32_t first = audio->position / CDROM_RESAMPLE_PHASES;
+        int16_t left = cdrom_audio_dot(audio->input[0] + first, phase);
+        audio->output[frames * 2] = left;
+        audio->output[frames * 2 + 1] = channels == 2 ? cdrom_audio_dot(audio->input[1] + first, phase) : left;
+        frames++;
+    }
+    audio->position -= end;
+    return frames;
+}
+
+#endif
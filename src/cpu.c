@@ -1,15 +1,19 @@
 #include "ram.h"
 #include "bus.h"
 #include "cpu.h"
-
-#define RS (cpu->opcode >> 21) & 0x1F
-#define RT (cpu->opcode >> 16) & 0x1F
-#define RD (cpu->opcode >> 11) & 0x1F
-#define BASE (cpu->opcode >> 21) & 0x1F
-#define IMM16BITS (cpu->opcode & 0xFFFF)
-#define OFFSET16BITS (cpu->opcode & 0xFFFF)
-#define MASK26BITS (cpu->opcode & 0x3FFFFFF)
-#define IMM5BITS ((cpu->opcode >> 6) & 0x1F)
+#include "block_cache.h"
+#include "jit.h"
+#include "scheduler.h"
+
+//Operand fields are extracted once by cpu_decode_instr, handlers only read them back
+#define RS (instr->rs)
+#define RT (instr->rt)
+#define RD (instr->rd)
+#define BASE (instr->rs)
+#define IMM16BITS (instr->imm)
+#define OFFSET16BITS (instr->imm)
+#define MASK26BITS (instr->target)
+#define IMM5BITS (instr->shamt)
 //Useful for the Address error exception to check if it is trying to read from outside KUSEG in user mode
 #define valid_address(address) (address >= 0x00000000 && address <= 0x7FFFFFFF && (cpu->cop0[COP0_SR] & 2))
 #define HANDLE_BRANCH \
@@ -87,7 +91,11 @@ void ps1_cpu_init(ps1_cpu* cpu)
     memset(cpu, 0, sizeof(ps1_cpu));
     cpu->pc = 0xbfc00000;
     cpu->branch_delay = true;
-    cpu->load_exe = true;
+    cpu->backend = CPU_BACKEND_BLOCK_CACHE;
+
+    cpu->block_cache = ps1_block_cache_create();
+    ps1_block_cache_init(cpu->block_cache);
+    ps1_gte_init(&cpu->gte);
 
     //Init logging
     cpu->log = fopen("log.txt", "w");
@@ -96,168 +104,391 @@ void ps1_cpu_init(ps1_cpu* cpu)
 
 void ps1_cpu_destroy(ps1_cpu* cpu)
 {
+    if(cpu->jit != NULL)
+        ps1_jit_destroy(cpu->jit);
+    ps1_block_cache_destroy(cpu->block_cache);
+    free (cpu->exe);
     free (cpu);
 }
 
 void ps1_connect_bus_cpu(ps1_bus* bus, ps1_cpu* cpu)
 {
     cpu->bus = bus;
+    ps1_connect_bus_block_cache(bus, cpu->block_cache);
+}
+
+void ps1_connect_scheduler_cpu(ps1_scheduler* scheduler, ps1_cpu* cpu)
+{
+    cpu->scheduler = scheduler;
 }
 
-void sideload_exe(ps1_cpu* cpu) 
+bool ps1_cpu_set_backend(ps1_cpu* cpu, CPU_BACKEND backend)
 {
-    FILE *file = fopen("psx_tests/psxtest_cpu.exe", "rb");
-    if (!file) 
+    if(backend == CPU_BACKEND_JIT && cpu->jit == NULL)
     {
-        perror("Failed to open EXE");
-        return;
+        cpu->jit = ps1_jit_create();
+        if(!ps1_jit_init(cpu->jit))
+        {
+            printf("JIT not available on this host, keeping the current backend\n");
+            ps1_jit_destroy(cpu->jit);
+            cpu->jit = NULL;
+            return false;
+        }
     }
 
-    // Get file size
-    fseek(file, 0, SEEK_END);
-    long file_size = ftell(file);
-    rewind(file);
+    cpu->backend = backend;
+    return true;
+}
 
-    // Allocate memory for EXE file
-    uint8_t *exe = malloc(file_size);
-    if (!exe) 
+//Drops every decoded block and all compiled code, must not be called while a block is running
+void ps1_cpu_flush_code(ps1_cpu* cpu)
+{
+    ps1_block_cache_flush(cpu->block_cache);
+    ps1_block_cache_release_retired(cpu->block_cache);
+    if(cpu->jit != NULL)
+        ps1_jit_reset(cpu->jit);
+}
+
+//Used to run two backends in lockstep, prints every difference found
+bool cpu_compare_state(ps1_cpu* cpu, ps1_cpu* reference)
+{
+    bool equal = true;
+
+    //r0 may hold a discarded write until the next instruction starts
+    for(int i = 1; i < 32; i++)
     {
-        perror("Memory allocation failed");
-        fclose(file);
-        return;
+        if(cpu->r[i] != reference->r[i])
+        {
+            printf("Mismatch in %s: %08x, expected %08x\n", cpu_registers[i], cpu->r[i], reference->r[i]);
+            equal = false;
+        }
     }
 
-    // Read EXE file into memory
-    if (fread(exe, 1, file_size, file) != file_size) 
+    if(cpu->pc != reference->pc || cpu->hi != reference->hi || cpu->lo != reference->lo)
     {
-        perror("Failed to read EXE file");
-        free(exe);
-        fclose(file);
-        return;
+        printf("Mismatch in pc/hi/lo: %08x %08x %08x, expected %08x %08x %08x\n", cpu->pc, cpu->hi, cpu->lo, reference->pc, reference->hi, reference->lo);
+        equal = false;
     }
-    fclose(file);
 
-    // Parse EXE header
-    cpu->pc = *(uint32_t*)(exe + 0x10);
-    cpu->r[28] = *(uint32_t*)(exe + 0x14);
-    uint32_t exe_ram_address = (*(uint32_t *)(exe + 0x18)) & 0x1FFFFF;
-    uint32_t exe_size_2kb = *(uint32_t *)(exe + 0x1C);
-    uint32_t initial_sp = *(uint32_t *)(exe + 0x30);
+    if(cpu->branch != reference->branch || cpu->branch_delay != reference->branch_delay ||
+       (cpu->branch && cpu->branch_address != reference->branch_address))
+    {
+        printf("Mismatch in branch state at pc %08x\n", reference->pc);
+        equal = false;
+    }
 
-    // Debugging output
-/*     printf("PC: %08X\n", cpu->pc);
-    printf("R28: %08X\n", cpu->r[28]);
-    printf("Raw EXE RAM Address: %08X\n", *(uint32_t *)(exe + 0x18));
-    printf("Final RAM Address (Masked): %08X\n", exe_ram_address);
-    printf("EXE Size (2KB units): %i\n", exe_size_2kb);
-    printf("Stack Pointer (R29, R30): %08X\n", initial_sp); */
+    if(cpu->cop0[COP0_SR] != reference->cop0[COP0_SR] || cpu->cop0[COP0_CAUSE] != reference->cop0[COP0_CAUSE] ||
+       cpu->cop0[COP0_EPC] != reference->cop0[COP0_EPC])
+    {
+        printf("Mismatch in cop0 SR/CAUSE/EPC at pc %08x\n", reference->pc);
+        equal = false;
+    }
+
+    for(uint32_t i = 0; i < 32; i++)
+    {
+        if(ps1_gte_read_data(&cpu->gte, i) != ps1_gte_read_data(&reference->gte, i) ||
+           ps1_gte_read_control(&cpu->gte, i) != ps1_gte_read_control(&reference->gte, i))
+        {
+            printf("Mismatch in GTE register %d at pc %08x\n", i, reference->pc);
+            equal = false;
+        }
+    }
+
+    return equal;
+}
+
+static uint32_t cpu_exe_word(const uint8_t* exe, uint32_t offset)
+{
+    uint32_t value;
+    memcpy(&value, exe + offset, sizeof(value));
+    return value;
+}
 
-    // Copy EXE data into RAM
-    memcpy(ps1_bus_get_ram(cpu->bus)->ram_buff + exe_ram_address, exe + 2048, exe_size_2kb);
+//Takes ownership of a PS-X EXE to inject at the shell handoff. Rejects anything that wouldn't fit in RAM
+bool cpu_queue_exe(ps1_cpu* cpu, uint8_t* exe, uint32_t size, uint32_t stack)
+{
+    if(size < CPU_EXE_HEADER_SIZE || memcmp(exe, "PS-X EXE", 8))
+    {
+        printf("Not a PS-X EXE\n");
+        free (exe);
+        return false;
+    }
 
-    // Set stack pointer only if it's non-zero
-    if (initial_sp) 
+    uint32_t address = cpu_exe_word(exe, 0x18) & (RAM_SIZE - 1);
+    uint32_t text_size = cpu_exe_word(exe, 0x1C);
+    if(text_size > size - CPU_EXE_HEADER_SIZE || text_size > RAM_SIZE - address)
     {
-        cpu->r[29] = initial_sp;
-        cpu->r[30] = initial_sp;
+        printf("The EXE is truncated or doesn't fit in RAM\n");
+        free (exe);
+        return false;
     }
 
-    // Cleanup
-    free(exe);
-    //log_add_fp(cpu->log, 0);
+    free (cpu->exe);
+    cpu->exe = exe;
+    cpu->exe_size = size;
+    cpu->exe_stack = stack;
+    return true;
 }
 
+//Loads the queued EXE the way the BIOS would: text copied to its address, BSS cleared, then gp, sp and pc set
+void sideload_exe(ps1_cpu* cpu)
+{
+    uint8_t* exe = cpu->exe;
+    ps1_ram* ram = ps1_bus_get_ram(cpu->bus);
+    uint32_t address = cpu_exe_word(exe, 0x18) & (RAM_SIZE - 1);
+    uint32_t text_size = cpu_exe_word(exe, 0x1C);
+    uint32_t bss_address = cpu_exe_word(exe, 0x28) & (RAM_SIZE - 1);
+    uint32_t bss_size = cpu_exe_word(exe, 0x2C);
+    uint32_t stack = cpu_exe_word(exe, 0x30);
+
+    memcpy(ram->ram_buff + address, exe + CPU_EXE_HEADER_SIZE, text_size);
+    ps1_block_cache_invalidate_range(cpu->block_cache, address, text_size);
+    if(bss_size && bss_size <= RAM_SIZE - bss_address)
+    {
+        memset(ram->ram_buff + bss_address, 0, bss_size);
+        ps1_block_cache_invalidate_range(cpu->block_cache, bss_address, bss_size);
+    }
 
+    cpu->pc = cpu_exe_word(exe, 0x10);
+    cpu->r[28] = cpu_exe_word(exe, 0x14);
+    stack = stack ? stack + cpu_exe_word(exe, 0x34) : cpu->exe_stack;
+    if(stack)
+    {
+        cpu->r[29] = stack;
+        cpu->r[30] = stack;
+    }
 
-void cpu_tick(ps1_cpu* cpu)
+    free (cpu->exe);
+    cpu->exe = NULL;
+}
+
+uint32_t cpu_tick(ps1_cpu* cpu)
 {
     tty_output((cpu->pc & 0x1FFFFFFF));
 
-/*     if(cpu->pc == 0x80030000 && cpu->load_exe)
-    {
+    //Blocks never run past a jump, so the BIOS always gets here through cpu_tick
+    if(cpu->exe != NULL && cpu->pc == CPU_SHELL_ENTRY)
         sideload_exe(cpu);
-        cpu->load_exe = false;
-    } */
 
     if(cpu->pc & 0x3)
+    {
         cpu_handle_exception(cpu, ADEL);
-        
-    else
+        return 1;
+    }
+
+    if(cpu->backend == CPU_BACKEND_INTERPRETER)
+    {
+        cpu_step(cpu);
+        return 1;
+    }
+
+    //Code outside of RAM and BIOS can't be cached, so it is interpreted one instruction at a time
+    cpu_block* block = ps1_block_cache_fetch(cpu->block_cache, cpu->pc);
+    if(block == NULL)
+    {
+        cpu_step(cpu);
+        return 1;
+    }
+
+    if(cpu->backend == CPU_BACKEND_JIT)
+        return cpu_run_jit(cpu, block);
+
+    return cpu_run_block(cpu, block);
+}
+
+//The emulator's inner loop: blocks run back to back and control only goes back to the caller when end is reached
+//or an event is due. Events scheduled by the code being run (a DMA start for example) cut the run short.
+//Instructions are charged one cycle each, memory wait states aren't modeled yet
+uint64_t cpu_run(ps1_cpu* cpu, uint64_t end)
+{
+    ps1_scheduler* scheduler = cpu->scheduler;
+    uint64_t start = scheduler->cycles;
+
+    while(scheduler->cycles < end && !ps1_scheduler_event_due(scheduler))
+    {
+        cpu_check_interrupt(cpu);
+        scheduler->cycles += cpu_tick(cpu);
+    }
+
+    return scheduler->cycles - start;
+}
+
+//Hardware interrupts are taken between blocks. CAUSE bit 10 is kept up to date by the interrupt controller and
+//instructions that change SR end their block, so nothing is checked per instruction
+void cpu_check_interrupt(ps1_cpu* cpu)
+{
+    uint32_t sr = cpu->cop0[COP0_SR];
+    if(!(sr & 1) || !(sr & cpu->cop0[COP0_CAUSE] & 0x700))
+        return;
+
+    //Between a branch and its delay slot the interrupt waits for the slot
+    if(cpu->branch)
+        return;
+
+    //A GTE command at EPC is skipped by the BIOS handler, which expects it to have run already
+    if((ps1_bus_read_word(cpu->bus, cpu->pc) >> 25) == 0x25)
+        return;
+
+    cpu_handle_exception(cpu, INTERRUPT);
+    cpu->pc += 4;
+}
+
+void cpu_step(ps1_cpu* cpu)
+{
+    HANDLE_LOAD;
+    cpu->opcode = ps1_bus_read_word(cpu->bus, cpu->pc);
+    cpu_execute_instr(cpu);
+    cpu->pc += 4;
+    HANDLE_BRANCH;
+}
+
+uint32_t cpu_run_block(ps1_cpu* cpu, cpu_block* block)
+{
+    const cpu_instr* instr = block->instr;
+    const cpu_instr* end = instr + block->length;
+    uint32_t pc = cpu->pc;
+
+    while(instr < end)
     {
         HANDLE_LOAD;
-        cpu->opcode = ps1_bus_read_word(cpu->bus, cpu->pc);
-        cpu_execute_instr(cpu);
+        instr->handler(cpu, instr);
         cpu->pc += 4;
         HANDLE_BRANCH;
-    }   
+        pc += 4;
+        instr++;
+
+        //Exceptions, taken branches and stores that invalidated cached code all leave the block early
+        if(cpu->pc != pc || cpu->block_cache->retired != NULL)
+            break;
+    }
+
+    ps1_block_cache_release_retired(cpu->block_cache);
+    return instr - block->instr;
+}
+
+uint32_t cpu_run_jit(ps1_cpu* cpu, cpu_block* block)
+{
+    //Compiled code has the block address built in, the same code seen through another segment is interpreted
+    if(block->pc != cpu->pc)
+        return cpu_run_block(cpu, block);
+
+    if(block->code == NULL)
+    {
+        if(ps1_jit_needs_flush(cpu->jit))
+        {
+            ps1_cpu_flush_code(cpu);
+            block = ps1_block_cache_fetch(cpu->block_cache, cpu->pc);
+        }
+
+        block->code = ps1_jit_compile(cpu->jit, cpu, block);
+        if(block->code == NULL)
+            return cpu_run_block(cpu, block);
+    }
+
+    uint32_t executed = block->code(cpu);
+    ps1_block_cache_release_retired(cpu->block_cache);
+    return executed;
+}
+
+void cpu_handle_load(ps1_cpu* cpu)
+{
+    HANDLE_LOAD;
+}
+
+void cpu_handle_branch(ps1_cpu* cpu)
+{
+    HANDLE_BRANCH;
+}
+
+void cpu_leave_instr(ps1_cpu* cpu)
+{
+    cpu->pc += 4;
+    HANDLE_BRANCH;
 }
 
 void cpu_execute_instr(ps1_cpu* cpu)
 {
-    switch((cpu->opcode & 0xFC000000) >> 26)
+    cpu_instr instr;
+    cpu_decode_instr(cpu->opcode, &instr);
+    instr.handler(cpu, &instr);
+}
+
+void cpu_decode_instr(uint32_t opcode, cpu_instr* instr)
+{
+    instr->handler = cpu_execute_unknown;
+    instr->opcode = opcode;
+    instr->rs = (opcode >> 21) & 0x1F;
+    instr->rt = (opcode >> 16) & 0x1F;
+    instr->rd = (opcode >> 11) & 0x1F;
+    instr->shamt = (opcode >> 6) & 0x1F;
+    instr->imm = opcode & 0xFFFF;
+    instr->target = opcode & 0x3FFFFFF;
+    instr->flags = 0;
+
+    switch((opcode & 0xFC000000) >> 26)
     {
         case (0b000000):
         {
-            switch(cpu->opcode & 0x3F)
+            switch(opcode & 0x3F)
             {
-                case 0b100000: cpu_execute_add(cpu); break;
-                case 0b100001: cpu_execute_addu(cpu); break;
-                case 0b100100: cpu_execute_and(cpu); break;
-                case 0b001101: cpu_execute_break(cpu); break;
-                case 0b011010: cpu_execute_div(cpu); break;
-                case 0b011011: cpu_execute_divu(cpu); break;
-                case 0b001001: cpu_execute_jalr(cpu); break;
-                case 0b001000: cpu_execute_jr(cpu); break;
-                case 0b010000: cpu_execute_mfhi(cpu); break;
-                case 0b010010: cpu_execute_mflo(cpu); break;
-                case 0b010001: cpu_execute_mthi(cpu); break;
-                case 0b010011: cpu_execute_mtlo(cpu); break;
-                case 0b011000: cpu_execute_mult(cpu); break;
-                case 0b011001: cpu_execute_multu(cpu); break;
-                case 0b100111: cpu_execute_nor(cpu); break;
-                case 0b100101: cpu_execute_or(cpu); break;
-                case 0b000000: cpu_execute_sll(cpu); break;
-                case 0b000100: cpu_execute_sllv(cpu); break;
-                case 0b101010: cpu_execute_slt(cpu); break;
-                case 0b101011: cpu_execute_sltu(cpu); break;
-                case 0b000011: cpu_execute_sra(cpu); break;
-                case 0b000111: cpu_execute_srav(cpu); break;
-                case 0b000010: cpu_execute_srl(cpu); break;
-                case 0b000110: cpu_execute_srlv(cpu); break;
-                case 0b100010: cpu_execute_sub(cpu); break;
-                case 0b100011: cpu_execute_subu(cpu); break;
-                case 0b001100: cpu_execute_syscall(cpu); break;
-                case 0b100110: cpu_execute_xor(cpu); break;
+                case 0b100000: instr->handler = cpu_execute_add; break;
+                case 0b100001: instr->handler = cpu_execute_addu; break;
+                case 0b100100: instr->handler = cpu_execute_and; break;
+                case 0b001101: instr->handler = cpu_execute_break; break;
+                case 0b011010: instr->handler = cpu_execute_div; break;
+                case 0b011011: instr->handler = cpu_execute_divu; break;
+                case 0b001001: instr->handler = cpu_execute_jalr; break;
+                case 0b001000: instr->handler = cpu_execute_jr; break;
+                case 0b010000: instr->handler = cpu_execute_mfhi; break;
+                case 0b010010: instr->handler = cpu_execute_mflo; break;
+                case 0b010001: instr->handler = cpu_execute_mthi; break;
+                case 0b010011: instr->handler = cpu_execute_mtlo; break;
+                case 0b011000: instr->handler = cpu_execute_mult; break;
+                case 0b011001: instr->handler = cpu_execute_multu; break;
+                case 0b100111: instr->handler = cpu_execute_nor; break;
+                case 0b100101: instr->handler = cpu_execute_or; break;
+                case 0b000000: instr->handler = cpu_execute_sll; break;
+                case 0b000100: instr->handler = cpu_execute_sllv; break;
+                case 0b101010: instr->handler = cpu_execute_slt; break;
+                case 0b101011: instr->handler = cpu_execute_sltu; break;
+                case 0b000011: instr->handler = cpu_execute_sra; break;
+                case 0b000111: instr->handler = cpu_execute_srav; break;
+                case 0b000010: instr->handler = cpu_execute_srl; break;
+                case 0b000110: instr->handler = cpu_execute_srlv; break;
+                case 0b100010: instr->handler = cpu_execute_sub; break;
+                case 0b100011: instr->handler = cpu_execute_subu; break;
+                case 0b001100: instr->handler = cpu_execute_syscall; break;
+                case 0b100110: instr->handler = cpu_execute_xor; break;
             }
             break;
         }
 
-        case (0b001000): cpu_execute_addi(cpu); break;
-        case (0b001001): cpu_execute_addiu(cpu); break;
-        case (0b001100): cpu_execute_andi(cpu); break;
-        case (0b000100): cpu_execute_beq(cpu); break;
-        case (0b000111): cpu_execute_bgtz(cpu); break;
-        case (0b000110): cpu_execute_blez(cpu); break;
-        case (0b000101): cpu_execute_bne(cpu); break;
-        case (0b000010): cpu_execute_jump(cpu); break;
-        case (0b000011): cpu_execute_jal(cpu); break;
-        case (0b100000): cpu_execute_lb(cpu); break;
-        case (0b100100): cpu_execute_lbu(cpu); break;
-        case (0b100001): cpu_execute_lh(cpu); break;
-        case (0b100101): cpu_execute_lhu(cpu); break;
-        case (0b001111): cpu_execute_lui(cpu); break;
-        case (0b100011): cpu_execute_lw(cpu); break;
-        case (0b100010): cpu_execute_lwl(cpu); break;
-        case (0b100110): cpu_execute_lwr(cpu); break;
-        case (0b001101): cpu_execute_ori(cpu); break;
-        case (0b101000): cpu_execute_sb(cpu); break;
-        case (0b101001): cpu_execute_sh(cpu); break;
-        case (0b001010): cpu_execute_slti(cpu); break;
-        case (0b001011): cpu_execute_sltiu(cpu); break;
-        case (0b101011): cpu_execute_sw(cpu); break;
-        case (0b101010): cpu_execute_swl(cpu); break;
-        case (0b101110): cpu_execute_swr(cpu); break;
-        case (0b001110): cpu_execute_xori(cpu); break;
+        case (0b001000): instr->handler = cpu_execute_addi; break;
+        case (0b001001): instr->handler = cpu_execute_addiu; break;
+        case (0b001100): instr->handler = cpu_execute_andi; break;
+        case (0b000100): instr->handler = cpu_execute_beq; break;
+        case (0b000111): instr->handler = cpu_execute_bgtz; break;
+        case (0b000110): instr->handler = cpu_execute_blez; break;
+        case (0b000101): instr->handler = cpu_execute_bne; break;
+        case (0b000010): instr->handler = cpu_execute_jump; break;
+        case (0b000011): instr->handler = cpu_execute_jal; break;
+        case (0b100000): instr->handler = cpu_execute_lb; break;
+        case (0b100100): instr->handler = cpu_execute_lbu; break;
+        case (0b100001): instr->handler = cpu_execute_lh; break;
+        case (0b100101): instr->handler = cpu_execute_lhu; break;
+        case (0b001111): instr->handler = cpu_execute_lui; break;
+        case (0b100011): instr->handler = cpu_execute_lw; break;
+        case (0b100010): instr->handler = cpu_execute_lwl; break;
+        case (0b100110): instr->handler = cpu_execute_lwr; break;
+        case (0b001101): instr->handler = cpu_execute_ori; break;
+        case (0b101000): instr->handler = cpu_execute_sb; break;
+        case (0b101001): instr->handler = cpu_execute_sh; break;
+        case (0b001010): instr->handler = cpu_execute_slti; break;
+        case (0b001011): instr->handler = cpu_execute_sltiu; break;
+        case (0b101011): instr->handler = cpu_execute_sw; break;
+        case (0b101010): instr->handler = cpu_execute_swl; break;
+        case (0b101110): instr->handler = cpu_execute_swr; break;
+        case (0b001110): instr->handler = cpu_execute_xori; break;
 
         case (0b000001):
         {
@@ -268,10 +499,10 @@ void cpu_execute_instr(ps1_cpu* cpu)
         
             switch(rt)
             {
-                case (0b00000): cpu_execute_bltz(cpu); break;   // BLTZ
-                case (0b00001): cpu_execute_bgez(cpu); break;   // BGEZ
-                case (0b10000): cpu_execute_bltzal(cpu); break; // BLTZAL
-                case (0b10001): cpu_execute_bgezal(cpu); break; // BGEZAL
+                case (0b00000): instr->handler = cpu_execute_bltz; break;   // BLTZ
+                case (0b00001): instr->handler = cpu_execute_bgez; break;   // BGEZ
+                case (0b10000): instr->handler = cpu_execute_bltzal; break; // BLTZAL
+                case (0b10001): instr->handler = cpu_execute_bgezal; break; // BGEZAL
             }
             break;
         }
@@ -280,20 +511,55 @@ void cpu_execute_instr(ps1_cpu* cpu)
        //COP0 instruction
        case (0b010000):
        {
-            switch((cpu->opcode >> 21) & 0x1F)
+            switch((opcode >> 21) & 0x1F)
+            {
+                case (0b00000): instr->handler = cpu_execute_mfc0; break;
+                case (0b00100): instr->handler = cpu_execute_mtc0; break;
+                case (0b10000): instr->handler = cpu_execute_rfe; break;
+            }
+            break;
+       }
+
+       //COP2 instruction, bit 25 set is a GTE command
+       case (0b010010):
+       {
+            if(opcode & (1 << 25))
+            {
+                instr->handler = cpu_execute_cop2;
+                break;
+            }
+            switch((opcode >> 21) & 0x1F)
             {
-                case (0b00000): cpu_execute_mfc0(cpu); break;
-                case (0b00100): cpu_execute_mtc0(cpu); break;
-                case (0b10000): cpu_execute_rfe(cpu); break;
+                case (0b00000): instr->handler = cpu_execute_mfc2; break;
+                case (0b00010): instr->handler = cpu_execute_cfc2; break;
+                case (0b00100): instr->handler = cpu_execute_mtc2; break;
+                case (0b00110): instr->handler = cpu_execute_ctc2; break;
             }
             break;
        }
 
+       case (0b110010): instr->handler = cpu_execute_lwc2; break;
+       case (0b111010): instr->handler = cpu_execute_swc2; break;
+
        default:
             break;
     }
 
-    //TODO: Add later COP 2,3 instructions which are required for GTE and MDEC i believe
+    if(instr->handler == cpu_execute_beq || instr->handler == cpu_execute_bne || instr->handler == cpu_execute_bgtz ||
+       instr->handler == cpu_execute_blez || instr->handler == cpu_execute_bltz || instr->handler == cpu_execute_bgez ||
+       instr->handler == cpu_execute_bltzal || instr->handler == cpu_execute_bgezal || instr->handler == cpu_execute_jump ||
+       instr->handler == cpu_execute_jal || instr->handler == cpu_execute_jr || instr->handler == cpu_execute_jalr)
+        instr->flags |= CPU_INSTR_BRANCH;
+
+    else if(instr->handler == cpu_execute_lb || instr->handler == cpu_execute_lbu || instr->handler == cpu_execute_lh ||
+            instr->handler == cpu_execute_lhu || instr->handler == cpu_execute_lw || instr->handler == cpu_execute_lwl ||
+            instr->handler == cpu_execute_lwr || instr->handler == cpu_execute_mfc2 || instr->handler == cpu_execute_cfc2)
+        instr->flags |= CPU_INSTR_LOAD;
+
+    //Instructions that can raise an exception unconditionally or change the interrupt state close the block
+    else if(instr->handler == cpu_execute_mtc0 || instr->handler == cpu_execute_rfe || instr->handler == cpu_execute_syscall ||
+            instr->handler == cpu_execute_break)
+        instr->flags |= CPU_INSTR_END_BLOCK;
 }
 
 void cpu_handle_exception(ps1_cpu* cpu, EXCEPTION exception)
@@ -316,7 +582,7 @@ void cpu_handle_exception(ps1_cpu* cpu, EXCEPTION exception)
     //log_trace("EXCEPTION");
 }
 
-void cpu_execute_add(ps1_cpu* cpu)
+void cpu_execute_add(ps1_cpu* cpu, const cpu_instr* instr)
 {
     int32_t value1 = cpu->r[RS];
     int32_t value2 = cpu->r[RT];
@@ -331,7 +597,7 @@ void cpu_execute_add(ps1_cpu* cpu)
     //LOG(ADD, cpu);
 }
 
-void cpu_execute_addi(ps1_cpu* cpu)
+void cpu_execute_addi(ps1_cpu* cpu, const cpu_instr* instr)
 {
     int32_t imm = (int32_t)(int16_t)IMM16BITS;
     int32_t rs = cpu->r[RS];
@@ -345,33 +611,33 @@ void cpu_execute_addi(ps1_cpu* cpu)
     //LOG(ADDI, cpu);
 }
 
-void cpu_execute_addiu(ps1_cpu* cpu)
+void cpu_execute_addiu(ps1_cpu* cpu, const cpu_instr* instr)
 {   
     uint32_t imm = (int32_t)(int16_t)IMM16BITS;
     cpu->r[RT] = cpu->r[RS] + imm;
     //LOG(ADDIU, cpu);
 }
 
-void cpu_execute_addu(ps1_cpu* cpu)
+void cpu_execute_addu(ps1_cpu* cpu, const cpu_instr* instr)
 {
 
     cpu->r[RD] = cpu->r[RS] + cpu->r[RT];
     //LOG(ADDU, cpu);
 }
 
-void cpu_execute_and(ps1_cpu* cpu)
+void cpu_execute_and(ps1_cpu* cpu, const cpu_instr* instr)
 {
     cpu->r[RD] = cpu->r[RS] & cpu->r[RT];
     //LOG(AND, cpu);
 }
 
-void cpu_execute_andi(ps1_cpu* cpu)
+void cpu_execute_andi(ps1_cpu* cpu, const cpu_instr* instr)
 {
     cpu->r[RT] = cpu->r[RS] & (uint32_t)IMM16BITS;
     //LOG(ANDI, cpu);
 }
 
-void cpu_execute_beq(ps1_cpu* cpu)
+void cpu_execute_beq(ps1_cpu* cpu, const cpu_instr* instr)
 {
     uint32_t offset = ((int32_t)(int16_t)OFFSET16BITS) << 2; // offset, shifted left two bits and sign-extended.
     uint32_t target_address = offset + (cpu->pc + 4);
@@ -383,13 +649,13 @@ void cpu_execute_beq(ps1_cpu* cpu)
     //LOG(BEQ, cpu);
 }
 
-void cpu_execute_break(ps1_cpu* cpu)
+void cpu_execute_break(ps1_cpu* cpu, const cpu_instr* instr)
 {
     cpu_handle_exception(cpu, BREAK);
     //LOG(BREAK, cpu);
 }
 
-void cpu_execute_div(ps1_cpu* cpu)
+void cpu_execute_div(ps1_cpu* cpu, const cpu_instr* instr)
 {
     int32_t rs = (int32_t)cpu->r[RS];
     int32_t rt = (int32_t)cpu->r[RT];
@@ -413,7 +679,7 @@ void cpu_execute_div(ps1_cpu* cpu)
     //LOG(DIV, cpu);
 }
 
-void cpu_execute_divu(ps1_cpu* cpu)
+void cpu_execute_divu(ps1_cpu* cpu, const cpu_instr* instr)
 {  
     if(!cpu->r[RT])
     {
@@ -428,7 +694,7 @@ void cpu_execute_divu(ps1_cpu* cpu)
     //LOG(DIVU, cpu);
 }
 
-void cpu_execute_jalr(ps1_cpu* cpu)
+void cpu_execute_jalr(ps1_cpu* cpu, const cpu_instr* instr)
 {
     uint32_t target_address = cpu->r[RS];
     cpu->branch_address = target_address;
@@ -437,7 +703,7 @@ void cpu_execute_jalr(ps1_cpu* cpu)
     //LOG(JALR, cpu);
 }
 
-void cpu_execute_jr(ps1_cpu* cpu)
+void cpu_execute_jr(ps1_cpu* cpu, const cpu_instr* instr)
 {
     uint32_t target_address = cpu->r[RS];
     if((target_address & 0x3) != 0)
@@ -449,31 +715,31 @@ void cpu_execute_jr(ps1_cpu* cpu)
     //LOG(JR, cpu);
 }
 
-void cpu_execute_mfhi(ps1_cpu* cpu)
+void cpu_execute_mfhi(ps1_cpu* cpu, const cpu_instr* instr)
 {
     cpu->r[RD] = cpu->hi;
     //LOG(MFHI, cpu);
 }
 
-void cpu_execute_mflo(ps1_cpu* cpu)
+void cpu_execute_mflo(ps1_cpu* cpu, const cpu_instr* instr)
 {
     cpu->r[RD] = cpu->lo;
     //LOG(MFLO, cpu);
 }
 
-void cpu_execute_mthi(ps1_cpu* cpu)
+void cpu_execute_mthi(ps1_cpu* cpu, const cpu_instr* instr)
 {
     cpu->hi = cpu->r[RS];
     //LOG(MTHI, cpu);
 }
 
-void cpu_execute_mtlo(ps1_cpu* cpu)
+void cpu_execute_mtlo(ps1_cpu* cpu, const cpu_instr* instr)
 { 
     cpu->lo = cpu->r[RS];
     //LOG(MTLO, cpu);
 }
 
-void cpu_execute_mult(ps1_cpu* cpu)
+void cpu_execute_mult(ps1_cpu* cpu, const cpu_instr* instr)
 { 
     int64_t result = (int64_t)(int32_t)cpu->r[RS] * (int64_t)(int32_t)cpu->r[RT];
     cpu->lo = result & 0xFFFFFFFF;
@@ -481,7 +747,7 @@ void cpu_execute_mult(ps1_cpu* cpu)
     //LOG(MULT, cpu);
 }
 
-void cpu_execute_multu(ps1_cpu* cpu)
+void cpu_execute_multu(ps1_cpu* cpu, const cpu_instr* instr)
 {
     uint64_t result = (uint64_t)cpu->r[RS] * (uint64_t)cpu->r[RT];
     cpu->lo = result & 0xFFFFFFFF;
@@ -489,67 +755,67 @@ void cpu_execute_multu(ps1_cpu* cpu)
     //LOG(MULTU, cpu);
 }
 
-void cpu_execute_nor(ps1_cpu* cpu)
+void cpu_execute_nor(ps1_cpu* cpu, const cpu_instr* instr)
 {
     cpu->r[RD] = ~(cpu->r[RS] | cpu->r[RT]);
     //LOG(NOR, cpu);
 }
 
-void cpu_execute_or(ps1_cpu* cpu)
+void cpu_execute_or(ps1_cpu* cpu, const cpu_instr* instr)
 {
     cpu->r[RD] = cpu->r[RS] | cpu->r[RT];
     //LOG(OR, cpu);
 }
 
-void cpu_execute_sll(ps1_cpu* cpu)
+void cpu_execute_sll(ps1_cpu* cpu, const cpu_instr* instr)
 {
     cpu->r[RD] = cpu->r[RT] << IMM5BITS;
     //LOG(SLL, cpu);
 }
 
-void cpu_execute_sllv(ps1_cpu* cpu)
+void cpu_execute_sllv(ps1_cpu* cpu, const cpu_instr* instr)
 {
     cpu->r[RD] = cpu->r[RT] << (cpu->r[RS] & 0x1F);
     //LOG(SLLV, cpu);
 }
 
-void cpu_execute_slt(ps1_cpu* cpu)
+void cpu_execute_slt(ps1_cpu* cpu, const cpu_instr* instr)
 {
     cpu->r[RD] = ((int32_t)cpu->r[RS] < (int32_t)cpu->r[RT]) ? 1 : 0;
     //LOG(SLT, cpu);
 }
 
-void cpu_execute_sltu(ps1_cpu* cpu)
+void cpu_execute_sltu(ps1_cpu* cpu, const cpu_instr* instr)
 {
     cpu->r[RD] = (cpu->r[RS] < cpu->r[RT]) ? 1 : 0;
     //LOG(SLTU, cpu);
 }
 
-void cpu_execute_sra(ps1_cpu* cpu)
+void cpu_execute_sra(ps1_cpu* cpu, const cpu_instr* instr)
 {
-    cpu->r[RD] = ((int32_t)cpu->r[RT] >> ((cpu->opcode >> 6) & 0x1F));
+    cpu->r[RD] = ((int32_t)cpu->r[RT] >> IMM5BITS);
     //LOG(SRA, cpu);
 }
 
-void cpu_execute_srav(ps1_cpu* cpu)
+void cpu_execute_srav(ps1_cpu* cpu, const cpu_instr* instr)
 {
     cpu->r[RD] = ((int32_t)cpu->r[RT] >> (cpu->r[RS] & 0x1F));
     //LOG(SRAV, cpu);
 }
 
-void cpu_execute_srl(ps1_cpu* cpu)
+void cpu_execute_srl(ps1_cpu* cpu, const cpu_instr* instr)
 {
-    cpu->r[RD] = (cpu->r[RT] >> ((cpu->opcode >> 6) & 0x1F)); 
+    cpu->r[RD] = (cpu->r[RT] >> IMM5BITS); 
     //LOG(SRL, cpu);
 }
 
-void cpu_execute_srlv(ps1_cpu* cpu)
+void cpu_execute_srlv(ps1_cpu* cpu, const cpu_instr* instr)
 {
     cpu->r[RD] = (cpu->r[RT] >> (cpu->r[RS] & 0x1F));
     //LOG(SRLV, cpu);
 }
 
-void cpu_execute_sub(ps1_cpu* cpu)
+void cpu_execute_sub(ps1_cpu* cpu, const cpu_instr* instr)
 {
     int32_t value1 = cpu->r[RS];
     int32_t value2 = cpu->r[RT];
@@ -564,25 +830,25 @@ void cpu_execute_sub(ps1_cpu* cpu)
 
 }
 
-void cpu_execute_subu(ps1_cpu* cpu)
+void cpu_execute_subu(ps1_cpu* cpu, const cpu_instr* instr)
 {
     cpu->r[RD] = cpu->r[RS] - cpu->r[RT];
     //LOG(SUBU, cpu);
 }
 
-void cpu_execute_syscall(ps1_cpu* cpu)
+void cpu_execute_syscall(ps1_cpu* cpu, const cpu_instr* instr)
 {
     cpu_handle_exception(cpu, SYSCALL);
     //LOG(INST_SYSCALL, cpu);
 }
 
-void cpu_execute_xor(ps1_cpu* cpu)
+void cpu_execute_xor(ps1_cpu* cpu, const cpu_instr* instr)
 {
     cpu->r[RD] = cpu->r[RS] ^ cpu->r[RT];
     //LOG(XOR, cpu);
 }
 
-void cpu_execute_bgtz(ps1_cpu* cpu)
+void cpu_execute_bgtz(ps1_cpu* cpu, const cpu_instr* instr)
 {
     int32_t offset = ((int16_t)OFFSET16BITS) << 2; // offset, shifted left two bits and sign-extended.
     uint32_t target_address = offset + (cpu->pc + 4);
@@ -594,7 +860,7 @@ void cpu_execute_bgtz(ps1_cpu* cpu)
     //LOG(BGTZ, cpu);
 }
 
-void cpu_execute_blez(ps1_cpu* cpu)
+void cpu_execute_blez(ps1_cpu* cpu, const cpu_instr* instr)
 {
     int32_t offset = ((int16_t)OFFSET16BITS) << 2; // offset, shifted left two bits and sign-extended.
     uint32_t target_address = offset + (cpu->pc + 4);
@@ -606,7 +872,7 @@ void cpu_execute_blez(ps1_cpu* cpu)
     //LOG(BLEZ, cpu);
 }
 
-void cpu_execute_bne(ps1_cpu* cpu)
+void cpu_execute_bne(ps1_cpu* cpu, const cpu_instr* instr)
 {
     int32_t offset = ((int16_t)OFFSET16BITS) << 2; // offset, shifted left two bits and sign-extended.
     uint32_t target_address = offset + (cpu->pc + 4);
@@ -618,14 +884,14 @@ void cpu_execute_bne(ps1_cpu* cpu)
     //LOG(BNE, cpu);
 }
 
-void cpu_execute_jump(ps1_cpu* cpu)
+void cpu_execute_jump(ps1_cpu* cpu, const cpu_instr* instr)
 {
     cpu->branch_address = (MASK26BITS << 2) | ((cpu->pc + 4) & 0xF0000000);
     cpu->branch = true;
     //LOG(JUMP, cpu);
 }
 
-void cpu_execute_jal(ps1_cpu* cpu)
+void cpu_execute_jal(ps1_cpu* cpu, const cpu_instr* instr)
 { 
     cpu->branch_address = (MASK26BITS << 2) | ((cpu->pc + 4) & 0xF0000000);
     cpu->branch = true;
@@ -633,7 +899,7 @@ void cpu_execute_jal(ps1_cpu* cpu)
     //LOG(JAL, cpu);
 }
 
-void cpu_execute_lb(ps1_cpu* cpu)
+void cpu_execute_lb(ps1_cpu* cpu, const cpu_instr* instr)
 {
     int32_t offset = (int16_t)OFFSET16BITS;
     cpu->virtual_address = offset + cpu->r[BASE];
@@ -642,7 +908,7 @@ void cpu_execute_lb(ps1_cpu* cpu)
     //LOG(LB, cpu);
 }   
 
-void cpu_execute_lbu(ps1_cpu* cpu)
+void cpu_execute_lbu(ps1_cpu* cpu, const cpu_instr* instr)
 {
     int32_t offset = (int16_t)OFFSET16BITS;
     cpu->virtual_address = offset + cpu->r[BASE];
@@ -651,7 +917,7 @@ void cpu_execute_lbu(ps1_cpu* cpu)
     //LOG(LBU, cpu);
 }
 
-void cpu_execute_lh(ps1_cpu* cpu)
+void cpu_execute_lh(ps1_cpu* cpu, const cpu_instr* instr)
 {
     int32_t offset = (int16_t)OFFSET16BITS;
     cpu->virtual_address = offset + cpu->r[BASE];
@@ -665,7 +931,7 @@ void cpu_execute_lh(ps1_cpu* cpu)
     //LOG(LH, cpu);
 }
 
-void cpu_execute_lhu(ps1_cpu* cpu)
+void cpu_execute_lhu(ps1_cpu* cpu, const cpu_instr* instr)
 {
     int32_t offset = (int16_t)OFFSET16BITS;
     cpu->virtual_address = offset + cpu->r[BASE];
@@ -679,14 +945,14 @@ void cpu_execute_lhu(ps1_cpu* cpu)
     //LOG(LHU, cpu);
 }
 
-void cpu_execute_lui(ps1_cpu* cpu)
+void cpu_execute_lui(ps1_cpu* cpu, const cpu_instr* instr)
 {
     
     cpu->r[RT] = (uint32_t)IMM16BITS << 16;
     //LOG(LUI, cpu);
 }
 
-void cpu_execute_lw(ps1_cpu* cpu)
+void cpu_execute_lw(ps1_cpu* cpu, const cpu_instr* instr)
 {
     
     int32_t offset = (int16_t)OFFSET16BITS;
@@ -701,7 +967,7 @@ void cpu_execute_lw(ps1_cpu* cpu)
     //LOG(LW, cpu);
 }
 
-void cpu_execute_lwl(ps1_cpu* cpu)
+void cpu_execute_lwl(ps1_cpu* cpu, const cpu_instr* instr)
 {
     int32_t offset = (int16_t)OFFSET16BITS;
     uint32_t base = 0;
@@ -734,7 +1000,7 @@ void cpu_execute_lwl(ps1_cpu* cpu)
     //LOG(LWL, cpu);
 }
 
-void cpu_execute_lwr(ps1_cpu* cpu)
+void cpu_execute_lwr(ps1_cpu* cpu, const cpu_instr* instr)
 {
     int32_t offset = (int16_t)OFFSET16BITS;
     uint32_t base = 0;
@@ -767,20 +1033,20 @@ void cpu_execute_lwr(ps1_cpu* cpu)
     //LOG(LWR, cpu);
 }
 
-void cpu_execute_ori(ps1_cpu* cpu)
+void cpu_execute_ori(ps1_cpu* cpu, const cpu_instr* instr)
 {
     cpu->r[RT] = ((uint32_t)IMM16BITS | cpu->r[RS]);
     //LOG(ORI, cpu);
 }
 
-void cpu_execute_sb(ps1_cpu* cpu)
+void cpu_execute_sb(ps1_cpu* cpu, const cpu_instr* instr)
 {
     cpu->virtual_address = (int32_t)(int16_t)IMM16BITS + cpu->r[BASE];
     ps1_bus_store_byte(cpu->bus, cpu->virtual_address, (cpu->r[RT] & 0xFF));
     //LOG(SB, cpu);
 }
 
-void cpu_execute_sh(ps1_cpu* cpu)
+void cpu_execute_sh(ps1_cpu* cpu, const cpu_instr* instr)
 {
     cpu->virtual_address = (int32_t)(int16_t)IMM16BITS + cpu->r[BASE];
 
@@ -791,20 +1057,20 @@ void cpu_execute_sh(ps1_cpu* cpu)
     //LOG(SH, cpu);
 }
 
-void cpu_execute_slti(ps1_cpu* cpu)
+void cpu_execute_slti(ps1_cpu* cpu, const cpu_instr* instr)
 {
     cpu->r[RT] = ((int32_t)cpu->r[RS] < ((int32_t)(int16_t)IMM16BITS)) ? 1 : 0;
     //LOG(SLTI, cpu);
 }
 
 
-void cpu_execute_sltiu(ps1_cpu* cpu)
+void cpu_execute_sltiu(ps1_cpu* cpu, const cpu_instr* instr)
 {
     cpu->r[RT] = (cpu->r[RS] < ((int32_t)(int16_t)IMM16BITS)) ? 1 : 0;
     //LOG(SLTIU, cpu);
 }
 
-void cpu_execute_sw(ps1_cpu* cpu)
+void cpu_execute_sw(ps1_cpu* cpu, const cpu_instr* instr)
 {
     cpu->virtual_address = (int32_t)(int16_t)IMM16BITS + cpu->r[BASE];
     if(cpu->virtual_address & 0x3)
@@ -814,7 +1080,7 @@ void cpu_execute_sw(ps1_cpu* cpu)
     //LOG(SW, cpu);
 }
 
-void cpu_execute_swl(ps1_cpu* cpu)
+void cpu_execute_swl(ps1_cpu* cpu, const cpu_instr* instr)
 {
     int32_t offset = (int16_t)OFFSET16BITS;
     cpu->virtual_address = offset + cpu->r[BASE];
@@ -826,7 +1092,7 @@ void cpu_execute_swl(ps1_cpu* cpu)
     //LOG(SWL, cpu);
 }
 
-void cpu_execute_swr(ps1_cpu* cpu)
+void cpu_execute_swr(ps1_cpu* cpu, const cpu_instr* instr)
 {
     int32_t offset = (int16_t)OFFSET16BITS;
     cpu->virtual_address = offset + cpu->r[BASE];
@@ -838,13 +1104,13 @@ void cpu_execute_swr(ps1_cpu* cpu)
     //LOG(SWR, cpu);
 }
 
-void cpu_execute_xori(ps1_cpu* cpu)
+void cpu_execute_xori(ps1_cpu* cpu, const cpu_instr* instr)
 {
     cpu->r[RT] = cpu->r[RS] ^ IMM16BITS;
     //LOG(XORI, cpu);
 }
 
-void cpu_execute_bgez(ps1_cpu* cpu)
+void cpu_execute_bgez(ps1_cpu* cpu, const cpu_instr* instr)
 {
     int32_t offset = ((int16_t)OFFSET16BITS) << 2; // offset, shifted left two bits and sign-extended.
     uint32_t target_address = offset + (cpu->pc + 4);
@@ -856,7 +1122,7 @@ void cpu_execute_bgez(ps1_cpu* cpu)
     //LOG(BGEZ, cpu);
 }
 
-void cpu_execute_bgezal(ps1_cpu* cpu)
+void cpu_execute_bgezal(ps1_cpu* cpu, const cpu_instr* instr)
 {
     int32_t offset = ((int16_t)OFFSET16BITS) << 2; // offset, shifted left two bits and sign-extended.
     uint32_t target_address = offset + (cpu->pc + 4);
@@ -869,7 +1135,7 @@ void cpu_execute_bgezal(ps1_cpu* cpu)
     //LOG(BGEZAL, cpu);
 }
 
-void cpu_execute_bltz(ps1_cpu* cpu)
+void cpu_execute_bltz(ps1_cpu* cpu, const cpu_instr* instr)
 {
     int32_t offset = ((int16_t)OFFSET16BITS) << 2; // offset, shifted left two bits and sign-extended.
     uint32_t target_address = offset + (cpu->pc + 4);
@@ -881,7 +1147,7 @@ void cpu_execute_bltz(ps1_cpu* cpu)
     //LOG(BLTZ, cpu);
 }
 
-void cpu_execute_bltzal(ps1_cpu* cpu)
+void cpu_execute_bltzal(ps1_cpu* cpu, const cpu_instr* instr)
 {
     int32_t offset = ((int16_t)OFFSET16BITS) << 2; // offset, shifted left two bits and sign-extended.
     uint32_t target_address = offset + (cpu->pc + 4);
@@ -895,21 +1161,99 @@ void cpu_execute_bltzal(ps1_cpu* cpu)
     //LOG(BLTZAL, cpu);
 }
 
-void cpu_execute_mfc0(ps1_cpu* cpu)
+void cpu_execute_mfc0(ps1_cpu* cpu, const cpu_instr* instr)
 {
     cpu->r[RT] = cpu->cop0[RD];
     //LOG(MFC0, cpu);
 }
 
-void cpu_execute_mtc0(ps1_cpu* cpu)
+void cpu_execute_mtc0(ps1_cpu* cpu, const cpu_instr* instr)
 {
-    cpu->cop0[RD] = cpu->r[RT] & cpu_cop0_writemask[RD];
+    //Read only bits keep their value, CAUSE bit 10 belongs to the interrupt controller
+    cpu->cop0[RD] = (cpu->cop0[RD] & ~cpu_cop0_writemask[RD]) | (cpu->r[RT] & cpu_cop0_writemask[RD]);
+    if(RD == COP0_SR)
+        ps1_bus_set_cache_isolation(cpu->bus, cpu->cop0[COP0_SR] & 0x10000);
     //LOG(MTC0, cpu);
 }
 
-void cpu_execute_rfe(ps1_cpu* cpu)
+void cpu_execute_rfe(ps1_cpu* cpu, const cpu_instr* instr)
 {
     uint32_t mode = cpu->cop0[COP0_SR] & 0x3F;
     cpu->cop0[COP0_SR] &= 0xFFFFFFF0;
     cpu->cop0[COP0_SR] |= mode >> 2;
-}
\ No newline at end of file
+}
+
+void cpu_execute_unknown(ps1_cpu* cpu, const cpu_instr* instr)
+{
+    //Unimplemented opcodes are ignored
+}
+
+//Coprocessor 2 has to be enabled in SR, otherwise its instructions raise an exception
+static bool cpu_cop2_usable(ps1_cpu* cpu)
+{
+    if(cpu->cop0[COP0_SR] & 0x40000000)
+        return true;
+    cpu_handle_exception(cpu, COPROCESSOR_UNUSABLE);
+    cpu->cop0[COP0_CAUSE] = (cpu->cop0[COP0_CAUSE] & ~0x30000000) | (2 << 28);
+    return false;
+}
+
+void cpu_execute_mfc2(ps1_cpu* cpu, const cpu_instr* instr)
+{
+    if(cpu_cop2_usable(cpu))
+    {
+        uint32_t value = ps1_gte_read_data(&cpu->gte, RD);
+        UPDATE_DELAY_LOAD(RT, value);
+    }
+}
+
+void cpu_execute_cfc2(ps1_cpu* cpu, const cpu_instr* instr)
+{
+    if(cpu_cop2_usable(cpu))
+    {
+        uint32_t value = ps1_gte_read_control(&cpu->gte, RD);
+        UPDATE_DELAY_LOAD(RT, value);
+    }
+}
+
+void cpu_execute_mtc2(ps1_cpu* cpu, const cpu_instr* instr)
+{
+    if(cpu_cop2_usable(cpu))
+        ps1_gte_write_data(&cpu->gte, RD, cpu->r[RT]);
+}
+
+void cpu_execute_ctc2(ps1_cpu* cpu, const cpu_instr* instr)
+{
+    if(cpu_cop2_usable(cpu))
+        ps1_gte_write_control(&cpu->gte, RD, cpu->r[RT]);
+}
+
+void cpu_execute_cop2(ps1_cpu* cpu, const cpu_instr* instr)
+{
+    if(cpu_cop2_usable(cpu))
+        ps1_gte_execute(&cpu->gte, instr->opcode & 0x1FFFFFF);
+}
+
+void cpu_execute_lwc2(ps1_cpu* cpu, const cpu_instr* instr)
+{
+    if(!cpu_cop2_usable(cpu))
+        return;
+
+    cpu->virtual_address = (int32_t)(int16_t)OFFSET16BITS + cpu->r[BASE];
+    if(cpu->virtual_address & 0x3)
+        cpu_handle_exception(cpu, ADEL);
+    else
+        ps1_gte_write_data(&cpu->gte, RT, ps1_bus_read_word(cpu->bus, cpu->virtual_address));
+}
+
+void cpu_execute_swc2(ps1_cpu* cpu, const cpu_instr* instr)
+{
+    if(!cpu_cop2_usable(cpu))
+        return;
+
+    cpu->virtual_address = (int32_t)(int16_t)OFFSET16BITS + cpu->r[BASE];
+    if(cpu->virtual_address & 0x3)
+        cpu_handle_exception(cpu, ADES);
+    else
+        ps1_bus_store_word(cpu->bus, cpu->virtual_address, ps1_gte_read_data(&cpu->gte, RT));
+}
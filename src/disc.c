@@ -0,0 +1,329 @@
+#include <ctype.h>
+#include "disc.h"
+#include "disc_packed.h"
+
+#ifdef DISC_MMAP
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+static const uint8_t disc_zero_sector[DISC_SECTOR_SIZE];
+
+bool disc_map_file(const char* path, disc_file* file)
+{
+#ifdef DISC_MMAP
+    int fd = open(path, O_RDONLY);
+    if(fd < 0)
+        return false;
+
+    struct stat info;
+    if(fstat(fd, &info) != 0 || info.st_size == 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    void* data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED)
+        return false;
+
+    //Sectors are mostly read in order
+    madvise(data, info.st_size, MADV_SEQUENTIAL);
+    file->data = data;
+    file->size = info.st_size;
+    file->mapped = true;
+    return true;
+#else
+    FILE* handle = fopen(path, "rb");
+    if(handle == NULL)
+        return false;
+
+    fseek(handle, 0, SEEK_END);
+    long size = ftell(handle);
+    fseek(handle, 0, SEEK_SET);
+    uint8_t* data = size > 0 ? (uint8_t*)malloc(size) : NULL;
+    if(data == NULL || fread(data, 1, size, handle) != (size_t)size)
+    {
+        free (data);
+        fclose(handle);
+        return false;
+    }
+    fclose(handle);
+
+    file->data = data;
+    file->size = size;
+    file->mapped = false;
+    return true;
+#endif
+}
+
+void disc_unmap_file(disc_file* file)
+{
+    if(file->data == NULL)
+        return;
+#ifdef DISC_MMAP
+    if(file->mapped)
+        munmap((void*)file->data, file->size);
+    else
+#endif
+        free ((void*)file->data);
+    file->data = NULL;
+}
+
+//Index 00 of a track and the PREGAP before it count as the track, reading them goes back from index 01
+int32_t ps1_disc_find_track(const ps1_disc* disc, uint32_t lba)
+{
+    int32_t found = -1;
+    for(uint32_t i = 0; i < disc->track_count; i++)
+    {
+        if(disc->tracks[i].start - disc->tracks[i].pregap > lba)
+            break;
+        found = i;
+    }
+    return found;
+}
+
+static const uint8_t* disc_raw_read(ps1_disc* disc, uint32_t lba, uint8_t* scratch)
+{
+    if(lba >= disc->sectors)
+        return NULL;
+
+    int32_t index = ps1_disc_find_track(disc, lba);
+    if(index < 0 || disc->tracks[index].file < 0)
+        return disc_zero_sector;
+
+    const disc_track* track = &disc->tracks[index];
+    if(lba < track->start - track->pregap + track->silence)
+        return disc_zero_sector;
+    const disc_file* file = &disc->files[track->file];
+    int64_t offset = (int64_t)track->file_offset + ((int64_t)lba - track->start) * DISC_SECTOR_SIZE;
+    if(offset < 0 || offset + DISC_SECTOR_SIZE > (int64_t)file->size)
+        return disc_zero_sector;
+    return file->data + offset;
+}
+
+static void disc_raw_close(ps1_disc* disc)
+{
+    for(uint32_t i = 0; i < disc->file_count; i++)
+        disc_unmap_file(&disc->files[i]);
+}
+
+//Sectors are served straight from the mapped track files
+static const disc_backend disc_raw_backend = {disc_raw_read, disc_raw_close};
+
+static bool disc_parse_msf(const char* text, uint32_t* frames)
+{
+    uint32_t minute, second, frame;
+    if(sscanf(text, "%u:%u:%u", &minute, &second, &frame) != 3)
+        return false;
+    *frames = (minute * 60 + second) * DISC_SECTORS_PER_SECOND + frame;
+    return true;
+}
+
+//Track lengths and the lead-out, once every track and file is known
+static void disc_finish_layout(ps1_disc* disc)
+{
+    for(uint32_t i = 0; i < disc->track_count; i++)
+    {
+        disc_track* track = &disc->tracks[i];
+        uint32_t end;
+        if(i + 1 < disc->track_count && disc->tracks[i + 1].file == track->file)
+            end = disc->tracks[i + 1].start - disc->tracks[i + 1].pregap;
+        else
+            end = track->start + (disc->files[track->file].size - track->file_offset) / DISC_SECTOR_SIZE;
+        track->length = end > track->start ? end - track->start : 0;
+        disc->sectors = track->start + track->length;
+    }
+}
+
+/*
+ FILE, TRACK, INDEX and PREGAP are all that matter for a disc image. Every file follows the previous one on the
+ disc, PREGAP sectors aren't in any file and push everything after them further.
+*/
+static bool disc_parse_cue(ps1_disc* disc, const char* path)
+{
+    FILE* cue = fopen(path, "r");
+    if(cue == NULL)
+    {
+        printf("Couldn't open %s\n", path);
+        return false;
+    }
+
+    //FILE names are relative to the cue sheet
+    char directory[1024];
+    const char* slash = strrchr(path, '/');
+    const char* backslash = strrchr(path, '\\');
+    if(backslash > slash)
+        slash = backslash;
+    size_t directory_length = slash != NULL ? (size_t)(slash - path + 1) : 0;
+    if(directory_length >= sizeof(directory))
+        directory_length = 0;
+    memcpy(directory, path, directory_length);
+    directory[directory_length] = 0;
+
+    uint32_t position = 0;   //Disc LBA where the current file begins
+    uint32_t file_shift = 0; //PREGAP sectors since then
+    uint32_t pending_pregap = 0;
+    int32_t index0 = -1;   //INDEX 00 of the current track, in frames from the start of its file
+    disc_track* track = NULL;
+    bool ok = true;
+    char line[1024];
+
+    while(ok && fgets(line, sizeof(line), cue) != NULL)
+    {
+        char* text = line;
+        while(isspace((unsigned char)*text))
+            text++;
+
+        if(!strncmp(text, "FILE", 4))
+        {
+            char* open_quote = strchr(text, '"');
+            char* close_quote = open_quote != NULL ? strchr(open_quote + 1, '"') : NULL;
+            if(close_quote == NULL || disc->file_count >= DISC_MAX_FILES)
+            {
+                ok = false;
+                break;
+            }
+            *close_quote = 0;
+
+            if(disc->file_count > 0)
+                position += disc->files[disc->file_count - 1].size / DISC_SECTOR_SIZE + file_shift;
+            file_shift = 0;
+
+            char file_path[2048];
+            snprintf(file_path, sizeof(file_path), "%s%s", directory, open_quote + 1);
+            if(!disc_map_file(file_path, &disc->files[disc->file_count]))
+            {
+                printf("Couldn't map the track file %s\n", file_path);
+                ok = false;
+                break;
+            }
+            disc->file_count++;
+        }
+        else if(!strncmp(text, "TRACK", 5))
+        {
+            uint32_t number;
+            char type[32];
+            if(sscanf(text + 5, "%u %31s", &number, type) != 2 || disc->track_count >= DISC_MAX_TRACKS || disc->file_count == 0)
+            {
+                ok = false;
+                break;
+            }
+
+            track = &disc->tracks[disc->track_count++];
+            memset(track, 0, sizeof(disc_track));
+            track->file = disc->file_count - 1;
+            track->type = !strncmp(type, "AUDIO", 5) ? DISC_TRACK_AUDIO : !strncmp(type, "MODE1", 5) ? DISC_TRACK_MODE1 : DISC_TRACK_MODE2;
+            if(strstr(type, "2352") == NULL && track->type != DISC_TRACK_AUDIO)
+            {
+                printf("Only raw 2352 byte sectors are supported, track %u is %s\n", number, type);
+                ok = false;
+            }
+            pending_pregap = 0;
+            index0 = -1;
+        }
+        else if(!strncmp(text, "PREGAP", 6) && track != NULL)
+            ok = disc_parse_msf(text + 6, &pending_pregap);
+        else if(!strncmp(text, "INDEX", 5) && track != NULL)
+        {
+            uint32_t number, frames;
+            char msf[32];
+            if(sscanf(text + 5, "%u %31s", &number, msf) != 2 || !disc_parse_msf(msf, &frames))
+            {
+                ok = false;
+                break;
+            }
+
+            if(number == 0)
+                index0 = frames;
+            else if(number == 1)
+            {
+                file_shift += pending_pregap;
+                track->start = position + file_shift + frames;
+                track->pregap = pending_pregap + (index0 >= 0 ? frames - index0 : 0);
+                track->silence = pending_pregap;
+                track->file_offset = (uint64_t)frames * DISC_SECTOR_SIZE;
+            }
+        }
+    }
+    fclose(cue);
+
+    if(ok && disc->track_count == 0)
+        ok = false;
+    if(!ok)
+    {
+        printf("Couldn't parse the cue sheet %s\n", path);
+        return false;
+    }
+
+    disc_finish_layout(disc);
+    return true;
+}
+
+//A lone .bin is one mode 2 data track
+static bool disc_open_bin(ps1_disc* disc, const char* path)
+{
+    if(!disc_map_file(path, &disc->files[0]))
+    {
+        printf("Couldn't map the disc image %s\n", path);
+        return false;
+    }
+
+    disc->file_count = 1;
+    disc->track_count = 1;
+    disc->tracks[0].type = DISC_TRACK_MODE2;
+    disc_finish_layout(disc);
+    return true;
+}
+
+static bool disc_has_extension(const char* path, const char* extension)
+{
+    size_t length = strlen(path);
+    size_t extension_length = strlen(extension);
+    if(length < extension_length)
+        return false;
+    for(size_t i = 0; i < extension_length; i++)
+    {
+        if(tolower((unsigned char)path[length - extension_length + i]) != extension[i])
+            return false;
+    }
+    return true;
+}
+
+//A .cue sheet and its BIN files, a packed .cdz image or a single raw .bin
+ps1_disc* ps1_disc_open(const char* path)
+{
+    ps1_disc* disc = (ps1_disc*)malloc(sizeof(ps1_disc));
+    memset(disc, 0, sizeof(ps1_disc));
+    disc->backend = &disc_raw_backend;
+
+    bool ok;
+    if(disc_has_extension(path, ".cue"))
+        ok = disc_parse_cue(disc, path);
+    else if(disc_has_extension(path, ".cdz"))
+        ok = disc_open_packed(disc, path);
+    else
+        ok = disc_open_bin(disc, path);
+    if(!ok)
+    {
+        ps1_disc_close(disc);
+        return NULL;
+    }
+    return disc;
+}
+
+void ps1_disc_close(ps1_disc* disc)
+{
+    if(disc == NULL)
+        return;
+    disc->backend->close(disc);
+    free (disc);
+}
+
+const uint8_t* ps1_disc_read_sector(ps1_disc* disc, uint32_t lba, uint8_t* scratch)
+{
+    return disc->backend->read(disc, lba, scratch);
+}
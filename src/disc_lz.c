@@ -0,0 +1,161 @@
+#include "disc_lz.h"
+
+#define DISC_LZ_MIN_MATCH 4
+#define DISC_LZ_MAX_OFFSET 0xFFFF
+
+static inline uint32_t disc_lz_read32(const uint8_t* data)
+{
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static inline uint32_t disc_lz_hash(uint32_t value)
+{
+    return (value * 2654435761u) >> (32 - DISC_LZ_HASH_BITS);
+}
+
+//Lengths of 15 and more go on in extra bytes of 255 and a last smaller one
+static bool disc_lz_put_length(uint8_t** output, const uint8_t* end, uint32_t length)
+{
+    while(length >= 255)
+    {
+        if(*output >= end)
+            return false;
+        *(*output)++ = 255;
+        length -= 255;
+    }
+    if(*output >= end)
+        return false;
+    *(*output)++ = length;
+    return true;
+}
+
+static bool disc_lz_put_sequence(uint8_t** output, const uint8_t* end, const uint8_t* literals, uint32_t literal_length, uint32_t offset, uint32_t match_length)
+{
+    if(*output >= end)
+        return false;
+
+    uint8_t* token = (*output)++;
+    *token = (literal_length < 15 ? literal_length : 15) << 4;
+    if(literal_length >= 15 && !disc_lz_put_length(output, end, literal_length - 15))
+        return false;
+    if(end - *output < literal_length)
+        return false;
+    memcpy(*output, literals, literal_length);
+    *output += literal_length;
+
+    //The last sequence is only literals
+    if(!match_length)
+        return true;
+
+    if(end - *output < 2)
+        return false;
+    *(*output)++ = offset;
+    *(*output)++ = offset >> 8;
+    match_length -= DISC_LZ_MIN_MATCH;
+    *token |= match_length < 15 ? match_length : 15;
+    return match_length < 15 || disc_lz_put_length(output, end, match_length - 15);
+}
+
+//Greedy, one candidate per hash. Packing runs once per image, so the ratio matters more than the speed
+uint32_t disc_lz_compress(const uint8_t* source, uint32_t size, uint8_t* destination, uint32_t capacity)
+{
+    uint32_t* table = (uint32_t*)calloc(1 << DISC_LZ_HASH_BITS, sizeof(uint32_t)); //Positions + 1, 0 is empty
+    if(table == NULL)
+        return 0;
+
+    uint8_t* output = destination;
+    const uint8_t* end = destination + capacity;
+    uint32_t anchor = 0;
+    uint32_t position = 0;
+    bool ok = true;
+
+    while(ok && position + DISC_LZ_MIN_MATCH <= size)
+    {
+        uint32_t value = disc_lz_read32(source + position);
+        uint32_t hash = disc_lz_hash(value);
+        uint32_t candidate = table[hash];
+        table[hash] = position + 1;
+
+        if(!candidate || position - (candidate - 1) > DISC_LZ_MAX_OFFSET || disc_lz_read32(source + candidate - 1) != value)
+        {
+            position++;
+            continue;
+        }
+
+        candidate--;
+        uint32_t length = DISC_LZ_MIN_MATCH;
+        while(position + length < size && source[candidate + length] == source[position + length])
+            length++;
+
+        ok = disc_lz_put_sequence(&output, end, source + anchor, position - anchor, position - candidate, length);
+        position += length;
+        anchor = position;
+    }
+
+    if(ok)
+        ok = disc_lz_put_sequence(&output, end, source + anchor, size - anchor, 0, 0);
+    free (table);
+    return ok ? output - destination : 0;
+}
+
+static bool disc_lz_get_length(const uint8_t** input, const uint8_t* end, uint32_t* length)
+{
+    uint8_t value;
+    do
+    {
+        if(*input >= end)
+            return false;
+        value = *(*input)++;
+        *length += value;
+    } while(value == 255);
+    return true;
+}
+
+bool disc_lz_decompress(const uint8_t* source, uint32_t compressed_size, uint8_t* destination, uint32_t size)
+{
+    const uint8_t* input = source;
+    const uint8_t* input_end = source + compressed_size;
+    uint8_t* output = destination;
+    uint8_t* output_end = destination + size;
+
+    while(input < input_end)
+    {
+        uint8_t token = *input++;
+        uint32_t literal_length = token >> 4;
+        if(literal_length == 15 && !disc_lz_get_length(&input, input_end, &literal_length))
+            return false;
+        if(input_end - input < literal_length || output_end - output < literal_length)
+            return false;
+        memcpy(output, input, literal_length);
+        input += literal_length;
+        output += literal_length;
+
+        if(input == input_end)
+            break;
+
+        if(input_end - input < 2)
+            return false;
+        uint32_t offset = input[0] | input[1] << 8;
+        input += 2;
+        uint32_t match_length = token & 0xF;
+        if(match_length == 15 && !disc_lz_get_length(&input, input_end, &match_length))
+            return false;
+        match_length += DISC_LZ_MIN_MATCH;
+        if(!offset || offset > output - destination || output_end - output < match_length)
+            return false;
+
+        //Runs overlap their own output. The pattern repeats every offset bytes, so every copy can take twice as much
+        const uint8_t* match = output - offset;
+        uint32_t copied = 0;
+        while(copied < match_length)
+        {
+            uint32_t chunk = match_length - copied < offset + copied ? match_length - copied : offset + copied;
+            memcpy(output + copied, match, chunk);
+            copied += chunk;
+        }
+        output += match_length;
+    }
+    return output == output_end;
+}
@@ -0,0 +1,378 @@
+#include "disc_lz.h"
+#include "disc_packed.h"
+
+//Decompresses a hunk, without the lock. A damaged hunk reads as zeroes
+static void disc_packed_inflate(ps1_disc* disc, disc_packed* packed, int32_t hunk, uint8_t* data)
+{
+    const disc_packed_hunk* entry = &packed->hunks[hunk];
+    const disc_file* file = &disc->files[0];
+    bool ok = entry->offset <= file->size && entry->length <= file->size - entry->offset;
+
+    if(ok)
+    {
+        const uint8_t* source = file->data + entry->offset;
+        switch(entry->codec)
+        {
+            case DISC_PACKED_STORED:
+                ok = entry->length == packed->hunk_size;
+                if(ok)
+                    memcpy(data, source, packed->hunk_size);
+                break;
+            case DISC_PACKED_LZ:
+                ok = disc_lz_decompress(source, entry->length, data, packed->hunk_size);
+                break;
+            case DISC_PACKED_ZERO:
+                memset(data, 0, packed->hunk_size);
+                break;
+            default:
+                ok = false;
+                break;
+        }
+    }
+
+    if(!ok)
+    {
+        printf("Hunk %d of the disc image is damaged\n", hunk);
+        memset(data, 0, packed->hunk_size);
+    }
+}
+
+//Takes the least recently used slot that isn't being filled, with the lock held
+static disc_hunk_slot* disc_packed_claim(disc_packed* packed, int32_t hunk)
+{
+    disc_hunk_slot* victim = NULL;
+    for(uint32_t i = 0; i < DISC_PACKED_CACHE_HUNKS; i++)
+    {
+        disc_hunk_slot* slot = &packed->slots[i];
+        if(slot->hunk >= 0 && !slot->ready)
+            continue;
+        if(victim == NULL || slot->used < victim->used)
+            victim = slot;
+    }
+    if(victim == NULL)
+        return NULL;
+
+    if(victim->hunk >= 0)
+        packed->slot_of[victim->hunk] = -1;
+    victim->hunk = hunk;
+    victim->ready = false;
+    victim->used = ++packed->clock;
+    packed->slot_of[hunk] = victim - packed->slots;
+    return victim;
+}
+
+//Decompresses into a claimed slot, the lock is released meanwhile so reads of other hunks go on
+static void disc_packed_fill(ps1_disc* disc, disc_packed* packed, disc_hunk_slot* slot)
+{
+    int32_t hunk = slot->hunk;
+    pthread_mutex_unlock(&packed->lock);
+    disc_packed_inflate(disc, packed, hunk, slot->data);
+    pthread_mutex_lock(&packed->lock);
+    slot->ready = true;
+    pthread_cond_broadcast(&packed->done);
+}
+
+static void* disc_packed_worker(void* arg)
+{
+    ps1_disc* disc = (ps1_disc*)arg;
+    disc_packed* packed = (disc_packed*)disc->data;
+
+    pthread_mutex_lock(&packed->lock);
+    while(!packed->quit)
+    {
+        if(!packed->queue_count)
+        {
+            pthread_cond_wait(&packed->wake, &packed->lock);
+            continue;
+        }
+
+        int32_t hunk = packed->queue[0];
+        packed->queue_count--;
+        memmove(packed->queue, packed->queue + 1, packed->queue_count * sizeof(int32_t));
+        if(packed->slot_of[hunk] >= 0)
+            continue;
+
+        disc_hunk_slot* slot = disc_packed_claim(packed, hunk);
+        if(slot != NULL)
+            disc_packed_fill(disc, packed, slot);
+    }
+    pthread_mutex_unlock(&packed->lock);
+    return NULL;
+}
+
+/*
+ Queues the hunks after the one being read for the workers, with the lock held. Reads go forward unless they just
+ stepped back a hunk, a seek anywhere else starts a new forward run. Whatever was queued for the old position is
+ dropped.
+*/
+static void disc_packed_read_ahead(disc_packed* packed, int32_t hunk)
+{
+    packed->direction = hunk == packed->last_hunk - 1 ? -1 : 1;
+    packed->last_hunk = hunk;
+    if(!packed->worker_count)
+        return;
+
+    packed->queue_count = 0;
+    for(int32_t i = 1; i <= DISC_PACKED_READ_AHEAD; i++)
+    {
+        int32_t next = hunk + i * packed->direction;
+        if(next < 0 || next >= (int32_t)packed->hunk_count)
+            break;
+        if(packed->slot_of[next] < 0)
+            packed->queue[packed->queue_count++] = next;
+    }
+    if(packed->queue_count)
+        pthread_cond_broadcast(&packed->wake);
+}
+
+//Slots can be reused as soon as the lock is released, sectors are always copied out
+static const uint8_t* disc_packed_read(ps1_disc* disc, uint32_t lba, uint8_t* scratch)
+{
+    if(lba >= disc->sectors)
+        return NULL;
+
+    disc_packed* packed = (disc_packed*)disc->data;
+    int32_t hunk = lba / packed->hunk_sectors;
+    disc_hunk_slot* slot;
+
+    pthread_mutex_lock(&packed->lock);
+    while(true)
+    {
+        int32_t index = packed->slot_of[hunk];
+        if(index >= 0)
+        {
+            //Read-ahead that hasn't finished yet is waited for rather than done twice
+            slot = &packed->slots[index];
+            if(slot->ready)
+            {
+                packed->hits++;
+                break;
+            }
+            pthread_cond_wait(&packed->done, &packed->lock);
+            continue;
+        }
+
+        slot = disc_packed_claim(packed, hunk);
+        if(slot == NULL)
+        {
+            pthread_cond_wait(&packed->done, &packed->lock);
+            continue;
+        }
+        packed->misses++;
+        disc_packed_fill(disc, packed, slot);
+        break;
+    }
+
+    slot->used = ++packed->clock;
+    memcpy(scratch, slot->data + (lba % packed->hunk_sectors) * DISC_SECTOR_SIZE, DISC_SECTOR_SIZE);
+    if(hunk != packed->last_hunk)
+        disc_packed_read_ahead(packed, hunk);
+    pthread_mutex_unlock(&packed->lock);
+    return scratch;
+}
+
+static void disc_packed_close(ps1_disc* disc)
+{
+    disc_packed* packed = (disc_packed*)disc->data;
+    if(packed != NULL)
+    {
+        pthread_mutex_lock(&packed->lock);
+        packed->quit = true;
+        pthread_cond_broadcast(&packed->wake);
+        pthread_mutex_unlock(&packed->lock);
+        for(uint32_t i = 0; i < packed->worker_count; i++)
+            pthread_join(packed->workers[i], NULL);
+
+        pthread_cond_destroy(&packed->done);
+        pthread_cond_destroy(&packed->wake);
+        pthread_mutex_destroy(&packed->lock);
+        for(uint32_t i = 0; i < DISC_PACKED_CACHE_HUNKS; i++)
+            free (packed->slots[i].data);
+        free (packed->slot_of);
+        free (packed);
+        disc->data = NULL;
+    }
+
+    for(uint32_t i = 0; i < disc->file_count; i++)
+        disc_unmap_file(&disc->files[i]);
+}
+
+static const disc_backend disc_packed_backend = {disc_packed_read, disc_packed_close};
+
+//The image stays mapped, only the tables are read up front
+bool disc_open_packed(ps1_disc* disc, const char* path)
+{
+    disc->backend = &disc_packed_backend;
+    if(!disc_map_file(path, &disc->files[0]))
+    {
+        printf("Couldn't map the disc image %s\n", path);
+        return false;
+    }
+    disc->file_count = 1;
+
+    const disc_file* file = &disc->files[0];
+    disc_packed_header header;
+    memset(&header, 0, sizeof(header));
+    if(file->size >= sizeof(header))
+        memcpy(&header, file->data, sizeof(header));
+
+    uint64_t tables = sizeof(header) + (uint64_t)header.track_count * sizeof(disc_packed_track) + (uint64_t)header.hunk_count * sizeof(disc_packed_hunk);
+    if(memcmp(header.magic, DISC_PACKED_MAGIC, sizeof(header.magic)) || header.version != DISC_PACKED_VERSION
+        || !header.track_count || header.track_count > DISC_MAX_TRACKS || header.hunk_sectors != DISC_PACKED_HUNK_SECTORS
+        || (uint64_t)header.hunk_count * header.hunk_sectors < header.sectors || tables > file->size)
+    {
+        printf("%s isn't a packed disc image\n", path);
+        return false;
+    }
+
+    const uint8_t* tracks = file->data + sizeof(header);
+    for(uint32_t i = 0; i < header.track_count; i++)
+    {
+        disc_packed_track entry;
+        memcpy(&entry, tracks + i * sizeof(entry), sizeof(entry));
+        disc_track* track = &disc->tracks[i];
+        track->type = entry.type;
+        track->start = entry.start;
+        track->length = entry.length;
+        track->pregap = entry.pregap;
+        track->silence = entry.silence;
+        track->file = 0;
+        track->file_offset = 0;
+    }
+    disc->track_count = header.track_count;
+    disc->sectors = header.sectors;
+
+    disc_packed* packed = (disc_packed*)calloc(1, sizeof(disc_packed));
+    disc->data = packed;
+    packed->hunks = (const disc_packed_hunk*)(tracks + header.track_count * sizeof(disc_packed_track));
+    packed->hunk_count = header.hunk_count;
+    packed->hunk_sectors = header.hunk_sectors;
+    packed->hunk_size = header.hunk_sectors * DISC_SECTOR_SIZE;
+    packed->slot_of = (int16_t*)malloc(header.hunk_count * sizeof(int16_t));
+    memset(packed->slot_of, 0xFF, header.hunk_count * sizeof(int16_t));
+    for(uint32_t i = 0; i < DISC_PACKED_CACHE_HUNKS; i++)
+    {
+        packed->slots[i].data = (uint8_t*)malloc(packed->hunk_size);
+        packed->slots[i].hunk = -1;
+    }
+    packed->last_hunk = -1;
+    packed->direction = 1;
+
+    pthread_mutex_init(&packed->lock, NULL);
+    pthread_cond_init(&packed->wake, NULL);
+    pthread_cond_init(&packed->done, NULL);
+
+    //Without workers every hunk is decompressed on a miss, which still works
+    for(uint32_t i = 0; i < DISC_PACKED_WORKERS; i++)
+    {
+        if(pthread_create(&packed->workers[packed->worker_count], NULL, disc_packed_worker, disc) != 0)
+        {
+            printf("Couldn't start the disc read-ahead workers\n");
+            break;
+        }
+        packed->worker_count++;
+    }
+    return true;
+}
+
+static bool disc_packed_all_zero(const uint8_t* data, uint32_t size)
+{
+    for(uint32_t i = 0; i < size; i++)
+    {
+        if(data[i])
+            return false;
+    }
+    return true;
+}
+
+//Writes an open disc out as a packed image, hunks that don't get smaller are stored as they are
+bool ps1_disc_pack(ps1_disc* disc, const char* path)
+{
+    FILE* output = fopen(path, "wb");
+    if(output == NULL)
+    {
+        printf("Couldn't create %s\n", path);
+        return false;
+    }
+
+    disc_packed_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, DISC_PACKED_MAGIC, sizeof(header.magic));
+    header.version = DISC_PACKED_VERSION;
+    header.hunk_sectors = DISC_PACKED_HUNK_SECTORS;
+    header.hunk_count = (disc->sectors + DISC_PACKED_HUNK_SECTORS - 1) / DISC_PACKED_HUNK_SECTORS;
+    header.sectors = disc->sectors;
+    header.track_count = disc->track_count;
+    bool ok = fwrite(&header, sizeof(header), 1, output) == 1;
+
+    for(uint32_t i = 0; ok && i < disc->track_count; i++)
+    {
+        disc_packed_track entry;
+        memset(&entry, 0, sizeof(entry));
+        entry.type = disc->tracks[i].type;
+        entry.start = disc->tracks[i].start;
+        entry.length = disc->tracks[i].length;
+        entry.pregap = disc->tracks[i].pregap;
+        entry.silence = disc->tracks[i].silence;
+        ok = fwrite(&entry, sizeof(entry), 1, output) == 1;
+    }
+
+    //The index goes in once the hunk sizes are known
+    long index_offset = ftell(output);
+    disc_packed_hunk* hunks = (disc_packed_hunk*)calloc(header.hunk_count, sizeof(disc_packed_hunk));
+    if(ok)
+        ok = fwrite(hunks, sizeof(disc_packed_hunk), header.hunk_count, output) == header.hunk_count;
+
+    uint32_t hunk_size = DISC_PACKED_HUNK_SECTORS * DISC_SECTOR_SIZE;
+    uint8_t* hunk = (uint8_t*)malloc(hunk_size);
+    uint8_t* compressed = (uint8_t*)malloc(hunk_size);
+    uint8_t scratch[DISC_SECTOR_SIZE];
+    uint64_t offset = index_offset + (uint64_t)header.hunk_count * sizeof(disc_packed_hunk);
+
+    for(uint32_t i = 0; ok && i < header.hunk_count; i++)
+    {
+        //The last hunk is padded with zeroes
+        for(uint32_t j = 0; j < DISC_PACKED_HUNK_SECTORS; j++)
+        {
+            const uint8_t* sector = ps1_disc_read_sector(disc, i * DISC_PACKED_HUNK_SECTORS + j, scratch);
+            if(sector != NULL)
+                memcpy(hunk + j * DISC_SECTOR_SIZE, sector, DISC_SECTOR_SIZE);
+            else
+                memset(hunk + j * DISC_SECTOR_SIZE, 0, DISC_SECTOR_SIZE);
+        }
+
+        hunks[i].offset = offset;
+        if(disc_packed_all_zero(hunk, hunk_size))
+        {
+            hunks[i].codec = DISC_PACKED_ZERO;
+            continue;
+        }
+
+        uint32_t length = disc_lz_compress(hunk, hunk_size, compressed, hunk_size - 1);
+        if(length)
+        {
+            hunks[i].codec = DISC_PACKED_LZ;
+            hunks[i].length = length;
+            ok = fwrite(compressed, 1, length, output) == length;
+        }
+        else
+        {
+            hunks[i].codec = DISC_PACKED_STORED;
+            hunks[i].length = hunk_size;
+            ok = fwrite(hunk, 1, hunk_size, output) == hunk_size;
+        }
+        offset += hunks[i].length;
+    }
+
+    if(ok)
+        ok = fseek(output, index_offset, SEEK_SET) == 0 && fwrite(hunks, sizeof(disc_packed_hunk), header.hunk_count, output) == header.hunk_count;
+    if(fclose(output) != 0)
+        ok = false;
+    if(!ok)
+        printf("Couldn't write %s\n", path);
+
+    free (compressed);
+    free (hunk);
+    free (hunks);
+    return ok;
+}
@@ -1,7 +1,16 @@
+#include "ram.h"
 #include "bus.h"
+#include "cpu.h"
+#include "block_cache.h"
 #include "dma.h"
+#include "irq.h"
+#include "scheduler.h"
 #include "log.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 ps1_dma* ps1_dma_create()
 {
     return (ps1_dma*)malloc(sizeof(ps1_dma));
@@ -17,213 +26,387 @@ void ps1_dma_destroy(ps1_dma* dma)
     free (dma);
 }
 
-void ps1_dma_store_word(ps1_dma* dma, uint32_t address, uint32_t value)
+void ps1_dma_connect_port(ps1_dma* dma, DMA_CHANNEL channel, void* device, dma_write_fn write, dma_read_fn read)
+{
+    dma->port[channel].device = device;
+    dma->port[channel].write = write;
+    dma->port[channel].read = read;
+}
+
+//Called by devices that pace their transfers, from then on request mode transfers on the channel wait for the line
+void ps1_dma_set_request(ps1_dma* dma, DMA_CHANNEL channel, bool active)
+{
+    bool rising = active && !(dma->requests & (1 << channel));
+    dma->request_driven |= 1 << channel;
+    if(active)
+        dma->requests |= 1 << channel;
+    else
+        dma->requests &= ~(1 << channel);
+
+    if(rising && (dma->channel[channel].chcr & DMA_CHCR_BUSY) && dma->scheduler != NULL)
+        ps1_scheduler_schedule(dma->scheduler, EVENT_DMA, 0);
+}
+
+//DICR bit 31 is set when forced (bit 15) or when an enabled channel flag is set with the master enable (bit 23) on
+static void ps1_dma_update_irq(ps1_dma* dma)
+{
+    uint32_t enabled = (dma->dicr >> 16) & 0x7F;
+    uint32_t flags = (dma->dicr >> 24) & 0x7F;
+    bool line = (dma->dicr & (1 << 15)) || ((dma->dicr & (1 << 23)) && (enabled & flags));
+
+    if(line && !dma->irq_line)
+    {
+        log_trace("DMA IRQ");
+        if(dma->irq != NULL)
+            ps1_irq_raise(dma->irq, IRQ_DMA);
+    }
+    dma->irq_line = line;
+
+    dma->dicr = (dma->dicr & 0x7FFFFFFF) | (line ? 0x80000000 : 0);
+}
+
+static uint32_t ps1_dma_read_register(ps1_dma* dma, uint32_t address)
 {
     uint8_t channel = (address >> 4) & 0x7;
-    uint8_t reg = address & 0xF;
-    switch (reg)
-    {
-        case 0x0:
-            if(address == 0x1F8010F0)
-                dma->dpcr = value;
-            else
-                dma->channel[channel].madr = value; 
-            break;
-        case 0x4: 
-            if(address == 0x1F8010F4)
-                dma->dicr = value;
-            else
-                dma->channel[channel].bcr = value; 
+    switch(address & 0xFFFFFFFC)
+    {
+        case DMA_DPCR: return dma->dpcr;
+        case DMA_DICR: return dma->dicr;
+    }
+
+    switch(address & 0xC)
+    {
+        case 0x0: return dma->channel[channel].madr;
+        case 0x4: return dma->channel[channel].bcr;
+        case 0x8: return dma->channel[channel].chcr;
+        default: printf("Unhandled read from DMA address: %08x\n", address); return 0;
+    }
+}
+
+static void ps1_dma_store_register(ps1_dma* dma, uint32_t address, uint32_t value)
+{
+    uint8_t channel = (address >> 4) & 0x7;
+    switch(address & 0xFFFFFFFC)
+    {
+        case DMA_DPCR:
+            dma->dpcr = value;
+            return;
+        case DMA_DICR:
+            //Bits 24-30 are acknowledged by writing 1, bit 31 is read only
+            dma->dicr = (value & 0x00FF803F) | (dma->dicr & ~value & 0x7F000000);
+            ps1_dma_update_irq(dma);
+            return;
+    }
+
+    switch(address & 0xC)
+    {
+        case 0x0: dma->channel[channel].madr = value & 0x00FFFFFF; break;
+        case 0x4: dma->channel[channel].bcr = value; break;
+        case 0x8:
+            //OTC only has the start bits writable and always counts down
+            if(channel == DMA_CHANNEL_OTC)
+                value = (value & 0x51000000) | DMA_CHCR_DECREMENT;
+            dma->channel[channel].chcr = value;
+
+            //Transfers only start on CHCR writes, so that is the only time the channels have to be looked at
+            if(dma->scheduler != NULL)
+                ps1_scheduler_schedule(dma->scheduler, EVENT_DMA, 0);
             break;
-        case 0x8: dma->channel[channel].chcr = value; break;
-        case 0xC: dma->channel[channel].chcr = value; break;
-        default: printf("Unhandled word write to DMA address: %08x\n", address); break;;
+        default: printf("Unhandled write to DMA address: %08x, value: %08x\n", address, value); break;
     }
-    printf("Write to %08x, value written: %08x\n", address, value);
+}
+
+void ps1_dma_store_word(ps1_dma* dma, uint32_t address, uint32_t value)
+{
+    ps1_dma_store_register(dma, address, value);
 }
 
 //Even though it's a halfword write the whole 32bits of the bus are written to the register as explained in https://psx-spx.consoledev.net/unpredictablethings/
 //same applies to byte writes
 void ps1_dma_store_halfword(ps1_dma* dma, uint32_t address, uint16_t value)
 {
-    uint8_t channel = (address >> 4) & 0xF;
-    uint8_t reg = address & 0xF;
-    switch (reg)
-    {
-        case 0x0:
-            if(address == 0x1F8010F0)
-                dma->dpcr = value;
-            else
-                dma->channel[channel].madr = value; 
-            break;
-        case 0x4: 
-            if(address == 0x1F8010F4)
-                dma->dicr = value;
-            else
-                dma->channel[channel].bcr = value; 
-            break;
-        case 0x8: dma->channel[channel].chcr = value; break;
-        case 0xC: dma->channel[channel].chcr = value; break;
-        default: printf("Unhandled halfword write to DMA address: %08x", address); break;;
-    }
+    ps1_dma_store_register(dma, address, value);
 }
 
 void ps1_dma_store_byte(ps1_dma* dma, uint32_t address, uint8_t value)
 {
-    uint8_t channel = (address >> 4) & 0xF;
-    uint8_t reg = address & 0xF;
-    switch (reg)
-    {
-        case 0x0:
-            if(address == 0x1F8010F0)
-                dma->dpcr = value;
-            else
-                dma->channel[channel].madr = value; 
-            break;
-        case 0x4: 
-            if(address == 0x1F8010F4)
-                dma->dicr = value;
-            else
-                dma->channel[channel].bcr = value; 
-            break;
-        case 0x8: dma->channel[channel].chcr = value; break;
-        case 0xC: dma->channel[channel].chcr = value; break;
-        default: printf("Unhandled byte write to DMA address: %08x\n", address); break;;
-    }
+    ps1_dma_store_register(dma, address, value);
 }
 
 uint8_t ps1_dma_read_byte(ps1_dma* dma, uint32_t address)
 {
-    printf("Unhandled BYTE read from DMA address 0x%08X\n", address);
-    return 0xFF;
+    return ps1_dma_read_register(dma, address) >> ((address & 0x3) * 8);
 }
 
 uint16_t ps1_dma_read_halfword(ps1_dma* dma, uint32_t address)
 {
-    printf("Unhandled HALFWORD read from DMA address 0x%08X\n", address);
-    return 0xFFFF;
+    return ps1_dma_read_register(dma, address) >> ((address & 0x2) * 8);
 }
 
 uint32_t ps1_dma_read_word(ps1_dma* dma, uint32_t address)
 {
-    uint32_t data = 0x0;
-    uint8_t channel = (address >> 4) & 0xF;
-    uint8_t reg = address & 0xF;
-    switch (reg)
+    return ps1_dma_read_register(dma, address);
+}
+
+//RAM addresses are resolved once per span, transfers then work directly on the host buffer
+static uint32_t* ps1_dma_ram(ps1_dma* dma, uint32_t address)
+{
+    return (uint32_t*)(dma->bus->ram->ram_buff + (address & (RAM_SIZE-4)));
+}
+
+//Words that can be accessed from address on before RAM wraps around
+static uint32_t ps1_dma_span_length(uint32_t address, uint32_t words)
+{
+    uint32_t until_wrap = (RAM_SIZE - (address & (RAM_SIZE-4))) / 4;
+    return words < until_wrap ? words : until_wrap;
+}
+
+//Moves words of RAM to the device in contiguous spans, returns the address after the last word
+static uint32_t ps1_dma_ram_to_device(ps1_dma* dma, dma_port* port, uint32_t address, uint32_t words, bool decrement)
+{
+    if(decrement)
     {
-        case 0x0:
-            if(address == 0x1F8010F0)
-                data = dma->dpcr;
-            else
-                data = dma->channel[channel].madr; 
-            break;
-        case 0x4: 
-            if(address == 0x1F8010F4)
-                data = dma->dicr;
-            else
-                data = dma->channel[channel].bcr; 
-            break;
-        case 0x8: data = dma->channel[channel].chcr; break;
-        case 0xC: data = dma->channel[channel].chcr; break;
-        default: printf("Unhandled word read to DMA address: %08x\n", address); break;;
+        //Counting down is only used for OTC, other devices get one word at a time
+        for(uint32_t i = 0; i < words; i++, address -= 4)
+        {
+            if(port->write != NULL)
+                port->write(port->device, ps1_dma_ram(dma, address), 1);
+        }
+        return address;
     }
 
-    //printf("Read from %08x, value read: %08x\n", address, data);
-    return data;
+    while(words)
+    {
+        uint32_t span = ps1_dma_span_length(address, words);
+        if(port->write != NULL)
+            port->write(port->device, ps1_dma_ram(dma, address), span);
+        address += span * 4;
+        words -= span;
+    }
+    return address;
 }
 
-void ps1_dma_do_transfer(ps1_dma* dma)
+//Lets the device fill spans of RAM directly, returns the address after the last word
+static uint32_t ps1_dma_device_to_ram(ps1_dma* dma, dma_port* port, uint32_t address, uint32_t words, bool decrement)
 {
-    if(dma->channel[6].chcr == 0x11000002) //Clear OTC
+    if(port->read == NULL)
+        return decrement ? address - words * 4 : address + words * 4;
+
+    if(decrement)
     {
-        printf("START OTC\n");
-        ps1_dma_do_otc(dma);       
+        for(uint32_t i = 0; i < words; i++, address -= 4)
+        {
+            port->read(port->device, ps1_dma_ram(dma, address), 1);
+            ps1_block_cache_notify_write(dma->bus->cpu->block_cache, address);
+        }
+        return address;
     }
 
-    else if(dma->channel[2].chcr == 0x01000401) //GPU linked list
+    while(words)
     {
-        printf("START GPU LINKLIST\n");
-        ps1_dma_do_linklist(dma);
+        uint32_t span = ps1_dma_span_length(address, words);
+        port->read(port->device, ps1_dma_ram(dma, address), span);
+        ps1_block_cache_invalidate_range(dma->bus->cpu->block_cache, address, span * 4);
+        address += span * 4;
+        words -= span;
     }
+    return address;
+}
 
-    else if(dma->channel[2].chcr == 0x01000200)
+//Walks a GPU command list, every node is a header (word count and next node) followed by its words.
+//Returns the number of words moved
+static uint32_t ps1_dma_linked_list(ps1_dma* dma, dma_port* port, uint32_t* cycles)
+{
+    channel* ch = &dma->channel[DMA_CHANNEL_GPU];
+    uint32_t addr = ch->madr & 0x00FFFFFF;
+    uint32_t words = 0;
+
+    //A list that loops back on itself hangs the real hardware, here it is cut after every word of RAM was visited once
+    for(uint32_t nodes = 0; !(addr & 0x00800000) && nodes < RAM_SIZE / 4; nodes++) //Any address with bit 23 set is an end marker
     {
-        printf("VRAMREAD");
+        uint32_t header = *ps1_dma_ram(dma, addr);
+        ps1_dma_ram_to_device(dma, port, addr + 4, header >> 24, false);
+        words += header >> 24;
+        *cycles += DMA_CYCLES_PER_NODE;
+        addr = header & 0x00FFFFFF;
     }
 
-    else if(dma->channel[2].chcr == 0x01000201)
+    ch->madr = 0x00FFFFFF;
+    return words;
+}
+
+//Fills words [0, count) with start + 4 * index, four at a time when SSE2 is there
+static void ps1_dma_fill_ascending(uint32_t* words, uint32_t count, uint32_t start)
+{
+    uint32_t i = 0;
+#ifdef __SSE2__
+    __m128i value = _mm_add_epi32(_mm_set1_epi32(start), _mm_set_epi32(12, 8, 4, 0));
+    __m128i step = _mm_set1_epi32(16);
+    __m128i mask = _mm_set1_epi32(0x00FFFFFF);
+    for(; i + 4 <= count; i += 4)
     {
-        printf("START VRAMWRITE\n");
-        ps1_dma_do_vramwrite(dma);
+        _mm_storeu_si128((__m128i*)(words + i), _mm_and_si128(value, mask));
+        value = _mm_add_epi32(value, step);
     }
-    
+#endif
+    for(; i < count; i++)
+        words[i] = (start + i * 4) & 0x00FFFFFF;
 }
 
-void ps1_dma_do_vramwrite(ps1_dma* dma)
+//Builds the empty ordering table: every entry points at the one below it and the lowest one is the end marker
+static void ps1_dma_clear_ordering_table(ps1_dma* dma, uint32_t first, uint32_t count)
 {
-    uint32_t length = (dma->channel[2].bcr & 0xFFFF) * ((dma->channel[2].bcr >> 16) & 0xFFFF);
-    int8_t increment_type = (dma->channel[2].chcr & 0x2 ? -4 : 4); 
-    for(int i = 0; i < length; i++)
+    uint32_t last = (first - (count - 1) * 4) & (RAM_SIZE-4);
+
+    //The table is filled from its lowest word up, which allows the spans to be written front to back
+    uint32_t address = last;
+    uint32_t remaining = count;
+    while(remaining)
     {
-        uint32_t word = ps1_bus_read_word(dma->bus, dma->channel[2].madr);
-        ps1_bus_store_word(dma->bus, 0x1F801810, word);
-        printf("ADDRESS: %08x\n", dma->channel[2].madr);
-        dma->channel[2].madr += increment_type;
+        uint32_t span = ps1_dma_span_length(address, remaining);
+        ps1_dma_fill_ascending(ps1_dma_ram(dma, address), span, address - 4);
+        address += span * 4;
+        remaining -= span;
     }
-    printf("FINISH VRAMWRITE\n");
-    dma->channel[2].chcr = ~( (1 << 24) | (1 << 28) );
+    *ps1_dma_ram(dma, last) = 0x00FFFFFF;
+    ps1_block_cache_invalidate_range(dma->bus->cpu->block_cache, last, count * 4);
 }
 
-void ps1_dma_do_linklist(ps1_dma* dma)
+//Runs a whole transfer at once, the cpu is stalled for the time it would take. Chopping, which would let the cpu
+//run in between, is treated like a burst. Returns the cycles the transfer takes
+static uint32_t ps1_dma_run_channel(ps1_dma* dma, DMA_CHANNEL index)
 {
-    uint32_t addr = dma->channel[2].madr & 0x00FFFFFF;
-    uint32_t header = 0x0;
-    while(!(addr & 0x00800000)) //Any address with bit 23 set is an end marker
+    channel* ch = &dma->channel[index];
+    dma_port* port = &dma->port[index];
+    DMA_SYNC sync = (ch->chcr >> DMA_CHCR_SYNC_SHIFT) & 0x3;
+    bool decrement = ch->chcr & DMA_CHCR_DECREMENT;
+    uint32_t cycles = 0;
+    uint32_t words = 0;
+
+    if(sync == DMA_SYNC_LINKED_LIST)
+    {
+        if(index == DMA_CHANNEL_GPU && (ch->chcr & DMA_CHCR_FROM_RAM))
+            words = ps1_dma_linked_list(dma, port, &cycles);
+        else
+            printf("Unhandled linked list DMA on channel %d, CHCR: %08x\n", index, ch->chcr);
+    }
+    else
     {
-        header = ps1_bus_read_word(dma->bus, addr);
-        uint8_t num_packets = (header >> 24) & 0xFF;
-        uint32_t addr_next_node = header & 0x00FFFFFF;
-        for(int i = 0; i < num_packets; i++)
+        uint32_t block_size = ch->bcr & 0xFFFF;
+        uint32_t blocks = ch->bcr >> 16;
+        if(sync == DMA_SYNC_MANUAL)
+            words = block_size ? block_size : 0x10000;
+        else
+            words = (block_size ? block_size : 0x10000) * blocks;
+
+        if(index == DMA_CHANNEL_OTC)
+            ps1_dma_clear_ordering_table(dma, ch->madr, words);
+        else if(ch->chcr & DMA_CHCR_FROM_RAM)
+        {
+            uint32_t end = ps1_dma_ram_to_device(dma, port, ch->madr, words, decrement);
+            if(sync == DMA_SYNC_REQUEST)
+                ch->madr = end & 0x00FFFFFF;
+        }
+        else
         {
-            addr += 4;
-            uint32_t word = ps1_bus_read_word(dma->bus, addr);
-            ps1_bus_store_word(dma->bus, 0x1F801810, word);
-        }   
-        addr = addr_next_node;
+            uint32_t end = ps1_dma_device_to_ram(dma, port, ch->madr, words, decrement);
+            if(sync == DMA_SYNC_REQUEST)
+                ch->madr = end & 0x00FFFFFF;
+        }
+
+        //Request mode counts the blocks down as they are sent
+        if(sync == DMA_SYNC_REQUEST)
+            ch->bcr &= 0xFFFF;
     }
 
-    printf("FINISH GPU LINKLIST\n");
-    dma->channel[2].chcr = ~( (1 << 24) | (1 << 28) );
+    cycles += words * DMA_CYCLES_PER_WORD;
+    ch->chcr &= ~(DMA_CHCR_BUSY | DMA_CHCR_TRIGGER);
+
+    //Completion flags are only raised for channels with their interrupt enabled
+    if(dma->dicr & (1 << (16 + index)))
+        dma->dicr |= 1 << (24 + index);
+    ps1_dma_update_irq(dma);
+    return cycles;
 }
 
-void ps1_dma_do_otc(ps1_dma* dma)
+static bool ps1_dma_channel_ready(ps1_dma* dma, DMA_CHANNEL index)
 {
-    //TODO: What happens when chopping enabled?
-    int8_t increment_type = (dma->channel[6].chcr & 0x2 ? -4 : 4);
-    int32_t increment = 0;
-    uint32_t address = 0;
+    uint32_t chcr = dma->channel[index].chcr;
+    if(!(dma->dpcr & (0x8 << (index * 4))) || !(chcr & DMA_CHCR_BUSY))
+        return false;
 
-    for(int i = 0; i < dma->channel[6].bcr; i++)
+    //Manual transfers also wait for the trigger bit, request transfers for the device when it drives its line
+    DMA_SYNC sync = (chcr >> DMA_CHCR_SYNC_SHIFT) & 0x3;
+    if(sync == DMA_SYNC_REQUEST && (dma->request_driven & (1 << index)))
+        return dma->requests & (1 << index);
+    return sync != DMA_SYNC_MANUAL || (chcr & DMA_CHCR_TRIGGER);
+}
+
+//Runs every channel that is enabled and started, highest DPCR priority first (0 is the highest, the higher
+//channel number wins a tie). The cycles the transfers take are stolen from the cpu
+void ps1_dma_do_transfer(ps1_dma* dma)
+{
+    while(true)
     {
-        address = dma->channel[6].madr + increment;
-        increment += increment_type;
-        if(i == (dma->channel[6].bcr - 1))
-            ps1_bus_store_word(dma->bus, address, 0x00FFFFFF);
+        int best = -1;
+        for(int i = 0; i < DMA_CHANNEL_COUNT; i++)
+        {
+            if(!ps1_dma_channel_ready(dma, i))
+                continue;
+            if(best < 0 || ((dma->dpcr >> (i * 4)) & 0x7) <= ((dma->dpcr >> (best * 4)) & 0x7))
+                best = i;
+        }
 
-        else
-            ps1_bus_store_word(dma->bus, address, (0x00000000 | (0x00FFFFFF & (address + increment_type))) );
+        if(best < 0)
+            return;
 
-        
+        uint32_t cycles = ps1_dma_run_channel(dma, best);
+        dma->stolen_cycles += cycles;
+        if(dma->scheduler != NULL)
+            ps1_scheduler_add_cycles(dma->scheduler, cycles);
     }
-    dma->channel[6].chcr = ~( (1 << 24) | (1 << 28) );
-    printf("FINISH OTC\n");
 }
 
-void ps1_connect_bus_dma(ps1_bus* bus, ps1_dma* dma)
+static uint32_t ps1_dma_io_read(void* device, uint32_t address, BUS_WIDTH width)
 {
-    dma->bus = bus;
+    ps1_dma* dma = (ps1_dma*)device;
+    switch(width)
+    {
+        case BUS_WIDTH_BYTE: return ps1_dma_read_byte(dma, address);
+        case BUS_WIDTH_HALFWORD: return ps1_dma_read_halfword(dma, address);
+        default: return ps1_dma_read_word(dma, address);
+    }
 }
 
+static void ps1_dma_io_write(void* device, uint32_t address, uint32_t value, BUS_WIDTH width)
+{
+    ps1_dma* dma = (ps1_dma*)device;
+    switch(width)
+    {
+        case BUS_WIDTH_BYTE: ps1_dma_store_byte(dma, address, value); break;
+        case BUS_WIDTH_HALFWORD: ps1_dma_store_halfword(dma, address, value); break;
+        default: ps1_dma_store_word(dma, address, value); break;
+    }
+}
+
+static void ps1_dma_event(void* device, uint64_t timestamp)
+{
+    ps1_dma_do_transfer((ps1_dma*)device);
+}
 
+void ps1_connect_scheduler_dma(ps1_scheduler* scheduler, ps1_dma* dma)
+{
+    dma->scheduler = scheduler;
+    ps1_scheduler_register(scheduler, EVENT_DMA, ps1_dma_event, dma);
+}
 
+void ps1_connect_irq_dma(ps1_irq* irq, ps1_dma* dma)
+{
+    dma->irq = irq;
+}
 
+void ps1_connect_bus_dma(ps1_bus* bus, ps1_dma* dma)
+{
+    dma->bus = bus;
+    ps1_bus_register_io(bus, DMA_MDEC_IN, 0x80, dma, ps1_dma_io_read, ps1_dma_io_write, BUS_WIDTH_ALL);
+}
@@ -0,0 +1,342 @@
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include "ram.h"
+#include "bios.h"
+#include "bus.h"
+#include "cpu.h"
+#include "block_cache.h"
+#include "jit.h"
+#include "fastmem.h"
+
+#ifdef FASTMEM_SUPPORTED
+#include <signal.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+//Segments that see physical memory: KUSEG, KSEG0 and KSEG1
+static const uint32_t fastmem_segments[] = {0x00000000, 0x80000000, 0xA0000000};
+#define FASTMEM_SEGMENTS (sizeof(fastmem_segments) / sizeof(fastmem_segments[0]))
+
+ps1_fastmem* ps1_fastmem_create()
+{
+    return (ps1_fastmem*)malloc(sizeof(ps1_fastmem));
+}
+
+bool ps1_fastmem_available()
+{
+#ifdef FASTMEM_SUPPORTED
+    return true;
+#else
+    return false;
+#endif
+}
+
+#ifdef FASTMEM_SUPPORTED
+
+/*
+ Live instances for the fault handler, which may run on any thread at any time. A slot is published by storing its
+ region base last and withdrawn by clearing the base first, so the handler only follows instances it has matched
+ by base, and a fault inside a region means that instance is alive. The lock only orders init and destroy.
+*/
+static _Atomic(uint8_t*) fastmem_bases[FASTMEM_MAX_INSTANCES];
+static ps1_fastmem* fastmem_instances[FASTMEM_MAX_INSTANCES];
+static pthread_mutex_t fastmem_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct sigaction fastmem_previous_action;
+static bool fastmem_handler_installed = false;
+
+//x86 register number to its slot in the signal context
+static const int fastmem_gregs[8] = {REG_RAX, REG_RCX, REG_RDX, REG_RBX, REG_RSP, REG_RBP, REG_RSI, REG_RDI};
+
+/*
+ Only the accesses the JIT emits are emulated, they always have the form "op r32, [rdx+rcx]" without REX prefix:
+ 8B (lw), 0F B6/B7/BE/BF (lbu/lhu/lb/lh), 89 (sw), 66 89 (sh) and 88 (sb).
+*/
+static bool fastmem_emulate(ps1_fastmem* fastmem, ucontext_t* context, uint32_t address)
+{
+    greg_t* gregs = context->uc_mcontext.gregs;
+    uint8_t* code = (uint8_t*)gregs[REG_RIP];
+    ps1_jit* jit = fastmem->bus->cpu->jit;
+
+    if(jit == NULL || jit->buffer == NULL || code < jit->buffer || code >= jit->buffer + JIT_BUFFER_SIZE)
+        return false;
+
+    uint8_t* instruction = code;
+    bool operand16 = false;
+    if(*code == 0x66)
+    {
+        operand16 = true;
+        code++;
+    }
+
+    uint8_t opcode = *code++;
+    uint8_t extended = 0;
+    if(opcode == 0x0F)
+        extended = *code++;
+
+    //mod 00, rm 100 (SIB) and a SIB without displacement
+    uint8_t modrm = *code++;
+    uint8_t sib = *code++;
+    if((modrm & 0xC7) != 0x04 || (sib & 0x07) == 0x05)
+        return false;
+
+    greg_t* reg = &gregs[fastmem_gregs[(modrm >> 3) & 7]];
+    ps1_bus* bus = fastmem->bus;
+
+    if(opcode == 0x8B && !operand16)
+        *reg = ps1_bus_read_word(bus, address);
+    else if(opcode == 0x0F && extended == 0xB6)
+        *reg = ps1_bus_read_byte(bus, address);
+    else if(opcode == 0x0F && extended == 0xB7)
+        *reg = ps1_bus_read_halfword(bus, address);
+    else if(opcode == 0x0F && extended == 0xBE)
+        *reg = (uint32_t)(int32_t)(int8_t)ps1_bus_read_byte(bus, address);
+    else if(opcode == 0x0F && extended == 0xBF)
+        *reg = (uint32_t)(int32_t)(int16_t)ps1_bus_read_halfword(bus, address);
+    else if(opcode == 0x89 && operand16)
+        ps1_bus_store_halfword(bus, address, (uint16_t)*reg);
+    else if(opcode == 0x89)
+        ps1_bus_store_word(bus, address, (uint32_t)*reg);
+    else if(opcode == 0x88 && !operand16)
+        ps1_bus_store_byte(bus, address, (uint8_t)*reg);
+    else
+        return false;
+
+    gregs[REG_RIP] += code - instruction;
+    fastmem->faults++;
+    return true;
+}
+
+static void fastmem_signal_handler(int signal, siginfo_t* info, void* context)
+{
+    uint8_t* fault = (uint8_t*)info->si_addr;
+
+    for(uint32_t i = 0; i < FASTMEM_MAX_INSTANCES; i++)
+    {
+        uint8_t* base = atomic_load_explicit(&fastmem_bases[i], memory_order_acquire);
+        if(base != NULL && fault >= base && fault < base + FASTMEM_REGION_SIZE)
+        {
+            if(fastmem_emulate(fastmem_instances[i], (ucontext_t*)context, (uint32_t)(fault - base)))
+                return;
+            break;
+        }
+    }
+
+    //Not one of ours, the previous handler gets it and ours stays in place for the other faults
+    struct sigaction* previous = &fastmem_previous_action;
+    if(previous->sa_flags & SA_SIGINFO)
+        previous->sa_sigaction(signal, info, context);
+    else if(previous->sa_handler != SIG_DFL && previous->sa_handler != SIG_IGN)
+        previous->sa_handler(signal);
+    else
+    {
+        //A real crash, the faulting instruction runs again with the default action and takes the process down
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = SIG_DFL;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGSEGV, &action, NULL);
+    }
+}
+
+static bool fastmem_install_handler()
+{
+    if(fastmem_handler_installed)
+        return true;
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = fastmem_signal_handler;
+    action.sa_flags = SA_SIGINFO;
+    sigemptyset(&action.sa_mask);
+
+    if(sigaction(SIGSEGV, &action, &fastmem_previous_action) != 0)
+    {
+        perror("Error: Could not install the fastmem fault handler");
+        return false;
+    }
+
+    fastmem_handler_installed = true;
+    return true;
+}
+
+static void fastmem_protect_ram(ps1_fastmem* fastmem, uint32_t offset, uint32_t length, int protection)
+{
+    for(uint32_t segment = 0; segment < FASTMEM_SEGMENTS; segment++)
+    {
+        for(uint32_t mirror = 0; mirror < FASTMEM_MIRROR_SIZE; mirror += RAM_SIZE)
+            mprotect(fastmem->base + fastmem_segments[segment] + mirror + offset, length, protection);
+    }
+}
+
+//Undoes whatever part of ps1_fastmem_init succeeded
+static void fastmem_release(ps1_fastmem* fastmem)
+{
+    if(fastmem->slot >= 0)
+    {
+        pthread_mutex_lock(&fastmem_lock);
+        atomic_store_explicit(&fastmem_bases[fastmem->slot], NULL, memory_order_release);
+        fastmem_instances[fastmem->slot] = NULL;
+        pthread_mutex_unlock(&fastmem_lock);
+        fastmem->slot = -1;
+    }
+
+    if(fastmem->bus != NULL && fastmem->bus->ram->ram_buff == fastmem->memory)
+        fastmem->bus->ram->ram_buff = NULL;
+
+    if(fastmem->base != NULL && fastmem->base != MAP_FAILED)
+        munmap(fastmem->base, FASTMEM_REGION_SIZE);
+    if(fastmem->memory != NULL && fastmem->memory != MAP_FAILED)
+        munmap(fastmem->memory, RAM_SIZE + (BIOS_SIZE));
+    if(fastmem->fd >= 0)
+        close(fastmem->fd);
+}
+
+bool ps1_fastmem_init(ps1_fastmem* fastmem, ps1_bus* bus)
+{
+    memset(fastmem, 0, sizeof(ps1_fastmem));
+    fastmem->bus = bus;
+    fastmem->fd = -1;
+    fastmem->slot = -1;
+
+    uint32_t size = RAM_SIZE + (BIOS_SIZE);
+    fastmem->fd = memfd_create("ps1_memory", MFD_CLOEXEC);
+    if(fastmem->fd < 0 || ftruncate(fastmem->fd, size) != 0)
+    {
+        perror("Error: Could not create the fastmem backing memory");
+        fastmem_release(fastmem);
+        return false;
+    }
+
+    fastmem->memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fastmem->fd, 0);
+    fastmem->base = mmap(NULL, FASTMEM_REGION_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if(fastmem->memory == MAP_FAILED || fastmem->base == MAP_FAILED)
+    {
+        perror("Error: Could not reserve the fastmem region");
+        fastmem_release(fastmem);
+        return false;
+    }
+
+    for(uint32_t segment = 0; segment < FASTMEM_SEGMENTS; segment++)
+    {
+        for(uint32_t mirror = 0; mirror < FASTMEM_MIRROR_SIZE; mirror += RAM_SIZE)
+        {
+            uint8_t* view = fastmem->base + fastmem_segments[segment] + mirror;
+            if(mmap(view, RAM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fastmem->fd, 0) == MAP_FAILED)
+            {
+                perror("Error: Could not map the fastmem RAM mirrors");
+                fastmem_release(fastmem);
+                return false;
+            }
+        }
+    }
+
+    pthread_mutex_lock(&fastmem_lock);
+    bool installed = fastmem_install_handler();
+    for(int32_t i = 0; installed && i < FASTMEM_MAX_INSTANCES; i++)
+    {
+        if(atomic_load(&fastmem_bases[i]) == NULL)
+        {
+            fastmem->slot = i;
+            fastmem_instances[i] = fastmem;
+            atomic_store_explicit(&fastmem_bases[i], fastmem->base, memory_order_release);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&fastmem_lock);
+
+    if(fastmem->slot < 0)
+    {
+        if(installed)
+            printf("Error: Too many fastmem instances\n");
+        fastmem_release(fastmem);
+        return false;
+    }
+
+    //RAM moves into the memfd, everything else keeps using it through ram_buff
+    memcpy(fastmem->memory, bus->ram->ram_buff, RAM_SIZE);
+    free (bus->ram->ram_buff);
+    bus->ram->ram_buff = fastmem->memory;
+    return true;
+}
+
+void ps1_fastmem_destroy(ps1_fastmem* fastmem)
+{
+    fastmem_release(fastmem);
+    free (fastmem);
+}
+
+//The BIOS is copied behind RAM in the memfd and mapped read only, stores to it fault and get dropped by the bus
+void ps1_fastmem_map_bios(ps1_fastmem* fastmem)
+{
+    ps1_bios* bios = fastmem->bus->bios;
+    if(bios->buffer == NULL)
+        return;
+
+    memcpy(fastmem->memory + RAM_SIZE, bios->buffer, BIOS_SIZE);
+    for(uint32_t segment = 0; segment < FASTMEM_SEGMENTS; segment++)
+        mmap(fastmem->base + fastmem_segments[segment] + 0x1FC00000, BIOS_SIZE, PROT_READ, MAP_SHARED | MAP_FIXED, fastmem->fd, RAM_SIZE);
+}
+
+//With the cache isolated every RAM store has to reach the bus, which drops it
+void ps1_fastmem_set_cache_isolation(ps1_fastmem* fastmem, bool isolated)
+{
+    if(fastmem->isolated == isolated)
+        return;
+
+    fastmem->isolated = isolated;
+    fastmem_protect_ram(fastmem, 0, RAM_SIZE, isolated ? PROT_READ : PROT_READ | PROT_WRITE);
+
+    if(!isolated)
+    {
+        ps1_block_cache* cache = fastmem->bus->cpu->block_cache;
+        for(uint32_t address = 0; address < RAM_SIZE; address += BLOCK_PAGE_SIZE)
+        {
+            if(cache->ram_page_blocks[address >> BLOCK_PAGE_SHIFT])
+                ps1_fastmem_set_code_page(fastmem, address, true);
+        }
+    }
+}
+
+void ps1_fastmem_set_code_page(ps1_fastmem* fastmem, uint32_t address, bool has_code)
+{
+    if(fastmem->isolated)
+        return;
+
+    uint32_t offset = address & (RAM_SIZE-1) & ~(BUS_PAGE_SIZE-1);
+    fastmem_protect_ram(fastmem, offset, BUS_PAGE_SIZE, has_code ? PROT_READ : PROT_READ | PROT_WRITE);
+}
+
+#else
+
+bool ps1_fastmem_init(ps1_fastmem* fastmem, ps1_bus* bus)
+{
+    memset(fastmem, 0, sizeof(ps1_fastmem));
+    printf("Error: Fastmem is only supported on Linux x86-64\n");
+    return false;
+}
+
+void ps1_fastmem_destroy(ps1_fastmem* fastmem)
+{
+    free (fastmem);
+}
+
+void ps1_fastmem_map_bios(ps1_fastmem* fastmem)
+{
+}
+
+void ps1_fastmem_set_cache_isolation(ps1_fastmem* fastmem, bool isolated)
+{
+}
+
+void ps1_fastmem_set_code_page(ps1_fastmem* fastmem, uint32_t address, bool has_code)
+{
+}
+
+#endif
@@ -1,29 +1,922 @@
 #include "bus.h"
+#include "dma.h"
 #include "gpu.h"
+#include "gpu_raster.h"
+#include "gpu_thread.h"
+#include "gpu_tiles.h"
+#include "gpu_texture_cache.h"
+#include "gpu_trace.h"
+#include "gpu_dump.h"
+#include "irq.h"
+#include "scheduler.h"
+#include "log.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+//Words of every GP0 packet, indexed by the command byte
+static uint8_t gp0_packet_length[256];
+
+static uint32_t gp0_compute_packet_length(uint32_t command)
+{
+    switch(command >> 5)
+    {
+        case 0x1: //Polygon
+        {
+            uint32_t vertices = (command & 0x08) ? 4 : 3;
+            uint32_t length = 1 + vertices;
+            if(command & 0x04)
+                length += vertices;
+            if(command & 0x10)
+                length += vertices - 1;
+            return length;
+        }
+        case 0x2: //Line, polylines continue in GP0_MODE_POLYLINE after the first segment
+            return (command & 0x10) ? 4 : 3;
+        case 0x3: //Rectangle
+            return 2 + ((command & 0x18) == 0 ? 1 : 0) + ((command & 0x04) ? 1 : 0);
+        case 0x4: //VRAM to VRAM
+            return 4;
+        case 0x5: //CPU to VRAM
+        case 0x6: //VRAM to CPU
+            return 3;
+        default:
+            return command == 0x02 ? 3 : 1;
+    }
+}
 
 ps1_gpu* ps1_gpu_create()
 {
     return (ps1_gpu*)malloc(sizeof(ps1_gpu));
 }
 
+//GP1(00h), everything but VRAM goes back to its power on state
+static void ps1_gpu_reset(ps1_gpu* gpu)
+{
+    gpu->GPUSTAT = 0x14802000;
+    gpu->gpuread = 0;
+    gpu->mode = GP0_MODE_COMMAND;
+    gpu->fifo_count = 0;
+    gpu->vram_write.active = false;
+    gpu->vram_read.active = false;
+
+    gpu->texture_window_mask_x = 0;
+    gpu->texture_window_mask_y = 0;
+    gpu->texture_window_offset_x = 0;
+    gpu->texture_window_offset_y = 0;
+    gpu->rect_flip_x = false;
+    gpu->rect_flip_y = false;
+    gpu->draw_left = 0;
+    gpu->draw_top = 0;
+    gpu->draw_right = 0;
+    gpu->draw_bottom = 0;
+    gpu->draw_offset_x = 0;
+    gpu->draw_offset_y = 0;
+
+    gpu->display_x = 0;
+    gpu->display_y = 0;
+    gpu->display_h_start = 0x200;
+    gpu->display_h_end = 0xC00;
+    gpu->display_v_start = 0x10;
+    gpu->display_v_end = 0x100;
+}
+
 void ps1_gpu_init(ps1_gpu* gpu)
 {
     memset(gpu, 0, sizeof(ps1_gpu));
+    //The extra halfword lets the vector rasterizer gather 32 bits at the last pixel
+    gpu->vram = malloc(GPU_VRAM_SIZE + 2);
+    memset(gpu->vram, 0, GPU_VRAM_SIZE + 2);
+    ps1_gpu_set_simd(gpu, true);
+    ps1_gpu_set_texture_cache(gpu, true);
+
+    for(uint32_t i = 0; i < 256; i++)
+        gp0_packet_length[i] = gp0_compute_packet_length(i);
+
+    ps1_gpu_reset(gpu);
 }
 
 void ps1_gpu_destroy(ps1_gpu* gpu)
 {
+    ps1_gpu_stop_trace(gpu);
+    ps1_gpu_stop_dump(gpu);
+    ps1_gpu_stop_thread(gpu);
+    ps1_gpu_stop_workers(gpu);
+    ps1_gpu_set_texture_cache(gpu, false);
+    if(gpu->vram != NULL)
+        free (gpu->vram);
     free (gpu);
 }
 
+static inline int32_t gpu_sign_extend_11(uint32_t value)
+{
+    return ((int32_t)(value << 21)) >> 21;
+}
+
+//Drawing environment shared by every primitive, texpage holds the E1h bits used for this primitive
+static void ps1_gpu_setup_state(ps1_gpu* gpu, gpu_draw_state* state, uint32_t flags, uint32_t texpage, uint32_t clut)
+{
+    state->flags = flags;
+    state->semi_mode = (texpage >> 5) & 0x3;
+    state->texture_depth = ((texpage >> 7) & 0x3) >= GPU_TEXTURE_15BIT ? GPU_TEXTURE_15BIT : (texpage >> 7) & 0x3;
+    state->texpage_x = (texpage & 0xF) * 64;
+    state->texpage_y = ((texpage >> 4) & 0x1) * 256;
+    state->clut_x = (clut & 0x3F) * 16;
+    state->clut_y = (clut >> 6) & 0x1FF;
+    state->texels = NULL;
+
+    state->window_and_u = ~(gpu->texture_window_mask_x * 8);
+    state->window_and_v = ~(gpu->texture_window_mask_y * 8);
+    state->window_or_u = (gpu->texture_window_offset_x & gpu->texture_window_mask_x) * 8;
+    state->window_or_v = (gpu->texture_window_offset_y & gpu->texture_window_mask_y) * 8;
+
+    state->clip_left = gpu->draw_left;
+    state->clip_top = gpu->draw_top;
+    state->clip_right = gpu->draw_right < GPU_VRAM_WIDTH ? gpu->draw_right : GPU_VRAM_WIDTH - 1;
+    state->clip_bottom = gpu->draw_bottom < GPU_VRAM_HEIGHT ? gpu->draw_bottom : GPU_VRAM_HEIGHT - 1;
+
+    state->mask_set = (gpu->GPUSTAT & GPUSTAT_SET_MASK) ? 0x8000 : 0;
+    state->mask_check = (gpu->GPUSTAT & GPUSTAT_CHECK_MASK) ? 0x8000 : 0;
+    state->flip_x = gpu->rect_flip_x;
+    state->flip_y = gpu->rect_flip_y;
+}
+
+static void gpu_unpack_vertex(ps1_gpu* gpu, gpu_vertex* vertex, uint32_t position, uint32_t color)
+{
+    vertex->x = gpu_sign_extend_11(position) + gpu->draw_offset_x;
+    vertex->y = gpu_sign_extend_11(position >> 16) + gpu->draw_offset_y;
+    vertex->r = color;
+    vertex->g = color >> 8;
+    vertex->b = color >> 16;
+}
+
+//Primitives bigger than 1023x511 are not drawn at all
+static bool gpu_triangle_too_big(const gpu_vertex* v0, const gpu_vertex* v1, const gpu_vertex* v2)
+{
+    int32_t min_x = v0->x, max_x = v0->x, min_y = v0->y, max_y = v0->y;
+    const gpu_vertex* others[2] = {v1, v2};
+    for(int i = 0; i < 2; i++)
+    {
+        min_x = others[i]->x < min_x ? others[i]->x : min_x;
+        max_x = others[i]->x > max_x ? others[i]->x : max_x;
+        min_y = others[i]->y < min_y ? others[i]->y : min_y;
+        max_y = others[i]->y > max_y ? others[i]->y : max_y;
+    }
+    return max_x - min_x >= GPU_VRAM_WIDTH || max_y - min_y >= GPU_VRAM_HEIGHT;
+}
+
+static void gp0_polygon(ps1_gpu* gpu)
+{
+    uint32_t command = gpu->fifo[0] >> 24;
+    uint32_t vertex_count = (command & 0x08) ? 4 : 3;
+    bool gouraud = command & 0x10;
+    bool textured = command & 0x04;
+
+    uint32_t flags = 0;
+    if(gouraud)
+        flags |= GPU_DRAW_GOURAUD;
+    if(textured)
+        flags |= GPU_DRAW_TEXTURED | ((command & 0x01) ? GPU_DRAW_RAW : 0);
+    if(command & 0x02)
+        flags |= GPU_DRAW_SEMI;
+    if((gpu->GPUSTAT & GPUSTAT_DITHER) && (gouraud || (textured && !(flags & GPU_DRAW_RAW))))
+        flags |= GPU_DRAW_DITHER;
+
+    //Packet layout: color, vertex, [texcoord], then [color], vertex, [texcoord] for the rest
+    gpu_vertex vertices[4];
+    uint32_t clut = 0;
+    uint32_t texpage = gpu->GPUSTAT & GPUSTAT_TEXPAGE_MASK;
+    uint32_t index = 0;
+    uint32_t color = gpu->fifo[0];
+    for(uint32_t i = 0; i < vertex_count; i++)
+    {
+        if(gouraud && i > 0)
+            color = gpu->fifo[index++];
+        else if(i == 0)
+            index++;
+
+        gpu_unpack_vertex(gpu, &vertices[i], gpu->fifo[index++], color);
+        if(textured)
+        {
+            uint32_t texcoord = gpu->fifo[index++];
+            vertices[i].u = texcoord;
+            vertices[i].v = texcoord >> 8;
+            if(i == 0)
+                clut = texcoord >> 16;
+            else if(i == 1)
+                texpage = (texcoord >> 16) & GPUSTAT_TEXPAGE_MASK;
+        }
+    }
+
+    //The texture page of a polygon becomes the current one
+    if(textured)
+        gpu->GPUSTAT = (gpu->GPUSTAT & ~GPUSTAT_TEXPAGE_MASK) | texpage;
+
+    gpu_draw_state state;
+    ps1_gpu_setup_state(gpu, &state, flags, texpage, clut);
+
+    if(!gpu_triangle_too_big(&vertices[0], &vertices[1], &vertices[2]))
+        ps1_gpu_queue_triangle(gpu, &state, &vertices[0], &vertices[1], &vertices[2]);
+    if(vertex_count == 4 && !gpu_triangle_too_big(&vertices[1], &vertices[2], &vertices[3]))
+        ps1_gpu_queue_triangle(gpu, &state, &vertices[1], &vertices[2], &vertices[3]);
+}
+
+static void gp0_line_segment(ps1_gpu* gpu, uint32_t command, uint32_t color0, uint32_t position0, uint32_t color1, uint32_t position1)
+{
+    uint32_t flags = 0;
+    if(command & 0x10)
+        flags |= GPU_DRAW_GOURAUD;
+    if(command & 0x02)
+        flags |= GPU_DRAW_SEMI;
+    if((gpu->GPUSTAT & GPUSTAT_DITHER) && (command & 0x10))
+        flags |= GPU_DRAW_DITHER;
+
+    gpu_vertex v0, v1;
+    gpu_unpack_vertex(gpu, &v0, position0, color0);
+    gpu_unpack_vertex(gpu, &v1, position1, (command & 0x10) ? color1 : color0);
+    if(abs(v1.x - v0.x) >= GPU_VRAM_WIDTH || abs(v1.y - v0.y) >= GPU_VRAM_HEIGHT)
+        return;
+
+    gpu_draw_state state;
+    ps1_gpu_setup_state(gpu, &state, flags, gpu->GPUSTAT & GPUSTAT_TEXPAGE_MASK, 0);
+    ps1_gpu_queue_line(gpu, &state, &v0, &v1);
+}
+
+static void gp0_line(ps1_gpu* gpu)
+{
+    uint32_t command = gpu->fifo[0] >> 24;
+    bool gouraud = command & 0x10;
+    uint32_t color1 = gouraud ? gpu->fifo[2] : gpu->fifo[0];
+    uint32_t position1 = gouraud ? gpu->fifo[3] : gpu->fifo[2];
+
+    gp0_line_segment(gpu, command, gpu->fifo[0], gpu->fifo[1], color1, position1);
+
+    if(command & 0x08)
+    {
+        //The command word stays in the fifo, the next vertices are collected after it
+        gpu->mode = GP0_MODE_POLYLINE;
+        gpu->polyline_color = color1;
+        gpu->polyline_vertex = position1;
+        gpu->fifo_count = 1;
+    }
+}
+
+static void gp0_polyline_word(ps1_gpu* gpu, uint32_t value)
+{
+    if((value & 0xF000F000) == 0x50005000)
+    {
+        gpu->mode = GP0_MODE_COMMAND;
+        gpu->fifo_count = 0;
+        return;
+    }
+
+    uint32_t command = gpu->fifo[0] >> 24;
+    gpu->fifo[gpu->fifo_count++] = value;
+    if(gpu->fifo_count < ((command & 0x10) ? 3 : 2))
+        return;
+
+    uint32_t color = (command & 0x10) ? gpu->fifo[1] : gpu->fifo[0];
+    uint32_t position = gpu->fifo[gpu->fifo_count - 1];
+    gp0_line_segment(gpu, command, gpu->polyline_color, gpu->polyline_vertex, color, position);
+
+    gpu->polyline_color = color;
+    gpu->polyline_vertex = position;
+    gpu->fifo_count = 1;
+}
+
+static void gp0_rectangle(ps1_gpu* gpu)
+{
+    uint32_t command = gpu->fifo[0] >> 24;
+    bool textured = command & 0x04;
+
+    uint32_t flags = 0;
+    if(textured)
+        flags |= GPU_DRAW_TEXTURED | ((command & 0x01) ? GPU_DRAW_RAW : 0);
+    if(command & 0x02)
+        flags |= GPU_DRAW_SEMI;
+
+    gpu_vertex origin;
+    uint32_t index = 1;
+    uint32_t clut = 0;
+    gpu_unpack_vertex(gpu, &origin, gpu->fifo[index++], gpu->fifo[0]);
+    origin.u = origin.v = 0;
+    if(textured)
+    {
+        uint32_t texcoord = gpu->fifo[index++];
+        origin.u = texcoord;
+        origin.v = texcoord >> 8;
+        clut = texcoord >> 16;
+    }
+
+    int32_t width, height;
+    switch((command >> 3) & 0x3)
+    {
+        case 0:
+            width = gpu->fifo[index] & 0x3FF;
+            height = (gpu->fifo[index] >> 16) & 0x1FF;
+            break;
+        case 1: width = height = 1; break;
+        case 2: width = height = 8; break;
+        default: width = height = 16; break;
+    }
+
+    gpu_draw_state state;
+    ps1_gpu_setup_state(gpu, &state, flags, gpu->GPUSTAT & GPUSTAT_TEXPAGE_MASK, clut);
+    ps1_gpu_queue_rect(gpu, &state, &origin, width, height);
+}
+
+/*
+ Copies a run of pixels, from and to either don't overlap or are the same. Without mask bits it is a plain
+ memmove, otherwise 8 pixels at a time: a pixel is only written when its mask bit is clear or not checked.
+*/
+static void gpu_copy_pixels(uint16_t* to, const uint16_t* from, uint32_t count, uint16_t mask_set, uint16_t mask_check)
+{
+    if(!mask_set && !mask_check)
+    {
+        memmove(to, from, count * sizeof(uint16_t));
+        return;
+    }
+
+    uint32_t i = 0;
+#ifdef __SSE2__
+    const __m128i set = _mm_set1_epi16(mask_set);
+    const __m128i check = _mm_set1_epi16(mask_check);
+    for(; i + 8 <= count; i += 8)
+    {
+        __m128i back = _mm_loadu_si128((const __m128i*)(to + i));
+        __m128i front = _mm_or_si128(_mm_loadu_si128((const __m128i*)(from + i)), set);
+        __m128i write = _mm_cmpeq_epi16(_mm_and_si128(back, check), _mm_setzero_si128());
+        _mm_storeu_si128((__m128i*)(to + i), _mm_or_si128(_mm_and_si128(write, front), _mm_andnot_si128(write, back)));
+    }
+#endif
+    for(; i < count; i++)
+    {
+        if(!(to[i] & mask_check))
+            to[i] = from[i] | mask_set;
+    }
+}
+
+//Pixels into a VRAM row from x on, wrapping around the right edge
+static void gpu_write_row(ps1_gpu* gpu, uint32_t x, uint32_t y, const uint16_t* from, uint32_t count, uint16_t mask_set, uint16_t mask_check)
+{
+    uint16_t* row = gpu->vram + (y & 0x1FF) * GPU_VRAM_WIDTH;
+    x &= 0x3FF;
+    while(count)
+    {
+        uint32_t length = count < GPU_VRAM_WIDTH - x ? count : GPU_VRAM_WIDTH - x;
+        gpu_copy_pixels(row + x, from, length, mask_set, mask_check);
+        from += length;
+        count -= length;
+        x = 0;
+    }
+}
+
+static void gpu_read_row(ps1_gpu* gpu, uint32_t x, uint32_t y, uint16_t* to, uint32_t count)
+{
+    const uint16_t* row = gpu->vram + (y & 0x1FF) * GPU_VRAM_WIDTH;
+    x &= 0x3FF;
+    while(count)
+    {
+        uint32_t length = count < GPU_VRAM_WIDTH - x ? count : GPU_VRAM_WIDTH - x;
+        memcpy(to, row + x, length * sizeof(uint16_t));
+        to += length;
+        count -= length;
+        x = 0;
+    }
+}
+
+//GP0(02h) ignores the drawing area and the mask settings, x and width are in steps of 16 pixels
+static void gp0_fill_rectangle(ps1_gpu* gpu)
+{
+    uint32_t color = gpu->fifo[0];
+    uint16_t pixel = ((color >> 3) & 0x1F) | (((color >> 11) & 0x1F) << 5) | (((color >> 19) & 0x1F) << 10);
+    uint32_t x = gpu->fifo[1] & 0x3F0;
+    uint32_t y = (gpu->fifo[1] >> 16) & 0x1FF;
+    uint32_t width = ((gpu->fifo[2] & 0x3FF) + 0xF) & ~0xF;
+    uint32_t height = (gpu->fifo[2] >> 16) & 0x1FF;
+    ps1_gpu_texture_cache_invalidate(gpu, x, y, width, height);
+
+    for(uint32_t row = 0; row < height; row++)
+    {
+        uint16_t* line = gpu->vram + ((y + row) & 0x1FF) * GPU_VRAM_WIDTH;
+        for(uint32_t column = 0; column < width; column++)
+            line[(x + column) & 0x3FF] = pixel;
+    }
+}
+
+//Transfer sizes of 0 mean the whole VRAM width or height
+static void gpu_setup_transfer(gpu_transfer* transfer, uint32_t position, uint32_t size)
+{
+    transfer->x = position & 0x3FF;
+    transfer->y = (position >> 16) & 0x1FF;
+    transfer->width = ((size - 1) & 0x3FF) + 1;
+    transfer->height = (((size >> 16) - 1) & 0x1FF) + 1;
+    transfer->current_x = 0;
+    transfer->current_y = 0;
+    transfer->active = true;
+}
+
+//Copied row by row from the top, so overlapping rectangles behave as if every pixel was copied in order
+static void gp0_vram_to_vram(ps1_gpu* gpu)
+{
+    gpu_transfer source, dest;
+    gpu_setup_transfer(&source, gpu->fifo[1], gpu->fifo[3]);
+    gpu_setup_transfer(&dest, gpu->fifo[2], gpu->fifo[3]);
+
+    uint16_t mask_set = (gpu->GPUSTAT & GPUSTAT_SET_MASK) ? 0x8000 : 0;
+    uint16_t mask_check = (gpu->GPUSTAT & GPUSTAT_CHECK_MASK) ? 0x8000 : 0;
+    ps1_gpu_texture_cache_invalidate(gpu, dest.x, dest.y, dest.width, dest.height);
+    for(uint32_t row = 0; row < source.height; row++)
+    {
+        uint16_t* from = gpu->vram + ((source.y + row) & 0x1FF) * GPU_VRAM_WIDTH;
+        uint16_t* to = gpu->vram + ((dest.y + row) & 0x1FF) * GPU_VRAM_WIDTH;
+
+        //Within one row a pixel may be read after it was written, only an exact pixel by pixel copy gets that right
+        if(from == to && source.x != dest.x)
+        {
+            for(uint32_t column = 0; column < source.width; column++)
+            {
+                uint16_t* pixel = &to[(dest.x + column) & 0x3FF];
+                if(!(*pixel & mask_check))
+                    *pixel = from[(source.x + column) & 0x3FF] | mask_set;
+            }
+            continue;
+        }
+
+        //Runs end wherever either side wraps around the right edge
+        uint32_t from_x = source.x, to_x = dest.x;
+        for(uint32_t column = 0; column < source.width;)
+        {
+            uint32_t length = source.width - column;
+            length = length < GPU_VRAM_WIDTH - from_x ? length : GPU_VRAM_WIDTH - from_x;
+            length = length < GPU_VRAM_WIDTH - to_x ? length : GPU_VRAM_WIDTH - to_x;
+            gpu_copy_pixels(to + to_x, from + from_x, length, mask_set, mask_check);
+            column += length;
+            from_x = (from_x + length) & 0x3FF;
+            to_x = (to_x + length) & 0x3FF;
+        }
+    }
+}
+
+//Takes pixels of a CPU to VRAM transfer two per word, returns the words used. An odd pixel count leaves the
+//upper half of the last word unused.
+static uint32_t gpu_vram_write_words(ps1_gpu* gpu, const uint32_t* words, uint32_t count)
+{
+    gpu_transfer* transfer = &gpu->vram_write;
+    const uint16_t* pixels = (const uint16_t*)words;
+    uint32_t available = count * 2;
+    uint32_t used = 0;
+    uint16_t mask_set = (gpu->GPUSTAT & GPUSTAT_SET_MASK) ? 0x8000 : 0;
+    uint16_t mask_check = (gpu->GPUSTAT & GPUSTAT_CHECK_MASK) ? 0x8000 : 0;
+
+    while(used < available && transfer->active)
+    {
+        uint32_t length = transfer->width - transfer->current_x;
+        length = length < available - used ? length : available - used;
+        gpu_write_row(gpu, transfer->x + transfer->current_x, transfer->y + transfer->current_y, pixels + used, length, mask_set, mask_check);
+        used += length;
+
+        transfer->current_x += length;
+        if(transfer->current_x == transfer->width)
+        {
+            transfer->current_x = 0;
+            if(++transfer->current_y == transfer->height)
+            {
+                transfer->active = false;
+                gpu->mode = GP0_MODE_COMMAND;
+            }
+        }
+    }
+    return (used + 1) / 2;
+}
+
+//Pixels of a VRAM to CPU transfer, returns how many were read before the transfer ended
+static uint32_t gpu_vram_read_pixels(ps1_gpu* gpu, uint16_t* pixels, uint32_t count)
+{
+    gpu_transfer* transfer = &gpu->vram_read;
+    uint32_t done = 0;
+
+    while(done < count && transfer->active)
+    {
+        uint32_t length = transfer->width - transfer->current_x;
+        length = length < count - done ? length : count - done;
+        gpu_read_row(gpu, transfer->x + transfer->current_x, transfer->y + transfer->current_y, pixels + done, length);
+        done += length;
+
+        transfer->current_x += length;
+        if(transfer->current_x == transfer->width)
+        {
+            transfer->current_x = 0;
+            if(++transfer->current_y == transfer->height)
+            {
+                transfer->active = false;
+                gpu->GPUSTAT &= ~GPUSTAT_READY_VRAM_READ;
+            }
+        }
+    }
+    return done;
+}
+
+static void gp0_draw_mode(ps1_gpu* gpu, uint32_t value)
+{
+    //Bit 11 (texture disable) lands on GPUSTAT bit 15
+    gpu->GPUSTAT = (gpu->GPUSTAT & ~0x87FF) | (value & 0x7FF) | ((value & 0x800) << 4);
+    gpu->rect_flip_x = value & (1 << 12);
+    gpu->rect_flip_y = value & (1 << 13);
+}
+
+static void gp0_execute(ps1_gpu* gpu)
+{
+    uint32_t value = gpu->fifo[0];
+    uint32_t command = value >> 24;
+
+    //Fills and transfers touch VRAM directly, queued primitives have to be drawn before them
+    if(command == 0x02 || (command >= 0x80 && command < 0xE0))
+        ps1_gpu_flush_primitives(gpu);
+
+    switch(command >> 5)
+    {
+        case 0x1: gp0_polygon(gpu); return;
+        case 0x2: gp0_line(gpu); return;
+        case 0x3: gp0_rectangle(gpu); return;
+        case 0x4: gp0_vram_to_vram(gpu); return;
+        case 0x5:
+            gpu_setup_transfer(&gpu->vram_write, gpu->fifo[1], gpu->fifo[2]);
+            //No primitive runs until the transfer is over, so the whole rectangle can be dropped up front
+            ps1_gpu_texture_cache_invalidate(gpu, gpu->vram_write.x, gpu->vram_write.y, gpu->vram_write.width, gpu->vram_write.height);
+            gpu->mode = GP0_MODE_VRAM_WRITE;
+            return;
+        case 0x6:
+            gpu_setup_transfer(&gpu->vram_read, gpu->fifo[1], gpu->fifo[2]);
+            gpu->GPUSTAT |= GPUSTAT_READY_VRAM_READ;
+            return;
+    }
+
+    switch(command)
+    {
+        case 0x00: break; //NOP
+        case 0x01: break; //Clear texture cache, there is no cache to clear
+        case 0x02: gp0_fill_rectangle(gpu); break;
+        case 0x1F: gpu->GPUSTAT |= GPUSTAT_IRQ; break;
+        case 0xE1: gp0_draw_mode(gpu, value); break;
+        case 0xE2:
+            gpu->texture_window_mask_x = value & 0x1F;
+            gpu->texture_window_mask_y = (value >> 5) & 0x1F;
+            gpu->texture_window_offset_x = (value >> 10) & 0x1F;
+            gpu->texture_window_offset_y = (value >> 15) & 0x1F;
+            break;
+        case 0xE3:
+            gpu->draw_left = value & 0x3FF;
+            gpu->draw_top = (value >> 10) & 0x3FF;
+            break;
+        case 0xE4:
+            gpu->draw_right = value & 0x3FF;
+            gpu->draw_bottom = (value >> 10) & 0x3FF;
+            break;
+        case 0xE5:
+            gpu->draw_offset_x = gpu_sign_extend_11(value);
+            gpu->draw_offset_y = gpu_sign_extend_11(value >> 11);
+            break;
+        case 0xE6:
+            gpu->GPUSTAT = (gpu->GPUSTAT & ~(GPUSTAT_SET_MASK | GPUSTAT_CHECK_MASK)) | ((value & 0x3) << 11);
+            break;
+        default:
+            log_trace("Unhandled GP0 command: %08x", value);
+            break;
+    }
+}
+
+static void gp0_write(ps1_gpu* gpu, uint32_t value)
+{
+    switch(gpu->mode)
+    {
+        case GP0_MODE_VRAM_WRITE:
+            gpu_vram_write_words(gpu, &value, 1);
+            return;
+        case GP0_MODE_POLYLINE:
+            gp0_polyline_word(gpu, value);
+            return;
+        default:
+            break;
+    }
+
+    if(gpu->fifo_count == 0)
+        gpu->fifo_length = gp0_packet_length[value >> 24];
+
+    gpu->fifo[gpu->fifo_count++] = value;
+    if(gpu->fifo_count == gpu->fifo_length)
+    {
+        gpu->fifo_count = 0;
+        gp0_execute(gpu);
+    }
+}
+
+//Runs GP0 words on the calling thread, the render thread calls this directly
+void ps1_gpu_execute_gp0_block(ps1_gpu* gpu, const uint32_t* words, uint32_t count)
+{
+    for(uint32_t i = 0; i < count;)
+    {
+        //Transfer data is copied a row at a time instead of word by word
+        if(gpu->mode == GP0_MODE_VRAM_WRITE)
+            i += gpu_vram_write_words(gpu, words + i, count - i);
+        else
+            gp0_write(gpu, words[i++]);
+    }
+}
+
+//GPUSTAT after the GP1 commands that only change GPUSTAT
+static uint32_t gp1_status(uint32_t status, uint32_t value)
+{
+    switch((value >> 24) & 0x3F)
+    {
+        case 0x02: return status & ~GPUSTAT_IRQ;
+        case 0x03: return (status & ~GPUSTAT_DISPLAY_DISABLE) | ((value & 0x1) << 23);
+        case 0x04: return (status & ~(0x3 << GPUSTAT_DMA_SHIFT)) | ((value & 0x3) << GPUSTAT_DMA_SHIFT);
+        case 0x08:
+        {
+            //Horizontal resolution 1 and 2, vertical resolution, video mode, color depth, interlace, reverse flag
+            uint32_t mode = ((value & 0x3F) << 17) | ((value & 0x40) << 10) | ((value & 0x80) << 7);
+            return (status & ~GPUSTAT_DISPLAY_MODE_MASK) | mode;
+        }
+        default: return status;
+    }
+}
+
+void ps1_gpu_execute_gp1(ps1_gpu* gpu, uint32_t value)
+{
+    uint32_t command = (value >> 24) & 0x3F;
+    switch(command)
+    {
+        case 0x00: ps1_gpu_reset(gpu); break;
+        case 0x01:
+            gpu->mode = GP0_MODE_COMMAND;
+            gpu->fifo_count = 0;
+            gpu->vram_write.active = false;
+            break;
+        case 0x02:
+        case 0x03:
+        case 0x04:
+        case 0x08:
+            gpu->GPUSTAT = gp1_status(gpu->GPUSTAT, value);
+            break;
+        case 0x05:
+            gpu->display_x = value & 0x3FE;
+            gpu->display_y = (value >> 10) & 0x1FF;
+            break;
+        case 0x06:
+            gpu->display_h_start = value & 0xFFF;
+            gpu->display_h_end = (value >> 12) & 0xFFF;
+            break;
+        case 0x07:
+            gpu->display_v_start = value & 0x3FF;
+            gpu->display_v_end = (value >> 10) & 0x3FF;
+            break;
+        default:
+            if(command >= 0x10)
+            {
+                //GPU info requests latch their answer into GPUREAD
+                switch(value & 0x7)
+                {
+                    case 0x2:
+                        gpu->gpuread = gpu->texture_window_mask_x | (gpu->texture_window_mask_y << 5) |
+                            (gpu->texture_window_offset_x << 10) | (gpu->texture_window_offset_y << 15);
+                        break;
+                    case 0x3: gpu->gpuread = gpu->draw_left | (gpu->draw_top << 10); break;
+                    case 0x4: gpu->gpuread = gpu->draw_right | (gpu->draw_bottom << 10); break;
+                    case 0x5: gpu->gpuread = (gpu->draw_offset_x & 0x7FF) | ((gpu->draw_offset_y & 0x7FF) << 11); break;
+                    case 0x7: gpu->gpuread = 2; break; //GPU version
+                }
+            }
+            else
+                log_trace("Unhandled GP1 command: %08x", value);
+            break;
+    }
+}
+
+//Follows a finished packet on the cpu thread, only the commands that change GPUSTAT matter
+static void gpu_status_packet(gpu_status_tracker* tracker)
+{
+    const uint32_t* packet = tracker->packet;
+    uint32_t command = packet[0] >> 24;
+
+    switch(command >> 5)
+    {
+        case 0x1:
+            //The texture page of a textured polygon comes with the second vertex, after its color if gouraud
+            if(command & 0x04)
+            {
+                uint32_t texpage = packet[(command & 0x10) ? 5 : 4] >> 16;
+                tracker->status = (tracker->status & ~GPUSTAT_TEXPAGE_MASK) | (texpage & GPUSTAT_TEXPAGE_MASK);
+            }
+            return;
+        case 0x2:
+            if(command & 0x08)
+                tracker->mode = GP0_MODE_POLYLINE;
+            return;
+        case 0x5:
+        {
+            gpu_transfer transfer;
+            gpu_setup_transfer(&transfer, packet[1], packet[2]);
+            tracker->transfer_words = (transfer.width * transfer.height + 1) / 2;
+            tracker->mode = GP0_MODE_VRAM_WRITE;
+            return;
+        }
+        case 0x6:
+            tracker->status |= GPUSTAT_READY_VRAM_READ;
+            return;
+    }
+
+    switch(command)
+    {
+        case 0x1F: tracker->status |= GPUSTAT_IRQ; break;
+        case 0xE1: tracker->status = (tracker->status & ~0x87FF) | (packet[0] & 0x7FF) | ((packet[0] & 0x800) << 4); break;
+        case 0xE6: tracker->status = (tracker->status & ~(GPUSTAT_SET_MASK | GPUSTAT_CHECK_MASK)) | ((packet[0] & 0x3) << 11); break;
+    }
+}
+
+static void gpu_status_gp0(ps1_gpu* gpu, const uint32_t* words, uint32_t count)
+{
+    gpu_status_tracker* tracker = &gpu->cpu_status;
+
+    for(uint32_t i = 0; i < count;)
+    {
+        if(tracker->mode == GP0_MODE_VRAM_WRITE)
+        {
+            //Transfer data is skipped whole
+            uint32_t length = tracker->transfer_words < count - i ? tracker->transfer_words : count - i;
+            i += length;
+            tracker->transfer_words -= length;
+            if(tracker->transfer_words == 0)
+                tracker->mode = GP0_MODE_COMMAND;
+            continue;
+        }
+
+        uint32_t value = words[i++];
+        if(tracker->mode == GP0_MODE_POLYLINE)
+        {
+            if((value & 0xF000F000) == 0x50005000)
+                tracker->mode = GP0_MODE_COMMAND;
+            continue;
+        }
+
+        if(tracker->count == 0)
+            tracker->length = gp0_packet_length[value >> 24];
+        tracker->packet[tracker->count++] = value;
+        if(tracker->count == tracker->length)
+        {
+            tracker->count = 0;
+            gpu_status_packet(tracker);
+        }
+    }
+}
+
+static void gpu_status_gp1(ps1_gpu* gpu, uint32_t value)
+{
+    gpu_status_tracker* tracker = &gpu->cpu_status;
+
+    switch((value >> 24) & 0x3F)
+    {
+        case 0x00:
+            tracker->status = 0x14802000;
+            tracker->mode = GP0_MODE_COMMAND;
+            tracker->count = 0;
+            break;
+        case 0x01:
+            tracker->mode = GP0_MODE_COMMAND;
+            tracker->count = 0;
+            break;
+        default:
+            tracker->status = gp1_status(tracker->status, value);
+            break;
+    }
+}
+
+//Picks up the GPU state when the render thread starts, from then on the tracker follows the commands pushed
+void ps1_gpu_seed_status(ps1_gpu* gpu)
+{
+    gpu_status_tracker* tracker = &gpu->cpu_status;
+    gpu_transfer* transfer = &gpu->vram_write;
+
+    tracker->status = gpu->GPUSTAT;
+    tracker->mode = gpu->mode;
+    memcpy(tracker->packet, gpu->fifo, sizeof(tracker->packet));
+    tracker->count = gpu->fifo_count;
+    tracker->length = gpu->fifo_length;
+    tracker->transfer_words = 0;
+    if(gpu->mode == GP0_MODE_VRAM_WRITE)
+    {
+        uint32_t done = transfer->current_y * transfer->width + transfer->current_x;
+        tracker->transfer_words = (transfer->width * transfer->height - done + 1) / 2;
+    }
+}
+
+void ps1_gpu_write_gp0(ps1_gpu* gpu, uint32_t value)
+{
+    if(gpu->trace != NULL)
+        ps1_gpu_trace_record(gpu, GPU_TRACE_GP0, &value, 1);
+    if(gpu->thread != NULL)
+    {
+        gpu_status_gp0(gpu, &value, 1);
+        ps1_gpu_thread_push(gpu->thread, GPU_RING_GP0, &value, 1);
+    }
+    else
+        gp0_write(gpu, value);
+}
+
+//DMA hands over whole spans of RAM instead of going through 0x1F801810 one word at a time
+void ps1_gpu_write_gp0_block(ps1_gpu* gpu, const uint32_t* words, uint32_t count)
+{
+    if(gpu->trace != NULL)
+        ps1_gpu_trace_record(gpu, GPU_TRACE_GP0, words, count);
+    if(gpu->thread != NULL)
+    {
+        gpu_status_gp0(gpu, words, count);
+        ps1_gpu_thread_push(gpu->thread, GPU_RING_GP0, words, count);
+    }
+    else
+        ps1_gpu_execute_gp0_block(gpu, words, count);
+}
+
+void ps1_gpu_write_gp1(ps1_gpu* gpu, uint32_t value)
+{
+    if(gpu->trace != NULL)
+        ps1_gpu_trace_record(gpu, GPU_TRACE_GP1, &value, 1);
+    if(gpu->thread != NULL)
+    {
+        gpu_status_gp1(gpu, value);
+        ps1_gpu_thread_push(gpu->thread, GPU_RING_GP1, &value, 1);
+    }
+    else
+        ps1_gpu_execute_gp1(gpu, value);
+}
+
+//Reading the GPU state from the cpu thread is a sync point, whatever is still queued is drawn first
+void ps1_gpu_sync(ps1_gpu* gpu)
+{
+    if(gpu->thread != NULL)
+        ps1_gpu_thread_sync(gpu->thread);
+    else
+        ps1_gpu_flush_primitives(gpu);
+}
+
+//Never waits for the render thread, games poll GPUSTAT in tight loops
+static uint32_t ps1_gpu_read_gpustat(ps1_gpu* gpu)
+{
+    uint32_t status = gpu->thread != NULL ? gpu->cpu_status.status : gpu->GPUSTAT;
+    status |= GPUSTAT_READY_CMD | GPUSTAT_READY_DMA | (gpu->odd_field ? GPUSTAT_ODD_LINE : 0);
+    switch((status >> GPUSTAT_DMA_SHIFT) & 0x3)
+    {
+        case 1: status |= GPUSTAT_DMA_REQUEST; break; //The FIFO is never full
+        case 2: status |= (status & GPUSTAT_READY_DMA) ? GPUSTAT_DMA_REQUEST : 0; break;
+        case 3: status |= (status & GPUSTAT_READY_VRAM_READ) ? GPUSTAT_DMA_REQUEST : 0; break;
+    }
+    return status;
+}
+
+//GPUREAD words, for DMA transfers from the GPU to RAM as well. Two pixels per word while a VRAM to CPU
+//transfer is going on, the last word read or an info request answer otherwise.
+static void ps1_gpu_read_block(ps1_gpu* gpu, uint32_t* words, uint32_t count)
+{
+    ps1_gpu_sync(gpu);
+
+    uint32_t i = 0;
+    if(gpu->vram_read.active)
+    {
+        uint16_t* pixels = (uint16_t*)words;
+        uint32_t done = gpu_vram_read_pixels(gpu, pixels, count * 2);
+        if(done & 1)
+            pixels[done++] = 0;
+        i = done / 2;
+        gpu->gpuread = words[i - 1];
+    }
+
+    for(; i < count; i++)
+        words[i] = gpu->gpuread;
+
+    //The render thread is idle until the next push, the end of the transfer shows up in the tracker
+    if(gpu->thread != NULL)
+        gpu->cpu_status.status = gpu->GPUSTAT;
+}
+
+static uint32_t ps1_gpu_read_gpuread(ps1_gpu* gpu)
+{
+    uint32_t value;
+    ps1_gpu_read_block(gpu, &value, 1);
+    return value;
+}
+
 uint32_t ps1_gpu_read_word(ps1_gpu* gpu, uint32_t address)
 {
     uint32_t data = 0;
 
     switch(address)
     {
+        case 0x1F801810:
+            data = ps1_gpu_read_gpuread(gpu);
+            break;
         case 0x1F801814:
-            data = gpu->GPUSTAT;
+            data = ps1_gpu_read_gpustat(gpu);
             break;
     }
 
@@ -35,10 +928,67 @@ void ps1_gpu_write_word(ps1_gpu* gpu, uint32_t address, uint32_t value)
     switch(address)
     {
         case 0x1F801810:
-            printf("Command: %08x\n", value);
+            ps1_gpu_write_gp0(gpu, value);
             break;
         case 0x1F801814:
-            gpu->GPUSTAT = value;
+            ps1_gpu_write_gp1(gpu, value);
             break;
-    }   
-}
\ No newline at end of file
+    }
+}
+
+static uint32_t ps1_gpu_io_read(void* device, uint32_t address, BUS_WIDTH width)
+{
+    return ps1_gpu_read_word((ps1_gpu*)device, address);
+}
+
+static void ps1_gpu_io_write(void* device, uint32_t address, uint32_t value, BUS_WIDTH width)
+{
+    ps1_gpu_write_word((ps1_gpu*)device, address, value);
+}
+
+void ps1_connect_bus_gpu(ps1_bus* bus, ps1_gpu* gpu)
+{
+    ps1_bus_register_io(bus, 0x1F801810, 8, gpu, ps1_gpu_io_read, ps1_gpu_io_write, BUS_WIDTH_WORD);
+}
+
+static void ps1_gpu_dma_write(void* device, const uint32_t* words, uint32_t count)
+{
+    ps1_gpu_write_gp0_block((ps1_gpu*)device, words, count);
+}
+
+static void ps1_gpu_dma_read(void* device, uint32_t* words, uint32_t count)
+{
+    ps1_gpu_read_block((ps1_gpu*)device, words, count);
+}
+
+void ps1_connect_dma_gpu(ps1_dma* dma, ps1_gpu* gpu)
+{
+    ps1_dma_connect_port(dma, DMA_CHANNEL_GPU, gpu, ps1_gpu_dma_write, ps1_gpu_dma_read);
+}
+
+//Only the VBlank interrupt, GP0(1Fh) may run on the render thread and just sets GPUSTAT bit 24
+void ps1_connect_irq_gpu(ps1_irq* irq, ps1_gpu* gpu)
+{
+    gpu->irq = irq;
+}
+
+static void ps1_gpu_vblank_event(void* device, uint64_t timestamp)
+{
+    ps1_gpu* gpu = (ps1_gpu*)device;
+    gpu->frame_count++;
+    gpu->odd_field = !gpu->odd_field; //Only tracks the field, the per line toggle isn't emulated
+    if(gpu->trace != NULL)
+        ps1_gpu_trace_frame(gpu);
+    if(gpu->dump != NULL)
+        ps1_gpu_dump_frame(gpu);
+    if(gpu->irq != NULL)
+        ps1_irq_raise(gpu->irq, IRQ_VBLANK);
+    ps1_scheduler_schedule_at(gpu->scheduler, EVENT_VBLANK, timestamp + GPU_CYCLES_PER_FRAME);
+}
+
+void ps1_connect_scheduler_gpu(ps1_scheduler* scheduler, ps1_gpu* gpu)
+{
+    gpu->scheduler = scheduler;
+    ps1_scheduler_register(scheduler, EVENT_VBLANK, ps1_gpu_vblank_event, gpu);
+    ps1_scheduler_schedule(scheduler, EVENT_VBLANK, GPU_CYCLES_PER_FRAME);
+}
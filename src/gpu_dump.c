@@ -0,0 +1,351 @@
+#include "gpu.h"
+#include "gpu_dump.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static const uint32_t gpu_dump_widths[4] = {256, 320, 512, 640};
+
+//Size of the display area from the GP1(08h) bits in GPUSTAT
+static void gpu_dump_display_size(uint32_t status, uint32_t* width, uint32_t* height)
+{
+    *width = (status & (1 << 16)) ? 368 : gpu_dump_widths[(status >> 17) & 0x3];
+    *height = (status & (1 << 20)) ? 256 : 240;
+    if((status & (1 << 19)) && (status & (1 << 22)))
+        *height *= 2;
+}
+
+//BT.601 studio range, the same integer steps as the vector path
+static inline void gpu_dump_yuv(int32_t r, int32_t g, int32_t b, uint8_t* y, uint8_t* u, uint8_t* v)
+{
+    *y = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+    *u = ((112 * b - 38 * r - 74 * g + 128) >> 8) + 128;
+    *v = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+}
+
+static inline uint32_t gpu_dump_expand(uint32_t component)
+{
+    return (component << 3) | (component >> 2);
+}
+
+#ifdef __SSE2__
+//Eight pixels with 8 bit components in 16 bit lanes
+static inline void gpu_dump_yuv8(__m128i r, __m128i g, __m128i b, uint8_t* y, uint8_t* u, uint8_t* v)
+{
+    const __m128i round = _mm_set1_epi16(128);
+
+    //Y stays below 65536 so it is computed unsigned, U and V fit in a signed 16 bit lane
+    __m128i luma = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(66)), _mm_mullo_epi16(g, _mm_set1_epi16(129))),
+        _mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(25)), round));
+    luma = _mm_add_epi16(_mm_srli_epi16(luma, 8), _mm_set1_epi16(16));
+    __m128i cb = _mm_sub_epi16(_mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(112)), round),
+        _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(38)), _mm_mullo_epi16(g, _mm_set1_epi16(74))));
+    cb = _mm_add_epi16(_mm_srai_epi16(cb, 8), round);
+    __m128i cr = _mm_sub_epi16(_mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(112)), round),
+        _mm_add_epi16(_mm_mullo_epi16(g, _mm_set1_epi16(94)), _mm_mullo_epi16(b, _mm_set1_epi16(18))));
+    cr = _mm_add_epi16(_mm_srai_epi16(cr, 8), round);
+
+    _mm_storel_epi64((__m128i*)y, _mm_packus_epi16(luma, luma));
+    _mm_storel_epi64((__m128i*)u, _mm_packus_epi16(cb, cb));
+    _mm_storel_epi64((__m128i*)v, _mm_packus_epi16(cr, cr));
+}
+
+//Eight 15 bit pixels split into components expanded to 8 bits
+static inline void gpu_dump_unpack15(__m128i pixels, __m128i* r, __m128i* g, __m128i* b)
+{
+    const __m128i five = _mm_set1_epi16(0x1F);
+    *r = _mm_and_si128(pixels, five);
+    *g = _mm_and_si128(_mm_srli_epi16(pixels, 5), five);
+    *b = _mm_and_si128(_mm_srli_epi16(pixels, 10), five);
+    *r = _mm_or_si128(_mm_slli_epi16(*r, 3), _mm_srli_epi16(*r, 2));
+    *g = _mm_or_si128(_mm_slli_epi16(*g, 3), _mm_srli_epi16(*g, 2));
+    *b = _mm_or_si128(_mm_slli_epi16(*b, 3), _mm_srli_epi16(*b, 2));
+}
+
+//Four 0BGR pixels in 32 bit lanes stored as 12 bytes of RGB
+static inline void gpu_dump_store_rgb4(__m128i pixels, uint8_t* out)
+{
+    //Every 64 bit lane drops its top byte and the one in the middle, leaving 6 bytes at the bottom
+    __m128i low = _mm_and_si128(pixels, _mm_set1_epi64x(0x0000000000FFFFFF));
+    __m128i high = _mm_and_si128(_mm_srli_epi64(pixels, 8), _mm_set1_epi64x(0x0000FFFFFF000000));
+    __m128i packed = _mm_or_si128(low, high);
+    packed = _mm_or_si128(_mm_and_si128(packed, _mm_set_epi64x(0, -1)), _mm_slli_si128(_mm_srli_si128(packed, 8), 6));
+    _mm_storel_epi64((__m128i*)out, packed);
+    uint32_t tail = _mm_cvtsi128_si32(_mm_srli_si128(packed, 8));
+    memcpy(out + 8, &tail, 4);
+}
+#endif
+
+static void gpu_dump_row_yuv15(const uint16_t* row, uint32_t x, uint32_t width, uint8_t* y, uint8_t* u, uint8_t* v)
+{
+    uint32_t i = 0;
+#ifdef __SSE2__
+    for(; i + 8 <= width && x + i + 8 <= GPU_VRAM_WIDTH; i += 8)
+    {
+        __m128i r, g, b;
+        gpu_dump_unpack15(_mm_loadu_si128((const __m128i*)&row[x + i]), &r, &g, &b);
+        gpu_dump_yuv8(r, g, b, &y[i], &u[i], &v[i]);
+    }
+#endif
+    for(; i < width; i++)
+    {
+        uint16_t pixel = row[(x + i) & 0x3FF];
+        gpu_dump_yuv(gpu_dump_expand(pixel & 0x1F), gpu_dump_expand((pixel >> 5) & 0x1F), gpu_dump_expand((pixel >> 10) & 0x1F), &y[i], &u[i], &v[i]);
+    }
+}
+
+//24 bit pixels are three bytes each, packed across the 16 bit halfwords of the row
+static void gpu_dump_row_yuv24(const uint16_t* row, uint32_t x, uint32_t width, uint8_t* y, uint8_t* u, uint8_t* v)
+{
+    const uint8_t* bytes = (const uint8_t*)row;
+    uint32_t offset = x * 2;
+    uint32_t i = 0;
+#ifdef __SSE2__
+    //Every pixel is loaded as a 32 bit word at its own offset, so the last one reads a byte past its own
+    const __m128i byte = _mm_set1_epi32(0xFF);
+    for(; i + 8 <= width && offset + 8 * 3 + 1 <= GPU_VRAM_WIDTH * 2; i += 8, offset += 8 * 3)
+    {
+        uint32_t words[8];
+        for(uint32_t j = 0; j < 8; j++)
+            memcpy(&words[j], bytes + offset + j * 3, 4);
+        __m128i first = _mm_loadu_si128((const __m128i*)&words[0]);
+        __m128i second = _mm_loadu_si128((const __m128i*)&words[4]);
+        __m128i r = _mm_packs_epi32(_mm_and_si128(first, byte), _mm_and_si128(second, byte));
+        __m128i g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(first, 8), byte), _mm_and_si128(_mm_srli_epi32(second, 8), byte));
+        __m128i b = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(first, 16), byte), _mm_and_si128(_mm_srli_epi32(second, 16), byte));
+        gpu_dump_yuv8(r, g, b, &y[i], &u[i], &v[i]);
+    }
+#endif
+    for(; i < width; i++, offset += 3)
+        gpu_dump_yuv(bytes[offset & 0x7FF], bytes[(offset + 1) & 0x7FF], bytes[(offset + 2) & 0x7FF], &y[i], &u[i], &v[i]);
+}
+
+static void gpu_dump_row_rgb15(const uint16_t* row, uint32_t x, uint32_t width, uint8_t* out)
+{
+    uint32_t i = 0;
+#ifdef __SSE2__
+    for(; i + 8 <= width && x + i + 8 <= GPU_VRAM_WIDTH; i += 8, out += 8 * 3)
+    {
+        __m128i r, g, b;
+        gpu_dump_unpack15(_mm_loadu_si128((const __m128i*)&row[x + i]), &r, &g, &b);
+        __m128i rg = _mm_or_si128(r, _mm_slli_epi16(g, 8));
+        gpu_dump_store_rgb4(_mm_unpacklo_epi16(rg, b), out);
+        gpu_dump_store_rgb4(_mm_unpackhi_epi16(rg, b), out + 4 * 3);
+    }
+#endif
+    for(; i < width; i++, out += 3)
+    {
+        uint16_t pixel = row[(x + i) & 0x3FF];
+        out[0] = gpu_dump_expand(pixel & 0x1F);
+        out[1] = gpu_dump_expand((pixel >> 5) & 0x1F);
+        out[2] = gpu_dump_expand((pixel >> 10) & 0x1F);
+    }
+}
+
+//Already in file order, so it is a copy in at most two pieces around the right edge of VRAM
+static void gpu_dump_row_rgb24(const uint16_t* row, uint32_t x, uint32_t width, uint8_t* out)
+{
+    const uint8_t* bytes = (const uint8_t*)row;
+    uint32_t offset = x * 2;
+    uint32_t length = width * 3;
+    uint32_t first = GPU_VRAM_WIDTH * 2 - offset < length ? GPU_VRAM_WIDTH * 2 - offset : length;
+    memcpy(out, bytes + offset, first);
+    memcpy(out + first, bytes, length - first);
+}
+
+static void gpu_dump_convert(ps1_gpu* gpu, GPU_DUMP_FORMAT format, gpu_dump_frame* frame)
+{
+    uint32_t status = gpu->GPUSTAT;
+    uint32_t plane = frame->width * frame->height;
+
+    if(status & GPUSTAT_DISPLAY_DISABLE)
+    {
+        if(format == GPU_DUMP_Y4M)
+        {
+            memset(frame->data, 16, plane);
+            memset(frame->data + plane, 128, plane * 2);
+        }
+        else
+            memset(frame->data, 0, plane * 3);
+        return;
+    }
+
+    bool depth24 = status & GPUSTAT_24BIT;
+    for(uint32_t line = 0; line < frame->height; line++)
+    {
+        const uint16_t* row = gpu->vram + ((gpu->display_y + line) & 0x1FF) * GPU_VRAM_WIDTH;
+        if(format == GPU_DUMP_Y4M)
+        {
+            uint8_t* y = frame->data + line * frame->width;
+            if(depth24)
+                gpu_dump_row_yuv24(row, gpu->display_x, frame->width, y, y + plane, y + plane * 2);
+            else
+                gpu_dump_row_yuv15(row, gpu->display_x, frame->width, y, y + plane, y + plane * 2);
+        }
+        else
+        {
+            uint8_t* out = frame->data + line * frame->width * 3;
+            if(depth24)
+                gpu_dump_row_rgb24(row, gpu->display_x, frame->width, out);
+            else
+                gpu_dump_row_rgb15(row, gpu->display_x, frame->width, out);
+        }
+    }
+}
+
+static bool gpu_dump_write(ps1_gpu_dump* dump, const gpu_dump_frame* frame)
+{
+    if(dump->format == GPU_DUMP_Y4M)
+    {
+        if(dump->written == 0 && fprintf(dump->file, "YUV4MPEG2 W%u H%u %s Ip A1:1 C444\n", dump->width, dump->height,
+            dump->pal ? "F50:1" : "F60000:1001") < 0)
+            return false;
+        if(fputs("FRAME\n", dump->file) < 0)
+            return false;
+    }
+    else if(fprintf(dump->file, "P6\n%u %u\n255\n", frame->width, frame->height) < 0)
+        return false;
+
+    size_t size = frame->width * frame->height * 3;
+    return fwrite(frame->data, 1, size, dump->file) == size;
+}
+
+static void* gpu_dump_main(void* arg)
+{
+    ps1_gpu_dump* dump = (ps1_gpu_dump*)arg;
+
+    pthread_mutex_lock(&dump->lock);
+    while(true)
+    {
+        while(dump->head == dump->tail && !dump->quit)
+            pthread_cond_wait(&dump->ready, &dump->lock);
+        if(dump->head == dump->tail)
+            break;
+        gpu_dump_frame* frame = &dump->frames[dump->tail % GPU_DUMP_QUEUE];
+        pthread_mutex_unlock(&dump->lock);
+
+        if(!dump->failed)
+        {
+            if(gpu_dump_write(dump, frame))
+                dump->written++;
+            else
+            {
+                printf("Frame dump write failed, stopped after %llu frames\n", (unsigned long long)dump->written);
+                dump->failed = true;
+            }
+        }
+
+        pthread_mutex_lock(&dump->lock);
+        dump->tail++;
+    }
+    pthread_mutex_unlock(&dump->lock);
+    return NULL;
+}
+
+//Writes the display area at every VBlank, PPM when the name ends in .ppm and Y4M otherwise, "-" is stdout
+bool ps1_gpu_start_dump(ps1_gpu* gpu, const char* path)
+{
+    ps1_gpu_stop_dump(gpu);
+
+    bool to_stdout = !strcmp(path, "-");
+    FILE* file = to_stdout ? stdout : fopen(path, "wb");
+    if(file == NULL)
+    {
+        printf("Couldn't create the frame dump %s\n", path);
+        return false;
+    }
+    setvbuf(file, NULL, _IONBF, 0);
+
+    ps1_gpu_dump* dump = (ps1_gpu_dump*)malloc(sizeof(ps1_gpu_dump));
+    memset(dump, 0, sizeof(ps1_gpu_dump));
+    dump->file = file;
+    dump->close_file = !to_stdout;
+    size_t length = strlen(path);
+    dump->format = length >= 4 && !strcmp(path + length - 4, ".ppm") ? GPU_DUMP_PPM : GPU_DUMP_Y4M;
+    for(uint32_t i = 0; i < GPU_DUMP_QUEUE; i++)
+        dump->frames[i].data = (uint8_t*)malloc(GPU_DUMP_MAX_WIDTH * GPU_DUMP_MAX_HEIGHT * 3);
+
+    pthread_mutex_init(&dump->lock, NULL);
+    pthread_cond_init(&dump->ready, NULL);
+    if(pthread_create(&dump->thread, NULL, gpu_dump_main, dump) != 0)
+    {
+        printf("Couldn't start the frame dump thread\n");
+        pthread_cond_destroy(&dump->ready);
+        pthread_mutex_destroy(&dump->lock);
+        for(uint32_t i = 0; i < GPU_DUMP_QUEUE; i++)
+            free (dump->frames[i].data);
+        if(dump->close_file)
+            fclose(file);
+        free (dump);
+        return false;
+    }
+
+    gpu->dump = dump;
+    return true;
+}
+
+//Waits for the queued frames to reach the file
+void ps1_gpu_stop_dump(ps1_gpu* gpu)
+{
+    ps1_gpu_dump* dump = gpu->dump;
+    if(dump == NULL)
+        return;
+
+    gpu->dump = NULL;
+    pthread_mutex_lock(&dump->lock);
+    dump->quit = true;
+    pthread_cond_signal(&dump->ready);
+    pthread_mutex_unlock(&dump->lock);
+    pthread_join(dump->thread, NULL);
+
+    if(dump->dropped)
+        printf("Frame dump: %llu frames written, %llu dropped\n", (unsigned long long)dump->written, (unsigned long long)dump->dropped);
+    pthread_cond_destroy(&dump->ready);
+    pthread_mutex_destroy(&dump->lock);
+    for(uint32_t i = 0; i < GPU_DUMP_QUEUE; i++)
+        free (dump->frames[i].data);
+    if(dump->close_file)
+        fclose(dump->file);
+    else
+        fflush(dump->file);
+    free (dump);
+}
+
+//Called at VBlank on the cpu thread, VRAM has to hold everything sent before it
+void ps1_gpu_dump_frame(ps1_gpu* gpu)
+{
+    ps1_gpu_dump* dump = gpu->dump;
+
+    pthread_mutex_lock(&dump->lock);
+    bool full = dump->head - dump->tail == GPU_DUMP_QUEUE;
+    pthread_mutex_unlock(&dump->lock);
+    if(full)
+    {
+        dump->dropped++;
+        return;
+    }
+
+    ps1_gpu_sync(gpu);
+
+    gpu_dump_frame* frame = &dump->frames[dump->head % GPU_DUMP_QUEUE];
+    gpu_dump_display_size(gpu->GPUSTAT, &frame->width, &frame->height);
+    if(dump->format == GPU_DUMP_Y4M)
+    {
+        //A Y4M stream can't change size, later modes are cropped or padded with VRAM to the first one
+        if(dump->head == 0)
+        {
+            dump->width = frame->width;
+            dump->height = frame->height;
+            dump->pal = gpu->GPUSTAT & (1 << 20);
+        }
+        frame->width = dump->width;
+        frame->height = dump->height;
+    }
+    gpu_dump_convert(gpu, dump->format, frame);
+
+    pthread_mutex_lock(&dump->lock);
+    dump->head++;
+    pthread_cond_signal(&dump->ready);
+    pthread_mutex_unlock(&dump->lock);
+}
@@ -0,0 +1,412 @@
+#include "gpu.h"
+#include "gpu_raster.h"
+#include "gpu_thread.h"
+
+//Flags that change the per pixel work, spans are specialised on every combination of them
+#define GPU_SPAN_FLAGS (GPU_DRAW_TEXTURED | GPU_DRAW_RAW | GPU_DRAW_SEMI | GPU_DRAW_DITHER | GPU_DRAW_CACHED)
+
+static const int8_t gpu_dither_matrix[4][4] =
+{
+    {-4,  0, -3,  1},
+    { 2, -2,  3, -1},
+    {-3,  1, -4,  0},
+    { 3, -1,  2, -2}
+};
+
+static inline int32_t gpu_clamp_color(int32_t value)
+{
+    return value < 0 ? 0 : (value > 255 ? 255 : value);
+}
+
+static inline int32_t gpu_clamp_fixed(int64_t value)
+{
+    return value < INT32_MIN ? INT32_MIN : (value > INT32_MAX ? INT32_MAX : (int32_t)value);
+}
+
+static inline uint16_t gpu_fetch_texel(const uint16_t* vram, const gpu_draw_state* state, const uint32_t flags, uint32_t u, uint32_t v)
+{
+    u = (u & state->window_and_u) | state->window_or_u;
+    v = (v & state->window_and_v) | state->window_or_v;
+    if(flags & GPU_DRAW_CACHED)
+        return state->texels[(v << 8) | u];
+
+    const uint16_t* row = vram + ((state->texpage_y + v) & 0x1FF) * GPU_VRAM_WIDTH;
+
+    switch(state->texture_depth)
+    {
+        case GPU_TEXTURE_4BIT:
+        {
+            uint16_t indices = row[(state->texpage_x + u / 4) & 0x3FF];
+            uint32_t index = (indices >> ((u & 3) * 4)) & 0xF;
+            return vram[state->clut_y * GPU_VRAM_WIDTH + ((state->clut_x + index) & 0x3FF)];
+        }
+        case GPU_TEXTURE_8BIT:
+        {
+            uint16_t indices = row[(state->texpage_x + u / 2) & 0x3FF];
+            uint32_t index = (indices >> ((u & 1) * 8)) & 0xFF;
+            return vram[state->clut_y * GPU_VRAM_WIDTH + ((state->clut_x + index) & 0x3FF)];
+        }
+        default:
+            return row[(state->texpage_x + u) & 0x3FF];
+    }
+}
+
+//Channels are 5 bits, back is the pixel already in VRAM
+static inline uint16_t gpu_blend(uint16_t back, uint16_t front, uint8_t mode)
+{
+    int32_t result = 0;
+    for(int shift = 0; shift < 15; shift += 5)
+    {
+        int32_t b = (back >> shift) & 0x1F;
+        int32_t f = (front >> shift) & 0x1F;
+        int32_t c;
+        switch(mode)
+        {
+            case 0: c = (b + f) >> 1; break;
+            case 1: c = b + f; break;
+            case 2: c = b - f; break;
+            default: c = b + (f >> 2); break;
+        }
+        c = c < 0 ? 0 : (c > 31 ? 31 : c);
+        result |= c << shift;
+    }
+    return result;
+}
+
+//Colors come in as 8 bit channels, u and v are already wrapped to 8 bits
+static inline void gpu_shade_pixel(uint16_t* vram, const gpu_draw_state* state, const uint32_t flags, int32_t x, int32_t y, int32_t r, int32_t g, int32_t b, uint32_t u, uint32_t v)
+{
+    uint16_t* dest = vram + y * GPU_VRAM_WIDTH + x;
+    uint16_t back = *dest;
+    if(back & state->mask_check)
+        return;
+
+    uint16_t texel = 0;
+    if(flags & GPU_DRAW_TEXTURED)
+    {
+        texel = gpu_fetch_texel(vram, state, flags, u, v);
+        if(texel == 0) //Fully transparent
+            return;
+
+        if(flags & GPU_DRAW_RAW)
+        {
+            r = (texel & 0x1F) << 3;
+            g = ((texel >> 5) & 0x1F) << 3;
+            b = ((texel >> 10) & 0x1F) << 3;
+        }
+        else
+        {
+            //A vertex color of 128 leaves the texel unchanged
+            r = gpu_clamp_color(((texel & 0x1F) * r) >> 4);
+            g = gpu_clamp_color((((texel >> 5) & 0x1F) * g) >> 4);
+            b = gpu_clamp_color((((texel >> 10) & 0x1F) * b) >> 4);
+        }
+    }
+
+    if(flags & GPU_DRAW_DITHER)
+    {
+        int32_t offset = gpu_dither_matrix[y & 3][x & 3];
+        r = gpu_clamp_color(r + offset);
+        g = gpu_clamp_color(g + offset);
+        b = gpu_clamp_color(b + offset);
+    }
+
+    uint16_t color = (r >> 3) | ((g >> 3) << 5) | ((b >> 3) << 10);
+    if((flags & GPU_DRAW_SEMI) && (!(flags & GPU_DRAW_TEXTURED) || (texel & 0x8000)))
+        color = gpu_blend(back, color, state->semi_mode);
+
+    *dest = color | state->mask_set | (texel & 0x8000);
+}
+
+//flags is a constant at every call site, so each combination gets its own loop without the unused work
+static inline void gpu_span_loop(uint16_t* vram, const gpu_draw_state* state, const gpu_span* span, const uint32_t flags)
+{
+    uint32_t r = span->r, g = span->g, b = span->b, u = span->u, v = span->v;
+
+    for(int32_t i = 0; i < span->length; i++)
+    {
+        gpu_shade_pixel(vram, state, flags, span->x + i, span->y,
+            gpu_clamp_color((int32_t)r >> 16), gpu_clamp_color((int32_t)g >> 16), gpu_clamp_color((int32_t)b >> 16),
+            ((int32_t)u >> 16) & 0xFF, ((int32_t)v >> 16) & 0xFF);
+
+        r += span->dr;
+        g += span->dg;
+        b += span->db;
+        u += span->du;
+        v += span->dv;
+    }
+}
+
+//Picks the vector span routine when the cpu supports it, returns false if only the scalar loop is available
+bool ps1_gpu_set_simd(ps1_gpu* gpu, bool enable)
+{
+    if(gpu->thread != NULL)
+        ps1_gpu_thread_sync(gpu->thread);
+
+    gpu->span_simd = NULL;
+#ifdef PS1_SIMD_AVX2
+    if(enable && ps1_cpu_has_avx2())
+        gpu->span_simd = ps1_gpu_draw_span_avx2;
+#endif
+    return gpu->span_simd != NULL || !enable;
+}
+
+#define GPU_SPAN_CASE(f) case (f): gpu_span_loop(gpu->vram, state, span, (f)); break;
+
+void ps1_gpu_draw_span(ps1_gpu* gpu, const gpu_draw_state* state, const gpu_span* span)
+{
+    gpu_span tail;
+    if(gpu->span_simd != NULL && span->length >= 8)
+    {
+        int32_t done = gpu->span_simd(gpu->vram, state, span);
+        if(done == span->length)
+            return;
+
+        //The scalar loop picks up where the vector one stopped
+        tail = *span;
+        tail.x += done;
+        tail.length -= done;
+        tail.r += (uint32_t)span->dr * done;
+        tail.g += (uint32_t)span->dg * done;
+        tail.b += (uint32_t)span->db * done;
+        tail.u += (uint32_t)span->du * done;
+        tail.v += (uint32_t)span->dv * done;
+        span = &tail;
+    }
+
+    switch(state->flags & GPU_SPAN_FLAGS)
+    {
+        GPU_SPAN_CASE(0)
+        GPU_SPAN_CASE(GPU_DRAW_TEXTURED)
+        GPU_SPAN_CASE(GPU_DRAW_TEXTURED | GPU_DRAW_RAW)
+        GPU_SPAN_CASE(GPU_DRAW_SEMI)
+        GPU_SPAN_CASE(GPU_DRAW_SEMI | GPU_DRAW_TEXTURED)
+        GPU_SPAN_CASE(GPU_DRAW_SEMI | GPU_DRAW_TEXTURED | GPU_DRAW_RAW)
+        GPU_SPAN_CASE(GPU_DRAW_DITHER)
+        GPU_SPAN_CASE(GPU_DRAW_DITHER | GPU_DRAW_TEXTURED)
+        GPU_SPAN_CASE(GPU_DRAW_DITHER | GPU_DRAW_TEXTURED | GPU_DRAW_RAW)
+        GPU_SPAN_CASE(GPU_DRAW_DITHER | GPU_DRAW_SEMI)
+        GPU_SPAN_CASE(GPU_DRAW_DITHER | GPU_DRAW_SEMI | GPU_DRAW_TEXTURED)
+        GPU_SPAN_CASE(GPU_DRAW_DITHER | GPU_DRAW_SEMI | GPU_DRAW_TEXTURED | GPU_DRAW_RAW)
+        GPU_SPAN_CASE(GPU_DRAW_CACHED | GPU_DRAW_TEXTURED)
+        GPU_SPAN_CASE(GPU_DRAW_CACHED | GPU_DRAW_TEXTURED | GPU_DRAW_RAW)
+        GPU_SPAN_CASE(GPU_DRAW_CACHED | GPU_DRAW_SEMI | GPU_DRAW_TEXTURED)
+        GPU_SPAN_CASE(GPU_DRAW_CACHED | GPU_DRAW_SEMI | GPU_DRAW_TEXTURED | GPU_DRAW_RAW)
+        GPU_SPAN_CASE(GPU_DRAW_CACHED | GPU_DRAW_DITHER | GPU_DRAW_TEXTURED)
+        GPU_SPAN_CASE(GPU_DRAW_CACHED | GPU_DRAW_DITHER | GPU_DRAW_TEXTURED | GPU_DRAW_RAW)
+        GPU_SPAN_CASE(GPU_DRAW_CACHED | GPU_DRAW_DITHER | GPU_DRAW_SEMI | GPU_DRAW_TEXTURED)
+        GPU_SPAN_CASE(GPU_DRAW_CACHED | GPU_DRAW_DITHER | GPU_DRAW_SEMI | GPU_DRAW_TEXTURED | GPU_DRAW_RAW)
+        default: gpu_span_loop(gpu->vram, state, span, state->flags); break; //Raw without texture
+    }
+}
+
+//Division rounding towards negative and positive infinity, C only truncates
+static inline int64_t gpu_floor_div(int64_t n, int64_t d)
+{
+    int64_t q = n / d;
+    return (n % d != 0 && ((n < 0) != (d < 0))) ? q - 1 : q;
+}
+
+static inline int64_t gpu_ceil_div(int64_t n, int64_t d)
+{
+    int64_t q = n / d;
+    return (n % d != 0 && ((n < 0) == (d < 0))) ? q + 1 : q;
+}
+
+//Plane of one attribute over the triangle in 16.16 fixed point
+typedef struct gpu_gradient
+{
+    int64_t base; //Value at the first vertex, rounding included
+    int64_t dx;
+    int64_t dy;
+} gpu_gradient;
+
+static void gpu_setup_gradient(gpu_gradient* gradient, int32_t a0, int32_t a1, int32_t a2, const gpu_vertex* v0, const gpu_vertex* v1, const gpu_vertex* v2, int64_t area)
+{
+    int64_t dx1 = v1->x - v0->x, dy1 = v1->y - v0->y;
+    int64_t dx2 = v2->x - v0->x, dy2 = v2->y - v0->y;
+
+    gradient->base = ((int64_t)a0 << 16) + 0x8000;
+    gradient->dx = (((a1 - a0) * dy2 - (a2 - a0) * dy1) * 65536) / area;
+    gradient->dy = (((a2 - a0) * dx1 - (a1 - a0) * dx2) * 65536) / area;
+}
+
+static inline void gpu_gradient_at(const gpu_gradient* gradient, int32_t x, int32_t y, const gpu_vertex* origin, int32_t* value, int32_t* step)
+{
+    *value = gpu_clamp_fixed(gradient->base + gradient->dx * (x - origin->x) + gradient->dy * (y - origin->y));
+    *step = gpu_clamp_fixed(gradient->dx);
+}
+
+//Pixels are sampled at integer coordinates, pixels on the right and bottom edges are not drawn. Like the other
+//draw functions it returns the pixels covered inside the drawing area, masked and transparent ones included.
+uint32_t ps1_gpu_draw_triangle(ps1_gpu* gpu, const gpu_draw_state* state, const gpu_vertex* v0, const gpu_vertex* v1, const gpu_vertex* v2)
+{
+    int64_t area = (int64_t)(v1->x - v0->x) * (v2->y - v0->y) - (int64_t)(v2->x - v0->x) * (v1->y - v0->y);
+    if(area == 0)
+        return 0;
+
+    //Make the winding positive so every edge function is positive inside
+    if(area < 0)
+    {
+        const gpu_vertex* swap = v1;
+        v1 = v2;
+        v2 = swap;
+        area = -area;
+    }
+
+    const gpu_vertex* vertices[3] = {v0, v1, v2};
+    int64_t edge_a[3], edge_b[3], edge_c[3], edge_bias[3];
+    int32_t min_x = v0->x, max_x = v0->x, min_y = v0->y, max_y = v0->y;
+    for(int i = 0; i < 3; i++)
+    {
+        const gpu_vertex* a = vertices[i];
+        const gpu_vertex* b = vertices[(i + 1) % 3];
+
+        edge_a[i] = a->y - b->y;
+        edge_b[i] = b->x - a->x;
+        edge_c[i] = (int64_t)(b->y - a->y) * a->x - (int64_t)(b->x - a->x) * a->y;
+        //Top and left edges own the pixels exactly on them
+        edge_bias[i] = (edge_a[i] > 0 || (edge_a[i] == 0 && edge_b[i] > 0)) ? 0 : 1;
+
+        min_x = a->x < min_x ? a->x : min_x;
+        max_x = a->x > max_x ? a->x : max_x;
+        min_y = a->y < min_y ? a->y : min_y;
+        max_y = a->y > max_y ? a->y : max_y;
+    }
+
+    min_x = min_x > state->clip_left ? min_x : state->clip_left;
+    max_x = max_x < state->clip_right ? max_x : state->clip_right;
+    min_y = min_y > state->clip_top ? min_y : state->clip_top;
+    max_y = max_y < state->clip_bottom ? max_y : state->clip_bottom;
+
+    gpu_gradient r = {0}, g = {0}, b = {0}, u = {0}, v = {0};
+    if(state->flags & GPU_DRAW_GOURAUD)
+    {
+        gpu_setup_gradient(&r, v0->r, v1->r, v2->r, v0, v1, v2, area);
+        gpu_setup_gradient(&g, v0->g, v1->g, v2->g, v0, v1, v2, area);
+        gpu_setup_gradient(&b, v0->b, v1->b, v2->b, v0, v1, v2, area);
+    }
+    else
+    {
+        r.base = (int64_t)v0->r << 16;
+        g.base = (int64_t)v0->g << 16;
+        b.base = (int64_t)v0->b << 16;
+    }
+    if(state->flags & GPU_DRAW_TEXTURED)
+    {
+        gpu_setup_gradient(&u, v0->u, v1->u, v2->u, v0, v1, v2, area);
+        gpu_setup_gradient(&v, v0->v, v1->v, v2->v, v0, v1, v2, area);
+    }
+
+    uint32_t pixels = 0;
+    for(int32_t y = min_y; y <= max_y; y++)
+    {
+        //Every edge limits the row to one side of it: a * x >= bias - b * y - c
+        int64_t left = min_x, right = max_x;
+        for(int i = 0; i < 3; i++)
+        {
+            int64_t limit = edge_bias[i] - edge_b[i] * y - edge_c[i];
+            if(edge_a[i] > 0)
+            {
+                int64_t x = gpu_ceil_div(limit, edge_a[i]);
+                left = x > left ? x : left;
+            }
+            else if(edge_a[i] < 0)
+            {
+                int64_t x = gpu_floor_div(limit, edge_a[i]);
+                right = x < right ? x : right;
+            }
+            else if(limit > 0)
+                right = left - 1;
+        }
+
+        if(left > right)
+            continue;
+
+        gpu_span span;
+        span.x = left;
+        span.y = y;
+        span.length = right - left + 1;
+        gpu_gradient_at(&r, left, y, v0, &span.r, &span.dr);
+        gpu_gradient_at(&g, left, y, v0, &span.g, &span.dg);
+        gpu_gradient_at(&b, left, y, v0, &span.b, &span.db);
+        gpu_gradient_at(&u, left, y, v0, &span.u, &span.du);
+        gpu_gradient_at(&v, left, y, v0, &span.v, &span.dv);
+        ps1_gpu_draw_span(gpu, state, &span);
+        pixels += span.length;
+    }
+    return pixels;
+}
+
+//Both end points are drawn, the major axis advances one pixel per step
+uint32_t ps1_gpu_draw_line(ps1_gpu* gpu, const gpu_draw_state* state, const gpu_vertex* v0, const gpu_vertex* v1)
+{
+    int32_t dx = v1->x - v0->x;
+    int32_t dy = v1->y - v0->y;
+    int32_t steps = abs(dx) > abs(dy) ? abs(dx) : abs(dy);
+
+    int32_t x = v0->x * 65536 + 0x8000, y = v0->y * 65536 + 0x8000;
+    int32_t r = v0->r << 16, g = v0->g << 16, b = v0->b << 16;
+    int32_t step_x = 0, step_y = 0, step_r = 0, step_g = 0, step_b = 0;
+    if(steps > 0)
+    {
+        step_x = (int32_t)(((int64_t)dx << 16) / steps);
+        step_y = (int32_t)(((int64_t)dy << 16) / steps);
+        if(state->flags & GPU_DRAW_GOURAUD)
+        {
+            step_r = (v1->r - v0->r) * 65536 / steps;
+            step_g = (v1->g - v0->g) * 65536 / steps;
+            step_b = (v1->b - v0->b) * 65536 / steps;
+        }
+    }
+
+    uint32_t pixels = 0;
+    for(int32_t i = 0; i <= steps; i++)
+    {
+        int32_t px = x >> 16, py = y >> 16;
+        if(px >= state->clip_left && px <= state->clip_right && py >= state->clip_top && py <= state->clip_bottom)
+        {
+            gpu_shade_pixel(gpu->vram, state, state->flags & ~GPU_DRAW_TEXTURED, px, py, r >> 16, g >> 16, b >> 16, 0, 0);
+            pixels++;
+        }
+
+        x += step_x;
+        y += step_y;
+        r += step_r;
+        g += step_g;
+        b += step_b;
+    }
+    return pixels;
+}
+
+//Rectangles map texels one to one, u and v wrap at 256 and may run backwards when flipped
+uint32_t ps1_gpu_draw_rect(ps1_gpu* gpu, const gpu_draw_state* state, const gpu_vertex* origin, int32_t width, int32_t height)
+{
+    int32_t left = origin->x > state->clip_left ? origin->x : state->clip_left;
+    int32_t right = origin->x + width - 1 < state->clip_right ? origin->x + width - 1 : state->clip_right;
+    int32_t top = origin->y > state->clip_top ? origin->y : state->clip_top;
+    int32_t bottom = origin->y + height - 1 < state->clip_bottom ? origin->y + height - 1 : state->clip_bottom;
+    if(left > right || top > bottom)
+        return 0;
+
+    int32_t step_u = state->flip_x ? -1 : 1;
+    int32_t step_v = state->flip_y ? -1 : 1;
+
+    gpu_span span;
+    span.x = left;
+    span.length = right - left + 1;
+    span.r = origin->r << 16;
+    span.g = origin->g << 16;
+    span.b = origin->b << 16;
+    span.u = (origin->u + (left - origin->x) * step_u) * 65536;
+    span.dr = span.dg = span.db = span.dv = 0;
+    span.du = step_u << 16;
+
+    for(int32_t y = top; y <= bottom; y++)
+    {
+        span.y = y;
+        span.v = (origin->v + (y - origin->y) * step_v) * 65536;
+        ps1_gpu_draw_span(gpu, state, &span);
+    }
+    return span.length * (bottom - top + 1);
+}
@@ -0,0 +1,187 @@
+#include "gpu.h"
+#include "gpu_raster.h"
+
+#ifdef PS1_SIMD_AVX2
+
+#include <immintrin.h>
+
+PS1_AVX2_TARGET static inline __m256i gpu_avx2_clamp(__m256i value, int32_t max)
+{
+    return _mm256_min_epi32(_mm256_max_epi32(value, _mm256_setzero_si256()), _mm256_set1_epi32(max));
+}
+
+//16 bit VRAM words at the given pixel indices, the 32 bit gathers read one halfword past the last pixel
+PS1_AVX2_TARGET static inline __m256i gpu_avx2_gather(const uint16_t* vram, __m256i index)
+{
+    return _mm256_and_si256(_mm256_i32gather_epi32((const int*)vram, index, 2), _mm256_set1_epi32(0xFFFF));
+}
+
+PS1_AVX2_TARGET static inline __m256i gpu_avx2_fetch_texels(const uint16_t* vram, const gpu_draw_state* state, __m256i u, __m256i v)
+{
+    u = _mm256_or_si256(_mm256_and_si256(u, _mm256_set1_epi32(state->window_and_u)), _mm256_set1_epi32(state->window_or_u));
+    v = _mm256_or_si256(_mm256_and_si256(v, _mm256_set1_epi32(state->window_and_v)), _mm256_set1_epi32(state->window_or_v));
+    if(state->flags & GPU_DRAW_CACHED)
+        return gpu_avx2_gather(state->texels, _mm256_or_si256(_mm256_slli_epi32(v, 8), u));
+
+    __m256i row = _mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(v, _mm256_set1_epi32(state->texpage_y)), _mm256_set1_epi32(0x1FF)), 10);
+    __m256i column_mask = _mm256_set1_epi32(0x3FF);
+    __m256i page_x = _mm256_set1_epi32(state->texpage_x);
+
+    if(state->texture_depth == GPU_TEXTURE_15BIT)
+        return gpu_avx2_gather(vram, _mm256_add_epi32(row, _mm256_and_si256(_mm256_add_epi32(page_x, u), column_mask)));
+
+    __m256i index;
+    if(state->texture_depth == GPU_TEXTURE_4BIT)
+    {
+        __m256i column = _mm256_and_si256(_mm256_add_epi32(page_x, _mm256_srli_epi32(u, 2)), column_mask);
+        __m256i indices = gpu_avx2_gather(vram, _mm256_add_epi32(row, column));
+        __m256i shift = _mm256_slli_epi32(_mm256_and_si256(u, _mm256_set1_epi32(3)), 2);
+        index = _mm256_and_si256(_mm256_srlv_epi32(indices, shift), _mm256_set1_epi32(0xF));
+    }
+    else
+    {
+        __m256i column = _mm256_and_si256(_mm256_add_epi32(page_x, _mm256_srli_epi32(u, 1)), column_mask);
+        __m256i indices = gpu_avx2_gather(vram, _mm256_add_epi32(row, column));
+        __m256i shift = _mm256_slli_epi32(_mm256_and_si256(u, _mm256_set1_epi32(1)), 3);
+        index = _mm256_and_si256(_mm256_srlv_epi32(indices, shift), _mm256_set1_epi32(0xFF));
+    }
+
+    __m256i clut = _mm256_and_si256(_mm256_add_epi32(_mm256_set1_epi32(state->clut_x), index), column_mask);
+    return gpu_avx2_gather(vram, _mm256_add_epi32(_mm256_set1_epi32(state->clut_y * GPU_VRAM_WIDTH), clut));
+}
+
+//Same per channel rules as the scalar gpu_blend, on 5 bit channels
+PS1_AVX2_TARGET static inline __m256i gpu_avx2_blend(__m256i back, __m256i front, uint8_t mode)
+{
+    __m256i result = _mm256_setzero_si256();
+    __m256i channel_mask = _mm256_set1_epi32(0x1F);
+    for(int shift = 0; shift < 15; shift += 5)
+    {
+        __m256i b = _mm256_and_si256(_mm256_srli_epi32(back, shift), channel_mask);
+        __m256i f = _mm256_and_si256(_mm256_srli_epi32(front, shift), channel_mask);
+        __m256i c;
+        switch(mode)
+        {
+            case 0: c = _mm256_srli_epi32(_mm256_add_epi32(b, f), 1); break;
+            case 1: c = _mm256_add_epi32(b, f); break;
+            case 2: c = _mm256_sub_epi32(b, f); break;
+            default: c = _mm256_add_epi32(b, _mm256_srli_epi32(f, 2)); break;
+        }
+        result = _mm256_or_si256(result, _mm256_slli_epi32(gpu_avx2_clamp(c, 31), shift));
+    }
+    return result;
+}
+
+/*
+ Draws the span 8 pixels at a time and returns how many pixels it drew, always a multiple of 8. The caller
+ finishes the rest with the scalar loop. Every lane goes through the same steps as gpu_shade_pixel, so the
+ result is identical as long as the span doesn't sample texels it is drawing over itself.
+*/
+PS1_AVX2_TARGET int32_t ps1_gpu_draw_span_avx2(uint16_t* vram, const gpu_draw_state* state, const gpu_span* span)
+{
+    const uint32_t flags = state->flags;
+    const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i top_bit = _mm256_set1_epi32(0x8000);
+    const __m256i channel_mask = _mm256_set1_epi32(0x1F);
+    const __m256i byte_mask = _mm256_set1_epi32(0xFF);
+
+    //Attributes of every lane, the steps wrap around exactly like the scalar 32 bit additions
+    __m256i r = _mm256_add_epi32(_mm256_set1_epi32(span->r), _mm256_mullo_epi32(lane, _mm256_set1_epi32(span->dr)));
+    __m256i g = _mm256_add_epi32(_mm256_set1_epi32(span->g), _mm256_mullo_epi32(lane, _mm256_set1_epi32(span->dg)));
+    __m256i b = _mm256_add_epi32(_mm256_set1_epi32(span->b), _mm256_mullo_epi32(lane, _mm256_set1_epi32(span->db)));
+    __m256i u = _mm256_add_epi32(_mm256_set1_epi32(span->u), _mm256_mullo_epi32(lane, _mm256_set1_epi32(span->du)));
+    __m256i v = _mm256_add_epi32(_mm256_set1_epi32(span->v), _mm256_mullo_epi32(lane, _mm256_set1_epi32(span->dv)));
+    const __m256i step_r = _mm256_set1_epi32((uint32_t)span->dr * 8);
+    const __m256i step_g = _mm256_set1_epi32((uint32_t)span->dg * 8);
+    const __m256i step_b = _mm256_set1_epi32((uint32_t)span->db * 8);
+    const __m256i step_u = _mm256_set1_epi32((uint32_t)span->du * 8);
+    const __m256i step_v = _mm256_set1_epi32((uint32_t)span->dv * 8);
+
+    //Blocks start 8 pixels apart, so every block sees the same dither column pattern
+    __m256i dither = zero;
+    if(flags & GPU_DRAW_DITHER)
+    {
+        static const int8_t matrix[4][4] = {{-4, 0, -3, 1}, {2, -2, 3, -1}, {-3, 1, -4, 0}, {3, -1, 2, -2}};
+        const int8_t* row = matrix[span->y & 3];
+        int32_t x = span->x;
+        dither = _mm256_setr_epi32(row[x & 3], row[(x + 1) & 3], row[(x + 2) & 3], row[(x + 3) & 3],
+                                   row[x & 3], row[(x + 1) & 3], row[(x + 2) & 3], row[(x + 3) & 3]);
+    }
+
+    const __m256i mask_check = _mm256_set1_epi32(state->mask_check);
+    const __m256i mask_set = _mm256_set1_epi32(state->mask_set);
+    uint16_t* dest = vram + span->y * GPU_VRAM_WIDTH + span->x;
+    int32_t blocks = span->length / 8;
+
+    for(int32_t block = 0; block < blocks; block++, dest += 8)
+    {
+        __m256i back = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)dest));
+        __m256i write = _mm256_cmpeq_epi32(_mm256_and_si256(back, mask_check), zero);
+
+        __m256i cr = gpu_avx2_clamp(_mm256_srai_epi32(r, 16), 255);
+        __m256i cg = gpu_avx2_clamp(_mm256_srai_epi32(g, 16), 255);
+        __m256i cb = gpu_avx2_clamp(_mm256_srai_epi32(b, 16), 255);
+        __m256i texel = zero;
+
+        if(flags & GPU_DRAW_TEXTURED)
+        {
+            __m256i tu = _mm256_and_si256(_mm256_srai_epi32(u, 16), byte_mask);
+            __m256i tv = _mm256_and_si256(_mm256_srai_epi32(v, 16), byte_mask);
+            texel = gpu_avx2_fetch_texels(vram, state, tu, tv);
+            write = _mm256_andnot_si256(_mm256_cmpeq_epi32(texel, zero), write);
+
+            __m256i tr = _mm256_and_si256(texel, channel_mask);
+            __m256i tg = _mm256_and_si256(_mm256_srli_epi32(texel, 5), channel_mask);
+            __m256i tb = _mm256_and_si256(_mm256_srli_epi32(texel, 10), channel_mask);
+            if(flags & GPU_DRAW_RAW)
+            {
+                cr = _mm256_slli_epi32(tr, 3);
+                cg = _mm256_slli_epi32(tg, 3);
+                cb = _mm256_slli_epi32(tb, 3);
+            }
+            else
+            {
+                cr = _mm256_min_epi32(_mm256_srli_epi32(_mm256_mullo_epi32(tr, cr), 4), byte_mask);
+                cg = _mm256_min_epi32(_mm256_srli_epi32(_mm256_mullo_epi32(tg, cg), 4), byte_mask);
+                cb = _mm256_min_epi32(_mm256_srli_epi32(_mm256_mullo_epi32(tb, cb), 4), byte_mask);
+            }
+        }
+
+        if(flags & GPU_DRAW_DITHER)
+        {
+            cr = gpu_avx2_clamp(_mm256_add_epi32(cr, dither), 255);
+            cg = gpu_avx2_clamp(_mm256_add_epi32(cg, dither), 255);
+            cb = gpu_avx2_clamp(_mm256_add_epi32(cb, dither), 255);
+        }
+
+        __m256i color = _mm256_or_si256(_mm256_srli_epi32(cr, 3),
+                        _mm256_or_si256(_mm256_slli_epi32(_mm256_srli_epi32(cg, 3), 5), _mm256_slli_epi32(_mm256_srli_epi32(cb, 3), 10)));
+
+        if(flags & GPU_DRAW_SEMI)
+        {
+            __m256i blended = gpu_avx2_blend(back, color, state->semi_mode);
+            if(flags & GPU_DRAW_TEXTURED)
+                color = _mm256_blendv_epi8(color, blended, _mm256_cmpeq_epi32(_mm256_and_si256(texel, top_bit), top_bit));
+            else
+                color = blended;
+        }
+
+        color = _mm256_or_si256(_mm256_or_si256(color, mask_set), _mm256_and_si256(texel, top_bit));
+        __m256i result = _mm256_blendv_epi8(back, color, write);
+
+        //packus works inside each 128 bit half, the permute puts the 8 halfwords back in order
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(result, result), 0x08);
+        _mm_storeu_si128((__m128i*)dest, _mm256_castsi256_si128(packed));
+
+        r = _mm256_add_epi32(r, step_r);
+        g = _mm256_add_epi32(g, step_g);
+        b = _mm256_add_epi32(b, step_b);
+        u = _mm256_add_epi32(u, step_u);
+        v = _mm256_add_epi32(v, step_v);
+    }
+
+    return blocks * 8;
+}
+
+#endif
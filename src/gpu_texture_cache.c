@@ -0,0 +1,200 @@
+#include "gpu.h"
+#include "gpu_texture_cache.h"
+#include "gpu_thread.h"
+#include "gpu_tiles.h"
+
+ps1_gpu_texture_cache* ps1_gpu_texture_cache_create()
+{
+    return (ps1_gpu_texture_cache*)malloc(sizeof(ps1_gpu_texture_cache));
+}
+
+void ps1_gpu_texture_cache_init(ps1_gpu_texture_cache* cache)
+{
+    memset(cache, 0, sizeof(ps1_gpu_texture_cache));
+}
+
+void ps1_gpu_texture_cache_destroy(ps1_gpu_texture_cache* cache)
+{
+    for(uint32_t i = 0; i < GPU_TEXTURE_CACHE_ENTRIES; i++)
+    {
+        if(cache->entries[i].texels != NULL)
+            free (cache->entries[i].texels);
+    }
+    free (cache);
+}
+
+//Textures are sampled straight from VRAM when the cache is off
+bool ps1_gpu_set_texture_cache(ps1_gpu* gpu, bool enable)
+{
+    if(gpu->thread != NULL)
+        ps1_gpu_thread_sync(gpu->thread);
+    ps1_gpu_flush_primitives(gpu);
+
+    if(enable && gpu->texture_cache == NULL)
+    {
+        gpu->texture_cache = ps1_gpu_texture_cache_create();
+        ps1_gpu_texture_cache_init(gpu->texture_cache);
+    }
+    else if(!enable && gpu->texture_cache != NULL)
+    {
+        ps1_gpu_texture_cache_destroy(gpu->texture_cache);
+        gpu->texture_cache = NULL;
+    }
+    return true;
+}
+
+//VRAM a textured primitive may sample, its texture page plus the CLUT for the palette depths
+void ps1_gpu_texture_box(const gpu_draw_state* state, int32_t* box)
+{
+    gpu_box_clear(box);
+    if(!(state->flags & GPU_DRAW_TEXTURED))
+        return;
+
+    gpu_box_add(box, state->texpage_x, state->texpage_y, 64 << state->texture_depth, 256);
+    switch(state->texture_depth)
+    {
+        case GPU_TEXTURE_4BIT: gpu_box_add(box, state->clut_x, state->clut_y, 16, 1); break;
+        case GPU_TEXTURE_8BIT: gpu_box_add(box, state->clut_x, state->clut_y, 256, 1); break;
+        default: break;
+    }
+}
+
+//15 bit textures don't use the CLUT, so any CLUT maps to the same entry
+static uint32_t gpu_texture_key(const gpu_draw_state* state)
+{
+    uint32_t key = (state->texpage_x / 64) | ((state->texpage_y / 256) << 4) | (state->texture_depth << 5);
+    if(state->texture_depth != GPU_TEXTURE_15BIT)
+        key |= ((state->clut_x / 16) << 7) | (state->clut_y << 13);
+    return key;
+}
+
+//Same addressing as gpu_fetch_texel for every u and v
+static void gpu_texture_decode(const uint16_t* vram, const gpu_draw_state* state, uint16_t* texels)
+{
+    const uint16_t* clut = vram + state->clut_y * GPU_VRAM_WIDTH;
+
+    for(uint32_t v = 0; v < 256; v++)
+    {
+        const uint16_t* row = vram + ((state->texpage_y + v) & 0x1FF) * GPU_VRAM_WIDTH;
+        uint16_t* out = texels + v * 256;
+
+        switch(state->texture_depth)
+        {
+            case GPU_TEXTURE_4BIT:
+                for(uint32_t u = 0; u < 256; u += 4)
+                {
+                    uint16_t indices = row[(state->texpage_x + u / 4) & 0x3FF];
+                    for(uint32_t i = 0; i < 4; i++)
+                        out[u + i] = clut[(state->clut_x + ((indices >> (i * 4)) & 0xF)) & 0x3FF];
+                }
+                break;
+            case GPU_TEXTURE_8BIT:
+                for(uint32_t u = 0; u < 256; u += 2)
+                {
+                    uint16_t indices = row[(state->texpage_x + u / 2) & 0x3FF];
+                    out[u] = clut[(state->clut_x + (indices & 0xFF)) & 0x3FF];
+                    out[u + 1] = clut[(state->clut_x + (indices >> 8)) & 0x3FF];
+                }
+                break;
+            default:
+                for(uint32_t u = 0; u < 256; u++)
+                    out[u] = row[(state->texpage_x + u) & 0x3FF];
+                break;
+        }
+    }
+}
+
+//Decoded texels for a textured primitive, NULL when the cache is off
+const uint16_t* ps1_gpu_texture_cache_lookup(ps1_gpu* gpu, const gpu_draw_state* state)
+{
+    ps1_gpu_texture_cache* cache = gpu->texture_cache;
+    if(cache == NULL)
+        return NULL;
+
+    uint32_t key = gpu_texture_key(state);
+    cache->clock++;
+
+    gpu_cached_texture* entry = &cache->entries[cache->last];
+    if(!entry->valid || entry->key != key)
+    {
+        entry = NULL;
+        for(uint32_t i = 0; i < GPU_TEXTURE_CACHE_ENTRIES; i++)
+        {
+            if(cache->entries[i].valid && cache->entries[i].key == key)
+            {
+                entry = &cache->entries[i];
+                cache->last = i;
+                break;
+            }
+        }
+    }
+
+    if(entry != NULL)
+    {
+        cache->hits++;
+        entry->last_used = cache->clock;
+        return entry->texels;
+    }
+
+    cache->misses++;
+
+    //Batched primitives may still point at the entry about to be replaced
+    ps1_gpu_flush_primitives(gpu);
+
+    uint32_t victim = 0;
+    for(uint32_t i = 0; i < GPU_TEXTURE_CACHE_ENTRIES; i++)
+    {
+        if(!cache->entries[i].valid)
+        {
+            victim = i;
+            break;
+        }
+        if(cache->entries[i].last_used < cache->entries[victim].last_used)
+            victim = i;
+    }
+
+    entry = &cache->entries[victim];
+    if(entry->texels == NULL)
+        entry->texels = (uint16_t*)malloc((GPU_TEXTURE_TEXELS + 1) * sizeof(uint16_t));
+    entry->texels[GPU_TEXTURE_TEXELS] = 0;
+
+    gpu_texture_decode(gpu->vram, state, entry->texels);
+    entry->key = key;
+    entry->valid = true;
+    entry->last_used = cache->clock;
+    ps1_gpu_texture_box(state, entry->box);
+    cache->last = victim;
+    return entry->texels;
+}
+
+//Drops the entries decoded from a VRAM rectangle, which may wrap around either edge
+void ps1_gpu_texture_cache_invalidate(ps1_gpu* gpu, int32_t x, int32_t y, int32_t width, int32_t height)
+{
+    ps1_gpu_texture_cache* cache = gpu->texture_cache;
+    if(cache == NULL)
+        return;
+
+    if(x + width > GPU_VRAM_WIDTH)
+    {
+        ps1_gpu_texture_cache_invalidate(gpu, x, y, GPU_VRAM_WIDTH - x, height);
+        ps1_gpu_texture_cache_invalidate(gpu, 0, y, x + width - GPU_VRAM_WIDTH, height);
+        return;
+    }
+    if(y + height > GPU_VRAM_HEIGHT)
+    {
+        ps1_gpu_texture_cache_invalidate(gpu, x, y, width, GPU_VRAM_HEIGHT - y);
+        ps1_gpu_texture_cache_invalidate(gpu, x, 0, width, y + height - GPU_VRAM_HEIGHT);
+        return;
+    }
+
+    int32_t box[4] = {x, y, x + width - 1, y + height - 1};
+    for(uint32_t i = 0; i < GPU_TEXTURE_CACHE_ENTRIES; i++)
+    {
+        gpu_cached_texture* entry = &cache->entries[i];
+        if(entry->valid && gpu_box_overlaps(entry->box, box))
+        {
+            entry->valid = false;
+            cache->invalidations++;
+        }
+    }
+}
@@ -0,0 +1,159 @@
+#include <sched.h>
+#include "gpu.h"
+#include "gpu_thread.h"
+#include "gpu_tiles.h"
+
+#define GPU_THREAD_SPINS 64 //Yields before the render thread goes to sleep on an empty ring
+
+static void gpu_thread_wait_for_work(ps1_gpu_thread* thread, uint32_t tail)
+{
+    for(int i = 0; i < GPU_THREAD_SPINS; i++)
+    {
+        if(atomic_load_explicit(&thread->head, memory_order_acquire) != tail)
+            return;
+        sched_yield();
+    }
+
+    //sleeping is set before head is checked again, the producer publishes head before it checks sleeping
+    pthread_mutex_lock(&thread->lock);
+    atomic_store(&thread->sleeping, true);
+    while(atomic_load(&thread->head) == tail)
+        pthread_cond_wait(&thread->wake, &thread->lock);
+    atomic_store(&thread->sleeping, false);
+    pthread_mutex_unlock(&thread->lock);
+}
+
+static void* gpu_thread_main(void* arg)
+{
+    ps1_gpu_thread* thread = (ps1_gpu_thread*)arg;
+
+    while(true)
+    {
+        uint32_t tail = atomic_load_explicit(&thread->tail, memory_order_relaxed);
+        if(atomic_load_explicit(&thread->head, memory_order_acquire) == tail)
+        {
+            gpu_thread_wait_for_work(thread, tail);
+            continue;
+        }
+
+        uint32_t offset = tail & (GPU_RING_SIZE - 1);
+        uint32_t header = thread->ring[offset];
+        uint32_t count = header & 0xFFFFFF;
+
+        switch(header >> 24)
+        {
+            case GPU_RING_GP0:
+                ps1_gpu_execute_gp0_block(thread->gpu, &thread->ring[offset + 1], count);
+                break;
+            case GPU_RING_GP1:
+                ps1_gpu_execute_gp1(thread->gpu, thread->ring[offset + 1]);
+                break;
+            case GPU_RING_PAD:
+                count = GPU_RING_SIZE - offset - 1;
+                break;
+            case GPU_RING_QUIT:
+                atomic_store_explicit(&thread->tail, tail + 1, memory_order_release);
+                return NULL;
+        }
+
+        //Primitives still batched for the workers are drawn once the ring runs dry, before sync can return
+        if(atomic_load_explicit(&thread->head, memory_order_acquire) == tail + 1 + count)
+            ps1_gpu_flush_primitives(thread->gpu);
+
+        //Only now is the entry done, sync waits for tail to reach head
+        atomic_store_explicit(&thread->tail, tail + 1 + count, memory_order_release);
+    }
+}
+
+void ps1_gpu_thread_push(ps1_gpu_thread* thread, GPU_RING_ENTRY type, const uint32_t* words, uint32_t count)
+{
+    while(count > GPU_RING_MAX_ENTRY)
+    {
+        ps1_gpu_thread_push(thread, type, words, GPU_RING_MAX_ENTRY);
+        words += GPU_RING_MAX_ENTRY;
+        count -= GPU_RING_MAX_ENTRY;
+    }
+
+    uint32_t head = atomic_load_explicit(&thread->head, memory_order_relaxed);
+    uint32_t offset = head & (GPU_RING_SIZE - 1);
+    uint32_t needed = count + 1;
+    uint32_t pad = GPU_RING_SIZE - offset < needed ? GPU_RING_SIZE - offset : 0;
+
+    //A full ring means the render thread is behind, the cpu thread waits for it
+    while(head + pad + needed - atomic_load_explicit(&thread->tail, memory_order_acquire) > GPU_RING_SIZE)
+        sched_yield();
+
+    if(pad)
+    {
+        thread->ring[offset] = GPU_RING_PAD << 24;
+        head += pad;
+        offset = 0;
+    }
+
+    thread->ring[offset] = (type << 24) | count;
+    if(count)
+        memcpy(&thread->ring[offset + 1], words, count * sizeof(uint32_t));
+    atomic_store(&thread->head, head + needed);
+
+    if(atomic_load(&thread->sleeping))
+    {
+        pthread_mutex_lock(&thread->lock);
+        pthread_cond_signal(&thread->wake);
+        pthread_mutex_unlock(&thread->lock);
+    }
+}
+
+//Waits until the render thread has executed everything pushed so far, after this the cpu thread may look at the GPU state
+void ps1_gpu_thread_sync(ps1_gpu_thread* thread)
+{
+    uint32_t head = atomic_load_explicit(&thread->head, memory_order_relaxed);
+    while(atomic_load_explicit(&thread->tail, memory_order_acquire) != head)
+        sched_yield();
+}
+
+bool ps1_gpu_start_thread(ps1_gpu* gpu)
+{
+    if(gpu->thread != NULL)
+        return true;
+
+    ps1_gpu_thread* thread = (ps1_gpu_thread*)malloc(sizeof(ps1_gpu_thread));
+    memset(thread, 0, sizeof(ps1_gpu_thread));
+    thread->gpu = gpu;
+    thread->ring = (uint32_t*)malloc(GPU_RING_SIZE * sizeof(uint32_t));
+    atomic_init(&thread->head, 0);
+    atomic_init(&thread->tail, 0);
+    atomic_init(&thread->sleeping, false);
+    pthread_mutex_init(&thread->lock, NULL);
+    pthread_cond_init(&thread->wake, NULL);
+    ps1_gpu_seed_status(gpu);
+
+    if(pthread_create(&thread->thread, NULL, gpu_thread_main, thread) != 0)
+    {
+        printf("Couldn't start the GPU thread\n");
+        pthread_cond_destroy(&thread->wake);
+        pthread_mutex_destroy(&thread->lock);
+        free (thread->ring);
+        free (thread);
+        return false;
+    }
+
+    gpu->thread = thread;
+    return true;
+}
+
+//Runs what is left in the ring and goes back to executing commands on the cpu thread
+void ps1_gpu_stop_thread(ps1_gpu* gpu)
+{
+    ps1_gpu_thread* thread = gpu->thread;
+    if(thread == NULL)
+        return;
+
+    ps1_gpu_thread_push(thread, GPU_RING_QUIT, NULL, 0);
+    pthread_join(thread->thread, NULL);
+    gpu->thread = NULL;
+
+    pthread_cond_destroy(&thread->wake);
+    pthread_mutex_destroy(&thread->lock);
+    free (thread->ring);
+    free (thread);
+}
@@ -0,0 +1,254 @@
+#include "gpu.h"
+#include "gpu_tiles.h"
+#include "gpu_texture_cache.h"
+
+static uint32_t gpu_primitive_draw(ps1_gpu* gpu, const gpu_primitive* primitive, const gpu_draw_state* state)
+{
+    switch(primitive->type)
+    {
+        case GPU_PRIMITIVE_TRIANGLE:
+            return ps1_gpu_draw_triangle(gpu, state, &primitive->vertices[0], &primitive->vertices[1], &primitive->vertices[2]);
+        case GPU_PRIMITIVE_LINE:
+            return ps1_gpu_draw_line(gpu, state, &primitive->vertices[0], &primitive->vertices[1]);
+        case GPU_PRIMITIVE_RECT:
+            return ps1_gpu_draw_rect(gpu, state, &primitive->vertices[0], primitive->width, primitive->height);
+    }
+    return 0;
+}
+
+//Returns the pixels the worker drew
+static uint64_t gpu_tiles_draw(ps1_gpu_tiles* tiles, uint32_t worker)
+{
+    uint64_t pixels = 0;
+    for(uint32_t i = 0; i < tiles->batch_count; i++)
+    {
+        const gpu_primitive* primitive = &tiles->batch[i];
+
+        for(uint32_t tile = worker; tile < tiles->tile_count; tile += tiles->worker_count)
+        {
+            int32_t band_top = tile * tiles->tile_height;
+            int32_t band_bottom = tile == tiles->tile_count - 1 ? GPU_VRAM_HEIGHT - 1 : band_top + tiles->tile_height - 1;
+            if(primitive->bottom < band_top || primitive->top > band_bottom)
+                continue;
+
+            gpu_draw_state state = primitive->state;
+            state.clip_top = state.clip_top > band_top ? state.clip_top : band_top;
+            state.clip_bottom = state.clip_bottom < band_bottom ? state.clip_bottom : band_bottom;
+            pixels += gpu_primitive_draw(tiles->gpu, primitive, &state);
+        }
+    }
+    return pixels;
+}
+
+static void* gpu_worker_main(void* arg)
+{
+    gpu_worker* worker = (gpu_worker*)arg;
+    ps1_gpu_tiles* tiles = worker->tiles;
+    uint32_t seen = 0;
+
+    while(true)
+    {
+        pthread_mutex_lock(&tiles->lock);
+        while(tiles->generation == seen)
+            pthread_cond_wait(&tiles->start, &tiles->lock);
+        seen = tiles->generation;
+        if(tiles->quit)
+        {
+            pthread_mutex_unlock(&tiles->lock);
+            return NULL;
+        }
+        pthread_mutex_unlock(&tiles->lock);
+
+        uint64_t pixels = gpu_tiles_draw(tiles, worker->index);
+
+        pthread_mutex_lock(&tiles->lock);
+        tiles->pixels += pixels;
+        if(--tiles->busy == 0)
+            pthread_cond_signal(&tiles->done);
+        pthread_mutex_unlock(&tiles->lock);
+    }
+}
+
+static void gpu_tiles_reset_batch(ps1_gpu_tiles* tiles)
+{
+    tiles->batch_count = 0;
+    gpu_box_clear(tiles->dirty);
+    gpu_box_clear(tiles->sampled);
+}
+
+//Draws the batch on every worker, the calling thread included, and returns once all of them are done
+void ps1_gpu_flush_primitives(ps1_gpu* gpu)
+{
+    ps1_gpu_tiles* tiles = gpu->tiles;
+    if(tiles == NULL || tiles->batch_count == 0)
+        return;
+
+    pthread_mutex_lock(&tiles->lock);
+    tiles->busy = tiles->worker_count - 1;
+    tiles->generation++;
+    pthread_cond_broadcast(&tiles->start);
+    pthread_mutex_unlock(&tiles->lock);
+
+    uint64_t pixels = gpu_tiles_draw(tiles, 0);
+
+    pthread_mutex_lock(&tiles->lock);
+    while(tiles->busy)
+        pthread_cond_wait(&tiles->done, &tiles->lock);
+    gpu->pixel_count += pixels + tiles->pixels;
+    tiles->pixels = 0;
+    pthread_mutex_unlock(&tiles->lock);
+
+    gpu_tiles_reset_batch(tiles);
+}
+
+/*
+ Every primitive goes through here, batched or not: the texture is looked up in the cache once VRAM holds
+ everything sent before it, and whatever it draws over is dropped from the cache. bounds is left, top, right,
+ bottom before clipping.
+*/
+static void gpu_queue_primitive(ps1_gpu* gpu, gpu_primitive* primitive, const int32_t* bounds)
+{
+    gpu_draw_state* state = &primitive->state;
+    int32_t box[4] = {
+        bounds[0] > state->clip_left ? bounds[0] : state->clip_left,
+        bounds[1] > state->clip_top ? bounds[1] : state->clip_top,
+        bounds[2] < state->clip_right ? bounds[2] : state->clip_right,
+        bounds[3] < state->clip_bottom ? bounds[3] : state->clip_bottom
+    };
+    if(box[0] > box[2] || box[1] > box[3])
+        return;
+    gpu->primitive_count++;
+
+    //Workers run ahead of each other, so neither may a texture be sampled before the batch has drawn it
+    //nor drawn over before the batch is done sampling it
+    ps1_gpu_tiles* tiles = gpu->tiles;
+    int32_t texture[4];
+    ps1_gpu_texture_box(state, texture);
+    if(tiles != NULL && (tiles->batch_count == GPU_TILES_BATCH_SIZE || gpu_box_overlaps(texture, tiles->dirty) || gpu_box_overlaps(box, tiles->sampled)))
+        ps1_gpu_flush_primitives(gpu);
+
+    //A primitive sampling what it draws itself depends on the order its pixels are drawn in, so it reads
+    //VRAM as it goes and can't be split
+    bool self_sampling = gpu_box_overlaps(texture, box);
+    if((state->flags & GPU_DRAW_TEXTURED) && !self_sampling)
+    {
+        state->texels = ps1_gpu_texture_cache_lookup(gpu, state);
+        if(state->texels != NULL)
+            state->flags |= GPU_DRAW_CACHED;
+    }
+    ps1_gpu_texture_cache_invalidate(gpu, box[0], box[1], box[2] - box[0] + 1, box[3] - box[1] + 1);
+
+    if(tiles == NULL || self_sampling)
+    {
+        ps1_gpu_flush_primitives(gpu);
+        gpu->pixel_count += gpu_primitive_draw(gpu, primitive, state);
+        return;
+    }
+
+    primitive->top = box[1];
+    primitive->bottom = box[3];
+    tiles->batch[tiles->batch_count++] = *primitive;
+
+    gpu_box_add(tiles->dirty, box[0], box[1], box[2] - box[0] + 1, box[3] - box[1] + 1);
+    if(texture[0] <= texture[2] && !(state->flags & GPU_DRAW_CACHED))
+        gpu_box_add(tiles->sampled, texture[0], texture[1], texture[2] - texture[0] + 1, texture[3] - texture[1] + 1);
+}
+
+static void gpu_vertex_bounds(int32_t* bounds, const gpu_vertex* vertices, uint32_t count)
+{
+    bounds[0] = bounds[2] = vertices[0].x;
+    bounds[1] = bounds[3] = vertices[0].y;
+    for(uint32_t i = 1; i < count; i++)
+    {
+        bounds[0] = vertices[i].x < bounds[0] ? vertices[i].x : bounds[0];
+        bounds[1] = vertices[i].y < bounds[1] ? vertices[i].y : bounds[1];
+        bounds[2] = vertices[i].x > bounds[2] ? vertices[i].x : bounds[2];
+        bounds[3] = vertices[i].y > bounds[3] ? vertices[i].y : bounds[3];
+    }
+}
+
+void ps1_gpu_queue_triangle(ps1_gpu* gpu, const gpu_draw_state* state, const gpu_vertex* v0, const gpu_vertex* v1, const gpu_vertex* v2)
+{
+    gpu_primitive primitive = {.type = GPU_PRIMITIVE_TRIANGLE, .state = *state, .vertices = {*v0, *v1, *v2}};
+    int32_t bounds[4];
+    gpu_vertex_bounds(bounds, primitive.vertices, 3);
+    gpu_queue_primitive(gpu, &primitive, bounds);
+}
+
+void ps1_gpu_queue_line(ps1_gpu* gpu, const gpu_draw_state* state, const gpu_vertex* v0, const gpu_vertex* v1)
+{
+    gpu_primitive primitive = {.type = GPU_PRIMITIVE_LINE, .state = *state, .vertices = {*v0, *v1}};
+    int32_t bounds[4];
+    gpu_vertex_bounds(bounds, primitive.vertices, 2);
+    gpu_queue_primitive(gpu, &primitive, bounds);
+}
+
+void ps1_gpu_queue_rect(ps1_gpu* gpu, const gpu_draw_state* state, const gpu_vertex* origin, int32_t width, int32_t height)
+{
+    gpu_primitive primitive = {.type = GPU_PRIMITIVE_RECT, .state = *state, .vertices = {*origin}, .width = width, .height = height};
+    int32_t bounds[4] = {origin->x, origin->y, origin->x + width - 1, origin->y + height - 1};
+    gpu_queue_primitive(gpu, &primitive, bounds);
+}
+
+//Workers counts the thread that sends the commands, 1 or less goes back to drawing every primitive right away
+bool ps1_gpu_start_workers(ps1_gpu* gpu, uint32_t workers, uint32_t tiles)
+{
+    ps1_gpu_stop_workers(gpu);
+    if(workers <= 1)
+        return true;
+
+    workers = workers < GPU_TILES_MAX_WORKERS ? workers : GPU_TILES_MAX_WORKERS;
+    tiles = tiles < 1 ? 1 : (tiles > GPU_VRAM_HEIGHT ? GPU_VRAM_HEIGHT : tiles);
+
+    ps1_gpu_tiles* pool = (ps1_gpu_tiles*)malloc(sizeof(ps1_gpu_tiles));
+    memset(pool, 0, sizeof(ps1_gpu_tiles));
+    pool->gpu = gpu;
+    pool->tile_count = tiles;
+    pool->tile_height = GPU_VRAM_HEIGHT / tiles;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    gpu_tiles_reset_batch(pool);
+
+    //Worker 0 is the thread that flushes, only the others get a thread of their own
+    pool->worker_count = 1;
+    for(uint32_t i = 1; i < workers; i++)
+    {
+        gpu_worker* worker = &pool->workers[i];
+        worker->tiles = pool;
+        worker->index = i;
+        if(pthread_create(&worker->thread, NULL, gpu_worker_main, worker) != 0)
+        {
+            printf("Couldn't start GPU worker %d\n", i);
+            break;
+        }
+        pool->worker_count++;
+    }
+
+    gpu->tiles = pool;
+    return pool->worker_count == workers;
+}
+
+void ps1_gpu_stop_workers(ps1_gpu* gpu)
+{
+    ps1_gpu_tiles* tiles = gpu->tiles;
+    if(tiles == NULL)
+        return;
+
+    ps1_gpu_flush_primitives(gpu);
+
+    pthread_mutex_lock(&tiles->lock);
+    tiles->quit = true;
+    tiles->generation++;
+    pthread_cond_broadcast(&tiles->start);
+    pthread_mutex_unlock(&tiles->lock);
+
+    for(uint32_t i = 1; i < tiles->worker_count; i++)
+        pthread_join(tiles->workers[i].thread, NULL);
+
+    gpu->tiles = NULL;
+    pthread_cond_destroy(&tiles->done);
+    pthread_cond_destroy(&tiles->start);
+    pthread_mutex_destroy(&tiles->lock);
+    free (tiles);
+}
@@ -0,0 +1,163 @@
+#include "gpu.h"
+#include "gpu_trace.h"
+
+static void gpu_trace_flush(ps1_gpu_trace* trace)
+{
+    if(trace->buffer_count)
+        fwrite(trace->buffer, sizeof(uint32_t), trace->buffer_count, trace->file);
+    trace->buffer_count = 0;
+    trace->last_is_gp0 = false;
+}
+
+static void gpu_trace_write(ps1_gpu_trace* trace, const uint32_t* words, uint32_t count)
+{
+    while(count)
+    {
+        if(trace->buffer_count == GPU_TRACE_BUFFER_SIZE)
+            gpu_trace_flush(trace);
+
+        uint32_t length = GPU_TRACE_BUFFER_SIZE - trace->buffer_count;
+        length = count < length ? count : length;
+        memcpy(&trace->buffer[trace->buffer_count], words, length * sizeof(uint32_t));
+        trace->buffer_count += length;
+        words += length;
+        count -= length;
+    }
+}
+
+static void gpu_trace_append(ps1_gpu_trace* trace, GPU_TRACE_RECORD type, const uint32_t* words, uint32_t count)
+{
+    while(count > GPU_TRACE_MAX_RECORD)
+    {
+        gpu_trace_append(trace, type, words, GPU_TRACE_MAX_RECORD);
+        words += GPU_TRACE_MAX_RECORD;
+        count -= GPU_TRACE_MAX_RECORD;
+    }
+
+    //Single GP0 words written one after the other go into one record
+    if(type == GPU_TRACE_GP0 && trace->last_is_gp0 && trace->buffer_count + count <= GPU_TRACE_BUFFER_SIZE &&
+       (trace->buffer[trace->last_gp0] & 0xFFFFFF) + count <= GPU_TRACE_MAX_RECORD)
+    {
+        trace->buffer[trace->last_gp0] += count;
+        gpu_trace_write(trace, words, count);
+        return;
+    }
+
+    uint32_t header = (type << 24) | count;
+    gpu_trace_write(trace, &header, 1);
+    trace->last_gp0 = trace->buffer_count - 1;
+    trace->last_is_gp0 = type == GPU_TRACE_GP0;
+    gpu_trace_write(trace, words, count);
+}
+
+static void gpu_trace_gp0(ps1_gpu_trace* trace, uint32_t value)
+{
+    gpu_trace_append(trace, GPU_TRACE_GP0, &value, 1);
+}
+
+static void gpu_trace_gp1(ps1_gpu_trace* trace, uint32_t value)
+{
+    gpu_trace_append(trace, GPU_TRACE_GP1, &value, 1);
+}
+
+/*
+ The trace can only start between commands, a packet or transfer cut in half would not replay. Once the GPU is
+ idle its state goes out as the commands that rebuild it: VRAM as a full screen upload, then the drawing and
+ display environment.
+*/
+static void gpu_trace_try_start(ps1_gpu* gpu)
+{
+    ps1_gpu_trace* trace = gpu->trace;
+    ps1_gpu_sync(gpu);
+
+    if(gpu->mode != GP0_MODE_COMMAND || gpu->fifo_count != 0)
+        return;
+
+    uint32_t upload[3] = {0xA0000000, 0, 0}; //A size of 0 is the whole VRAM
+    gpu_trace_gp0(trace, 0xE6000000);
+    gpu_trace_append(trace, GPU_TRACE_GP0, upload, 3);
+    gpu_trace_append(trace, GPU_TRACE_GP0, (const uint32_t*)gpu->vram, GPU_VRAM_SIZE / 4);
+
+    uint32_t status = gpu->GPUSTAT;
+    gpu_trace_gp0(trace, 0xE1000000 | (status & 0x7FF) | ((status >> 4) & 0x800) | (gpu->rect_flip_x << 12) | (gpu->rect_flip_y << 13));
+    gpu_trace_gp0(trace, 0xE2000000 | gpu->texture_window_mask_x | (gpu->texture_window_mask_y << 5) |
+        (gpu->texture_window_offset_x << 10) | (gpu->texture_window_offset_y << 15));
+    gpu_trace_gp0(trace, 0xE3000000 | gpu->draw_left | (gpu->draw_top << 10));
+    gpu_trace_gp0(trace, 0xE4000000 | gpu->draw_right | (gpu->draw_bottom << 10));
+    gpu_trace_gp0(trace, 0xE5000000 | (gpu->draw_offset_x & 0x7FF) | ((gpu->draw_offset_y & 0x7FF) << 11));
+    gpu_trace_gp0(trace, 0xE6000000 | ((status >> 11) & 0x3));
+    if(status & GPUSTAT_IRQ)
+        gpu_trace_gp0(trace, 0x1F000000);
+
+    gpu_trace_gp1(trace, 0x03000000 | ((status >> 23) & 0x1));
+    gpu_trace_gp1(trace, 0x04000000 | ((status >> GPUSTAT_DMA_SHIFT) & 0x3));
+    gpu_trace_gp1(trace, 0x05000000 | gpu->display_x | (gpu->display_y << 10));
+    gpu_trace_gp1(trace, 0x06000000 | gpu->display_h_start | (gpu->display_h_end << 12));
+    gpu_trace_gp1(trace, 0x07000000 | gpu->display_v_start | (gpu->display_v_end << 10));
+    gpu_trace_gp1(trace, 0x08000000 | ((status >> 17) & 0x3F) | ((status >> 10) & 0x40) | ((status >> 7) & 0x80));
+    trace->started = true;
+}
+
+//Records from here on, starting at the first moment the GPU is between commands
+bool ps1_gpu_start_trace(ps1_gpu* gpu, const char* path)
+{
+    ps1_gpu_stop_trace(gpu);
+
+    FILE* file = fopen(path, "wb");
+    if(file == NULL)
+    {
+        printf("Couldn't create the GPU trace %s\n", path);
+        return false;
+    }
+
+    ps1_gpu_trace* trace = (ps1_gpu_trace*)malloc(sizeof(ps1_gpu_trace));
+    memset(trace, 0, sizeof(ps1_gpu_trace));
+    trace->file = file;
+    trace->buffer = (uint32_t*)malloc(GPU_TRACE_BUFFER_SIZE * sizeof(uint32_t));
+    uint32_t header[2] = {GPU_TRACE_MAGIC, GPU_TRACE_VERSION};
+    gpu_trace_write(trace, header, 2);
+
+    gpu->trace = trace;
+    gpu_trace_try_start(gpu);
+    return true;
+}
+
+void ps1_gpu_stop_trace(ps1_gpu* gpu)
+{
+    ps1_gpu_trace* trace = gpu->trace;
+    if(trace == NULL)
+        return;
+
+    gpu->trace = NULL;
+    gpu_trace_flush(trace);
+    fclose(trace->file);
+    free (trace->buffer);
+    free (trace);
+}
+
+//Called by the GP0 and GP1 writes on the cpu thread, before the words reach the render thread
+void ps1_gpu_trace_record(ps1_gpu* gpu, GPU_TRACE_RECORD type, const uint32_t* words, uint32_t count)
+{
+    ps1_gpu_trace* trace = gpu->trace;
+    if(!trace->started)
+        return;
+
+    trace->words += count;
+    gpu_trace_append(trace, type, words, count);
+}
+
+//Frames are also where the file catches up, so a trace cut short by closing the emulator ends on a whole frame
+void ps1_gpu_trace_frame(ps1_gpu* gpu)
+{
+    ps1_gpu_trace* trace = gpu->trace;
+    if(!trace->started)
+    {
+        gpu_trace_try_start(gpu);
+        return;
+    }
+
+    gpu_trace_append(trace, GPU_TRACE_FRAME, NULL, 0);
+    trace->frames++;
+    gpu_trace_flush(trace);
+    fflush(trace->file);
+}
@@ -0,0 +1,582 @@
+#include "gte.h"
+
+#define GTE_MAC_MAX ((1LL << 43) - 1)
+#define GTE_MAC_MIN (-(1LL << 43))
+
+static const int32_t gte_zero[3] = {0, 0, 0};
+
+//Reciprocal seeds of the hardware divider
+static uint8_t gte_unr_table[0x101];
+
+void ps1_gte_init(ps1_gte* gte)
+{
+    memset(gte, 0, sizeof(ps1_gte));
+    for(int32_t i = 0; i < 0x101; i++)
+    {
+        int32_t value = (0x40000 / (i + 0x100) + 1) / 2 - 0x101;
+        gte_unr_table[i] = value > 0 ? value : 0;
+    }
+    ps1_gte_set_simd(gte, true);
+}
+
+//Only the matrix products of the triple vertex commands have a vector version
+void ps1_gte_set_simd(ps1_gte* gte, bool enable)
+{
+    gte->transform3 = ps1_gte_transform3;
+#ifdef PS1_SIMD_AVX2
+    if(enable && ps1_cpu_has_avx2())
+        gte->transform3 = ps1_gte_transform3_avx2;
+#endif
+}
+
+static inline int32_t gte_clamp(int32_t value, int32_t min, int32_t max)
+{
+    return value < min ? min : value > max ? max : value;
+}
+
+//Packed pairs of the matrices, register 4 holds the last element alone
+static uint32_t gte_read_matrix(const int16_t m[3][3], uint32_t reg)
+{
+    const int16_t* e = &m[0][0];
+    if(reg == 4)
+        return (int32_t)e[8];
+    return (uint16_t)e[reg * 2] | ((uint32_t)(uint16_t)e[reg * 2 + 1] << 16);
+}
+
+static void gte_write_matrix(int16_t m[3][3], uint32_t reg, uint32_t value)
+{
+    int16_t* e = &m[0][0];
+    e[reg * 2] = value;
+    if(reg < 4)
+        e[reg * 2 + 1] = value >> 16;
+}
+
+static uint32_t gte_orgb(const ps1_gte* gte)
+{
+    uint32_t value = 0;
+    for(uint32_t i = 0; i < 3; i++)
+        value |= gte_clamp(gte->ir[i + 1] >> 7, 0, 0x1F) << (i * 5);
+    return value;
+}
+
+uint32_t ps1_gte_read_data(ps1_gte* gte, uint32_t reg)
+{
+    switch(reg)
+    {
+        case 0: case 2: case 4: return (uint16_t)gte->v[reg / 2][0] | ((uint32_t)(uint16_t)gte->v[reg / 2][1] << 16);
+        case 1: case 3: case 5: return (int32_t)gte->v[reg / 2][2];
+        case 6: return gte->rgbc;
+        case 7: return gte->otz;
+        case 8: case 9: case 10: case 11: return (int32_t)gte->ir[reg - 8];
+        case 12: case 13: case 14: return (uint16_t)gte->sxy[reg - 12][0] | ((uint32_t)(uint16_t)gte->sxy[reg - 12][1] << 16);
+        case 15: return (uint16_t)gte->sxy[2][0] | ((uint32_t)(uint16_t)gte->sxy[2][1] << 16); //SXYP mirrors SXY2
+        case 16: case 17: case 18: case 19: return gte->sz[reg - 16];
+        case 20: case 21: case 22: return gte->rgb[reg - 20];
+        case 23: return gte->res1;
+        case 24: case 25: case 26: case 27: return gte->mac[reg - 24];
+        case 28: case 29: return gte_orgb(gte); //IRGB reads back as ORGB
+        case 30: return gte->lzcs;
+        default: return gte->lzcr;
+    }
+}
+
+void ps1_gte_write_data(ps1_gte* gte, uint32_t reg, uint32_t value)
+{
+    switch(reg)
+    {
+        case 0: case 2: case 4:
+            gte->v[reg / 2][0] = value;
+            gte->v[reg / 2][1] = value >> 16;
+            break;
+        case 1: case 3: case 5: gte->v[reg / 2][2] = value; break;
+        case 6: gte->rgbc = value; break;
+        case 7: gte->otz = value; break;
+        case 8: case 9: case 10: case 11: gte->ir[reg - 8] = value; break;
+        case 12: case 13: case 14:
+            gte->sxy[reg - 12][0] = value;
+            gte->sxy[reg - 12][1] = value >> 16;
+            break;
+        case 15: //SXYP pushes the FIFO
+            memmove(gte->sxy[0], gte->sxy[1], sizeof(gte->sxy[0]) * 2);
+            gte->sxy[2][0] = value;
+            gte->sxy[2][1] = value >> 16;
+            break;
+        case 16: case 17: case 18: case 19: gte->sz[reg - 16] = value; break;
+        case 20: case 21: case 22: gte->rgb[reg - 20] = value; break;
+        case 23: gte->res1 = value; break;
+        case 24: case 25: case 26: case 27: gte->mac[reg - 24] = value; break;
+        case 28: //IRGB expands 5 bit colors into IR1-3
+            for(uint32_t i = 0; i < 3; i++)
+                gte->ir[i + 1] = ((value >> (i * 5)) & 0x1F) << 7;
+            break;
+        case 30: //LZCR counts the leading bits equal to the sign
+            gte->lzcs = value;
+            value = (int32_t)value < 0 ? ~value : value;
+            gte->lzcr = value ? __builtin_clz(value) : 32;
+            break;
+        default: break; //ORGB and LZCR are read only
+    }
+}
+
+uint32_t ps1_gte_read_control(ps1_gte* gte, uint32_t reg)
+{
+    switch(reg)
+    {
+        case 0: case 1: case 2: case 3: case 4: return gte_read_matrix(gte->rotation, reg);
+        case 5: case 6: case 7: return gte->translation[reg - 5];
+        case 8: case 9: case 10: case 11: case 12: return gte_read_matrix(gte->light, reg - 8);
+        case 13: case 14: case 15: return gte->background[reg - 13];
+        case 16: case 17: case 18: case 19: case 20: return gte_read_matrix(gte->color, reg - 16);
+        case 21: case 22: case 23: return gte->far_color[reg - 21];
+        case 24: return gte->ofx;
+        case 25: return gte->ofy;
+        case 26: return (int32_t)(int16_t)gte->h; //Unsigned, but reads back sign extended
+        case 27: return (int32_t)gte->dqa;
+        case 28: return gte->dqb;
+        case 29: return (int32_t)gte->zsf3;
+        case 30: return (int32_t)gte->zsf4;
+        default: return gte->flag | ((gte->flag & GTE_FLAG_ERROR_MASK) ? 0x80000000 : 0);
+    }
+}
+
+void ps1_gte_write_control(ps1_gte* gte, uint32_t reg, uint32_t value)
+{
+    switch(reg)
+    {
+        case 0: case 1: case 2: case 3: case 4: gte_write_matrix(gte->rotation, reg, value); break;
+        case 5: case 6: case 7: gte->translation[reg - 5] = value; break;
+        case 8: case 9: case 10: case 11: case 12: gte_write_matrix(gte->light, reg - 8, value); break;
+        case 13: case 14: case 15: gte->background[reg - 13] = value; break;
+        case 16: case 17: case 18: case 19: case 20: gte_write_matrix(gte->color, reg - 16, value); break;
+        case 21: case 22: case 23: gte->far_color[reg - 21] = value; break;
+        case 24: gte->ofx = value; break;
+        case 25: gte->ofy = value; break;
+        case 26: gte->h = value; break;
+        case 27: gte->dqa = value; break;
+        case 28: gte->dqb = value; break;
+        case 29: gte->zsf3 = value; break;
+        case 30: gte->zsf4 = value; break;
+        default: gte->flag = value & GTE_FLAG_WRITE_MASK; break;
+    }
+}
+
+//Flags a MAC1-3 overflow and wraps the value to the 44 bits of the hardware adder
+static inline int64_t gte_check_mac(ps1_gte* gte, uint32_t index, int64_t value)
+{
+    if(value > GTE_MAC_MAX)
+        gte->flag |= GTE_FLAG_MAC_POSITIVE(index);
+    else if(value < GTE_MAC_MIN)
+        gte->flag |= GTE_FLAG_MAC_NEGATIVE(index);
+    return (int64_t)((uint64_t)value << 20) >> 20;
+}
+
+static inline void gte_check_mac0(ps1_gte* gte, int64_t value)
+{
+    if(value > INT32_MAX)
+        gte->flag |= GTE_FLAG_MAC0_POSITIVE;
+    else if(value < INT32_MIN)
+        gte->flag |= GTE_FLAG_MAC0_NEGATIVE;
+}
+
+static inline void gte_set_mac0(ps1_gte* gte, int64_t value)
+{
+    gte_check_mac0(gte, value);
+    gte->mac[0] = (int32_t)value;
+}
+
+static inline void gte_set_ir(ps1_gte* gte, uint32_t index, int32_t value, bool lm)
+{
+    int32_t min = lm ? 0 : -0x8000;
+    if(value < min || value > 0x7FFF)
+    {
+        gte->flag |= GTE_FLAG_IR(index);
+        value = value < min ? min : 0x7FFF;
+    }
+    gte->ir[index] = value;
+}
+
+static inline void gte_set_ir0(ps1_gte* gte, int32_t value)
+{
+    if(value < 0 || value > 0x1000)
+    {
+        gte->flag |= GTE_FLAG_IR(0);
+        value = value < 0 ? 0 : 0x1000;
+    }
+    gte->ir[0] = value;
+}
+
+static inline void gte_set_mac(ps1_gte* gte, uint32_t index, int64_t value, uint32_t shift)
+{
+    gte_check_mac(gte, index, value);
+    gte->mac[index] = (int32_t)(value >> shift);
+}
+
+static inline void gte_set_mac_ir(ps1_gte* gte, uint32_t index, int64_t value, uint32_t shift, bool lm)
+{
+    gte_set_mac(gte, index, value, shift);
+    gte_set_ir(gte, index, gte->mac[index], lm);
+}
+
+//(T SHL 12) + M * V, every partial sum is checked and wrapped like the hardware accumulates it
+static inline void gte_transform(ps1_gte* gte, const int16_t m[3][3], const int32_t* t, const int16_t* v, int64_t* out)
+{
+    for(uint32_t i = 0; i < 3; i++)
+    {
+        int64_t sum = (int64_t)t[i] << 12;
+        sum = gte_check_mac(gte, i + 1, sum + m[i][0] * v[0]);
+        sum = gte_check_mac(gte, i + 1, sum + m[i][1] * v[1]);
+        out[i] = gte_check_mac(gte, i + 1, sum + m[i][2] * v[2]);
+    }
+}
+
+void ps1_gte_transform3(ps1_gte* gte, const int16_t m[3][3], const int32_t* t, const int16_t v[3][3], int64_t out[3][3])
+{
+    for(uint32_t i = 0; i < 3; i++)
+        gte_transform(gte, m, t, v[i], out[i]);
+}
+
+//Unsigned Newton-Raphson division of the hardware, H / SZ3 as 1.16 fixed point
+static uint32_t gte_divide(ps1_gte* gte, uint32_t numerator, uint32_t denominator)
+{
+    if(denominator * 2 <= numerator)
+    {
+        gte->flag |= GTE_FLAG_DIVIDE;
+        return 0x1FFFF;
+    }
+
+    uint32_t shift = __builtin_clz(denominator) - 16;
+    numerator <<= shift;
+    denominator <<= shift;
+
+    int32_t u = gte_unr_table[(denominator - 0x7FC0) >> 7] + 0x101;
+    int32_t d = (0x2000080 - (int32_t)denominator * u) >> 8;
+    d = (0x0000080 + d * u) >> 8;
+    uint64_t result = ((uint64_t)numerator * d + 0x8000) >> 16;
+    return result < 0x1FFFF ? result : 0x1FFFF;
+}
+
+static inline void gte_push_sz(ps1_gte* gte, int32_t value)
+{
+    if(value < 0 || value > 0xFFFF)
+    {
+        gte->flag |= GTE_FLAG_SZ;
+        value = value < 0 ? 0 : 0xFFFF;
+    }
+    gte->sz[0] = gte->sz[1];
+    gte->sz[1] = gte->sz[2];
+    gte->sz[2] = gte->sz[3];
+    gte->sz[3] = value;
+}
+
+static inline int16_t gte_screen(ps1_gte* gte, int32_t value, uint32_t flag)
+{
+    if(value < -0x400 || value > 0x3FF)
+    {
+        gte->flag |= flag;
+        value = value < -0x400 ? -0x400 : 0x3FF;
+    }
+    return value;
+}
+
+static inline void gte_push_sxy(ps1_gte* gte, int32_t x, int32_t y)
+{
+    memmove(gte->sxy[0], gte->sxy[1], sizeof(gte->sxy[0]) * 2);
+    gte->sxy[2][0] = gte_screen(gte, x, GTE_FLAG_SX);
+    gte->sxy[2][1] = gte_screen(gte, y, GTE_FLAG_SY);
+}
+
+//MAC1-3 / 16 saturated to bytes, with the code byte of RGBC
+static void gte_push_color(ps1_gte* gte)
+{
+    uint32_t color = gte->rgbc & 0xFF000000;
+    for(uint32_t i = 0; i < 3; i++)
+    {
+        int32_t value = gte->mac[i + 1] >> 4;
+        if(value < 0 || value > 0xFF)
+        {
+            gte->flag |= GTE_FLAG_COLOR(i);
+            value = value < 0 ? 0 : 0xFF;
+        }
+        color |= value << (i * 8);
+    }
+    gte->rgb[0] = gte->rgb[1];
+    gte->rgb[1] = gte->rgb[2];
+    gte->rgb[2] = color;
+}
+
+//Perspective projection of one transformed vertex, depth cueing comes from the last one
+static void gte_project(ps1_gte* gte, const int64_t* sum, uint32_t shift, bool lm, bool last)
+{
+    gte_set_mac_ir(gte, 1, sum[0], shift, lm);
+    gte_set_mac_ir(gte, 2, sum[1], shift, lm);
+    gte_set_mac(gte, 3, sum[2], shift);
+
+    //IR3 saturates MAC3 but its flag looks at MAC3 SAR 12, the two differ when sf is 0
+    int32_t z = (int32_t)(sum[2] >> 12);
+    gte->ir[3] = gte_clamp(gte->mac[3], lm ? 0 : -0x8000, 0x7FFF);
+    if(z < -0x8000 || z > 0x7FFF)
+        gte->flag |= GTE_FLAG_IR(3);
+
+    gte_push_sz(gte, z);
+    int64_t ratio = gte_divide(gte, gte->h, gte->sz[3]);
+    int64_t x = ratio * gte->ir[1] + gte->ofx;
+    int64_t y = ratio * gte->ir[2] + gte->ofy;
+    gte_check_mac0(gte, x);
+    gte_check_mac0(gte, y);
+    gte_push_sxy(gte, (int32_t)(x >> 16), (int32_t)(y >> 16));
+
+    if(last)
+    {
+        int64_t depth = ratio * gte->dqa + gte->dqb;
+        gte_set_mac0(gte, depth);
+        gte_set_ir0(gte, (int32_t)(depth >> 12));
+    }
+}
+
+//MAC = in + (FC - in) * IR0, in being the unshifted color before depth cueing
+static void gte_depth_cue(ps1_gte* gte, const int64_t* in, uint32_t shift, bool lm)
+{
+    for(uint32_t i = 0; i < 3; i++)
+        gte_set_mac_ir(gte, i + 1, ((int64_t)gte->far_color[i] << 12) - in[i], shift, false);
+    for(uint32_t i = 0; i < 3; i++)
+        gte_set_mac_ir(gte, i + 1, (int64_t)gte->ir[i + 1] * gte->ir[0] + in[i], shift, lm);
+}
+
+static inline int64_t gte_rgbc_channel(const ps1_gte* gte, uint32_t channel)
+{
+    return (gte->rgbc >> (channel * 8)) & 0xFF;
+}
+
+typedef enum GTE_LIGHTING
+{
+    GTE_LIGHTING_NC,  //Light color only
+    GTE_LIGHTING_NCC, //Times RGBC
+    GTE_LIGHTING_NCD  //Times RGBC, then depth cued
+} GTE_LIGHTING;
+
+//Common tail of the normal color commands and CC/CDP, from the BK + LCM * IR sums to the color FIFO
+static void gte_lighting(ps1_gte* gte, GTE_LIGHTING mode, const int64_t* sum, uint32_t shift, bool lm)
+{
+    for(uint32_t i = 0; i < 3; i++)
+        gte_set_mac_ir(gte, i + 1, sum[i], shift, lm);
+
+    if(mode == GTE_LIGHTING_NCC)
+    {
+        for(uint32_t i = 0; i < 3; i++)
+            gte_set_mac_ir(gte, i + 1, (gte_rgbc_channel(gte, i) << 4) * gte->ir[i + 1], shift, lm);
+    }
+    else if(mode == GTE_LIGHTING_NCD)
+    {
+        int64_t in[3];
+        for(uint32_t i = 0; i < 3; i++)
+            in[i] = (gte_rgbc_channel(gte, i) << 4) * gte->ir[i + 1];
+        gte_depth_cue(gte, in, shift, lm);
+    }
+    gte_push_color(gte);
+}
+
+static void gte_normal_color(ps1_gte* gte, GTE_LIGHTING mode, uint32_t vertex, uint32_t shift, bool lm)
+{
+    int64_t sum[3];
+    gte_transform(gte, gte->light, gte_zero, gte->v[vertex], sum);
+    for(uint32_t i = 0; i < 3; i++)
+        gte_set_mac_ir(gte, i + 1, sum[i], shift, lm);
+
+    gte_transform(gte, gte->color, gte->background, &gte->ir[1], sum);
+    gte_lighting(gte, mode, sum, shift, lm);
+}
+
+//Both matrix products of the three vertices go through the kernel, only the per vertex tails run one by one
+static void gte_normal_color3(ps1_gte* gte, GTE_LIGHTING mode, uint32_t shift, bool lm)
+{
+    int64_t sums[3][3];
+    int16_t normals[3][3];
+
+    gte->transform3(gte, gte->light, gte_zero, gte->v, sums);
+    for(uint32_t vertex = 0; vertex < 3; vertex++)
+    {
+        for(uint32_t i = 0; i < 3; i++)
+        {
+            gte_set_mac_ir(gte, i + 1, sums[vertex][i], shift, lm);
+            normals[vertex][i] = gte->ir[i + 1];
+        }
+    }
+
+    gte->transform3(gte, gte->color, gte->background, normals, sums);
+    for(uint32_t vertex = 0; vertex < 3; vertex++)
+        gte_lighting(gte, mode, sums[vertex], shift, lm);
+}
+
+//MVMVA, with the hardware bugs of matrix 3 and of the far color translation
+static void gte_mvmva(ps1_gte* gte, uint32_t command, uint32_t shift, bool lm)
+{
+    uint32_t mx = (command >> 17) & 0x3;
+    uint32_t vx = (command >> 15) & 0x3;
+    uint32_t cv = (command >> 13) & 0x3;
+
+    int16_t garbage[3][3];
+    const int16_t (*m)[3];
+    switch(mx)
+    {
+        case 0: m = gte->rotation; break;
+        case 1: m = gte->light; break;
+        case 2: m = gte->color; break;
+        default:
+        {
+            int16_t r = (gte->rgbc & 0xFF) << 4;
+            int16_t values[3][3] = {
+                {-r, r, gte->ir[0]},
+                {gte->rotation[0][2], gte->rotation[0][2], gte->rotation[0][2]},
+                {gte->rotation[1][1], gte->rotation[1][1], gte->rotation[1][1]}
+            };
+            memcpy(garbage, values, sizeof(garbage));
+            m = garbage;
+            break;
+        }
+    }
+
+    int16_t v[3];
+    memcpy(v, vx == 3 ? &gte->ir[1] : gte->v[vx], sizeof(v));
+    const int32_t* t = cv == 0 ? gte->translation : cv == 1 ? gte->background : cv == 2 ? gte->far_color : gte_zero;
+
+    int64_t sum[3];
+    if(cv == 2)
+    {
+        //The first column with FC only sets flags, the result is the other two columns alone
+        for(uint32_t i = 0; i < 3; i++)
+        {
+            int64_t partial = gte_check_mac(gte, i + 1, ((int64_t)t[i] << 12) + m[i][0] * v[0]);
+            gte_set_ir(gte, i + 1, (int32_t)(partial >> shift), false);
+            sum[i] = gte_check_mac(gte, i + 1, gte_check_mac(gte, i + 1, (int64_t)m[i][1] * v[1]) + m[i][2] * v[2]);
+        }
+    }
+    else
+        gte_transform(gte, m, t, v, sum);
+
+    for(uint32_t i = 0; i < 3; i++)
+        gte_set_mac_ir(gte, i + 1, sum[i], shift, lm);
+}
+
+void ps1_gte_execute(ps1_gte* gte, uint32_t command)
+{
+    uint32_t shift = (command & (1 << 19)) ? 12 : 0;
+    bool lm = command & (1 << 10);
+    gte->flag = 0;
+    gte->commands++;
+
+    switch(command & 0x3F)
+    {
+        case 0x01: //RTPS
+        {
+            int64_t sum[3];
+            gte_transform(gte, gte->rotation, gte->translation, gte->v[0], sum);
+            gte_project(gte, sum, shift, lm, true);
+            break;
+        }
+        case 0x30: //RTPT
+        {
+            int64_t sums[3][3];
+            gte->transform3(gte, gte->rotation, gte->translation, gte->v, sums);
+            for(uint32_t i = 0; i < 3; i++)
+                gte_project(gte, sums[i], shift, lm, i == 2);
+            break;
+        }
+        case 0x06: //NCLIP
+        {
+            int64_t sx0 = gte->sxy[0][0], sy0 = gte->sxy[0][1];
+            int64_t sx1 = gte->sxy[1][0], sy1 = gte->sxy[1][1];
+            int64_t sx2 = gte->sxy[2][0], sy2 = gte->sxy[2][1];
+            gte_set_mac0(gte, sx0 * sy1 + sx1 * sy2 + sx2 * sy0 - sx0 * sy2 - sx1 * sy0 - sx2 * sy1);
+            break;
+        }
+        case 0x0C: //OP, cross product with the rotation matrix diagonal
+        {
+            int64_t ir1 = gte->ir[1], ir2 = gte->ir[2], ir3 = gte->ir[3];
+            int64_t d1 = gte->rotation[0][0], d2 = gte->rotation[1][1], d3 = gte->rotation[2][2];
+            gte_set_mac_ir(gte, 1, ir3 * d2 - ir2 * d3, shift, lm);
+            gte_set_mac_ir(gte, 2, ir1 * d3 - ir3 * d1, shift, lm);
+            gte_set_mac_ir(gte, 3, ir2 * d1 - ir1 * d2, shift, lm);
+            break;
+        }
+        case 0x10: //DPCS
+        {
+            int64_t in[3] = {gte_rgbc_channel(gte, 0) << 16, gte_rgbc_channel(gte, 1) << 16, gte_rgbc_channel(gte, 2) << 16};
+            gte_depth_cue(gte, in, shift, lm);
+            gte_push_color(gte);
+            break;
+        }
+        case 0x2A: //DPCT, the oldest FIFO color three times as the FIFO moves
+            for(uint32_t vertex = 0; vertex < 3; vertex++)
+            {
+                int64_t in[3];
+                for(uint32_t i = 0; i < 3; i++)
+                    in[i] = (int64_t)((gte->rgb[0] >> (i * 8)) & 0xFF) << 16;
+                gte_depth_cue(gte, in, shift, lm);
+                gte_push_color(gte);
+            }
+            break;
+        case 0x11: //INTPL
+        {
+            int64_t in[3] = {(int64_t)gte->ir[1] << 12, (int64_t)gte->ir[2] << 12, (int64_t)gte->ir[3] << 12};
+            gte_depth_cue(gte, in, shift, lm);
+            gte_push_color(gte);
+            break;
+        }
+        case 0x29: //DCPL
+        {
+            int64_t in[3];
+            for(uint32_t i = 0; i < 3; i++)
+                in[i] = (gte_rgbc_channel(gte, i) << 4) * gte->ir[i + 1];
+            gte_depth_cue(gte, in, shift, lm);
+            gte_push_color(gte);
+            break;
+        }
+        case 0x12: gte_mvmva(gte, command, shift, lm); break;
+        case 0x1E: gte_normal_color(gte, GTE_LIGHTING_NC, 0, shift, lm); break;   //NCS
+        case 0x20: gte_normal_color3(gte, GTE_LIGHTING_NC, shift, lm); break;     //NCT
+        case 0x1B: gte_normal_color(gte, GTE_LIGHTING_NCC, 0, shift, lm); break;  //NCCS
+        case 0x3F: gte_normal_color3(gte, GTE_LIGHTING_NCC, shift, lm); break;    //NCCT
+        case 0x13: gte_normal_color(gte, GTE_LIGHTING_NCD, 0, shift, lm); break;  //NCDS
+        case 0x16: gte_normal_color3(gte, GTE_LIGHTING_NCD, shift, lm); break;    //NCDT
+        case 0x1C: //CC
+        case 0x14: //CDP
+        {
+            int64_t sum[3];
+            int16_t ir[3] = {gte->ir[1], gte->ir[2], gte->ir[3]};
+            gte_transform(gte, gte->color, gte->background, ir, sum);
+            gte_lighting(gte, (command & 0x3F) == 0x1C ? GTE_LIGHTING_NCC : GTE_LIGHTING_NCD, sum, shift, lm);
+            break;
+        }
+        case 0x28: //SQR
+            for(uint32_t i = 1; i < 4; i++)
+                gte_set_mac_ir(gte, i, (int64_t)gte->ir[i] * gte->ir[i], shift, lm);
+            break;
+        case 0x2D: //AVSZ3
+        case 0x2E: //AVSZ4
+        {
+            int64_t sum = (int64_t)gte->sz[1] + gte->sz[2] + gte->sz[3];
+            int64_t average = (command & 0x3F) == 0x2D ? gte->zsf3 * sum : gte->zsf4 * (sum + gte->sz[0]);
+            gte_set_mac0(gte, average);
+            int32_t otz = (int32_t)(average >> 12);
+            if(otz < 0 || otz > 0xFFFF)
+            {
+                gte->flag |= GTE_FLAG_SZ;
+                otz = otz < 0 ? 0 : 0xFFFF;
+            }
+            gte->otz = otz;
+            break;
+        }
+        case 0x3D: //GPF
+            for(uint32_t i = 1; i < 4; i++)
+                gte_set_mac_ir(gte, i, (int64_t)gte->ir[i] * gte->ir[0], shift, lm);
+            gte_push_color(gte);
+            break;
+        case 0x3E: //GPL
+            for(uint32_t i = 1; i < 4; i++)
+                gte_set_mac_ir(gte, i, gte_check_mac(gte, i, (int64_t)gte->mac[i] << shift) + (int64_t)gte->ir[i] * gte->ir[0], shift, lm);
+            gte_push_color(gte);
+            break;
+        default:
+            break; //Unused opcodes only clear FLAG
+    }
+}
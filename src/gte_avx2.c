@@ -0,0 +1,54 @@
+#include "gte.h"
+
+#ifdef PS1_SIMD_AVX2
+
+#include <immintrin.h>
+
+/*
+ One 64 bit lane per matrix row, the fourth lane stays 0. The overflow flags of a lane are sticky, so they are
+ collected over all three vectors and the adds in any order. AVX2 has no 64 bit arithmetic shift, the 44 bit
+ wrap flips the sign bit around a subtraction instead.
+*/
+PS1_AVX2_TARGET static inline __m256i gte_avx2_accumulate(__m256i sum, __m256i column, int16_t value, __m256i* positive, __m256i* negative)
+{
+    const __m256i max = _mm256_set1_epi64x((1LL << 43) - 1);
+    const __m256i min = _mm256_set1_epi64x(-(1LL << 43));
+    const __m256i bits = _mm256_set1_epi64x((1LL << 44) - 1);
+    const __m256i sign = _mm256_set1_epi64x(1LL << 43);
+
+    sum = _mm256_add_epi64(sum, _mm256_mul_epi32(column, _mm256_set1_epi64x(value)));
+    *positive = _mm256_or_si256(*positive, _mm256_cmpgt_epi64(sum, max));
+    *negative = _mm256_or_si256(*negative, _mm256_cmpgt_epi64(min, sum));
+    return _mm256_sub_epi64(_mm256_xor_si256(_mm256_and_si256(sum, bits), sign), sign);
+}
+
+PS1_AVX2_TARGET void ps1_gte_transform3_avx2(ps1_gte* gte, const int16_t m[3][3], const int32_t* t, const int16_t v[3][3], int64_t out[3][3])
+{
+    __m256i columns[3];
+    for(uint32_t i = 0; i < 3; i++)
+        columns[i] = _mm256_set_epi64x(0, m[2][i], m[1][i], m[0][i]);
+    __m256i base = _mm256_set_epi64x(0, (int64_t)t[2] << 12, (int64_t)t[1] << 12, (int64_t)t[0] << 12);
+    __m256i store_mask = _mm256_set_epi64x(0, -1, -1, -1);
+
+    __m256i positive = _mm256_setzero_si256();
+    __m256i negative = _mm256_setzero_si256();
+    for(uint32_t vertex = 0; vertex < 3; vertex++)
+    {
+        __m256i sum = gte_avx2_accumulate(base, columns[0], v[vertex][0], &positive, &negative);
+        sum = gte_avx2_accumulate(sum, columns[1], v[vertex][1], &positive, &negative);
+        sum = gte_avx2_accumulate(sum, columns[2], v[vertex][2], &positive, &negative);
+        _mm256_maskstore_epi64((long long*)out[vertex], store_mask, sum);
+    }
+
+    uint32_t positive_lanes = _mm256_movemask_pd(_mm256_castsi256_pd(positive));
+    uint32_t negative_lanes = _mm256_movemask_pd(_mm256_castsi256_pd(negative));
+    for(uint32_t i = 0; i < 3; i++)
+    {
+        if(positive_lanes & (1 << i))
+            gte->flag |= GTE_FLAG_MAC_POSITIVE(i + 1);
+        if(negative_lanes & (1 << i))
+            gte->flag |= GTE_FLAG_MAC_NEGATIVE(i + 1);
+    }
+}
+
+#endif
@@ -0,0 +1,66 @@
+#include "bus.h"
+#include "cpu.h"
+#include "irq.h"
+
+#define IRQ_CAUSE_HARDWARE (1 << 10) //CAUSE bit 10, the controller's line into the cpu
+
+ps1_irq* ps1_irq_create()
+{
+    return (ps1_irq*)malloc(sizeof(ps1_irq));
+}
+
+void ps1_irq_init(ps1_irq* irq)
+{
+    memset(irq, 0, sizeof(ps1_irq));
+}
+
+void ps1_irq_destroy(ps1_irq* irq)
+{
+    free (irq);
+}
+
+static void ps1_irq_update(ps1_irq* irq)
+{
+    if(irq->cpu == NULL)
+        return;
+
+    if(irq->status & irq->mask)
+        irq->cpu->cop0[COP0_CAUSE] |= IRQ_CAUSE_HARDWARE;
+    else
+        irq->cpu->cop0[COP0_CAUSE] &= ~IRQ_CAUSE_HARDWARE;
+}
+
+void ps1_irq_raise(ps1_irq* irq, IRQ_SOURCE source)
+{
+    irq->status |= 1 << source;
+    ps1_irq_update(irq);
+}
+
+static uint32_t ps1_irq_io_read(void* device, uint32_t address, BUS_WIDTH width)
+{
+    ps1_irq* irq = (ps1_irq*)device;
+    uint32_t value = (address & ~0x3) == IRQ_STATUS ? irq->status : irq->mask;
+    return value >> ((address & 0x3) * 8);
+}
+
+//Narrower stores reach the register as they are, like on the DMA registers
+static void ps1_irq_io_write(void* device, uint32_t address, uint32_t value, BUS_WIDTH width)
+{
+    ps1_irq* irq = (ps1_irq*)device;
+    if((address & ~0x3) == IRQ_STATUS)
+        irq->status &= value;
+    else
+        irq->mask = value & ((1 << IRQ_COUNT) - 1);
+    ps1_irq_update(irq);
+}
+
+void ps1_connect_bus_irq(ps1_bus* bus, ps1_irq* irq)
+{
+    ps1_bus_register_io(bus, IRQ_STATUS, 8, irq, ps1_irq_io_read, ps1_irq_io_write, BUS_WIDTH_ALL);
+}
+
+void ps1_connect_irq_cpu(ps1_irq* irq, ps1_cpu* cpu)
+{
+    irq->cpu = cpu;
+    ps1_irq_update(irq);
+}
@@ -0,0 +1,240 @@
+#include <ctype.h>
+#include "iso9660.h"
+
+#define ISO_RECORD_MIN_LENGTH 34
+
+//User data of a sector, after the header in mode 1 and after the subheader in mode 2
+static const uint8_t* iso_read_block(ps1_iso* iso, uint32_t lba, uint8_t* scratch)
+{
+    const uint8_t* sector = ps1_disc_read_sector(iso->disc, lba, scratch);
+    if(sector == NULL)
+        return NULL;
+    return sector + (sector[15] == 1 ? 16 : 24);
+}
+
+//Fields are stored both ways round, the little endian half comes first
+static uint32_t iso_word(const uint8_t* data)
+{
+    return data[0] | data[1] << 8 | data[2] << 16 | (uint32_t)data[3] << 24;
+}
+
+static void iso_parse_record(const uint8_t* record, iso_entry* entry)
+{
+    entry->lba = iso_word(record + 2);
+    entry->size = iso_word(record + 10);
+    entry->directory = record[25] & 0x02;
+
+    //Without the ;1 version, or the dot of a name without an extension
+    uint32_t length = record[32];
+    const uint8_t* name = record + 33;
+    uint32_t i = 0;
+    for(; i < length && i < ISO_NAME_LENGTH - 1 && name[i] != ';'; i++)
+        entry->name[i] = name[i];
+    if(i > 0 && entry->name[i - 1] == '.')
+        i--;
+    entry->name[i] = 0;
+}
+
+ps1_iso* ps1_iso_open(ps1_disc* disc)
+{
+    uint8_t scratch[DISC_SECTOR_SIZE];
+    const uint8_t* sector = ps1_disc_read_sector(disc, ISO_PRIMARY_DESCRIPTOR, scratch);
+    const uint8_t* descriptor = sector != NULL ? sector + (sector[15] == 1 ? 16 : 24) : NULL;
+    if(descriptor == NULL || descriptor[0] != 1 || memcmp(descriptor + 1, "CD001", 5))
+    {
+        printf("The disc has no ISO9660 file system\n");
+        return NULL;
+    }
+
+    ps1_iso* iso = (ps1_iso*)malloc(sizeof(ps1_iso));
+    memset(iso, 0, sizeof(ps1_iso));
+    iso->disc = disc;
+    iso_parse_record(descriptor + 156, &iso->root);
+    return iso;
+}
+
+void ps1_iso_close(ps1_iso* iso)
+{
+    if(iso == NULL)
+        return;
+    for(uint32_t i = 0; i < iso->directory_count; i++)
+        free (iso->directories[i].entries);
+    free (iso->directories);
+    free (iso);
+}
+
+//Parses a directory the first time it is walked through
+static const iso_directory* iso_load_directory(ps1_iso* iso, const iso_entry* entry)
+{
+    for(uint32_t i = 0; i < iso->directory_count; i++)
+    {
+        if(iso->directories[i].lba == entry->lba)
+            return &iso->directories[i];
+    }
+
+    if(iso->directory_count == iso->directory_capacity)
+    {
+        iso->directory_capacity = iso->directory_capacity ? iso->directory_capacity * 2 : 8;
+        iso->directories = (iso_directory*)realloc(iso->directories, iso->directory_capacity * sizeof(iso_directory));
+    }
+    iso_directory* directory = &iso->directories[iso->directory_count++];
+    memset(directory, 0, sizeof(iso_directory));
+    directory->lba = entry->lba;
+
+    uint8_t scratch[DISC_SECTOR_SIZE];
+    uint32_t capacity = 0;
+    uint32_t blocks = (entry->size + ISO_BLOCK_SIZE - 1) / ISO_BLOCK_SIZE;
+    for(uint32_t block = 0; block < blocks; block++)
+    {
+        const uint8_t* data = iso_read_block(iso, entry->lba + block, scratch);
+        if(data == NULL)
+            break;
+
+        //Records never cross a block, a length of 0 pads the rest of it
+        for(uint32_t offset = 0; offset + ISO_RECORD_MIN_LENGTH <= ISO_BLOCK_SIZE; offset += data[offset])
+        {
+            const uint8_t* record = data + offset;
+            if(record[0] < ISO_RECORD_MIN_LENGTH || offset + record[0] > ISO_BLOCK_SIZE)
+                break;
+
+            //. and .. are single bytes 0 and 1
+            if(record[32] == 1 && record[33] <= 1)
+                continue;
+
+            if(directory->count == capacity)
+            {
+                capacity = capacity ? capacity * 2 : 16;
+                directory->entries = (iso_entry*)realloc(directory->entries, capacity * sizeof(iso_entry));
+            }
+            iso_parse_record(record, &directory->entries[directory->count++]);
+        }
+    }
+    return directory;
+}
+
+static bool iso_name_equal(const char* name, const char* component, size_t length)
+{
+    for(size_t i = 0; i < length; i++)
+    {
+        if(toupper((unsigned char)name[i]) != toupper((unsigned char)component[i]))
+            return false;
+    }
+    return name[length] == 0;
+}
+
+/*
+ Paths are the way games write them, "cdrom:\DIR\FILE.EXE;1", with the device, the version and the case all
+ optional and either kind of slash.
+*/
+bool ps1_iso_find(ps1_iso* iso, const char* path, iso_entry* entry)
+{
+    if(!strncmp(path, "cdrom:", 6) || !strncmp(path, "CDROM:", 6))
+        path += 6;
+
+    iso_entry current = iso->root;
+    while(*path)
+    {
+        while(*path == '\\' || *path == '/')
+            path++;
+        if(!*path)
+            break;
+
+        size_t length = strcspn(path, "\\/");
+        size_t name_length = strcspn(path, ";\\/");
+        if(name_length > 0 && path[name_length - 1] == '.')
+            name_length--;
+        if(!current.directory)
+            return false;
+
+        const iso_directory* directory = iso_load_directory(iso, &current);
+        uint32_t i = 0;
+        while(i < directory->count && !iso_name_equal(directory->entries[i].name, path, name_length))
+            i++;
+        if(i == directory->count)
+            return false;
+
+        current = directory->entries[i];
+        path += length;
+    }
+
+    *entry = current;
+    return true;
+}
+
+uint8_t* ps1_iso_read_file(ps1_iso* iso, const iso_entry* entry)
+{
+    uint8_t* data = (uint8_t*)malloc(entry->size ? entry->size : 1);
+    uint8_t scratch[DISC_SECTOR_SIZE];
+    for(uint32_t offset = 0; offset < entry->size; offset += ISO_BLOCK_SIZE)
+    {
+        const uint8_t* block = iso_read_block(iso, entry->lba + offset / ISO_BLOCK_SIZE, scratch);
+        if(block == NULL)
+        {
+            free (data);
+            return NULL;
+        }
+        uint32_t length = entry->size - offset < ISO_BLOCK_SIZE ? entry->size - offset : ISO_BLOCK_SIZE;
+        memcpy(data + offset, block, length);
+    }
+    return data;
+}
+
+//Finds and reads a whole file, NULL when it isn't there
+uint8_t* ps1_iso_load(ps1_iso* iso, const char* path, uint32_t* size)
+{
+    iso_entry entry;
+    if(!ps1_iso_find(iso, path, &entry) || entry.directory)
+        return NULL;
+    *size = entry.size;
+    return ps1_iso_read_file(iso, &entry);
+}
+
+/*
+ The EXE the BIOS would boot and the stack it would give it. SYSTEM.CNF has lines like "BOOT = cdrom:\SLUS_000.01;1"
+ and "STACK = 801FFFF0", discs without one boot PSX.EXE.
+*/
+bool ps1_iso_find_boot(ps1_iso* iso, char* path, size_t path_length, uint32_t* stack)
+{
+    uint32_t size;
+    char* config = (char*)ps1_iso_load(iso, "SYSTEM.CNF", &size);
+    snprintf(path, path_length, "PSX.EXE");
+    if(config == NULL)
+        return true;
+
+    bool found = false;
+    uint32_t position = 0;
+    while(position < size)
+    {
+        uint32_t end = position;
+        while(end < size && config[end] != '\n' && config[end] != '\r')
+            end++;
+
+        char line[256];
+        uint32_t length = end - position < sizeof(line) - 1 ? end - position : sizeof(line) - 1;
+        memcpy(line, config + position, length);
+        line[length] = 0;
+        position = end + 1;
+
+        char* equals = strchr(line, '=');
+        if(equals == NULL)
+            continue;
+        *equals = 0;
+        char key[16];
+        char value[sizeof(line)];
+        if(sscanf(line, " %15s", key) != 1 || sscanf(equals + 1, " %255s", value) != 1)
+            continue;
+
+        if(!strcmp(key, "BOOT"))
+        {
+            snprintf(path, path_length, "%s", value);
+            found = true;
+        }
+        else if(!strcmp(key, "STACK"))
+            *stack = strtoul(value, NULL, 16);
+    }
+    free (config);
+
+    if(!found)
+        printf("SYSTEM.CNF has no BOOT line\n");
+    return found;
+}
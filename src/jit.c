@@ -0,0 +1,619 @@
+#include <stddef.h>
+#include "ram.h"
+#include "bus.h"
+#include "cpu.h"
+#include "block_cache.h"
+#include "jit.h"
+#include "fastmem.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define JIT_X64
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+/*
+ Blocks are translated one guest instruction at a time into x86-64 code that works directly on the ps1_cpu struct,
+ which is kept in rbx for the whole block. Simple ALU instructions and RAM loads/stores are emitted inline, everything
+ else calls the interpreter handler with its pre-decoded cpu_instr. The delayed load fifo and the branch delay slot
+ use the same state as the interpreter, so both backends can be run in lockstep.
+*/
+
+#define GPR(n) ((int32_t)(offsetof(ps1_cpu, r) + (n) * 4))
+#define CPU_FIELD(field) ((int32_t)offsetof(ps1_cpu, field))
+#define FIFO_FIELD(i, field) ((int32_t)(offsetof(ps1_cpu, fifo_delay_load) + (i) * sizeof(delayed_register) + offsetof(delayed_register, field)))
+
+//x86 register numbers
+#define EAX 0
+#define ECX 1
+#define EDX 2
+#define EBX 3
+
+//x86 opcodes for "op r32, r/m32"
+#define X86_ADD 0x03
+#define X86_OR 0x0B
+#define X86_AND 0x23
+#define X86_SUB 0x2B
+#define X86_XOR 0x33
+#define X86_CMP 0x3B
+#define X86_MOV_LOAD 0x8B
+#define X86_MOV_STORE 0x89
+
+//Condition codes for jcc
+#define CC_AE 0x3
+#define CC_E 0x4
+#define CC_NE 0x5
+
+ps1_jit* ps1_jit_create()
+{
+    return (ps1_jit*)malloc(sizeof(ps1_jit));
+}
+
+bool ps1_jit_available()
+{
+#ifdef JIT_X64
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool ps1_jit_init(ps1_jit* jit)
+{
+    memset(jit, 0, sizeof(ps1_jit));
+
+    if(!ps1_jit_available())
+        return false;
+
+#ifdef _WIN32
+    jit->buffer = VirtualAlloc(NULL, JIT_BUFFER_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+#else
+    jit->buffer = mmap(NULL, JIT_BUFFER_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(jit->buffer == MAP_FAILED)
+        jit->buffer = NULL;
+#endif
+
+    if(jit->buffer == NULL)
+    {
+        perror("Error: Could not allocate executable memory for the JIT");
+        return false;
+    }
+
+    jit->ptr = jit->buffer;
+    return true;
+}
+
+void ps1_jit_destroy(ps1_jit* jit)
+{
+    if(jit->buffer != NULL)
+    {
+#ifdef _WIN32
+        VirtualFree(jit->buffer, 0, MEM_RELEASE);
+#else
+        munmap(jit->buffer, JIT_BUFFER_SIZE);
+#endif
+    }
+    free (jit);
+}
+
+bool ps1_jit_needs_flush(ps1_jit* jit)
+{
+    return jit->used + JIT_MAX_BLOCK_SIZE > JIT_BUFFER_SIZE;
+}
+
+//Only safe when no compiled block is referenced anymore, the block cache has to be flushed first
+void ps1_jit_reset(ps1_jit* jit)
+{
+    jit->ptr = jit->buffer;
+    jit->used = 0;
+    jit->flushes++;
+}
+
+#ifdef JIT_X64
+
+static void emit8(ps1_jit* jit, uint8_t value)
+{
+    *jit->ptr++ = value;
+}
+
+static void emit32(ps1_jit* jit, uint32_t value)
+{
+    memcpy(jit->ptr, &value, 4);
+    jit->ptr += 4;
+}
+
+static void emit64(ps1_jit* jit, uint64_t value)
+{
+    memcpy(jit->ptr, &value, 8);
+    jit->ptr += 8;
+}
+
+//op reg, [rbx+disp32]
+static void emit_rm(ps1_jit* jit, uint8_t opcode, uint8_t reg, int32_t disp)
+{
+    emit8(jit, opcode);
+    emit8(jit, 0x80 | (reg << 3) | EBX);
+    emit32(jit, disp);
+}
+
+//mov dword [rbx+disp32], imm32
+static void emit_store_imm32(ps1_jit* jit, int32_t disp, uint32_t value)
+{
+    emit8(jit, 0xC7);
+    emit8(jit, 0x80 | EBX);
+    emit32(jit, disp);
+    emit32(jit, value);
+}
+
+//mov byte [rbx+disp32], imm8
+static void emit_store_imm8(ps1_jit* jit, int32_t disp, uint8_t value)
+{
+    emit8(jit, 0xC6);
+    emit8(jit, 0x80 | EBX);
+    emit32(jit, disp);
+    emit8(jit, value);
+}
+
+//cmp dword [rbx+disp32], imm32
+static void emit_cmp_imm32(ps1_jit* jit, int32_t disp, uint32_t value)
+{
+    emit8(jit, 0x81);
+    emit8(jit, 0x80 | (7 << 3) | EBX);
+    emit32(jit, disp);
+    emit32(jit, value);
+}
+
+//op eax, imm32 using the short eax encodings (add 05, or 0D, and 25, sub 2D, xor 35, cmp 3D)
+static void emit_eax_imm32(ps1_jit* jit, uint8_t opcode, uint32_t value)
+{
+    emit8(jit, opcode);
+    emit32(jit, value);
+}
+
+static uint8_t* emit_jcc(ps1_jit* jit, uint8_t cc)
+{
+    emit8(jit, 0x0F);
+    emit8(jit, 0x80 | cc);
+    uint8_t* patch = jit->ptr;
+    emit32(jit, 0);
+    return patch;
+}
+
+static uint8_t* emit_jmp(ps1_jit* jit)
+{
+    emit8(jit, 0xE9);
+    uint8_t* patch = jit->ptr;
+    emit32(jit, 0);
+    return patch;
+}
+
+static void patch_here(ps1_jit* jit, uint8_t* patch)
+{
+    int32_t rel = (int32_t)(jit->ptr - (patch + 4));
+    memcpy(patch, &rel, 4);
+}
+
+//First argument is always the cpu
+static void emit_arg_cpu(ps1_jit* jit)
+{
+#ifdef _WIN32
+    emit8(jit, 0x48); emit8(jit, 0x89); emit8(jit, 0xD9); //mov rcx, rbx
+#else
+    emit8(jit, 0x48); emit8(jit, 0x89); emit8(jit, 0xDF); //mov rdi, rbx
+#endif
+}
+
+static void emit_arg2_imm64(ps1_jit* jit, uint64_t value)
+{
+#ifdef _WIN32
+    emit8(jit, 0x48); emit8(jit, 0xBA); //mov rdx, imm64
+#else
+    emit8(jit, 0x48); emit8(jit, 0xBE); //mov rsi, imm64
+#endif
+    emit64(jit, value);
+}
+
+static void emit_call(ps1_jit* jit, const void* function)
+{
+    emit8(jit, 0x48); emit8(jit, 0xB8); //mov rax, imm64
+    emit64(jit, (uint64_t)(uintptr_t)function);
+    emit8(jit, 0xFF); emit8(jit, 0xD0); //call rax
+}
+
+//mov rdx, imm64
+static void emit_rdx_imm64(ps1_jit* jit, const void* pointer)
+{
+    emit8(jit, 0x48); emit8(jit, 0xBA);
+    emit64(jit, (uint64_t)(uintptr_t)pointer);
+}
+
+static void emit_prologue(ps1_jit* jit)
+{
+    emit8(jit, 0x53); //push rbx
+#ifdef _WIN32
+    emit8(jit, 0x48); emit8(jit, 0x83); emit8(jit, 0xEC); emit8(jit, 0x20); //sub rsp, 32 (shadow space)
+    emit8(jit, 0x48); emit8(jit, 0x89); emit8(jit, 0xCB); //mov rbx, rcx
+#else
+    emit8(jit, 0x48); emit8(jit, 0x89); emit8(jit, 0xFB); //mov rbx, rdi
+#endif
+}
+
+//Leaves the block reporting how many guest instructions were executed
+static void emit_exit(ps1_jit* jit, uint32_t executed)
+{
+    emit8(jit, 0xB8); emit32(jit, executed); //mov eax, executed
+#ifdef _WIN32
+    emit8(jit, 0x48); emit8(jit, 0x83); emit8(jit, 0xC4); emit8(jit, 0x20); //add rsp, 32
+#endif
+    emit8(jit, 0x5B); //pop rbx
+    emit8(jit, 0xC3); //ret
+}
+
+//Same as HANDLE_LOAD, but the call is skipped when both fifo entries are empty
+static void emit_handle_load(ps1_jit* jit)
+{
+    emit8(jit, 0x0F); emit8(jit, 0xB6); emit8(jit, 0x80 | EBX); emit32(jit, FIFO_FIELD(0, modified)); //movzx eax, byte [fifo0.modified]
+    emit8(jit, 0x0A); emit8(jit, 0x80 | EBX); emit32(jit, FIFO_FIELD(1, modified)); //or al, byte [fifo1.modified]
+    uint8_t* skip = emit_jcc(jit, CC_E);
+    emit_arg_cpu(jit);
+    emit_call(jit, cpu_handle_load);
+    patch_here(jit, skip);
+}
+
+//pc += 4 plus HANDLE_BRANCH, leaving the block when the branch was taken
+static void emit_handle_branch(ps1_jit* jit, uint32_t pc, uint32_t executed)
+{
+    emit8(jit, 0x80); emit8(jit, 0x80 | (7 << 3) | EBX); emit32(jit, CPU_FIELD(branch)); emit8(jit, 0); //cmp byte [branch], 0
+    uint8_t* skip = emit_jcc(jit, CC_E);
+    emit_store_imm32(jit, CPU_FIELD(pc), pc + 4);
+    emit_arg_cpu(jit);
+    emit_call(jit, cpu_handle_branch);
+    emit_cmp_imm32(jit, CPU_FIELD(pc), pc + 4);
+    uint8_t* same = emit_jcc(jit, CC_E);
+    emit_exit(jit, executed);
+    patch_here(jit, skip);
+    patch_here(jit, same);
+}
+
+static bool is_store(const cpu_instr* instr)
+{
+    return instr->handler == cpu_execute_sb || instr->handler == cpu_execute_sh || instr->handler == cpu_execute_sw ||
+           instr->handler == cpu_execute_swl || instr->handler == cpu_execute_swr || instr->handler == cpu_execute_swc2;
+}
+
+//Calls the interpreter handler, leaving the block on exceptions and on stores that invalidated cached code
+static void emit_call_handler(ps1_jit* jit, ps1_cpu* cpu, const cpu_instr* instr, uint32_t pc, uint32_t executed)
+{
+    emit_store_imm32(jit, CPU_FIELD(pc), pc);
+    emit_arg_cpu(jit);
+    emit_arg2_imm64(jit, (uint64_t)(uintptr_t)instr);
+    emit_call(jit, instr->handler);
+    emit_store_imm32(jit, GPR(0), 0);
+
+    emit_cmp_imm32(jit, CPU_FIELD(pc), pc);
+    uint8_t* leave_exception = emit_jcc(jit, CC_NE);
+    uint8_t* leave_invalidated = NULL;
+
+    if(is_store(instr))
+    {
+        emit8(jit, 0x48); emit8(jit, 0xB8); emit64(jit, (uint64_t)(uintptr_t)&cpu->block_cache->retired); //mov rax, &retired
+        emit8(jit, 0x48); emit8(jit, 0x83); emit8(jit, 0x38); emit8(jit, 0x00); //cmp qword [rax], 0
+        leave_invalidated = emit_jcc(jit, CC_NE);
+    }
+
+    uint8_t* done = emit_jmp(jit);
+    patch_here(jit, leave_exception);
+    if(leave_invalidated != NULL)
+        patch_here(jit, leave_invalidated);
+    emit_arg_cpu(jit);
+    emit_call(jit, cpu_leave_instr);
+    emit_exit(jit, executed);
+    patch_here(jit, done);
+}
+
+//Computes the virtual address of a load/store into eax, jumping to the returned patch point when it is misaligned
+static void emit_virtual_address(ps1_jit* jit, const cpu_instr* instr, uint8_t align_mask, uint8_t** misaligned)
+{
+    emit_rm(jit, X86_MOV_LOAD, EAX, GPR(instr->rs));
+    if(instr->imm)
+        emit_eax_imm32(jit, 0x05, (uint32_t)(int32_t)(int16_t)instr->imm);
+    emit_rm(jit, X86_MOV_STORE, EAX, CPU_FIELD(virtual_address));
+
+    *misaligned = NULL;
+    if(align_mask)
+    {
+        emit8(jit, 0xA8); emit8(jit, align_mask); //test al, mask
+        *misaligned = emit_jcc(jit, CC_NE);
+    }
+}
+
+//Leaves the guest address in ecx. With fastmem it is used unchecked as the offset into the 4GB region, otherwise
+//it is masked down to the RAM offset and not_ram is set to the jump taken for everything that isn't RAM
+static void emit_host_address(ps1_jit* jit, ps1_cpu* cpu, const cpu_instr* instr, uint8_t align_mask, uint8_t** misaligned, uint8_t** not_ram)
+{
+    emit_virtual_address(jit, instr, align_mask, misaligned);
+    emit8(jit, 0x89); emit8(jit, 0xC1); //mov ecx, eax
+
+    *not_ram = NULL;
+    if(cpu->bus->fastmem != NULL)
+        return;
+
+    emit8(jit, 0x81); emit8(jit, 0xE1); emit32(jit, 0x1FFFFFFF); //and ecx, 0x1FFFFFFF
+    emit8(jit, 0x81); emit8(jit, 0xF9); emit32(jit, 0x00800000); //cmp ecx, 0x00800000
+    *not_ram = emit_jcc(jit, CC_AE);
+    emit8(jit, 0x81); emit8(jit, 0xE1); emit32(jit, RAM_SIZE-1); //and ecx, RAM_SIZE-1 (mirrors)
+}
+
+//mov rdx, base of the memory ecx indexes
+static void emit_host_base(ps1_jit* jit, ps1_cpu* cpu)
+{
+    if(cpu->bus->fastmem != NULL)
+        emit_rdx_imm64(jit, cpu->bus->fastmem->base);
+    else
+        emit_rdx_imm64(jit, cpu->bus->ram->ram_buff);
+}
+
+static void emit_load(ps1_jit* jit, ps1_cpu* cpu, const cpu_instr* instr, uint32_t pc, uint32_t executed)
+{
+    uint8_t align_mask = 0;
+    uint8_t load[3] = {0};
+
+    if(instr->handler == cpu_execute_lw)       { align_mask = 3; load[0] = 0x8B; }
+    else if(instr->handler == cpu_execute_lh)  { align_mask = 1; load[0] = 0x0F; load[1] = 0xBF; }
+    else if(instr->handler == cpu_execute_lhu) { align_mask = 1; load[0] = 0x0F; load[1] = 0xB7; }
+    else if(instr->handler == cpu_execute_lb)  { load[0] = 0x0F; load[1] = 0xBE; }
+    else                                       { load[0] = 0x0F; load[1] = 0xB6; }
+
+    uint8_t* misaligned;
+    uint8_t* not_ram;
+    emit_host_address(jit, cpu, instr, align_mask, &misaligned, &not_ram);
+    emit_host_base(jit, cpu);
+
+    //With fastmem anything that isn't RAM or BIOS faults here and is emulated by the signal handler
+    for(int i = 0; i < 2 && load[i]; i++)
+        emit8(jit, load[i]);
+    emit8(jit, 0x04); emit8(jit, 0x0A); //eax, [rdx+rcx]
+
+    //UPDATE_DELAY_LOAD
+    emit_rm(jit, X86_MOV_STORE, EAX, FIFO_FIELD(0, delayed_value));
+    emit_store_imm8(jit, FIFO_FIELD(0, delayed_register), instr->rt);
+    emit_store_imm8(jit, FIFO_FIELD(0, modified), 1);
+    emit_store_imm32(jit, FIFO_FIELD(0, pc), pc);
+    uint8_t* done = emit_jmp(jit);
+
+    if(misaligned != NULL)
+        patch_here(jit, misaligned);
+    if(not_ram != NULL)
+        patch_here(jit, not_ram);
+    emit_call_handler(jit, cpu, instr, pc, executed);
+    patch_here(jit, done);
+}
+
+static void emit_store(ps1_jit* jit, ps1_cpu* cpu, const cpu_instr* instr, uint32_t pc, uint32_t executed)
+{
+    uint8_t align_mask = 0;
+    if(instr->handler == cpu_execute_sw)
+        align_mask = 3;
+    else if(instr->handler == cpu_execute_sh)
+        align_mask = 1;
+
+    uint8_t* misaligned;
+    uint8_t* not_ram;
+    uint8_t* isolated = NULL;
+    uint8_t* code_page = NULL;
+    emit_host_address(jit, cpu, instr, align_mask, &misaligned, &not_ram);
+
+    //Isolated cache and pages holding cached code take the slow path, with fastmem those pages are read only instead
+    if(cpu->bus->fastmem == NULL)
+    {
+        emit8(jit, 0xF7); emit8(jit, 0x80 | EBX); emit32(jit, CPU_FIELD(cop0[COP0_SR])); emit32(jit, 0x10000); //test dword [sr], 0x10000
+        isolated = emit_jcc(jit, CC_NE);
+        emit8(jit, 0x89); emit8(jit, 0xC8); //mov eax, ecx
+        emit8(jit, 0xC1); emit8(jit, 0xE8); emit8(jit, BLOCK_PAGE_SHIFT); //shr eax, BLOCK_PAGE_SHIFT
+        emit_rdx_imm64(jit, cpu->block_cache->ram_page_blocks);
+        emit8(jit, 0x66); emit8(jit, 0x83); emit8(jit, 0x3C); emit8(jit, 0x42); emit8(jit, 0x00); //cmp word [rdx+rax*2], 0
+        code_page = emit_jcc(jit, CC_NE);
+    }
+
+    emit_host_base(jit, cpu);
+    emit_rm(jit, X86_MOV_LOAD, EAX, GPR(instr->rt));
+    if(instr->handler == cpu_execute_sw)
+        emit8(jit, 0x89);
+    else if(instr->handler == cpu_execute_sh)
+    {
+        emit8(jit, 0x66);
+        emit8(jit, 0x89);
+    }
+    else
+        emit8(jit, 0x88);
+    emit8(jit, 0x04); emit8(jit, 0x0A); //[rdx+rcx], eax/ax/al
+
+    //A faulting store went through the bus and may have invalidated this very block
+    uint8_t* invalidated = NULL;
+    if(cpu->bus->fastmem != NULL)
+    {
+        emit8(jit, 0x48); emit8(jit, 0xB8); emit64(jit, (uint64_t)(uintptr_t)&cpu->block_cache->retired); //mov rax, &retired
+        emit8(jit, 0x48); emit8(jit, 0x83); emit8(jit, 0x38); emit8(jit, 0x00); //cmp qword [rax], 0
+        invalidated = emit_jcc(jit, CC_NE);
+    }
+    uint8_t* done = emit_jmp(jit);
+
+    if(invalidated != NULL)
+    {
+        patch_here(jit, invalidated);
+        emit_store_imm32(jit, CPU_FIELD(pc), pc);
+        emit_arg_cpu(jit);
+        emit_call(jit, cpu_leave_instr);
+        emit_exit(jit, executed);
+    }
+
+    if(misaligned != NULL)
+        patch_here(jit, misaligned);
+    if(not_ram != NULL)
+        patch_here(jit, not_ram);
+    if(isolated != NULL)
+        patch_here(jit, isolated);
+    if(code_page != NULL)
+        patch_here(jit, code_page);
+    emit_call_handler(jit, cpu, instr, pc, executed);
+    patch_here(jit, done);
+}
+
+//rd = rs op rt
+static void emit_alu_reg(ps1_jit* jit, uint8_t opcode, const cpu_instr* instr)
+{
+    emit_rm(jit, X86_MOV_LOAD, EAX, GPR(instr->rs));
+    emit_rm(jit, opcode, EAX, GPR(instr->rt));
+}
+
+//rd = rs < rt, setcc decides signedness
+static void emit_set_less(ps1_jit* jit, uint8_t setcc, bool immediate, const cpu_instr* instr)
+{
+    emit_rm(jit, X86_MOV_LOAD, EAX, GPR(instr->rs));
+    if(immediate)
+        emit_eax_imm32(jit, 0x3D, (uint32_t)(int32_t)(int16_t)instr->imm);
+    else
+        emit_rm(jit, X86_CMP, EAX, GPR(instr->rt));
+    emit8(jit, 0x0F); emit8(jit, setcc); emit8(jit, 0xC0); //setcc al
+    emit8(jit, 0x0F); emit8(jit, 0xB6); emit8(jit, 0xC0); //movzx eax, al
+}
+
+//shift rt by a constant (ext selects shl/shr/sar) or by rs when variable
+static void emit_shift(ps1_jit* jit, uint8_t ext, bool variable, const cpu_instr* instr)
+{
+    if(variable)
+        emit_rm(jit, X86_MOV_LOAD, ECX, GPR(instr->rs));
+    emit_rm(jit, X86_MOV_LOAD, EAX, GPR(instr->rt));
+    if(variable)
+    {
+        emit8(jit, 0xD3); emit8(jit, 0xC0 | (ext << 3)); //shift eax, cl (x86 masks the count to 5 bits like MIPS)
+    }
+    else if(instr->shamt)
+    {
+        emit8(jit, 0xC1); emit8(jit, 0xC0 | (ext << 3)); emit8(jit, instr->shamt);
+    }
+}
+
+//Emits instructions that can't raise exceptions directly, returns false when the handler has to be called
+static bool emit_inline(ps1_jit* jit, const cpu_instr* instr)
+{
+    cpu_handler h = instr->handler;
+    uint8_t dest = instr->rd;
+
+    if(h == cpu_execute_addu) emit_alu_reg(jit, X86_ADD, instr);
+    else if(h == cpu_execute_subu) emit_alu_reg(jit, X86_SUB, instr);
+    else if(h == cpu_execute_and) emit_alu_reg(jit, X86_AND, instr);
+    else if(h == cpu_execute_or) emit_alu_reg(jit, X86_OR, instr);
+    else if(h == cpu_execute_xor) emit_alu_reg(jit, X86_XOR, instr);
+    else if(h == cpu_execute_nor)
+    {
+        emit_alu_reg(jit, X86_OR, instr);
+        emit8(jit, 0xF7); emit8(jit, 0xD0); //not eax
+    }
+    else if(h == cpu_execute_slt) emit_set_less(jit, 0x9C, false, instr);
+    else if(h == cpu_execute_sltu) emit_set_less(jit, 0x92, false, instr);
+    else if(h == cpu_execute_sll) emit_shift(jit, 4, false, instr);
+    else if(h == cpu_execute_srl) emit_shift(jit, 5, false, instr);
+    else if(h == cpu_execute_sra) emit_shift(jit, 7, false, instr);
+    else if(h == cpu_execute_sllv) emit_shift(jit, 4, true, instr);
+    else if(h == cpu_execute_srlv) emit_shift(jit, 5, true, instr);
+    else if(h == cpu_execute_srav) emit_shift(jit, 7, true, instr);
+    else if(h == cpu_execute_mfhi) emit_rm(jit, X86_MOV_LOAD, EAX, CPU_FIELD(hi));
+    else if(h == cpu_execute_mflo) emit_rm(jit, X86_MOV_LOAD, EAX, CPU_FIELD(lo));
+    else if(h == cpu_execute_mthi || h == cpu_execute_mtlo)
+    {
+        emit_rm(jit, X86_MOV_LOAD, EAX, GPR(instr->rs));
+        emit_rm(jit, X86_MOV_STORE, EAX, (h == cpu_execute_mthi) ? CPU_FIELD(hi) : CPU_FIELD(lo));
+        return true;
+    }
+    else
+    {
+        //Immediate instructions write rt
+        dest = instr->rt;
+
+        if(h == cpu_execute_lui)
+        {
+            if(dest)
+                emit_store_imm32(jit, GPR(dest), instr->imm << 16);
+            return true;
+        }
+        else if(h == cpu_execute_addiu || h == cpu_execute_andi || h == cpu_execute_ori || h == cpu_execute_xori)
+        {
+            uint8_t opcode = 0x05;
+            uint32_t imm = instr->imm;
+            if(h == cpu_execute_addiu)
+                imm = (uint32_t)(int32_t)(int16_t)instr->imm;
+            else if(h == cpu_execute_andi)
+                opcode = 0x25;
+            else if(h == cpu_execute_ori)
+                opcode = 0x0D;
+            else
+                opcode = 0x35;
+
+            emit_rm(jit, X86_MOV_LOAD, EAX, GPR(instr->rs));
+            emit_eax_imm32(jit, opcode, imm);
+        }
+        else if(h == cpu_execute_slti) emit_set_less(jit, 0x9C, true, instr);
+        else if(h == cpu_execute_sltiu) emit_set_less(jit, 0x92, true, instr);
+        else
+            return false;
+    }
+
+    //Writes to r0 are dropped, the value computed above is simply discarded
+    if(dest)
+        emit_rm(jit, X86_MOV_STORE, EAX, GPR(dest));
+    return true;
+}
+
+jit_block_fn ps1_jit_compile(ps1_jit* jit, ps1_cpu* cpu, cpu_block* block)
+{
+    if(jit->buffer == NULL || ps1_jit_needs_flush(jit))
+        return NULL;
+
+    uint8_t* start = jit->ptr;
+    emit_prologue(jit);
+
+    for(uint32_t k = 0; k < block->length; k++)
+    {
+        const cpu_instr* instr = &block->instr[k];
+        uint32_t pc = block->pc + k * 4;
+
+        //The fifo can only hold something at the start of the block or after a load
+        bool after_load = k < 2 || (block->instr[k-1].flags & CPU_INSTR_LOAD) || (block->instr[k-2].flags & CPU_INSTR_LOAD);
+        if(after_load)
+            emit_handle_load(jit);
+
+        cpu_handler h = instr->handler;
+        if(h == cpu_execute_lw || h == cpu_execute_lh || h == cpu_execute_lhu || h == cpu_execute_lb || h == cpu_execute_lbu)
+            emit_load(jit, cpu, instr, pc, k + 1);
+        else if(h == cpu_execute_sw || h == cpu_execute_sh || h == cpu_execute_sb)
+            emit_store(jit, cpu, instr, pc, k + 1);
+        else if(!emit_inline(jit, instr))
+            emit_call_handler(jit, cpu, instr, pc, k + 1);
+
+        //Branch state can only be pending at the start of the block, on branches and on their delay slots
+        bool branch_state = k == 0 || (instr->flags & CPU_INSTR_BRANCH) || (block->instr[k-1].flags & CPU_INSTR_BRANCH);
+        if(branch_state)
+            emit_handle_branch(jit, pc, k + 1);
+    }
+
+    emit_store_imm32(jit, CPU_FIELD(pc), block->pc + block->length * 4);
+    emit_exit(jit, block->length);
+
+    jit->used = jit->ptr - jit->buffer;
+    jit->compiled_blocks++;
+    return (jit_block_fn)start;
+}
+
+#else
+
+jit_block_fn ps1_jit_compile(ps1_jit* jit, ps1_cpu* cpu, cpu_block* block)
+{
+    return NULL;
+}
+
+#endif
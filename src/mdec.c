@@ -0,0 +1,581 @@
+#include "bus.h"
+#include "dma.h"
+#include "mdec.h"
+
+//Position in the block of every coefficient in stream order
+static const uint8_t mdec_zigzag[64] = {
+     0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63
+};
+
+ps1_mdec* ps1_mdec_create()
+{
+    return (ps1_mdec*)malloc(sizeof(ps1_mdec));
+}
+
+static void mdec_prepare_scale(ps1_mdec* mdec)
+{
+    const int16_t* s = mdec->scale;
+    for(uint32_t k = 0; k < 4; k++)
+    {
+        for(uint32_t y = 0; y < 8; y++)
+            mdec->scale_columns[y][k] = (uint16_t)s[2 * k * 8 + y] | (uint32_t)(uint16_t)s[(2 * k + 1) * 8 + y] << 16;
+        for(uint32_t x = 0; x < 8; x++)
+        {
+            mdec->scale_pairs[k][2 * x] = s[2 * k * 8 + x];
+            mdec->scale_pairs[k][2 * x + 1] = s[(2 * k + 1) * 8 + x];
+        }
+    }
+}
+
+//Color macroblocks start with Cr, monochrome ones only have the block in the Cr slot
+static void mdec_reset_decoder(ps1_mdec* mdec)
+{
+    mdec->block = MDEC_BLOCK_CR;
+    mdec->status_block = MDEC_BLOCK_CR;
+    mdec->k = 64;
+    mdec->q = 0;
+}
+
+void ps1_mdec_init(ps1_mdec* mdec)
+{
+    memset(mdec, 0, sizeof(ps1_mdec));
+    mdec->output_capacity = MDEC_MACROBLOCK_WORDS * 16;
+    mdec->output = (uint32_t*)malloc(mdec->output_capacity * sizeof(uint32_t));
+    mdec_reset_decoder(mdec);
+    mdec_prepare_scale(mdec);
+    ps1_mdec_set_simd(mdec, true);
+}
+
+void ps1_mdec_destroy(ps1_mdec* mdec)
+{
+    ps1_mdec_stop_thread(mdec);
+    free (mdec->output);
+    free (mdec);
+}
+
+bool ps1_mdec_set_simd(ps1_mdec* mdec, bool enable)
+{
+    mdec->idct = ps1_mdec_idct;
+#ifdef PS1_SIMD_AVX2
+    if(enable && ps1_cpu_has_avx2())
+        mdec->idct = ps1_mdec_idct_avx2;
+#endif
+    return mdec->idct != ps1_mdec_idct || !enable;
+}
+
+//Columns then rows. The sums wrap at 32 bits and round at each pass, the vector version does exactly the same
+void ps1_mdec_idct(const ps1_mdec* mdec, int16_t* block)
+{
+    const int16_t* s = mdec->scale;
+    int16_t temp[64];
+
+    for(uint32_t y = 0; y < 8; y++)
+    {
+        for(uint32_t x = 0; x < 8; x++)
+        {
+            uint32_t sum = 0x1000;
+            for(uint32_t u = 0; u < 8; u++)
+                sum += (uint32_t)(s[u * 8 + y] * block[u * 8 + x]);
+            int32_t value = (int32_t)sum >> 13;
+            temp[y * 8 + x] = value < -0x8000 ? -0x8000 : value > 0x7FFF ? 0x7FFF : value;
+        }
+    }
+
+    for(uint32_t y = 0; y < 8; y++)
+    {
+        for(uint32_t x = 0; x < 8; x++)
+        {
+            uint32_t sum = 0x40000;
+            for(uint32_t u = 0; u < 8; u++)
+                sum += (uint32_t)(temp[y * 8 + u] * s[u * 8 + x]);
+            int32_t value = (int32_t)sum >> 19;
+            block[y * 8 + x] = value < -128 ? -128 : value > 127 ? 127 : value;
+        }
+    }
+}
+
+static inline bool mdec_is_color(const ps1_mdec* mdec)
+{
+    return ((mdec->command >> 27) & 0x3) >= MDEC_DEPTH_24;
+}
+
+static inline int32_t mdec_sign_extend_10(uint32_t value)
+{
+    return (int32_t)(value << 22) >> 22;
+}
+
+static inline int32_t mdec_clamp_8(int32_t value)
+{
+    return value < -128 ? -128 : value > 127 ? 127 : value;
+}
+
+//Appends to the output FIFO, the worker and the cpu thread share it in threaded mode
+static void mdec_output_push(ps1_mdec* mdec, const uint32_t* words, uint32_t count)
+{
+    if(mdec->threaded)
+        pthread_mutex_lock(&mdec->lock);
+
+    //Words already read make room before the buffer grows
+    if(mdec->output_tail + count > mdec->output_capacity && mdec->output_head > 0)
+    {
+        memmove(mdec->output, mdec->output + mdec->output_head, (mdec->output_tail - mdec->output_head) * sizeof(uint32_t));
+        mdec->output_tail -= mdec->output_head;
+        mdec->output_head = 0;
+    }
+    if(mdec->output_tail + count > mdec->output_capacity)
+    {
+        while(mdec->output_tail + count > mdec->output_capacity)
+            mdec->output_capacity *= 2;
+        mdec->output = (uint32_t*)realloc(mdec->output, mdec->output_capacity * sizeof(uint32_t));
+    }
+    memcpy(mdec->output + mdec->output_tail, words, count * sizeof(uint32_t));
+    mdec->output_tail += count;
+    mdec->macroblocks++;
+
+    if(mdec->threaded)
+    {
+        pthread_cond_broadcast(&mdec->done);
+        pthread_mutex_unlock(&mdec->lock);
+    }
+}
+
+//16x16 pixels in rows, the chroma blocks cover the whole macroblock at half resolution
+static void mdec_output_color(ps1_mdec* mdec)
+{
+    uint32_t words[MDEC_MACROBLOCK_WORDS];
+    uint8_t* bytes = (uint8_t*)words;
+    uint16_t* halfwords = (uint16_t*)words;
+    bool depth_24 = ((mdec->command >> 27) & 0x3) == MDEC_DEPTH_24;
+    uint32_t flip = mdec->command & (1 << 26) ? 0 : 0x80; //Unsigned output adds 128
+    uint16_t bit15 = mdec->command & (1 << 25) ? 0x8000 : 0;
+    const int16_t* cr = mdec->blocks[MDEC_BLOCK_CR];
+    const int16_t* cb = mdec->blocks[MDEC_BLOCK_CB];
+
+    for(uint32_t y = 0; y < 16; y++)
+    {
+        for(uint32_t x = 0; x < 16; x++)
+        {
+            int32_t luma = mdec->blocks[(y >> 3) * 2 + (x >> 3)][(y & 7) * 8 + (x & 7)];
+            int32_t red = cr[(y >> 1) * 8 + (x >> 1)];
+            int32_t blue = cb[(y >> 1) * 8 + (x >> 1)];
+            uint32_t r = (mdec_clamp_8(luma + ((359 * red) >> 8)) ^ flip) & 0xFF;
+            uint32_t g = (mdec_clamp_8(luma + ((-88 * blue) >> 8) + ((-183 * red) >> 8)) ^ flip) & 0xFF;
+            uint32_t b = (mdec_clamp_8(luma + ((454 * blue) >> 8)) ^ flip) & 0xFF;
+
+            uint32_t i = y * 16 + x;
+            if(depth_24)
+            {
+                bytes[i * 3] = r;
+                bytes[i * 3 + 1] = g;
+                bytes[i * 3 + 2] = b;
+            }
+            else
+                halfwords[i] = (r >> 3) | (g >> 3) << 5 | (b >> 3) << 10 | bit15;
+        }
+    }
+    mdec_output_push(mdec, words, depth_24 ? 192 : 128);
+}
+
+//8x8 pixels, 4 bit output keeps the top of every byte
+static void mdec_output_mono(ps1_mdec* mdec)
+{
+    uint32_t words[16] = {0};
+    uint8_t* bytes = (uint8_t*)words;
+    bool depth_8 = ((mdec->command >> 27) & 0x3) == MDEC_DEPTH_8;
+    uint32_t flip = mdec->command & (1 << 26) ? 0 : 0x80;
+    const int16_t* luma = mdec->blocks[MDEC_BLOCK_CR];
+
+    for(uint32_t i = 0; i < 64; i++)
+    {
+        uint32_t value = (mdec_clamp_8(luma[i]) ^ flip) & 0xFF;
+        if(depth_8)
+            bytes[i] = value;
+        else
+            bytes[i >> 1] |= (value >> 4) << ((i & 1) * 4);
+    }
+    mdec_output_push(mdec, words, depth_8 ? 16 : 8);
+}
+
+//Color order is Cr, Cb, Y1, Y2, Y3, Y4, the macroblock goes out after the last one
+static void mdec_finish_block(ps1_mdec* mdec)
+{
+    mdec->idct(mdec, mdec->blocks[mdec->block]);
+    mdec->k = 64;
+
+    if(!mdec_is_color(mdec))
+    {
+        mdec_output_mono(mdec);
+        return;
+    }
+
+    switch(mdec->block)
+    {
+        case MDEC_BLOCK_CR: mdec->block = MDEC_BLOCK_CB; break;
+        case MDEC_BLOCK_CB: mdec->block = MDEC_BLOCK_Y1; break;
+        case MDEC_BLOCK_Y4:
+            mdec_output_color(mdec);
+            mdec->block = MDEC_BLOCK_CR;
+            break;
+        default: mdec->block++; break;
+    }
+}
+
+/*
+ Every block starts with the DC value and its quantization scale in the top 6 bits, FE00h before it is padding.
+ The AC values follow with the count of zeros before them in the top 6 bits, FE00h skips to the end. Values
+ with scale 0 are taken as they are and stored without the zigzag.
+*/
+static void mdec_decode_halfword(ps1_mdec* mdec, uint32_t n)
+{
+    int16_t* block = mdec->blocks[mdec->block];
+    const uint8_t* quant = mdec->quant[mdec_is_color(mdec) && mdec->block >= MDEC_BLOCK_CR];
+    int32_t value = mdec_sign_extend_10(n & 0x3FF);
+
+    if(mdec->k == 64)
+    {
+        if(n == 0xFE00)
+            return;
+        memset(block, 0, 64 * sizeof(int16_t));
+        mdec->k = 0;
+        mdec->q = n >> 10;
+        value = mdec->q ? value * quant[0] : value * 2;
+    }
+    else
+    {
+        mdec->k += (n >> 10) + 1;
+        if(mdec->k > 63)
+        {
+            mdec_finish_block(mdec);
+            return;
+        }
+        value = mdec->q ? (value * quant[mdec->k] * (int32_t)mdec->q + 4) / 8 : value * 2;
+    }
+
+    value = value < -0x400 ? -0x400 : value > 0x3FF ? 0x3FF : value;
+    block[mdec->q ? mdec_zigzag[mdec->k] : mdec->k] = value;
+}
+
+//Low halfword first
+static void mdec_decode(ps1_mdec* mdec, const uint32_t* words, uint32_t count)
+{
+    for(uint32_t i = 0; i < count; i++)
+    {
+        mdec_decode_halfword(mdec, words[i] & 0xFFFF);
+        mdec_decode_halfword(mdec, words[i] >> 16);
+    }
+}
+
+static void* mdec_thread_main(void* arg)
+{
+    ps1_mdec* mdec = (ps1_mdec*)arg;
+
+    pthread_mutex_lock(&mdec->lock);
+    while(true)
+    {
+        while(mdec->pending_count == 0 && !mdec->quit)
+            pthread_cond_wait(&mdec->wake, &mdec->lock);
+        if(mdec->pending_count == 0)
+            break;
+
+        //Takes the whole queue, the cpu thread goes on filling the other buffer
+        uint32_t* words = mdec->pending;
+        uint32_t capacity = mdec->pending_capacity;
+        uint32_t count = mdec->pending_count;
+        mdec->pending = mdec->working;
+        mdec->pending_capacity = mdec->working_capacity;
+        mdec->pending_count = 0;
+        mdec->working = words;
+        mdec->working_capacity = capacity;
+        mdec->busy = true;
+        pthread_mutex_unlock(&mdec->lock);
+
+        mdec_decode(mdec, words, count);
+
+        pthread_mutex_lock(&mdec->lock);
+        mdec->status_block = mdec->block;
+        mdec->busy = false;
+        pthread_cond_broadcast(&mdec->done);
+    }
+    pthread_mutex_unlock(&mdec->lock);
+    return NULL;
+}
+
+static void mdec_queue(ps1_mdec* mdec, const uint32_t* words, uint32_t count)
+{
+    pthread_mutex_lock(&mdec->lock);
+    if(mdec->pending_count + count > mdec->pending_capacity)
+    {
+        while(mdec->pending_count + count > mdec->pending_capacity)
+            mdec->pending_capacity = mdec->pending_capacity ? mdec->pending_capacity * 2 : 0x1000;
+        mdec->pending = (uint32_t*)realloc(mdec->pending, mdec->pending_capacity * sizeof(uint32_t));
+    }
+    memcpy(mdec->pending + mdec->pending_count, words, count * sizeof(uint32_t));
+    mdec->pending_count += count;
+    pthread_cond_signal(&mdec->wake);
+    pthread_mutex_unlock(&mdec->lock);
+}
+
+//Waits until every queued word is decoded
+static void mdec_sync(ps1_mdec* mdec)
+{
+    if(!mdec->threaded)
+        return;
+
+    pthread_mutex_lock(&mdec->lock);
+    while(mdec->busy || mdec->pending_count)
+        pthread_cond_wait(&mdec->done, &mdec->lock);
+    pthread_mutex_unlock(&mdec->lock);
+}
+
+//Decodes the parameter words of the next commands on a worker thread
+bool ps1_mdec_start_thread(ps1_mdec* mdec)
+{
+    if(mdec->threaded)
+        return true;
+
+    pthread_mutex_init(&mdec->lock, NULL);
+    pthread_cond_init(&mdec->wake, NULL);
+    pthread_cond_init(&mdec->done, NULL);
+    mdec->quit = false;
+    mdec->threaded = true;
+    if(pthread_create(&mdec->thread, NULL, mdec_thread_main, mdec) != 0)
+    {
+        printf("Couldn't start the MDEC thread\n");
+        mdec->threaded = false;
+        pthread_cond_destroy(&mdec->done);
+        pthread_cond_destroy(&mdec->wake);
+        pthread_mutex_destroy(&mdec->lock);
+        return false;
+    }
+    return true;
+}
+
+//The worker finishes the queued words before it exits
+void ps1_mdec_stop_thread(ps1_mdec* mdec)
+{
+    if(!mdec->threaded)
+        return;
+
+    pthread_mutex_lock(&mdec->lock);
+    mdec->quit = true;
+    pthread_cond_signal(&mdec->wake);
+    pthread_mutex_unlock(&mdec->lock);
+    pthread_join(mdec->thread, NULL);
+
+    mdec->threaded = false;
+    pthread_cond_destroy(&mdec->done);
+    pthread_cond_destroy(&mdec->wake);
+    pthread_mutex_destroy(&mdec->lock);
+    free (mdec->pending);
+    free (mdec->working);
+    mdec->pending = mdec->working = NULL;
+    mdec->pending_capacity = mdec->working_capacity = 0;
+}
+
+//DMA0 while parameters are expected, DMA1 while there is output or, in threaded mode, output on the way
+static void mdec_update_requests(ps1_mdec* mdec)
+{
+    if(mdec->dma == NULL)
+        return;
+
+    bool output;
+    if(mdec->threaded)
+    {
+        pthread_mutex_lock(&mdec->lock);
+        output = mdec->output_tail != mdec->output_head || mdec->busy || mdec->pending_count;
+        pthread_mutex_unlock(&mdec->lock);
+    }
+    else
+        output = mdec->output_tail != mdec->output_head;
+
+    ps1_dma_set_request(mdec->dma, DMA_CHANNEL_MDEC_IN, mdec->enable_in && mdec->remaining > 0);
+    ps1_dma_set_request(mdec->dma, DMA_CHANNEL_MDEC_OUT, mdec->enable_out && output);
+}
+
+static void mdec_command(ps1_mdec* mdec, uint32_t value)
+{
+    //The decoder state and the tables may still be in use by the worker
+    mdec_sync(mdec);
+
+    mdec->command = value;
+    mdec->table_index = 0;
+    switch(value >> 29)
+    {
+        case MDEC_COMMAND_DECODE:
+            mdec->mode = MDEC_COMMAND_DECODE;
+            mdec->remaining = value & 0xFFFF;
+            mdec_reset_decoder(mdec);
+            break;
+        case MDEC_COMMAND_QUANT:
+            mdec->mode = MDEC_COMMAND_QUANT;
+            mdec->remaining = value & 1 ? 32 : 16;
+            break;
+        case MDEC_COMMAND_SCALE:
+            mdec->mode = MDEC_COMMAND_SCALE;
+            mdec->remaining = 32;
+            break;
+        default:
+            mdec->mode = MDEC_COMMAND_NONE;
+            mdec->remaining = 0;
+            break;
+    }
+}
+
+//Commands and their parameters, from the cpu or DMA0
+void ps1_mdec_write_block(ps1_mdec* mdec, const uint32_t* words, uint32_t count)
+{
+    while(count > 0)
+    {
+        if(mdec->remaining == 0)
+        {
+            mdec_command(mdec, *words++);
+            count--;
+            continue;
+        }
+
+        uint32_t run = count < mdec->remaining ? count : mdec->remaining;
+        switch(mdec->mode)
+        {
+            case MDEC_COMMAND_DECODE:
+                if(mdec->threaded)
+                    mdec_queue(mdec, words, run);
+                else
+                    mdec_decode(mdec, words, run);
+                break;
+            case MDEC_COMMAND_QUANT:
+                memcpy((uint8_t*)mdec->quant + mdec->table_index * 4, words, run * 4);
+                break;
+            case MDEC_COMMAND_SCALE:
+                memcpy((uint8_t*)mdec->scale + mdec->table_index * 4, words, run * 4);
+                break;
+            default:
+                break;
+        }
+
+        mdec->table_index += run;
+        mdec->remaining -= run;
+        words += run;
+        count -= run;
+        if(mdec->remaining == 0 && mdec->mode == MDEC_COMMAND_SCALE)
+            mdec_prepare_scale(mdec);
+    }
+    mdec_update_requests(mdec);
+}
+
+//Output FIFO words, from the cpu or DMA1. Reads past the end of the output get 0
+void ps1_mdec_read_block(ps1_mdec* mdec, uint32_t* words, uint32_t count)
+{
+    //Only waits for as much output as is asked for
+    if(mdec->threaded)
+    {
+        pthread_mutex_lock(&mdec->lock);
+        while(mdec->output_tail - mdec->output_head < count && (mdec->busy || mdec->pending_count))
+            pthread_cond_wait(&mdec->done, &mdec->lock);
+    }
+
+    uint32_t available = mdec->output_tail - mdec->output_head;
+    uint32_t copied = available < count ? available : count;
+    memcpy(words, mdec->output + mdec->output_head, copied * sizeof(uint32_t));
+    mdec->output_head += copied;
+    if(mdec->output_head == mdec->output_tail)
+        mdec->output_head = mdec->output_tail = 0;
+
+    if(mdec->threaded)
+        pthread_mutex_unlock(&mdec->lock);
+
+    memset(words + copied, 0, (count - copied) * sizeof(uint32_t));
+    mdec_update_requests(mdec);
+}
+
+void ps1_mdec_write_control(ps1_mdec* mdec, uint32_t value)
+{
+    if(value & MDEC_CONTROL_RESET)
+    {
+        mdec_sync(mdec);
+        mdec->command = 0;
+        mdec->mode = MDEC_COMMAND_NONE;
+        mdec->remaining = 0;
+        mdec->output_head = mdec->output_tail = 0;
+        mdec_reset_decoder(mdec);
+    }
+    mdec->enable_in = value & MDEC_CONTROL_ENABLE_IN;
+    mdec->enable_out = value & MDEC_CONTROL_ENABLE_OUT;
+    mdec_update_requests(mdec);
+}
+
+//Games poll this on every DMA step, so it only looks at what the worker has published and never waits for it
+uint32_t ps1_mdec_read_status(ps1_mdec* mdec)
+{
+    bool empty, decoding = false;
+    MDEC_BLOCK block = mdec->block;
+    if(mdec->threaded)
+    {
+        pthread_mutex_lock(&mdec->lock);
+        empty = mdec->output_head == mdec->output_tail;
+        decoding = mdec->busy || mdec->pending_count;
+        block = mdec->status_block;
+        pthread_mutex_unlock(&mdec->lock);
+    }
+    else
+        empty = mdec->output_head == mdec->output_tail;
+
+    uint32_t status = (mdec->remaining - 1) & 0xFFFF;
+    status |= block << 16;
+    status |= ((mdec->command >> 25) & 0xF) << 23;
+    if(empty)
+        status |= MDEC_STATUS_OUT_EMPTY;
+    if(mdec->remaining > 0 || decoding)
+        status |= MDEC_STATUS_BUSY;
+    if(mdec->enable_in && mdec->remaining > 0)
+        status |= MDEC_STATUS_IN_REQUEST;
+    if(mdec->enable_out && !empty)
+        status |= MDEC_STATUS_OUT_REQUEST;
+    return status;
+}
+
+static uint32_t ps1_mdec_io_read(void* device, uint32_t address, BUS_WIDTH width)
+{
+    ps1_mdec* mdec = (ps1_mdec*)device;
+    if(address == MDEC_CONTROL)
+        return ps1_mdec_read_status(mdec);
+
+    uint32_t word;
+    ps1_mdec_read_block(mdec, &word, 1);
+    return word;
+}
+
+static void ps1_mdec_io_write(void* device, uint32_t address, uint32_t value, BUS_WIDTH width)
+{
+    ps1_mdec* mdec = (ps1_mdec*)device;
+    if(address == MDEC_CONTROL)
+        ps1_mdec_write_control(mdec, value);
+    else
+        ps1_mdec_write_block(mdec, &value, 1);
+}
+
+void ps1_connect_bus_mdec(ps1_bus* bus, ps1_mdec* mdec)
+{
+    ps1_bus_register_io(bus, MDEC_DATA, 8, mdec, ps1_mdec_io_read, ps1_mdec_io_write, BUS_WIDTH_WORD);
+}
+
+static void ps1_mdec_dma_write(void* device, const uint32_t* words, uint32_t count)
+{
+    ps1_mdec_write_block((ps1_mdec*)device, words, count);
+}
+
+static void ps1_mdec_dma_read(void* device, uint32_t* words, uint32_t count)
+{
+    ps1_mdec_read_block((ps1_mdec*)device, words, count);
+}
+
+//DMA0 feeds the input and DMA1 drains the output, both only run while the MDEC asks for them
+void ps1_connect_dma_mdec(ps1_dma* dma, ps1_mdec* mdec)
+{
+    mdec->dma = dma;
+    ps1_dma_connect_port(dma, DMA_CHANNEL_MDEC_IN, mdec, ps1_mdec_dma_write, NULL);
+    ps1_dma_connect_port(dma, DMA_CHANNEL_MDEC_OUT, mdec, NULL, ps1_mdec_dma_read);
+    mdec_update_requests(mdec);
+}
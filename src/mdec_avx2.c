@@ -0,0 +1,60 @@
+#include "mdec.h"
+
+#ifdef PS1_SIMD_AVX2
+
+#include <immintrin.h>
+
+/*
+ A row of 8 sums per register. madd multiplies pairs of 16 bit values and adds each pair, so the inputs are
+ interleaved two rows at a time: block rows 2k and 2k+1 against S[2k][y] | S[2k+1][y] for the columns, then
+ temp[y][2k] | temp[y][2k+1] against the interleaved scale rows. The pair sums wrap like the scalar loop does.
+ packs works within 128 bit lanes, the permute puts two packed rows back in order.
+*/
+PS1_AVX2_TARGET void ps1_mdec_idct_avx2(const ps1_mdec* mdec, int16_t* block)
+{
+    int16_t temp[64] __attribute__((aligned(32)));
+    __m256i rows[4];
+    for(uint32_t k = 0; k < 4; k++)
+    {
+        __m128i even = _mm_loadu_si128((const __m128i*)(block + 16 * k));
+        __m128i odd = _mm_loadu_si128((const __m128i*)(block + 16 * k + 8));
+        rows[k] = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi16(even, odd)), _mm_unpackhi_epi16(even, odd), 1);
+    }
+
+    for(uint32_t y = 0; y < 8; y += 2)
+    {
+        __m256i first = _mm256_set1_epi32(0x1000);
+        __m256i second = first;
+        for(uint32_t k = 0; k < 4; k++)
+        {
+            first = _mm256_add_epi32(first, _mm256_madd_epi16(rows[k], _mm256_set1_epi32(mdec->scale_columns[y][k])));
+            second = _mm256_add_epi32(second, _mm256_madd_epi16(rows[k], _mm256_set1_epi32(mdec->scale_columns[y + 1][k])));
+        }
+        __m256i packed = _mm256_packs_epi32(_mm256_srai_epi32(first, 13), _mm256_srai_epi32(second, 13));
+        _mm256_store_si256((__m256i*)(temp + y * 8), _mm256_permute4x64_epi64(packed, 0xD8));
+    }
+
+    __m256i pairs[4];
+    for(uint32_t k = 0; k < 4; k++)
+        pairs[k] = _mm256_loadu_si256((const __m256i*)mdec->scale_pairs[k]);
+    const __m256i min = _mm256_set1_epi16(-128);
+    const __m256i max = _mm256_set1_epi16(127);
+
+    for(uint32_t y = 0; y < 8; y += 2)
+    {
+        uint32_t values[8];
+        memcpy(values, temp + y * 8, sizeof(values));
+        __m256i first = _mm256_set1_epi32(0x40000);
+        __m256i second = first;
+        for(uint32_t k = 0; k < 4; k++)
+        {
+            first = _mm256_add_epi32(first, _mm256_madd_epi16(pairs[k], _mm256_set1_epi32(values[k])));
+            second = _mm256_add_epi32(second, _mm256_madd_epi16(pairs[k], _mm256_set1_epi32(values[4 + k])));
+        }
+        __m256i packed = _mm256_packs_epi32(_mm256_srai_epi32(first, 19), _mm256_srai_epi32(second, 19));
+        packed = _mm256_min_epi16(_mm256_max_epi16(packed, min), max);
+        _mm256_storeu_si256((__m256i*)(block + y * 8), _mm256_permute4x64_epi64(packed, 0xD8));
+    }
+}
+
+#endif
@@ -3,8 +3,22 @@
 #include "bus.h"
 #include "cpu.h"
 #include "gpu.h"
+#include "gpu_raster.h"
+#include "gpu_thread.h"
+#include "gpu_tiles.h"
+#include "gpu_texture_cache.h"
+#include "gpu_trace.h"
+#include "gpu_dump.h"
+#include "mdec.h"
+#include "irq.h"
+#include "timers.h"
+#include "cdrom.h"
+#include "spu.h"
+#include "disc.h"
+#include "iso9660.h"
 #include "scratchpad.h"
 #include "dma.h"
+#include "scheduler.h"
 #include "ps1.h"
 
 ps1* ps1_create()
@@ -21,37 +35,285 @@ void ps1_init(ps1* ps1)
     ps1->gpu = ps1_gpu_create();
     ps1->scratchpad = ps1_scratchpad_create();
     ps1->dma = ps1_dma_create();
+    ps1->mdec = ps1_mdec_create();
+    ps1->irq = ps1_irq_create();
+    ps1->timers = ps1_timers_create();
+    ps1->cdrom = ps1_cdrom_create();
+    ps1->spu = ps1_spu_create();
+    ps1->scheduler = ps1_scheduler_create();
   
+    ps1_scheduler_init(ps1->scheduler);
     ps1_dma_init(ps1->dma);
     ps1_bios_init(ps1->bios);
     ps1_cpu_init(ps1->cpu);
     ps1_ram_init(ps1->ram);
     ps1_gpu_init(ps1->gpu);
     ps1_scratchpad_init(ps1->scratchpad);
+    ps1_mdec_init(ps1->mdec);
+    ps1_irq_init(ps1->irq);
+    ps1_timers_init(ps1->timers, ps1->gpu);
+    ps1_cdrom_init(ps1->cdrom);
+    ps1_spu_init(ps1->spu);
     ps1_bus_init(ps1->bus, ps1->bios, ps1->cpu, ps1->ram, ps1->gpu, ps1->scratchpad, ps1->dma);
 
     ps1_connect_bus_cpu(ps1->bus, ps1->cpu);
     ps1_connect_bus_dma(ps1->bus, ps1->dma);
+    ps1_connect_bus_gpu(ps1->bus, ps1->gpu);
+    ps1_connect_bus_mdec(ps1->bus, ps1->mdec);
+    ps1_connect_bus_irq(ps1->bus, ps1->irq);
+    ps1_connect_bus_timers(ps1->bus, ps1->timers);
+    ps1_connect_bus_cdrom(ps1->bus, ps1->cdrom);
+    ps1_connect_bus_spu(ps1->bus, ps1->spu);
+
+    ps1_connect_scheduler_cpu(ps1->scheduler, ps1->cpu);
+    ps1_connect_scheduler_dma(ps1->scheduler, ps1->dma);
+    ps1_connect_scheduler_gpu(ps1->scheduler, ps1->gpu);
+    ps1_connect_scheduler_timers(ps1->scheduler, ps1->timers);
+    ps1_connect_scheduler_cdrom(ps1->scheduler, ps1->cdrom);
+    ps1_connect_scheduler_spu(ps1->scheduler, ps1->spu);
+
+    ps1_connect_dma_gpu(ps1->dma, ps1->gpu);
+    ps1_connect_dma_mdec(ps1->dma, ps1->mdec);
+    ps1_connect_dma_cdrom(ps1->dma, ps1->cdrom);
+    ps1_connect_dma_spu(ps1->dma, ps1->spu);
+
+    ps1_connect_irq_cpu(ps1->irq, ps1->cpu);
+    ps1_connect_irq_dma(ps1->irq, ps1->dma);
+    ps1_connect_irq_gpu(ps1->irq, ps1->gpu);
+    ps1_connect_irq_timers(ps1->irq, ps1->timers);
+    ps1_connect_irq_cdrom(ps1->irq, ps1->cdrom);
+    ps1_connect_irq_spu(ps1->irq, ps1->spu);
+
+    ps1_connect_spu_cdrom(ps1->spu, ps1->cdrom);
 }
 
 void ps1_destroy(ps1* ps1)
 {
+    //The cpu goes first, flushing its block cache touches the bus page tables
+    ps1_cpu_destroy(ps1->cpu);
+    ps1_bus_destroy(ps1->bus);
+    //Stops the render thread, the tile workers and any trace or dump writer, closing their files
+    ps1_gpu_destroy(ps1->gpu);
+    ps1_scratchpad_destroy(ps1->scratchpad);
     free (ps1->bios);
     free (ps1->ram);
-    free (ps1->cpu);
-    free (ps1->bus);
     free (ps1->dma);
+    ps1_mdec_destroy(ps1->mdec);
+    ps1_irq_destroy(ps1->irq);
+    ps1_timers_destroy(ps1->timers);
+    ps1_cdrom_destroy(ps1->cdrom);
+    ps1_spu_destroy(ps1->spu);
+    ps1_scheduler_destroy(ps1->scheduler);
     free (ps1);
 }
 
 void ps1_load_bios(ps1* ps1)
 {
     ps1_bios_load(ps1->bios);
+    ps1_bus_update_memory_map(ps1->bus);
 }
 
+static void ps1_advance(ps1* ps1, uint32_t cycles)
+{
+    ps1_scheduler_add_cycles(ps1->scheduler, cycles);
+    ps1_scheduler_run_events(ps1->scheduler);
+}
+
+//Runs the cpu without interruption until the next event is due, then lets the devices catch up
 void ps1_play(ps1* ps1)
 {
-    cpu_tick(ps1->cpu);
-    ps1_dma_do_transfer(ps1->dma);
-    
-}
\ No newline at end of file
+    cpu_run(ps1->cpu, UINT64_MAX);
+    ps1_scheduler_run_events(ps1->scheduler);
+}
+
+//Runs for at least the given number of cycles, the last block may overshoot a little.
+//Returns the cycles actually executed
+uint64_t ps1_run_cycles(ps1* ps1, uint64_t cycles)
+{
+    uint64_t start = ps1->scheduler->cycles;
+    uint64_t end = start + cycles;
+
+    while(ps1->scheduler->cycles < end)
+    {
+        cpu_run(ps1->cpu, end);
+        ps1_scheduler_run_events(ps1->scheduler);
+    }
+
+    return ps1->scheduler->cycles - start;
+}
+
+//Runs until the next VBlank
+void ps1_run_frame(ps1* ps1)
+{
+    uint64_t frame = ps1->gpu->frame_count;
+    while(ps1->gpu->frame_count == frame)
+    {
+        cpu_run(ps1->cpu, UINT64_MAX);
+        ps1_scheduler_run_events(ps1->scheduler);
+    }
+}
+
+void ps1_set_cpu_backend(ps1* ps1, CPU_BACKEND backend)
+{
+    ps1_cpu_set_backend(ps1->cpu, backend);
+}
+
+//The vector rasterizer is picked at init when the cpu supports it, this allows forcing the scalar loop
+bool ps1_set_gpu_simd(ps1* ps1, bool enable)
+{
+    return ps1_gpu_set_simd(ps1->gpu, enable);
+}
+
+//Moves GP0/GP1 processing to a render thread fed through a command ring, or back to the cpu thread
+bool ps1_set_gpu_threaded(ps1* ps1, bool enable)
+{
+    if(!enable)
+    {
+        ps1_gpu_stop_thread(ps1->gpu);
+        return true;
+    }
+    return ps1_gpu_start_thread(ps1->gpu);
+}
+
+//Splits rasterization over a pool of workers drawing bands of VRAM, 1 worker draws every primitive as it arrives
+bool ps1_set_gpu_workers(ps1* ps1, uint32_t workers, uint32_t tiles)
+{
+    //The pool belongs to whichever thread executes GP0, it has to be idle while the pool changes
+    if(ps1->gpu->thread != NULL)
+        ps1_gpu_thread_sync(ps1->gpu->thread);
+    return ps1_gpu_start_workers(ps1->gpu, workers, tiles);
+}
+
+//Textures are decoded through their CLUT once and kept until VRAM under them changes, this allows sampling VRAM directly
+bool ps1_set_gpu_texture_cache(ps1* ps1, bool enable)
+{
+    return ps1_gpu_set_texture_cache(ps1->gpu, enable);
+}
+
+//Records every GP0/GP1 word to a file that gpu_replay can run without the cpu, from the next frame boundary on
+bool ps1_start_gpu_trace(ps1* ps1, const char* path)
+{
+    return ps1_gpu_start_trace(ps1->gpu, path);
+}
+
+void ps1_stop_gpu_trace(ps1* ps1)
+{
+    ps1_gpu_stop_trace(ps1->gpu);
+}
+
+//Streams the displayed part of VRAM at every VBlank to a Y4M or PPM file or pipe, for running without a display
+bool ps1_start_frame_dump(ps1* ps1, const char* path)
+{
+    return ps1_gpu_start_dump(ps1->gpu, path);
+}
+
+void ps1_stop_frame_dump(ps1* ps1)
+{
+    ps1_gpu_stop_dump(ps1->gpu);
+}
+
+//Decodes the macroblocks sent to the MDEC on a worker thread, DMA1 and the cpu only wait for it when they read the output
+bool ps1_set_mdec_threaded(ps1* ps1, bool enable)
+{
+    if(!enable)
+    {
+        ps1_mdec_stop_thread(ps1->mdec);
+        return true;
+    }
+    return ps1_mdec_start_thread(ps1->mdec);
+}
+
+//Opens a .cue sheet or a raw .bin and closes the drive on it, the image is mapped rather than read
+bool ps1_insert_disc(ps1* ps1, const char* path)
+{
+    ps1_disc* disc = ps1_disc_open(path);
+    if(disc == NULL)
+        return false;
+    ps1_cdrom_insert(ps1->cdrom, disc);
+    return true;
+}
+
+//Takes up to count stereo 44.1kHz frames the SPU has rendered, from any thread. Returns how many there were
+uint32_t ps1_read_audio(ps1* ps1, int16_t* frames, uint32_t count)
+{
+    return ps1_spu_read_audio(ps1->spu, frames, count);
+}
+
+//Runs a PS-X EXE from the host instead of the shell, once the BIOS has set up the kernel
+bool ps1_boot_exe(ps1* ps1, const char* path)
+{
+    FILE* file = fopen(path, "rb");
+    if(file == NULL)
+    {
+        printf("Couldn't open %s\n", path);
+        return false;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    uint8_t* exe = size > 0 ? (uint8_t*)malloc(size) : NULL;
+    if(exe == NULL || fread(exe, 1, size, file) != (size_t)size)
+    {
+        printf("Couldn't read %s\n", path);
+        free (exe);
+        fclose(file);
+        return false;
+    }
+    fclose(file);
+    return cpu_queue_exe(ps1->cpu, exe, size, CPU_EXE_STACK);
+}
+
+//Boots the disc's EXE at the shell handoff, which skips the BIOS intro
+bool ps1_fast_boot(ps1* ps1)
+{
+    if(ps1->cdrom->disc == NULL)
+    {
+        printf("No disc to boot\n");
+        return false;
+    }
+
+    ps1_iso* iso = ps1_iso_open(ps1->cdrom->disc);
+    if(iso == NULL)
+        return false;
+
+    char path[256];
+    uint32_t stack = CPU_EXE_STACK;
+    uint32_t size = 0;
+    uint8_t* exe = ps1_iso_find_boot(iso, path, sizeof(path), &stack) ? ps1_iso_load(iso, path, &size) : NULL;
+    ps1_iso_close(iso);
+    if(exe == NULL)
+    {
+        printf("Couldn't find the boot EXE %s on the disc\n", path);
+        return false;
+    }
+    return cpu_queue_exe(ps1->cpu, exe, size, stack);
+}
+
+//Maps the guest address space through the host MMU, only makes a difference for the JIT
+bool ps1_enable_fastmem(ps1* ps1)
+{
+    if(!ps1_bus_enable_fastmem(ps1->bus))
+        return false;
+
+    //Compiled code points at the old RAM buffer
+    ps1_cpu_flush_code(ps1->cpu);
+    return true;
+}
+
+//Runs one block on test and the same number of instructions on reference, which should use the interpreter.
+//Returns false as soon as both cpus diverge
+bool ps1_lockstep(ps1* test, ps1* reference)
+{
+    //Interrupts are only taken here, so the reference can't take one in the middle of the test's block
+    cpu_check_interrupt(test->cpu);
+    cpu_check_interrupt(reference->cpu);
+    uint32_t executed = cpu_tick(test->cpu);
+    ps1_advance(test, executed);
+
+    for(uint32_t i = 0; i < executed; )
+        i += cpu_tick(reference->cpu);
+    ps1_advance(reference, executed);
+
+    return cpu_compare_state(test->cpu, reference->cpu);
+}
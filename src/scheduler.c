@@ -0,0 +1,127 @@
+#include "scheduler.h"
+
+ps1_scheduler* ps1_scheduler_create()
+{
+    return (ps1_scheduler*)malloc(sizeof(ps1_scheduler));
+}
+
+void ps1_scheduler_init(ps1_scheduler* scheduler)
+{
+    memset(scheduler, 0, sizeof(ps1_scheduler));
+    for(int i = 0; i < EVENT_COUNT; i++)
+        scheduler->events[i].heap_index = -1;
+    scheduler->next_deadline = UINT64_MAX;
+}
+
+void ps1_scheduler_destroy(ps1_scheduler* scheduler)
+{
+    free (scheduler);
+}
+
+void ps1_scheduler_register(ps1_scheduler* scheduler, SCHEDULER_EVENT event, scheduler_callback callback, void* device)
+{
+    scheduler->events[event].callback = callback;
+    scheduler->events[event].device = device;
+}
+
+static bool ps1_scheduler_before(ps1_scheduler* scheduler, uint32_t a, uint32_t b)
+{
+    return scheduler->events[scheduler->heap[a]].timestamp < scheduler->events[scheduler->heap[b]].timestamp;
+}
+
+static void ps1_scheduler_swap(ps1_scheduler* scheduler, uint32_t a, uint32_t b)
+{
+    uint8_t event = scheduler->heap[a];
+    scheduler->heap[a] = scheduler->heap[b];
+    scheduler->heap[b] = event;
+    scheduler->events[scheduler->heap[a]].heap_index = a;
+    scheduler->events[scheduler->heap[b]].heap_index = b;
+}
+
+static void ps1_scheduler_sift_up(ps1_scheduler* scheduler, uint32_t index)
+{
+    while(index > 0 && ps1_scheduler_before(scheduler, index, (index - 1) / 2))
+    {
+        ps1_scheduler_swap(scheduler, index, (index - 1) / 2);
+        index = (index - 1) / 2;
+    }
+}
+
+static void ps1_scheduler_sift_down(ps1_scheduler* scheduler, uint32_t index)
+{
+    while(true)
+    {
+        uint32_t smallest = index;
+        uint32_t left = index * 2 + 1;
+        uint32_t right = index * 2 + 2;
+
+        if(left < scheduler->heap_size && ps1_scheduler_before(scheduler, left, smallest))
+            smallest = left;
+        if(right < scheduler->heap_size && ps1_scheduler_before(scheduler, right, smallest))
+            smallest = right;
+        if(smallest == index)
+            return;
+
+        ps1_scheduler_swap(scheduler, index, smallest);
+        index = smallest;
+    }
+}
+
+static void ps1_scheduler_update_deadline(ps1_scheduler* scheduler)
+{
+    scheduler->next_deadline = scheduler->heap_size ? scheduler->events[scheduler->heap[0]].timestamp : UINT64_MAX;
+}
+
+void ps1_scheduler_cancel(ps1_scheduler* scheduler, SCHEDULER_EVENT event)
+{
+    int32_t index = scheduler->events[event].heap_index;
+    if(index < 0)
+        return;
+
+    scheduler->heap_size--;
+    if((uint32_t)index != scheduler->heap_size)
+    {
+        ps1_scheduler_swap(scheduler, index, scheduler->heap_size);
+        ps1_scheduler_sift_down(scheduler, index);
+        ps1_scheduler_sift_up(scheduler, index);
+    }
+
+    scheduler->events[event].heap_index = -1;
+    ps1_scheduler_update_deadline(scheduler);
+}
+
+//Scheduling an event that is already pending moves it to the new timestamp
+void ps1_scheduler_schedule_at(ps1_scheduler* scheduler, SCHEDULER_EVENT event, uint64_t timestamp)
+{
+    ps1_scheduler_cancel(scheduler, event);
+
+    scheduler->events[event].timestamp = timestamp;
+    scheduler->events[event].heap_index = scheduler->heap_size;
+    scheduler->heap[scheduler->heap_size++] = event;
+    ps1_scheduler_sift_up(scheduler, scheduler->heap_size - 1);
+    ps1_scheduler_update_deadline(scheduler);
+}
+
+void ps1_scheduler_schedule(ps1_scheduler* scheduler, SCHEDULER_EVENT event, uint64_t cycles_from_now)
+{
+    ps1_scheduler_schedule_at(scheduler, event, scheduler->cycles + cycles_from_now);
+}
+
+bool ps1_scheduler_is_scheduled(ps1_scheduler* scheduler, SCHEDULER_EVENT event)
+{
+    return scheduler->events[event].heap_index >= 0;
+}
+
+//Runs every event whose timestamp has been reached, in timestamp order
+void ps1_scheduler_run_events(ps1_scheduler* scheduler)
+{
+    while(ps1_scheduler_event_due(scheduler))
+    {
+        SCHEDULER_EVENT event = scheduler->heap[0];
+        uint64_t timestamp = scheduler->events[event].timestamp;
+        ps1_scheduler_cancel(scheduler, event);
+
+        if(scheduler->events[event].callback != NULL)
+            scheduler->events[event].callback(scheduler->events[event].device, timestamp);
+    }
+}
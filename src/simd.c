@@ -0,0 +1,11 @@
+#include "simd.h"
+
+bool ps1_cpu_has_avx2()
+{
+#ifdef PS1_SIMD_AVX2
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,870 @@
+#include "bus.h"
+#include "dma.h"
+#include "irq.h"
+#include "scheduler.h"
+#include "spu.h"
+
+//ADPCM block flags
+#define SPU_ADPCM_LOOP_END    (1 << 0)
+#define SPU_ADPCM_LOOP_REPEAT (1 << 1) //With the end flag, jump to the repeat address rather than release
+#define SPU_ADPCM_LOOP_START  (1 << 2) //Sets the repeat address
+
+#define SPU_EVENT_CYCLES (SPU_BLOCK * SPU_SAMPLE_CYCLES)
+
+static const int32_t spu_adpcm_positive[5] = {0, 60, 115, 98, 122};
+static const int32_t spu_adpcm_negative[5] = {0, 0, -52, -55, -60};
+
+//Interpolation table of the SPU, 4 taps for each of 256 phases. The taps of a phase add up to 7F7Fh-7F81h, just under unity
+static const int16_t spu_gauss[512] =
+{
+    -0x001, -0x001, -0x001, -0x001, -0x001, -0x001, -0x001, -0x001,
+    -0x001, -0x001, -0x001, -0x001, -0x001, -0x001, -0x001, -0x001,
+    0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x001,
+    0x001, 0x001, 0x001, 0x002, 0x002, 0x002, 0x003, 0x003,
+    0x003, 0x004, 0x004, 0x005, 0x005, 0x006, 0x007, 0x007,
+    0x008, 0x009, 0x009, 0x00A, 0x00B, 0x00C, 0x00D, 0x00E,
+    0x00F, 0x010, 0x011, 0x012, 0x013, 0x015, 0x016, 0x018,
+    0x019, 0x01B, 0x01C, 0x01E, 0x020, 0x021, 0x023, 0x025,
+    0x027, 0x029, 0x02C, 0x02E, 0x030, 0x033, 0x035, 0x038,
+    0x03A, 0x03D, 0x040, 0x043, 0x046, 0x049, 0x04D, 0x050,
+    0x054, 0x057, 0x05B, 0x05F, 0x063, 0x067, 0x06B, 0x06F,
+    0x074, 0x078, 0x07D, 0x082, 0x087, 0x08C, 0x091, 0x096,
+    0x09C, 0x0A1, 0x0A7, 0x0AD, 0x0B3, 0x0BA, 0x0C0, 0x0C7,
+    0x0CD, 0x0D4, 0x0DB, 0x0E3, 0x0EA, 0x0F2, 0x0FA, 0x101,
+    0x10A, 0x112, 0x11B, 0x123, 0x12C, 0x135, 0x13F, 0x148,
+    0x152, 0x15C, 0x166, 0x171, 0x17B, 0x186, 0x191, 0x19C,
+    0x1A8, 0x1B4, 0x1C0, 0x1CC, 0x1D9, 0x1E5, 0x1F2, 0x200,
+    0x20D, 0x21B, 0x229, 0x237, 0x246, 0x255, 0x264, 0x273,
+    0x283, 0x293, 0x2A3, 0x2B4, 0x2C4, 0x2D6, 0x2E7, 0x2F9,
+    0x30B, 0x31D, 0x330, 0x343, 0x356, 0x36A, 0x37E, 0x392,
+    0x3A7, 0x3BC, 0x3D1, 0x3E7, 0x3FC, 0x413, 0x42A, 0x441,
+    0x458, 0x470, 0x488, 0x4A0, 0x4B9, 0x4D2, 0x4EC, 0x506,
+    0x520, 0x53B, 0x556, 0x572, 0x58E, 0x5AA, 0x5C7, 0x5E4,
+    0x601, 0x61F, 0x63E, 0x65C, 0x67C, 0x69B, 0x6BB, 0x6DC,
+    0x6FD, 0x71E, 0x740, 0x762, 0x784, 0x7A7, 0x7CB, 0x7EF,
+    0x813, 0x838, 0x85D, 0x883, 0x8A9, 0x8D0, 0x8F7, 0x91E,
+    0x946, 0x96F, 0x998, 0x9C1, 0x9EB, 0xA16, 0xA40, 0xA6C,
+    0xA98, 0xAC4, 0xAF1, 0xB1E, 0xB4C, 0xB7A, 0xBA9, 0xBD8,
+    0xC07, 0xC38, 0xC68, 0xC99, 0xCCB, 0xCFD, 0xD30, 0xD63,
+    0xD97, 0xDCB, 0xE00, 0xE35, 0xE6B, 0xEA1, 0xED7, 0xF0F,
+    0xF46, 0xF7F, 0xFB7, 0xFF1, 0x102A, 0x1065, 0x109F, 0x10DB,
+    0x1116, 0x1153, 0x118F, 0x11CD, 0x120B, 0x1249, 0x1288, 0x12C7,
+    0x1307, 0x1347, 0x1388, 0x13C9, 0x140B, 0x144D, 0x1490, 0x14D4,
+    0x1517, 0x155C, 0x15A0, 0x15E6, 0x162C, 0x1672, 0x16B9, 0x1700,
+    0x1747, 0x1790, 0x17D8, 0x1821, 0x186B, 0x18B5, 0x1900, 0x194B,
+    0x1996, 0x19E2, 0x1A2E, 0x1A7B, 0x1AC8, 0x1B16, 0x1B64, 0x1BB3,
+    0x1C02, 0x1C51, 0x1CA1, 0x1CF1, 0x1D42, 0x1D93, 0x1DE5, 0x1E37,
+    0x1E89, 0x1EDC, 0x1F2F, 0x1F82, 0x1FD6, 0x202A, 0x207F, 0x20D4,
+    0x2129, 0x217F, 0x21D5, 0x222C, 0x2282, 0x22DA, 0x2331, 0x2389,
+    0x23E1, 0x2439, 0x2492, 0x24EB, 0x2545, 0x259E, 0x25F8, 0x2653,
+    0x26AD, 0x2708, 0x2763, 0x27BE, 0x281A, 0x2876, 0x28D2, 0x292E,
+    0x298B, 0x29E7, 0x2A44, 0x2AA1, 0x2AFF, 0x2B5C, 0x2BBA, 0x2C18,
+    0x2C76, 0x2CD4, 0x2D33, 0x2D91, 0x2DF0, 0x2E4F, 0x2EAE, 0x2F0D,
+    0x2F6C, 0x2FCC, 0x302B, 0x308B, 0x30EA, 0x314A, 0x31AA, 0x3209,
+    0x3269, 0x32C9, 0x3329, 0x3389, 0x33E9, 0x3449, 0x34A9, 0x3509,
+    0x3569, 0x35C9, 0x3629, 0x3689, 0x36E8, 0x3748, 0x37A8, 0x3807,
+    0x3867, 0x38C6, 0x3926, 0x3985, 0x39E4, 0x3A43, 0x3AA2, 0x3B00,
+    0x3B5F, 0x3BBD, 0x3C1B, 0x3C79, 0x3CD7, 0x3D35, 0x3D92, 0x3DEF,
+    0x3E4C, 0x3EA9, 0x3F05, 0x3F62, 0x3FBD, 0x4019, 0x4074, 0x40D0,
+    0x412A, 0x4185, 0x41DF, 0x4239, 0x4292, 0x42EB, 0x4344, 0x439C,
+    0x43F4, 0x444C, 0x44A3, 0x44FA, 0x4550, 0x45A6, 0x45FC, 0x4651,
+    0x46A6, 0x46FA, 0x474E, 0x47A1, 0x47F4, 0x4846, 0x4898, 0x48E9,
+    0x493A, 0x498A, 0x49D9, 0x4A29, 0x4A77, 0x4AC5, 0x4B13, 0x4B5F,
+    0x4BAC, 0x4BF7, 0x4C42, 0x4C8D, 0x4CD7, 0x4D20, 0x4D68, 0x4DB0,
+    0x4DF7, 0x4E3E, 0x4E84, 0x4EC9, 0x4F0E, 0x4F52, 0x4F95, 0x4FD7,
+    0x5019, 0x505A, 0x509A, 0x50DA, 0x5118, 0x5156, 0x5194, 0x51D0,
+    0x520C, 0x5247, 0x5281, 0x52BA, 0x52F3, 0x532A, 0x5361, 0x5397,
+    0x53CC, 0x5401, 0x5434, 0x5467, 0x5499, 0x54CA, 0x54FA, 0x5529,
+    0x5558, 0x5585, 0x55B2, 0x55DE, 0x5609, 0x5632, 0x565B, 0x5684,
+    0x56AB, 0x56D1, 0x56F6, 0x571B, 0x573E, 0x5761, 0x5782, 0x57A3,
+    0x57C3, 0x57E2, 0x57FF, 0x581C, 0x5838, 0x5853, 0x586D, 0x5886,
+    0x589E, 0x58B5, 0x58CB, 0x58E0, 0x58F4, 0x5907, 0x5919, 0x592A,
+    0x593A, 0x5949, 0x5958, 0x5965, 0x5971, 0x597C, 0x5986, 0x598F,
+    0x5997, 0x599E, 0x59A4, 0x59A9, 0x59AD, 0x59B0, 0x59B2, 0x59B3,
+};
+
+ps1_spu* ps1_spu_create()
+{
+    return (ps1_spu*)malloc(sizeof(ps1_spu));
+}
+
+void ps1_spu_init(ps1_spu* spu)
+{
+    memset(spu, 0, sizeof(ps1_spu));
+    spu->ram = (uint8_t*)malloc(SPU_RAM_SIZE);
+    memset(spu->ram, 0, SPU_RAM_SIZE);
+    spu->ring = (int16_t*)malloc(SPU_RING_SIZE * 2 * sizeof(int16_t));
+    spu->cd_ring = (int16_t*)malloc(SPU_CD_RING_SIZE * 2 * sizeof(int16_t));
+    atomic_init(&spu->ring_head, 0);
+    atomic_init(&spu->ring_tail, 0);
+    ps1_spu_set_simd(spu, true);
+}
+
+void ps1_spu_destroy(ps1_spu* spu)
+{
+    free (spu->ram);
+    free (spu->ring);
+    free (spu->cd_ring);
+    free (spu);
+}
+
+bool ps1_spu_set_simd(ps1_spu* spu, bool enable)
+{
+    spu->mixer = ps1_spu_mix;
+#ifdef PS1_SIMD_AVX2
+    if(enable && ps1_cpu_has_avx2())
+        spu->mixer = ps1_spu_mix_avx2;
+#endif
+    return spu->mixer != ps1_spu_mix || !enable;
+}
+
+static inline int32_t spu_clamp(int32_t value)
+{
+    return value < -0x8000 ? -0x8000 : value > 0x7FFF ? 0x7FFF : value;
+}
+
+//Once set, the flag stays until the IRQ enable bit is cleared
+static void spu_check_irq(ps1_spu* spu, uint32_t address, uint32_t length)
+{
+    if(!(spu->control & SPU_CONTROL_IRQ_ENABLE) || (spu->status & SPU_STATUS_IRQ))
+        return;
+    if(((spu->irq_address - address) & (SPU_RAM_SIZE - 1)) >= length)
+        return;
+
+    spu->status |= SPU_STATUS_IRQ;
+    if(spu->irq != NULL)
+        ps1_irq_raise(spu->irq, IRQ_SPU);
+}
+
+/*
+ One step of an envelope, shared by the ADSR phases and the volume sweeps. The step is +7..+4 going up and -8..-5
+ going down, shifted up for fast rates, slow rates only take it every few samples. Exponential envelopes go up
+ 4 times slower past 6000h and come down in proportion to the level.
+*/
+static int32_t spu_envelope_step(uint32_t* counter, int32_t level, uint32_t shift, uint32_t step, bool exponential, bool decreasing)
+{
+    int32_t delta = decreasing ? -8 + (int32_t)step : 7 - (int32_t)step;
+    uint32_t increment = 0x8000;
+    if(shift < 11)
+        delta *= 1 << (11 - shift);
+    else
+        increment >>= shift - 11;
+
+    if(exponential && !decreasing && level > 0x6000)
+    {
+        if(shift < 10)
+            delta >>= 2;
+        else if(shift >= 11)
+            increment >>= 2;
+        else
+        {
+            delta >>= 1;
+            increment >>= 1;
+        }
+    }
+    else if(exponential && decreasing)
+        delta = delta * level >> 15;
+
+    *counter += increment;
+    if(*counter < 0x8000)
+        return level;
+    *counter = 0;
+
+    level += delta;
+    return level < 0 ? 0 : level > 0x7FFF ? 0x7FFF : level;
+}
+
+static void spu_adsr_tick(spu_voice* voice)
+{
+    uint32_t low = voice->adsr & 0xFFFF;
+    uint32_t high = voice->adsr >> 16;
+    int32_t level = voice->level;
+
+    switch(voice->phase)
+    {
+        case SPU_ADSR_OFF:
+            return;
+        case SPU_ADSR_ATTACK:
+            level = spu_envelope_step(&voice->adsr_counter, level, (low >> 10) & 0x1F, (low >> 8) & 0x3, low & 0x8000, false);
+            if(level == 0x7FFF)
+            {
+                voice->phase = SPU_ADSR_DECAY;
+                voice->adsr_counter = 0;
+            }
+            break;
+        case SPU_ADSR_DECAY:
+            level = spu_envelope_step(&voice->adsr_counter, level, (low >> 4) & 0xF, 0, true, true);
+            if(level <= (int32_t)((low & 0xF) + 1) * 0x800)
+            {
+                voice->phase = SPU_ADSR_SUSTAIN;
+                voice->adsr_counter = 0;
+            }
+            break;
+        case SPU_ADSR_SUSTAIN:
+            level = spu_envelope_step(&voice->adsr_counter, level, (high >> 8) & 0x1F, (high >> 6) & 0x3, high & 0x8000, high & 0x4000);
+            break;
+        case SPU_ADSR_RELEASE:
+            level = spu_envelope_step(&voice->adsr_counter, level, high & 0x1F, 0, high & 0x20, true);
+            if(level == 0)
+                voice->phase = SPU_ADSR_OFF;
+            break;
+    }
+    voice->level = level;
+}
+
+static void spu_set_volume(spu_volume* volume, uint16_t value)
+{
+    volume->setting = value;
+    volume->counter = 0;
+    if(!(value & 0x8000))
+        volume->current = (int16_t)(value << 1);
+}
+
+//Sweeps move once per block by as many steps as it has samples, fixed volumes stay as written
+static void spu_sweep_volume(spu_volume* volume, uint32_t samples)
+{
+    uint16_t setting = volume->setting;
+    if(!(setting & 0x8000))
+        return;
+
+    bool negative = setting & 0x1000;
+    int32_t level = negative ? -volume->current : volume->current;
+    level = level < 0 ? 0 : level;
+    for(uint32_t i = 0; i < samples; i++)
+        level = spu_envelope_step(&volume->counter, level, (setting >> 2) & 0x1F, setting & 0x3, setting & 0x4000, setting & 0x2000);
+    volume->current = negative ? -level : level;
+}
+
+//Decodes the block at the voice address, the last 3 samples of the previous one stay in front for the interpolation
+static void spu_decode_block(ps1_spu* spu, spu_voice* voice)
+{
+    const uint8_t* block = spu->ram + voice->address;
+    spu_check_irq(spu, voice->address, 16);
+
+    uint32_t shift = block[0] & 0xF;
+    uint32_t filter = (block[0] >> 4) & 0x7;
+    shift = shift > 12 ? 9 : shift;
+    filter = filter > 4 ? 4 : filter;
+    voice->flags = block[1];
+    if(voice->flags & SPU_ADPCM_LOOP_START)
+        voice->repeat = voice->address >> 3;
+
+    memcpy(voice->samples, voice->samples + SPU_ADPCM_SAMPLES, 3 * sizeof(int16_t));
+    int32_t old = voice->history[0];
+    int32_t older = voice->history[1];
+    for(uint32_t i = 0; i < SPU_ADPCM_SAMPLES; i++)
+    {
+        int32_t nibble = (block[2 + i / 2] >> ((i & 1) * 4)) & 0xF;
+        int32_t sample = (int16_t)(nibble << 12) >> shift;
+        sample = spu_clamp(sample + ((old * spu_adpcm_positive[filter] + older * spu_adpcm_negative[filter] + 32) >> 6));
+        voice->samples[3 + i] = sample;
+        older = old;
+        old = sample;
+    }
+    voice->history[0] = old;
+    voice->history[1] = older;
+}
+
+//Start and repeat are in 8 byte units but blocks are 16 byte aligned, the low bit is ignored like on hardware
+static inline uint32_t spu_block_address(uint16_t value)
+{
+    return ((value & ~1u) << 3) & (SPU_RAM_SIZE - 1);
+}
+
+//Past the end flag the voice goes back to the repeat address, and is silenced unless the block also says to repeat
+static void spu_next_block(ps1_spu* spu, uint32_t index)
+{
+    spu_voice* voice = &spu->voices[index];
+    if(voice->flags & SPU_ADPCM_LOOP_END)
+    {
+        spu->endx |= 1 << index;
+        voice->address = spu_block_address(voice->repeat);
+        if(!(voice->flags & SPU_ADPCM_LOOP_REPEAT))
+        {
+            voice->phase = SPU_ADSR_RELEASE;
+            voice->level = 0;
+        }
+    }
+    else
+        voice->address = (voice->address + 16) & (SPU_RAM_SIZE - 16);
+    spu_decode_block(spu, voice);
+}
+
+static void spu_key_on(ps1_spu* spu, uint32_t index)
+{
+    spu_voice* voice = &spu->voices[index];
+    voice->address = spu_block_address(voice->start);
+    voice->counter = 0;
+    voice->phase = SPU_ADSR_ATTACK;
+    voice->level = 0;
+    voice->adsr_counter = 0;
+    memset(voice->samples, 0, sizeof(voice->samples));
+    memset(voice->history, 0, sizeof(voice->history));
+    spu->endx &= ~(1 << index);
+    spu_decode_block(spu, voice);
+}
+
+static void spu_key_off(ps1_spu* spu, uint32_t index)
+{
+    spu_voice* voice = &spu->voices[index];
+    if(voice->phase == SPU_ADSR_OFF)
+        return;
+    voice->phase = SPU_ADSR_RELEASE;
+    voice->adsr_counter = 0;
+}
+
+/*
+ Noise is a 16 bit shift register clocked at a rate set in SPUCNT, voices with their noise bit play it instead of
+ their samples but still go through their blocks and envelope.
+*/
+static void spu_render_noise(ps1_spu* spu, uint32_t count)
+{
+    uint32_t shift = (spu->control >> 10) & 0xF;
+    int32_t step = ((spu->control >> 8) & 0x3) + 4;
+    for(uint32_t i = 0; i < count; i++)
+    {
+        spu->noise_timer -= step;
+        if(spu->noise_timer < 0)
+        {
+            uint16_t level = spu->noise_level;
+            uint32_t parity = ((level >> 15) ^ (level >> 12) ^ (level >> 11) ^ (level >> 10) ^ 1) & 1;
+            spu->noise_level = level << 1 | parity;
+            spu->noise_timer += 0x20000 >> shift;
+            if(spu->noise_timer < 0)
+                spu->noise_timer += 0x20000 >> shift;
+        }
+        spu->noise[i] = spu->noise_level;
+    }
+}
+
+/*
+ Renders count samples of a voice into its output block, after the envelope and before the volume. Pitch
+ modulation scales the step by the output of the voice before, which has already rendered the same samples.
+*/
+static void spu_render_voice(ps1_spu* spu, uint32_t index, uint32_t count, bool modulated)
+{
+    spu_voice* voice = &spu->voices[index];
+    int16_t* output = spu->voice_output[index];
+    const int16_t* modulator = modulated ? spu->voice_output[index - 1] : NULL;
+    bool noise = spu->noise_on & (1 << index);
+
+    for(uint32_t i = 0; i < count; i++)
+    {
+        int32_t sample;
+        if(noise)
+            sample = spu->noise[i];
+        else
+        {
+            uint32_t phase = (voice->counter >> 4) & 0xFF;
+            const int16_t* s = voice->samples + (voice->counter >> 12);
+            sample = (spu_gauss[0x0FF - phase] * s[0] >> 15) + (spu_gauss[0x1FF - phase] * s[1] >> 15)
+                   + (spu_gauss[0x100 + phase] * s[2] >> 15) + (spu_gauss[phase] * s[3] >> 15);
+        }
+        output[i] = sample * voice->level >> 15;
+        spu_adsr_tick(voice);
+
+        uint32_t step = voice->pitch;
+        if(modulator != NULL)
+            step = ((int32_t)(int16_t)step * (modulator[i] + 0x8000) >> 15) & 0xFFFF;
+        voice->counter += step > 0x3FFF ? 0x4000 : step;
+        if(voice->counter >= SPU_ADPCM_SAMPLES << 12)
+        {
+            voice->counter -= SPU_ADPCM_SAMPLES << 12;
+            spu_next_block(spu, index);
+        }
+    }
+}
+
+//Sums are kept in 32 bits, each product rounds down like the vector version
+void ps1_spu_mix(ps1_spu* spu, uint32_t voices, uint32_t count)
+{
+    for(uint32_t i = 0; i < count; i++)
+    {
+        int32_t sums[4] = {0, 0, 0, 0};
+        for(uint32_t index = 0; index < SPU_VOICE_COUNT; index++)
+        {
+            if(!(voices & (1 << index)))
+                continue;
+            int32_t sample = spu->voice_output[index][i];
+            int32_t left = sample * spu->voices[index].volume[0].current >> 15;
+            int32_t right = sample * spu->voices[index].volume[1].current >> 15;
+            sums[0] += left;
+            sums[1] += right;
+            if(spu->reverb_on & (1 << index))
+            {
+                sums[2] += left;
+                sums[3] += right;
+            }
+        }
+        spu->mix[0][i] = sums[0];
+        spu->mix[1][i] = sums[1];
+        spu->reverb_input[0][i] = sums[2];
+        spu->reverb_input[1][i] = sums[3];
+    }
+}
+
+//The work area runs from the base to the end of SPU RAM, offsets are from the current position and wrap within it
+static uint32_t spu_reverb_address(ps1_spu* spu, int32_t offset)
+{
+    int64_t size = SPU_RAM_SIZE - spu->reverb_base;
+    int64_t relative = ((int64_t)spu->reverb_current - spu->reverb_base + offset) % size;
+    if(relative < 0)
+        relative += size;
+    return (spu->reverb_base + relative) & ~1u;
+}
+
+static int32_t spu_reverb_read(ps1_spu* spu, int32_t offset)
+{
+    int16_t value;
+    memcpy(&value, spu->ram + spu_reverb_address(spu, offset), sizeof(value));
+    return value;
+}
+
+static void spu_reverb_write(ps1_spu* spu, int32_t offset, int32_t value)
+{
+    int16_t sample = spu_clamp(value);
+    memcpy(spu->ram + spu_reverb_address(spu, offset), &sample, sizeof(sample));
+}
+
+//Reflection into [m], filtered against the sample before it
+static void spu_reverb_reflect(ps1_spu* spu, uint32_t m, int32_t input)
+{
+    int32_t previous = spu_reverb_read(spu, m * 8 - 2);
+    spu_reverb_write(spu, m * 8, ((input - previous) * (int16_t)spu->reverb[SPU_REVERB_VIIR] >> 15) + previous);
+}
+
+static int32_t spu_reverb_all_pass(ps1_spu* spu, uint32_t m, uint32_t d, int16_t volume, int32_t input)
+{
+    int32_t delayed = spu_reverb_read(spu, ((int32_t)m - (int32_t)d) * 8);
+    int32_t value = spu_clamp(input - (volume * delayed >> 15));
+    spu_reverb_write(spu, m * 8, value);
+    return (value * volume >> 15) + delayed;
+}
+
+/*
+ One step of the reverb unit, both sides at once. Input goes through the same side and cross reflections into the
+ work area, the output is the comb of four taps through two all pass filters. The unit runs at half the rate
+ and its output is held for two samples, without the resampling filters of the real one.
+*/
+static void spu_reverb(ps1_spu* spu, int32_t input_left, int32_t input_right)
+{
+    const uint16_t* r = spu->reverb;
+    int32_t left = spu_clamp(input_left) * (int16_t)r[SPU_REVERB_VLIN] >> 15;
+    int32_t right = spu_clamp(input_right) * (int16_t)r[SPU_REVERB_VRIN] >> 15;
+    int32_t wall = (int16_t)r[SPU_REVERB_VWALL];
+
+    spu_reverb_reflect(spu, r[SPU_REVERB_MLSAME], left + (spu_reverb_read(spu, r[SPU_REVERB_DLSAME] * 8) * wall >> 15));
+    spu_reverb_reflect(spu, r[SPU_REVERB_MRSAME], right + (spu_reverb_read(spu, r[SPU_REVERB_DRSAME] * 8) * wall >> 15));
+    spu_reverb_reflect(spu, r[SPU_REVERB_MLDIFF], left + (spu_reverb_read(spu, r[SPU_REVERB_DRDIFF] * 8) * wall >> 15));
+    spu_reverb_reflect(spu, r[SPU_REVERB_MRDIFF], right + (spu_reverb_read(spu, r[SPU_REVERB_DLDIFF] * 8) * wall >> 15));
+
+    for(uint32_t side = 0; side < 2; side++)
+    {
+        int32_t out = 0;
+        for(uint32_t k = 0; k < 4; k++)
+        {
+            static const uint8_t combs[4] = {SPU_REVERB_MLCOMB1, SPU_REVERB_MLCOMB2, SPU_REVERB_MLCOMB3, SPU_REVERB_MLCOMB4};
+            out += (int16_t)r[SPU_REVERB_VCOMB1 + k] * spu_reverb_read(spu, r[combs[k] + side] * 8);
+        }
+        out >>= 15;
+        out = spu_reverb_all_pass(spu, r[SPU_REVERB_MLAPF1 + side], r[SPU_REVERB_DAPF1], (int16_t)r[SPU_REVERB_VAPF1], out);
+        out = spu_reverb_all_pass(spu, r[SPU_REVERB_MLAPF2 + side], r[SPU_REVERB_DAPF2], (int16_t)r[SPU_REVERB_VAPF2], out);
+        spu->reverb_output[side] = spu_clamp(out) * spu->reverb_volume[side] >> 15;
+    }
+
+    spu->reverb_current = (spu->reverb_current + 2) & (SPU_RAM_SIZE - 2);
+    if(spu->reverb_current < spu->reverb_base)
+        spu->reverb_current = spu->reverb_base;
+}
+
+//Full ring drops the newest frames, the host is behind and would rather skip than drift
+static void spu_ring_push(ps1_spu* spu, const int16_t* frames, uint32_t count)
+{
+    uint32_t head = atomic_load_explicit(&spu->ring_head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&spu->ring_tail, memory_order_acquire);
+    uint32_t space = SPU_RING_SIZE - (head - tail);
+    if(count > space)
+    {
+        spu->dropped += count - space;
+        count = space;
+    }
+
+    for(uint32_t i = 0; i < count; i++)
+    {
+        uint32_t slot = (head + i) & (SPU_RING_SIZE - 1);
+        spu->ring[slot * 2] = frames[i * 2];
+        spu->ring[slot * 2 + 1] = frames[i * 2 + 1];
+    }
+    atomic_store_explicit(&spu->ring_head, head + count, memory_order_release);
+}
+
+//Takes up to count stereo frames out of the ring, from any thread. Returns how many there were
+uint32_t ps1_spu_read_audio(ps1_spu* spu, int16_t* frames, uint32_t count)
+{
+    uint32_t tail = atomic_load_explicit(&spu->ring_tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&spu->ring_head, memory_order_acquire);
+    if(count > head - tail)
+        count = head - tail;
+
+    for(uint32_t i = 0; i < count; i++)
+    {
+        uint32_t slot = (tail + i) & (SPU_RING_SIZE - 1);
+        frames[i * 2] = spu->ring[slot * 2];
+        frames[i * 2 + 1] = spu->ring[slot * 2 + 1];
+    }
+    atomic_store_explicit(&spu->ring_tail, tail + count, memory_order_release);
+    return count;
+}
+
+//Frames that don't fit are dropped, the drive is running ahead of the mixer
+void ps1_spu_queue_cd_audio(ps1_spu* spu, const int16_t* frames, uint32_t count)
+{
+    uint32_t space = SPU_CD_RING_SIZE - (spu->cd_head - spu->cd_tail);
+    count = count < space ? count : space;
+    for(uint32_t i = 0; i < count; i++)
+    {
+        uint32_t slot = (spu->cd_head + i) & (SPU_CD_RING_SIZE - 1);
+        spu->cd_ring[slot * 2] = frames[i * 2];
+        spu->cd_ring[slot * 2 + 1] = frames[i * 2 + 1];
+    }
+    spu->cd_head += count;
+}
+
+//Taken whether CD audio is enabled or not so the stream keeps its pace, silence once the queue runs dry
+static void spu_mix_cd_audio(ps1_spu* spu, uint32_t i)
+{
+    if(spu->cd_head == spu->cd_tail)
+        return;
+    uint32_t slot = spu->cd_tail++ & (SPU_CD_RING_SIZE - 1);
+    if(!(spu->control & SPU_CONTROL_CD_AUDIO))
+        return;
+
+    for(uint32_t side = 0; side < 2; side++)
+    {
+        int32_t sample = spu->cd_ring[slot * 2 + side] * spu->cd_volume[side] >> 15;
+        spu->mix[side][i] += sample;
+        if(spu->control & SPU_CONTROL_CD_REVERB)
+            spu->reverb_input[side][i] += sample;
+    }
+}
+
+static void spu_render(ps1_spu* spu, uint32_t count)
+{
+    if(spu->control & SPU_CONTROL_ENABLE)
+    {
+        spu_render_noise(spu, count);
+
+        uint32_t active = 0;
+        uint32_t rendered = 0;
+        for(uint32_t index = 0; index < SPU_VOICE_COUNT; index++)
+        {
+            //Silent voices only matter for the IRQ address their blocks may still hit
+            spu_voice* voice = &spu->voices[index];
+            if(voice->phase == SPU_ADSR_OFF && !(spu->control & SPU_CONTROL_IRQ_ENABLE))
+                continue;
+            if(voice->phase != SPU_ADSR_OFF)
+                active |= 1 << index;
+
+            //A voice that didn't render would modulate with silence, which leaves the pitch as it is
+            bool modulated = index > 0 && (spu->pitch_mod & (1 << index)) && (rendered & (1 << (index - 1)));
+            spu_render_voice(spu, index, count, modulated);
+            rendered |= 1 << index;
+            spu_sweep_volume(&voice->volume[0], count);
+            spu_sweep_volume(&voice->volume[1], count);
+        }
+        spu->mixer(spu, active, count);
+    }
+    else
+    {
+        memset(spu->mix, 0, sizeof(spu->mix));
+        memset(spu->reverb_input, 0, sizeof(spu->reverb_input));
+    }
+
+    int16_t frames[SPU_BLOCK * 2];
+    for(uint32_t i = 0; i < count; i++)
+    {
+        spu_mix_cd_audio(spu, i);
+        int32_t left = spu->mix[0][i];
+        int32_t right = spu->mix[1][i];
+        if(spu->control & SPU_CONTROL_REVERB)
+        {
+            if(!spu->reverb_odd)
+                spu_reverb(spu, spu->reverb_input[0][i], spu->reverb_input[1][i]);
+            spu->reverb_odd = !spu->reverb_odd;
+            left += spu->reverb_output[0];
+            right += spu->reverb_output[1];
+        }
+
+        bool muted = !(spu->control & SPU_CONTROL_UNMUTE);
+        frames[i * 2] = muted ? 0 : spu_clamp(spu_clamp(left) * spu->main_volume[0].current >> 15);
+        frames[i * 2 + 1] = muted ? 0 : spu_clamp(spu_clamp(right) * spu->main_volume[1].current >> 15);
+    }
+    spu_sweep_volume(&spu->main_volume[0], count);
+    spu_sweep_volume(&spu->main_volume[1], count);
+    spu_ring_push(spu, frames, count);
+}
+
+//Renders every sample whose period is over by a timestamp
+static void spu_run(ps1_spu* spu, uint64_t now)
+{
+    while(now >= spu->clock + SPU_SAMPLE_CYCLES)
+    {
+        uint64_t due = (now - spu->clock) / SPU_SAMPLE_CYCLES;
+        uint32_t count = due < SPU_BLOCK ? due : SPU_BLOCK;
+        spu_render(spu, count);
+        spu->clock += count * SPU_SAMPLE_CYCLES;
+    }
+}
+
+static void spu_sync(ps1_spu* spu)
+{
+    if(spu->scheduler != NULL)
+        spu_run(spu, spu->scheduler->cycles);
+}
+
+//The transfer address moves on with every halfword, whether it comes from the FIFO register or DMA4
+static void spu_write_ram(ps1_spu* spu, const uint8_t* data, uint32_t length)
+{
+    spu_check_irq(spu, spu->transfer_address, length);
+    while(length)
+    {
+        uint32_t chunk = SPU_RAM_SIZE - spu->transfer_address;
+        chunk = chunk < length ? chunk : length;
+        memcpy(spu->ram + spu->transfer_address, data, chunk);
+        spu->transfer_address = (spu->transfer_address + chunk) & (SPU_RAM_SIZE - 1);
+        data += chunk;
+        length -= chunk;
+    }
+}
+
+static void spu_read_ram(ps1_spu* spu, uint8_t* data, uint32_t length)
+{
+    spu_check_irq(spu, spu->transfer_address, length);
+    while(length)
+    {
+        uint32_t chunk = SPU_RAM_SIZE - spu->transfer_address;
+        chunk = chunk < length ? chunk : length;
+        memcpy(data, spu->ram + spu->transfer_address, chunk);
+        spu->transfer_address = (spu->transfer_address + chunk) & (SPU_RAM_SIZE - 1);
+        data += chunk;
+        length -= chunk;
+    }
+}
+
+static void spu_store_voice(ps1_spu* spu, spu_voice* voice, uint32_t reg, uint16_t value)
+{
+    switch(reg)
+    {
+        case SPU_VOICE_VOLUME_LEFT:
+        case SPU_VOICE_VOLUME_RIGHT:
+            spu_set_volume(&voice->volume[reg / 2], value);
+            break;
+        case SPU_VOICE_PITCH:
+            voice->pitch = value;
+            break;
+        case SPU_VOICE_START:
+            voice->start = value;
+            break;
+        case SPU_VOICE_ADSR_LOW:
+            voice->adsr = (voice->adsr & 0xFFFF0000) | value;
+            break;
+        case SPU_VOICE_ADSR_HIGH:
+            voice->adsr = (voice->adsr & 0xFFFF) | (uint32_t)value << 16;
+            break;
+        case SPU_VOICE_ADSR_LEVEL:
+            voice->level = value;
+            break;
+        case SPU_VOICE_REPEAT:
+            voice->repeat = value;
+            break;
+    }
+}
+
+//Voice masks are split over two halfwords, the second one holds voices 16-23
+static void spu_store_mask(uint32_t* mask, uint16_t value, bool high)
+{
+    if(high)
+        *mask = (*mask & 0xFFFF) | (value & 0xFF) << 16;
+    else
+        *mask = (*mask & 0xFF0000) | value;
+}
+
+uint16_t ps1_spu_read_register(ps1_spu* spu, uint32_t address)
+{
+    uint32_t offset = (address - SPU_BASE) & (SPU_SIZE - 2);
+    spu_sync(spu);
+
+    if(offset < SPU_VOICE_COUNT * 0x10)
+    {
+        spu_voice* voice = &spu->voices[offset >> 4];
+        if((offset & 0xF) == SPU_VOICE_ADSR_LEVEL)
+            return voice->level;
+        if((offset & 0xF) == SPU_VOICE_REPEAT)
+            return voice->repeat;
+        return spu->registers[offset / 2];
+    }
+    if(offset >= SPU_VOICE_CURRENT && offset < SPU_VOICE_CURRENT + SPU_VOICE_COUNT * 4)
+        return spu->voices[(offset - SPU_VOICE_CURRENT) / 4].volume[(offset / 2) & 1].current;
+
+    switch(offset)
+    {
+        case SPU_ENDX:
+            return spu->endx;
+        case SPU_ENDX + 2:
+            return spu->endx >> 16;
+        case SPU_STATUS:
+            return spu->status;
+        case SPU_CURRENT_VOLUME:
+        case SPU_CURRENT_VOLUME + 2:
+            return spu->main_volume[(offset / 2) & 1].current;
+    }
+    return spu->registers[offset / 2];
+}
+
+void ps1_spu_store_register(ps1_spu* spu, uint32_t address, uint16_t value)
+{
+    uint32_t offset = (address - SPU_BASE) & (SPU_SIZE - 2);
+    spu_sync(spu);
+    spu->registers[offset / 2] = value;
+
+    if(offset < SPU_VOICE_COUNT * 0x10)
+    {
+        spu_store_voice(spu, &spu->voices[offset >> 4], offset & 0xF, value);
+        return;
+    }
+    if(offset >= SPU_REVERB_CONFIG && offset < SPU_REVERB_CONFIG + SPU_REVERB_COUNT * 2)
+    {
+        spu->reverb[(offset - SPU_REVERB_CONFIG) / 2] = value;
+        return;
+    }
+
+    bool high = offset & 2;
+    switch(offset)
+    {
+        case SPU_MAIN_VOLUME:
+        case SPU_MAIN_VOLUME + 2:
+            spu_set_volume(&spu->main_volume[high], value);
+            break;
+        case SPU_REVERB_VOLUME:
+        case SPU_REVERB_VOLUME + 2:
+            spu->reverb_volume[high] = value;
+            break;
+        case SPU_KEY_ON:
+        case SPU_KEY_ON + 2:
+            for(uint32_t index = 0; index < 16; index++)
+            {
+                if((value & (1 << index)) && index + high * 16 < SPU_VOICE_COUNT)
+                    spu_key_on(spu, index + high * 16);
+            }
+            break;
+        case SPU_KEY_OFF:
+        case SPU_KEY_OFF + 2:
+            for(uint32_t index = 0; index < 16; index++)
+            {
+                if((value & (1 << index)) && index + high * 16 < SPU_VOICE_COUNT)
+                    spu_key_off(spu, index + high * 16);
+            }
+            break;
+        case SPU_PITCH_MOD:
+        case SPU_PITCH_MOD + 2:
+            spu_store_mask(&spu->pitch_mod, value, high);
+            break;
+        case SPU_NOISE_ON:
+        case SPU_NOISE_ON + 2:
+            spu_store_mask(&spu->noise_on, value, high);
+            break;
+        case SPU_REVERB_ON:
+        case SPU_REVERB_ON + 2:
+            spu_store_mask(&spu->reverb_on, value, high);
+            break;
+        case SPU_REVERB_BASE:
+            spu->reverb_base = value << 3;
+            spu->reverb_current = spu->reverb_base;
+            break;
+        case SPU_IRQ_ADDRESS:
+            spu->irq_address = value << 3;
+            break;
+        case SPU_CD_VOLUME:
+        case SPU_CD_VOLUME + 2:
+            spu->cd_volume[high] = value;
+            break;
+        case SPU_TRANSFER_ADDRESS:
+            spu->transfer_address = value << 3;
+            break;
+        case SPU_TRANSFER_FIFO:
+        {
+            uint8_t bytes[2] = {value, value >> 8};
+            spu_write_ram(spu, bytes, 2);
+            break;
+        }
+        case SPU_CONTROL:
+            spu->control = value;
+            spu->status = (spu->status & SPU_STATUS_IRQ) | (value & 0x3F);
+            if(!(value & SPU_CONTROL_IRQ_ENABLE))
+                spu->status &= ~SPU_STATUS_IRQ;
+            if(value & (1 << 5))
+                spu->status |= SPU_STATUS_DMA_REQUEST;
+            break;
+    }
+}
+
+//Words are two registers, low halfword first
+static uint32_t ps1_spu_io_read(void* device, uint32_t address, BUS_WIDTH width)
+{
+    ps1_spu* spu = (ps1_spu*)device;
+    if(width == BUS_WIDTH_WORD)
+        return ps1_spu_read_register(spu, address) | (uint32_t)ps1_spu_read_register(spu, address + 2) << 16;
+    return ps1_spu_read_register(spu, address);
+}
+
+static void ps1_spu_io_write(void* device, uint32_t address, uint32_t value, BUS_WIDTH width)
+{
+    ps1_spu* spu = (ps1_spu*)device;
+    ps1_spu_store_register(spu, address, value);
+    if(width == BUS_WIDTH_WORD)
+        ps1_spu_store_register(spu, address + 2, value >> 16);
+}
+
+void ps1_connect_bus_spu(ps1_bus* bus, ps1_spu* spu)
+{
+    ps1_bus_register_io(bus, SPU_BASE, SPU_SIZE, spu, ps1_spu_io_read, ps1_spu_io_write, BUS_WIDTH_HALFWORD | BUS_WIDTH_WORD);
+}
+
+static void ps1_spu_event(void* device, uint64_t timestamp)
+{
+    ps1_spu* spu = (ps1_spu*)device;
+    spu_run(spu, timestamp);
+    ps1_scheduler_schedule_at(spu->scheduler, EVENT_SPU, timestamp + SPU_EVENT_CYCLES);
+}
+
+void ps1_connect_scheduler_spu(ps1_scheduler* scheduler, ps1_spu* spu)
+{
+    spu->scheduler = scheduler;
+    spu->clock = scheduler->cycles;
+    ps1_scheduler_register(scheduler, EVENT_SPU, ps1_spu_event, spu);
+    ps1_scheduler_schedule_at(scheduler, EVENT_SPU, spu->clock + SPU_EVENT_CYCLES);
+}
+
+static void ps1_spu_dma_write(void* device, const uint32_t* words, uint32_t count)
+{
+    ps1_spu* spu = (ps1_spu*)device;
+    spu_sync(spu);
+    spu_write_ram(spu, (const uint8_t*)words, count * 4);
+}
+
+static void ps1_spu_dma_read(void* device, uint32_t* words, uint32_t count)
+{
+    ps1_spu* spu = (ps1_spu*)device;
+    spu_sync(spu);
+    spu_read_ram(spu, (uint8_t*)words, count * 4);
+}
+
+void ps1_connect_dma_spu(ps1_dma* dma, ps1_spu* spu)
+{
+    ps1_dma_connect_port(dma, DMA_CHANNEL_SPU, spu, ps1_spu_dma_write, ps1_spu_dma_read);
+}
+
+void ps1_connect_irq_spu(ps1_irq* irq, ps1_spu* spu)
+{
+    spu->irq = irq;
+}
@@ -0,0 +1,54 @@
+#include "spu.h"
+
+#ifdef PS1_SIMD_AVX2
+
+#include <immintrin.h>
+
+/*
+ Eight samples per register. The active voices are listed once with their volumes broadcast, then every group of
+ eight samples goes through all of them with the four sums kept in registers. Samples are widened to 32 bits
+ before the multiply, so each product is shifted down exactly like the scalar loop. Groups past count read
+ stale samples of the block, their sums are never used.
+*/
+PS1_AVX2_TARGET void ps1_spu_mix_avx2(ps1_spu* spu, uint32_t voices, uint32_t count)
+{
+    const int16_t* samples[SPU_VOICE_COUNT];
+    __m256i left_volume[SPU_VOICE_COUNT];
+    __m256i right_volume[SPU_VOICE_COUNT];
+    __m256i reverb_mask[SPU_VOICE_COUNT];
+    uint32_t active = 0;
+    for(uint32_t index = 0; index < SPU_VOICE_COUNT; index++)
+    {
+        if(!(voices & (1 << index)))
+            continue;
+        samples[active] = spu->voice_output[index];
+        left_volume[active] = _mm256_set1_epi32(spu->voices[index].volume[0].current);
+        right_volume[active] = _mm256_set1_epi32(spu->voices[index].volume[1].current);
+        reverb_mask[active] = _mm256_set1_epi32(spu->reverb_on & (1 << index) ? -1 : 0);
+        active++;
+    }
+
+    for(uint32_t i = 0; i < count; i += 8)
+    {
+        __m256i left = _mm256_setzero_si256();
+        __m256i right = _mm256_setzero_si256();
+        __m256i reverb_left = _mm256_setzero_si256();
+        __m256i reverb_right = _mm256_setzero_si256();
+        for(uint32_t k = 0; k < active; k++)
+        {
+            __m256i sample = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(samples[k] + i)));
+            __m256i l = _mm256_srai_epi32(_mm256_mullo_epi32(sample, left_volume[k]), 15);
+            __m256i r = _mm256_srai_epi32(_mm256_mullo_epi32(sample, right_volume[k]), 15);
+            left = _mm256_add_epi32(left, l);
+            right = _mm256_add_epi32(right, r);
+            reverb_left = _mm256_add_epi32(reverb_left, _mm256_and_si256(l, reverb_mask[k]));
+            reverb_right = _mm256_add_epi32(reverb_right, _mm256_and_si256(r, reverb_mask[k]));
+        }
+        _mm256_storeu_si256((__m256i*)(spu->mix[0] + i), left);
+        _mm256_storeu_si256((__m256i*)(spu->mix[1] + i), right);
+        _mm256_storeu_si256((__m256i*)(spu->reverb_input[0] + i), reverb_left);
+        _mm256_storeu_si256((__m256i*)(spu->reverb_input[1] + i), reverb_right);
+    }
+}
+
+#endif
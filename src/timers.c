@@ -0,0 +1,300 @@
+#include "bus.h"
+#include "gpu.h"
+#include "irq.h"
+#include "scheduler.h"
+#include "timers.h"
+
+#define TIMER_ONE_CYCLE (1ULL << TIMER_FIXED_SHIFT)
+
+//GPU cycles per dot for 256, 320, 512 and 640 pixels wide modes, 368 is 7
+static const uint32_t timer_dot_dividers[4] = {10, 8, 5, 4};
+
+ps1_timers* ps1_timers_create()
+{
+    return (ps1_timers*)malloc(sizeof(ps1_timers));
+}
+
+void ps1_timers_init(ps1_timers* timers, ps1_gpu* gpu)
+{
+    memset(timers, 0, sizeof(ps1_timers));
+    timers->gpu = gpu;
+    for(uint32_t i = 0; i < TIMERS_COUNT; i++)
+    {
+        timers->counter[i].mode = TIMER_MODE_IRQ_LINE;
+        timers->counter[i].period = TIMER_ONE_CYCLE;
+    }
+}
+
+void ps1_timers_destroy(ps1_timers* timers)
+{
+    free (timers);
+}
+
+static uint64_t timer_now(ps1_timers* timers)
+{
+    return timers->scheduler != NULL ? timers->scheduler->cycles << TIMER_FIXED_SHIFT : 0;
+}
+
+/*
+ The clock a counter runs on, as cpu cycles per tick. The GPU runs at 11/7 of the cpu clock, the dot clock is
+ taken from the display mode when the mode register is written. Counter 2 stops in sync modes 0 and 3, the
+ blanking sync modes of counters 0 and 1 aren't modeled and those run freely.
+*/
+static uint64_t timer_period(ps1_timers* timers, uint32_t index)
+{
+    root_counter* counter = &timers->counter[index];
+    uint32_t source = (counter->mode >> TIMER_MODE_CLOCK_SHIFT) & 0x3;
+    uint32_t sync = (counter->mode >> TIMER_MODE_SYNC_SHIFT) & 0x3;
+
+    switch(index)
+    {
+        case 0:
+            if((source & 1) && timers->gpu != NULL)
+            {
+                uint32_t status = timers->gpu->GPUSTAT;
+                uint32_t divider = status & (1 << 16) ? 7 : timer_dot_dividers[(status >> 17) & 0x3];
+                return ((uint64_t)divider * 7 << TIMER_FIXED_SHIFT) / 11;
+            }
+            break;
+        case 1:
+            if(source & 1)
+                return (uint64_t)GPU_CYCLES_PER_SCANLINE << TIMER_FIXED_SHIFT;
+            break;
+        case 2:
+            if((counter->mode & TIMER_MODE_SYNC_ENABLE) && (sync == 0 || sync == 3))
+                return 0;
+            if(source & 2)
+                return 8 * TIMER_ONE_CYCLE;
+            break;
+    }
+    return TIMER_ONE_CYCLE;
+}
+
+/*
+ Ticks until the counter next gets to the target or FFFFh, 0 when it never will. Resetting at the target makes it
+ go back to 0 on the tick it would reach the target, a counter left above its target runs up to FFFFh first.
+*/
+static uint32_t timer_to_target(const root_counter* counter)
+{
+    uint32_t value = counter->value;
+    uint32_t target = counter->target;
+    if(!(counter->mode & TIMER_MODE_RESET_AT_TARGET))
+        return ((target - value) & 0xFFFF) ? (target - value) & 0xFFFF : 0x10000;
+    if(target == 0)
+        return 1;
+    return value < target ? target - value : 0x10000 - value + target;
+}
+
+static uint32_t timer_to_overflow(const root_counter* counter)
+{
+    if((counter->mode & TIMER_MODE_RESET_AT_TARGET) && counter->value < counter->target)
+        return 0;
+    if(counter->target == 0 && (counter->mode & TIMER_MODE_RESET_AT_TARGET))
+        return 0;
+    return counter->value < 0xFFFF ? 0xFFFF - counter->value : 0x10000;
+}
+
+static uint16_t timer_step(const root_counter* counter, uint64_t ticks)
+{
+    uint64_t value = counter->value;
+    if(!(counter->mode & TIMER_MODE_RESET_AT_TARGET))
+        return (value + ticks) & 0xFFFF;
+    if(counter->target == 0)
+        return 0;
+
+    if(value >= counter->target)
+    {
+        uint32_t to_target = timer_to_target(counter);
+        if(ticks < to_target)
+            return (value + ticks) & 0xFFFF;
+        ticks -= to_target;
+        value = 0;
+    }
+    return (value + ticks) % counter->target;
+}
+
+//Interrupt requests pulse bit 10 low, or toggle it and only interrupt when it goes low
+static void timer_request_irq(ps1_timers* timers, uint32_t index)
+{
+    root_counter* counter = &timers->counter[index];
+    if(!(counter->mode & TIMER_MODE_IRQ_REPEAT) && counter->fired)
+        return;
+    counter->fired = true;
+
+    if(counter->mode & TIMER_MODE_IRQ_TOGGLE)
+    {
+        counter->mode ^= TIMER_MODE_IRQ_LINE;
+        if(counter->mode & TIMER_MODE_IRQ_LINE)
+            return;
+    }
+    else
+        counter->mode |= TIMER_MODE_IRQ_LINE;
+
+    if(timers->irq != NULL)
+        ps1_irq_raise(timers->irq, IRQ_TIMER0 + index);
+}
+
+//Puts the next target or FFFFh interrupt on the scheduler, or takes it off
+static void timer_schedule(ps1_timers* timers, uint32_t index)
+{
+    root_counter* counter = &timers->counter[index];
+    if(timers->scheduler == NULL)
+        return;
+
+    uint32_t ticks = 0;
+    if(counter->period && (counter->mode & TIMER_MODE_IRQ_REPEAT || !counter->fired))
+    {
+        if(counter->mode & TIMER_MODE_IRQ_TARGET)
+            ticks = timer_to_target(counter);
+        uint32_t to_overflow = timer_to_overflow(counter);
+        if((counter->mode & TIMER_MODE_IRQ_OVERFLOW) && to_overflow && (!ticks || to_overflow < ticks))
+            ticks = to_overflow;
+    }
+
+    SCHEDULER_EVENT event = EVENT_TIMER0 + index;
+    if(!ticks)
+    {
+        ps1_scheduler_cancel(timers->scheduler, event);
+        return;
+    }
+    uint64_t due = counter->base + ticks * counter->period;
+    ps1_scheduler_schedule_at(timers->scheduler, event, (due + TIMER_ONE_CYCLE - 1) >> TIMER_FIXED_SHIFT);
+}
+
+//Brings the counter up to now. Flags the target and FFFFh crossings and requests their interrupts
+static void timer_sync(ps1_timers* timers, uint32_t index, uint64_t now)
+{
+    root_counter* counter = &timers->counter[index];
+    if(!counter->period)
+    {
+        counter->base = now;
+        return;
+    }
+    if(now <= counter->base)
+        return;
+
+    uint64_t ticks = (now - counter->base) / counter->period;
+    if(!ticks)
+        return;
+
+    uint32_t to_target = timer_to_target(counter);
+    uint32_t to_overflow = timer_to_overflow(counter);
+    bool target = to_target && ticks >= to_target;
+    bool overflow = to_overflow && ticks >= to_overflow;
+    if(target)
+        counter->mode |= TIMER_MODE_REACHED_TARGET;
+    if(overflow)
+        counter->mode |= TIMER_MODE_REACHED_FFFF;
+
+    counter->value = timer_step(counter, ticks);
+    counter->base += ticks * counter->period;
+
+    if((target && (counter->mode & TIMER_MODE_IRQ_TARGET)) || (overflow && (counter->mode & TIMER_MODE_IRQ_OVERFLOW)))
+    {
+        timer_request_irq(timers, index);
+        timer_schedule(timers, index);
+    }
+}
+
+uint32_t ps1_timers_read_register(ps1_timers* timers, uint32_t address)
+{
+    uint32_t index = (address >> 4) & 0xF;
+    if(index >= TIMERS_COUNT)
+        return 0;
+
+    root_counter* counter = &timers->counter[index];
+    timer_sync(timers, index, timer_now(timers));
+    switch((address >> 2) & 0x3)
+    {
+        case 0: return counter->value;
+        case 1:
+        {
+            uint32_t mode = counter->mode;
+            counter->mode &= ~(TIMER_MODE_REACHED_TARGET | TIMER_MODE_REACHED_FFFF);
+            return mode;
+        }
+        case 2: return counter->target;
+    }
+    return 0;
+}
+
+void ps1_timers_store_register(ps1_timers* timers, uint32_t address, uint32_t value)
+{
+    uint32_t index = (address >> 4) & 0xF;
+    if(index >= TIMERS_COUNT)
+        return;
+
+    root_counter* counter = &timers->counter[index];
+    uint64_t now = timer_now(timers);
+    timer_sync(timers, index, now);
+    switch((address >> 2) & 0x3)
+    {
+        case 0:
+            counter->value = value;
+            counter->base = now;
+            break;
+        case 1:
+            //Writing the mode restarts the counter from 0 with the interrupt line released
+            counter->mode = (value & TIMER_MODE_WRITE_MASK) | TIMER_MODE_IRQ_LINE;
+            counter->value = 0;
+            counter->base = now;
+            counter->fired = false;
+            counter->period = timer_period(timers, index);
+            break;
+        case 2:
+            counter->target = value;
+            break;
+        default:
+            return;
+    }
+    timer_schedule(timers, index);
+}
+
+static uint32_t ps1_timers_io_read(void* device, uint32_t address, BUS_WIDTH width)
+{
+    return ps1_timers_read_register((ps1_timers*)device, address) >> ((address & 0x3) * 8);
+}
+
+static void ps1_timers_io_write(void* device, uint32_t address, uint32_t value, BUS_WIDTH width)
+{
+    ps1_timers_store_register((ps1_timers*)device, address, value);
+}
+
+void ps1_connect_bus_timers(ps1_bus* bus, ps1_timers* timers)
+{
+    ps1_bus_register_io(bus, TIMERS_BASE, TIMERS_COUNT * 0x10, timers, ps1_timers_io_read, ps1_timers_io_write, BUS_WIDTH_ALL);
+}
+
+static void ps1_timers_event(ps1_timers* timers, uint32_t index, uint64_t timestamp)
+{
+    timer_sync(timers, index, timestamp << TIMER_FIXED_SHIFT);
+    timer_schedule(timers, index);
+}
+
+static void ps1_timer0_event(void* device, uint64_t timestamp)
+{
+    ps1_timers_event((ps1_timers*)device, 0, timestamp);
+}
+
+static void ps1_timer1_event(void* device, uint64_t timestamp)
+{
+    ps1_timers_event((ps1_timers*)device, 1, timestamp);
+}
+
+static void ps1_timer2_event(void* device, uint64_t timestamp)
+{
+    ps1_timers_event((ps1_timers*)device, 2, timestamp);
+}
+
+void ps1_connect_scheduler_timers(ps1_scheduler* scheduler, ps1_timers* timers)
+{
+    timers->scheduler = scheduler;
+    ps1_scheduler_register(scheduler, EVENT_TIMER0, ps1_timer0_event, timers);
+    ps1_scheduler_register(scheduler, EVENT_TIMER1, ps1_timer1_event, timers);
+    ps1_scheduler_register(scheduler, EVENT_TIMER2, ps1_timer2_event, timers);
+}
+
+void ps1_connect_irq_timers(ps1_irq* irq, ps1_timers* timers)
+{
+    timers->irq = irq;
+}
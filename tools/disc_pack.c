@@ -0,0 +1,62 @@
+#include "disc.h"
+#include "disc_packed.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ Converts a .cue sheet or a raw .bin into a packed .cdz image that --disc can boot from, then reads the packed
+ image back and checks every sector against the original.
+*/
+
+int main(int argc, char** argv)
+{
+    if(argc < 3)
+    {
+        printf("Usage: disc_pack input.cue output.cdz\n");
+        return 1;
+    }
+
+    ps1_disc* disc = ps1_disc_open(argv[1]);
+    if(disc == NULL)
+        return 1;
+    if(!ps1_disc_pack(disc, argv[2]))
+    {
+        ps1_disc_close(disc);
+        return 1;
+    }
+
+    ps1_disc* packed = ps1_disc_open(argv[2]);
+    if(packed == NULL)
+    {
+        ps1_disc_close(disc);
+        return 1;
+    }
+
+    uint8_t scratch[DISC_SECTOR_SIZE];
+    uint8_t packed_scratch[DISC_SECTOR_SIZE];
+    uint32_t mismatches = 0;
+    for(uint32_t lba = 0; lba < disc->sectors; lba++)
+    {
+        const uint8_t* sector = ps1_disc_read_sector(disc, lba, scratch);
+        const uint8_t* packed_sector = ps1_disc_read_sector(packed, lba, packed_scratch);
+        if(packed_sector == NULL || memcmp(sector, packed_sector, DISC_SECTOR_SIZE))
+            mismatches++;
+    }
+
+    FILE* output = fopen(argv[2], "rb");
+    long size = 0;
+    if(output != NULL)
+    {
+        fseek(output, 0, SEEK_END);
+        size = ftell(output);
+        fclose(output);
+    }
+    uint64_t raw = (uint64_t)disc->sectors * DISC_SECTOR_SIZE;
+    printf("%u sectors, %llu bytes packed into %ld (%.1f%%), %u mismatches\n", disc->sectors, (unsigned long long)raw, size,
+        raw ? 100.0 * size / raw : 0.0, mismatches);
+
+    ps1_disc_close(packed);
+    ps1_disc_close(disc);
+    return mismatches ? 1 : 0;
+}
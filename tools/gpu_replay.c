@@ -0,0 +1,146 @@
+#include "gpu.h"
+#include "gpu_raster.h"
+#include "gpu_thread.h"
+#include "gpu_tiles.h"
+#include "gpu_texture_cache.h"
+#include "gpu_trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ Runs a trace recorded with --gpu-trace through the GPU alone, no cpu, BIOS or scheduler, as fast as it goes.
+ Prints the rendering rates and a hash of the final VRAM, so two builds can be compared on the same trace.
+*/
+
+static double replay_now()
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+static uint32_t* replay_load(const char* path, uint32_t* count)
+{
+    FILE* file = fopen(path, "rb");
+    if(file == NULL)
+    {
+        printf("Couldn't open %s\n", path);
+        return NULL;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    uint32_t* words = (uint32_t*)malloc(size > 0 ? size : 1);
+    *count = fread(words, 1, size, file) / sizeof(uint32_t);
+    fclose(file);
+
+    if(*count < 2 || words[0] != GPU_TRACE_MAGIC || words[1] != GPU_TRACE_VERSION)
+    {
+        printf("%s is not a version %d GPU trace\n", path, GPU_TRACE_VERSION);
+        free (words);
+        return NULL;
+    }
+    return words;
+}
+
+//Returns the frames replayed, stops at a record cut short
+static uint64_t replay_run(ps1_gpu* gpu, const uint32_t* words, uint32_t count)
+{
+    uint64_t frames = 0;
+    uint32_t i = 2;
+    while(i < count)
+    {
+        uint32_t header = words[i++];
+        uint32_t length = header & 0xFFFFFF;
+        if(length > count - i)
+            break;
+
+        switch(header >> 24)
+        {
+            case GPU_TRACE_GP0: ps1_gpu_write_gp0_block(gpu, &words[i], length); break;
+            case GPU_TRACE_GP1: ps1_gpu_write_gp1(gpu, words[i]); break;
+            case GPU_TRACE_FRAME: frames++; break;
+            default:
+                printf("Unknown trace record %08x\n", header);
+                return frames;
+        }
+        i += length;
+    }
+    return frames;
+}
+
+int main(int argc, char** argv)
+{
+    const char* path = NULL;
+    uint32_t loops = 1;
+    uint32_t workers = 1;
+    uint32_t tiles = 16;
+    bool threaded = false;
+    bool simd = true;
+    bool texture_cache = true;
+
+    for(int i = 1; i < argc; i++)
+    {
+        if(!strcmp(argv[i], "--loops") && i + 1 < argc)
+            loops = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "--workers") && i + 1 < argc)
+            workers = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "--tiles") && i + 1 < argc)
+            tiles = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "--threaded"))
+            threaded = true;
+        else if(!strcmp(argv[i], "--scalar"))
+            simd = false;
+        else if(!strcmp(argv[i], "--no-texture-cache"))
+            texture_cache = false;
+        else
+            path = argv[i];
+    }
+
+    if(path == NULL)
+    {
+        printf("Usage: gpu_replay trace [--loops n] [--threaded] [--workers n] [--tiles n] [--scalar] [--no-texture-cache]\n");
+        return 1;
+    }
+
+    uint32_t count;
+    uint32_t* words = replay_load(path, &count);
+    if(words == NULL)
+        return 1;
+
+    ps1_gpu* gpu = ps1_gpu_create();
+    ps1_gpu_init(gpu);
+    ps1_gpu_set_simd(gpu, simd);
+    ps1_gpu_set_texture_cache(gpu, texture_cache);
+    if(threaded)
+        ps1_gpu_start_thread(gpu);
+    ps1_gpu_start_workers(gpu, workers, tiles);
+
+    double start = replay_now();
+    uint64_t frames = 0;
+    for(uint32_t loop = 0; loop < loops; loop++)
+        frames += replay_run(gpu, words, count);
+
+    //Waits for the render thread and the workers to draw everything replayed
+    ps1_gpu_sync(gpu);
+    double seconds = replay_now() - start;
+
+    uint64_t hash = 0xCBF29CE484222325;
+    for(uint32_t i = 0; i < GPU_VRAM_WIDTH * GPU_VRAM_HEIGHT; i++)
+        hash = (hash ^ gpu->vram[i]) * 0x100000001B3;
+
+    printf("%llu frames, %llu primitives, %llu pixels in %.3f s\n", (unsigned long long)frames,
+        (unsigned long long)gpu->primitive_count, (unsigned long long)gpu->pixel_count, seconds);
+    printf("%.1f frames/s, %.0f primitives/s, %.0f pixels/s\n", frames / seconds, gpu->primitive_count / seconds, gpu->pixel_count / seconds);
+    if(gpu->texture_cache != NULL)
+        printf("Texture cache: %llu hits, %llu misses\n", (unsigned long long)gpu->texture_cache->hits, (unsigned long long)gpu->texture_cache->misses);
+    printf("VRAM hash %016llx\n", (unsigned long long)hash);
+
+    ps1_gpu_destroy(gpu);
+    free (words);
+    return 0;
+}
@@ -0,0 +1,118 @@
+#include "gte.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ Runs every GTE command back to back on a typical register setup and prints how many go through per second.
+ The triple vertex commands run once through the scalar loop and once through the vector kernel when the cpu
+ has AVX2.
+*/
+
+typedef struct bench_command
+{
+    const char* name;
+    uint32_t command;
+} bench_command;
+
+static const bench_command bench_commands[] = {
+    {"RTPS",  0x00080001},
+    {"RTPT",  0x00080030},
+    {"NCLIP", 0x00000006},
+    {"OP",    0x0008000C},
+    {"DPCS",  0x00080010},
+    {"INTPL", 0x00080011},
+    {"MVMVA", 0x00080412}, //Rotation * V0 + TR, lm
+    {"NCDS",  0x00080413},
+    {"CDP",   0x00080414},
+    {"NCDT",  0x00080416},
+    {"NCCS",  0x0008041B},
+    {"CC",    0x0008041C},
+    {"NCS",   0x0008041E},
+    {"NCT",   0x00080420},
+    {"SQR",   0x00080428},
+    {"DCPL",  0x00080029},
+    {"DPCT",  0x0008002A},
+    {"AVSZ3", 0x0000002D},
+    {"AVSZ4", 0x0000002E},
+    {"GPF",   0x0008003D},
+    {"GPL",   0x0008003E},
+    {"NCCT",  0x0008043F}
+};
+
+static double bench_now()
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+//A rotated camera, one light and a far color, with vertices in front of it
+static void bench_setup(ps1_gte* gte)
+{
+    static const uint32_t control[32] = {
+        0x00000F80, 0x02000000, 0x0F800000, 0xFE000000, 0x00000F80, //Rotation
+        0x00000010, 0xFFFFFFF0, 0x00000800,                         //Translation
+        0x08000400, 0xFC000000, 0x00000000, 0x00000000, 0x00000000, //Light
+        0x00000200, 0x00000200, 0x00000200,                         //Background
+        0x10000000, 0x00001000, 0x00000000, 0x00001000, 0x00000000, //Light color
+        0x00000100, 0x00000080, 0x00000040,                         //Far color
+        0x00A00000, 0x00780000, 0x00000140, 0xFFFFFF9C, 0x01400000, 0x00000155, 0x00000100, 0x00000000
+    };
+    for(uint32_t i = 0; i < 32; i++)
+        ps1_gte_write_control(gte, i, control[i]);
+
+    ps1_gte_write_data(gte, 0, 0x00400040);
+    ps1_gte_write_data(gte, 1, 0x00000080);
+    ps1_gte_write_data(gte, 2, 0xFFC00040);
+    ps1_gte_write_data(gte, 3, 0xFFFFFFC0);
+    ps1_gte_write_data(gte, 4, 0x0040FFC0);
+    ps1_gte_write_data(gte, 5, 0x00000040);
+    ps1_gte_write_data(gte, 6, 0x30808080);
+    ps1_gte_write_data(gte, 8, 0x00000800);
+}
+
+//Commands per second, the vertex moves every iteration so each command works on new input
+static double bench_run(ps1_gte* gte, uint32_t command, uint32_t iterations)
+{
+    bench_setup(gte);
+    double start = bench_now();
+    for(uint32_t i = 0; i < iterations; i++)
+    {
+        gte->v[0][0] = i & 0xFF;
+        ps1_gte_execute(gte, command);
+    }
+    return iterations / (bench_now() - start);
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t iterations = argc > 1 ? atoi(argv[1]) : 2000000;
+
+    ps1_gte gte;
+    ps1_gte_init(&gte);
+    bool avx2 = false;
+#ifdef PS1_SIMD_AVX2
+    avx2 = ps1_cpu_has_avx2();
+#endif
+
+    printf("%-6s %14s %14s\n", "", "scalar cmd/s", avx2 ? "AVX2 cmd/s" : "");
+    for(uint32_t i = 0; i < sizeof(bench_commands) / sizeof(bench_commands[0]); i++)
+    {
+        const bench_command* bench = &bench_commands[i];
+        ps1_gte_set_simd(&gte, false);
+        double scalar = bench_run(&gte, bench->command, iterations);
+        uint32_t op = bench->command & 0x3F;
+        bool triple = op == 0x30 || op == 0x20 || op == 0x3F || op == 0x16;
+
+        if(avx2 && triple)
+        {
+            ps1_gte_set_simd(&gte, true);
+            printf("%-6s %14.0f %14.0f\n", bench->name, scalar, bench_run(&gte, bench->command, iterations));
+        }
+        else
+            printf("%-6s %14.0f\n", bench->name, scalar);
+    }
+    return 0;
+}